@@ -0,0 +1,85 @@
+/*
+	TransferIt client
+	aes_bench.cpp
+	description: benchmark of the file content encryption, AES-CBC (serial) vs AES-CTR (with / without its MAC) over a
+	growing number of threads, the content is encrypted block by block the same way the client encrypts a file it sends.
+	also the one call encrypt / decrypt of a whole buffer across buffer sizes
+*/
+
+#include "../client/AESWrapper.h"
+#include "../client/client.h"
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <vector>
+
+static const size_t CONTENT_SIZE = 64 * 1024 * 1024;
+
+static void BM_AESEncrypt(benchmark::State& state)
+{
+	const AESMode mode = static_cast<AESMode>(state.range(0));
+	const unsigned int threads = static_cast<unsigned int>(state.range(1));
+	const size_t block_size = (mode != AES_CBC) ? CTR_FILE_BLOCK_SIZE : FILE_BLOCK_SIZE;
+
+	std::vector<uint8_t> content(CONTENT_SIZE);
+	std::mt19937 gen(1);
+	for (uint8_t& c : content)
+		c = static_cast<uint8_t>(gen());
+	CltSymmetricKey key;
+	for (uint8_t& c : key.symmetric_key)
+		c = static_cast<uint8_t>(gen());
+
+	const unsigned int default_threads = AESWrapper::get_threads();
+	AESWrapper::set_threads(threads);
+	AESWrapper aes(key, mode);
+	std::string cipher;
+	for (auto _ : state)
+	{
+		aes.encrypt_begin();
+		for (size_t offset = 0; offset < content.size(); offset += block_size)
+		{
+			aes.encrypt_update(content.data() + offset, std::min(block_size, content.size() - offset), cipher);
+			benchmark::DoNotOptimize(cipher.data());
+		}
+		aes.encrypt_final(cipher);
+		benchmark::DoNotOptimize(cipher.data());
+	}
+	AESWrapper::set_threads(default_threads);
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * CONTENT_SIZE);
+	state.SetLabel(mode == AES_CTR_HMAC ? "ctr+hmac" : (mode == AES_CTR ? "ctr" : "cbc"));
+}
+BENCHMARK(BM_AESEncrypt)
+	->ArgNames({ "mode", "threads" })
+	->Args({ AES_CBC, 1 })
+	->ArgsProduct({ { AES_CTR, AES_CTR_HMAC }, { 1, 2, 4, 8, 16, 32 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+static void BM_AESBuffer(benchmark::State& state)
+{
+	const bool decrypt = state.range(0) != 0;
+	const size_t size = static_cast<size_t>(state.range(1));
+
+	std::vector<uint8_t> plain(size);
+	std::mt19937 gen(1);
+	for (uint8_t& c : plain)
+		c = static_cast<uint8_t>(gen());
+	CltSymmetricKey key;
+	for (uint8_t& c : key.symmetric_key)
+		c = static_cast<uint8_t>(gen());
+
+	AESWrapper aes(key);
+	const std::string cipher = aes.encrypt(plain.data(), plain.size());
+	for (auto _ : state)
+	{
+		if (decrypt)
+			benchmark::DoNotOptimize(aes.decrypt(reinterpret_cast<const uint8_t*>(cipher.data()), cipher.size()));
+		else
+			benchmark::DoNotOptimize(aes.encrypt(plain.data(), plain.size()));
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+	state.SetLabel(decrypt ? "decrypt" : "encrypt");
+}
+BENCHMARK(BM_AESBuffer)
+	->ArgNames({ "decrypt", "size" })
+	->ArgsProduct({ { 0, 1 }, benchmark::CreateRange(16, 16 << 20, 16) });
@@ -0,0 +1,37 @@
+/*
+	TransferIt client
+	crc_bench.cpp
+	description: benchmark of the CRC update kernels (bytewise / slicing-by-8 / slicing-by-16 / pclmul) across buffer sizes
+*/
+
+#include "../client/crc.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+#include <random>
+
+static void BM_CRCUpdate(benchmark::State& state)
+{
+	const CRC::Kernel kernel = static_cast<CRC::Kernel>(state.range(0));
+	if (!CRC::kernel_supported(kernel))
+	{
+		state.SkipWithError("kernel not supported by this CPU");
+		return;
+	}
+
+	std::vector<unsigned char> buff(static_cast<size_t>(state.range(1)));
+	std::mt19937 gen(1);
+	for (unsigned char& c : buff)
+		c = static_cast<unsigned char>(gen());
+
+	for (auto _ : state)
+	{
+		CRC digest(kernel);
+		digest.update(buff.data(), static_cast<uint32_t>(buff.size()));
+		benchmark::DoNotOptimize(digest.digest());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+	state.SetLabel(CRC::kernel_name(kernel));
+}
+BENCHMARK(BM_CRCUpdate)
+	->ArgNames({ "kernel", "size" })
+	->ArgsProduct({ { CRC::BYTEWISE, CRC::SLICING_8, CRC::SLICING_16, CRC::PCLMUL }, benchmark::CreateRange(64, 16 << 20, 16) });
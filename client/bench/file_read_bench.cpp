@@ -0,0 +1,100 @@
+/*
+	TransferIt client
+	file_read_bench.cpp
+	description: benchmark of the FileHandler read paths (filestream vs memory mapping) across file sizes,
+	the file is read block by block into the cksum, the same way the client reads a file it sends
+*/
+
+#include "../client/file_handler.h"
+#include "../client/client.h"
+#include "../client/crc.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+static const std::string BENCH_FILE = "file_read_bench.tmp";
+
+enum ReadMode { FILESTREAM, FILESTREAM_VIEW, MAPPED, FILESTREAM_BYTES };
+
+static const char* mode_name(ReadMode mode)
+{
+	switch (mode)
+	{
+	case FILESTREAM: return "filestream (read_file_chunk)";
+	case FILESTREAM_VIEW: return "filestream (view_file_chunk)";
+	case FILESTREAM_BYTES: return "filestream (read_file_bytes)";
+	default: return "mapped (view_file_chunk)";
+	}
+}
+
+static bool create_bench_file(size_t size)
+{
+	std::vector<char> data(FILE_BLOCK_SIZE);
+	std::mt19937 gen(1);
+	for (char& c : data)
+		c = static_cast<char>(gen());
+
+	std::ofstream out(BENCH_FILE, std::ios::binary | std::ios::trunc);
+	for (size_t written = 0; written < size; written += data.size())
+		out.write(data.data(), static_cast<std::streamsize>(std::min(data.size(), size - written)));
+	return out.good();
+}
+
+static void BM_FileRead(benchmark::State& state)
+{
+	const ReadMode mode = static_cast<ReadMode>(state.range(0));
+	const size_t size = static_cast<size_t>(state.range(1));
+	if (!create_bench_file(size))
+	{
+		state.SkipWithError("cannot create the benchmark file");
+		return;
+	}
+
+	std::vector<uint8_t> buff(FILE_BLOCK_SIZE);
+	for (auto _ : state)
+	{
+		FileHandler file;
+		if (!file.open_file(BENCH_FILE, "rb") || (mode == MAPPED && !file.map_file()))
+		{
+			state.SkipWithError("cannot open / map the benchmark file");
+			break;
+		}
+
+		CRC digest;
+		size_t bytes_read = 0, offset = 0;
+		do
+		{
+			if (mode == FILESTREAM_BYTES)
+			{
+				// exact reads of a block (the last one shorter), read_file_bytes is called with a known size
+				bytes_read = std::min(buff.size(), size - offset);
+				if (bytes_read > 0)
+					file.read_file_bytes(buff.data(), bytes_read);
+				digest.update(buff.data(), static_cast<uint32_t>(bytes_read));
+				offset += bytes_read;
+			}
+			else if (mode == FILESTREAM)
+			{
+				file.read_file_chunk(buff.data(), buff.size(), bytes_read);
+				digest.update(buff.data(), static_cast<uint32_t>(bytes_read));
+			}
+			else
+			{
+				const uint8_t* block = nullptr;
+				file.view_file_chunk(block, FILE_BLOCK_SIZE, bytes_read);
+				digest.update(block, static_cast<uint32_t>(bytes_read));
+			}
+		} while (bytes_read > 0);
+		benchmark::DoNotOptimize(digest.digest());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+	state.SetLabel(mode_name(mode));
+	std::remove(BENCH_FILE.c_str());
+}
+BENCHMARK(BM_FileRead)
+	->ArgNames({ "mode", "size" })
+	->ArgsProduct({ { FILESTREAM, FILESTREAM_VIEW, MAPPED, FILESTREAM_BYTES }, { 1 << 20, 16 << 20, 256 << 20 } })
+	->Unit(benchmark::kMillisecond);
@@ -0,0 +1,30 @@
+/*
+	TransferIt client
+	helper_bench.cpp
+	description: benchmark of the Helper base64 encoding / decoding across input sizes (the private key of me.info is
+	base64, about 850 bytes encoded)
+*/
+
+#include "../client/helper.h"
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+
+static void BM_Base64(benchmark::State& state)
+{
+	const bool decode = state.range(0) != 0;
+	std::string plain(static_cast<size_t>(state.range(1)), '\0');
+	std::mt19937 gen(1);
+	for (char& c : plain)
+		c = static_cast<char>(gen());
+
+	const std::string encoded = Helper::base64_encode(plain);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(decode ? Helper::base64_decode(encoded) : Helper::base64_encode(plain));
+	// plain bytes either way
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+	state.SetLabel(decode ? "decode" : "encode");
+}
+BENCHMARK(BM_Base64)
+	->ArgNames({ "decode", "size" })
+	->ArgsProduct({ { 0, 1 }, benchmark::CreateRange(64, 1 << 20, 16) });
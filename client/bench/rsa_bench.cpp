@@ -0,0 +1,48 @@
+/*
+	TransferIt client
+	rsa_bench.cpp
+	description: benchmark of the RSA operations of a client run: key pair generation (first run), loading the private
+	key of me.info (later runs) and decrypting the AES key the server sent
+*/
+
+#include "../client/RSAWrapper.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+static void BM_RSAGenerate(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		RSAPrivateWrapper rsa;
+		benchmark::DoNotOptimize(rsa.getPublicKey());
+	}
+}
+BENCHMARK(BM_RSAGenerate)->Unit(benchmark::kMillisecond);
+
+static void BM_RSALoadKey(benchmark::State& state)
+{
+	const std::string private_key = RSAPrivateWrapper().getPrivateKey();
+	for (auto _ : state)
+	{
+		RSAPrivateWrapper rsa(private_key);
+		benchmark::DoNotOptimize(&rsa);
+	}
+}
+BENCHMARK(BM_RSALoadKey)->Unit(benchmark::kMicrosecond);
+
+static void BM_RSADecrypt(benchmark::State& state)
+{
+	RSAPrivateWrapper rsa;
+	CltPublicKey public_key;
+	const std::string key = rsa.getPublicKey();
+	memcpy(public_key.public_key, key.data(), std::min(key.size(), sizeof(public_key.public_key)));
+
+	// a symmetric key encrypted the way the server sends it
+	const uint8_t symmetric_key[CLT_SYMMETRICKEY_SIZE] = { 0 };
+	const std::string cipher = RSAPublicWrapper(public_key).encrypt(symmetric_key, sizeof(symmetric_key));
+	for (auto _ : state)
+		benchmark::DoNotOptimize(rsa.decrypt(reinterpret_cast<const uint8_t*>(cipher.data()), cipher.size()));
+}
+BENCHMARK(BM_RSADecrypt)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,81 @@
+/*
+	TransferIt client
+	socket_bench.cpp
+	description: benchmark of the SocketHandler write / recv across buffer sizes over a loopback connection, the
+	other end runs on a thread of its own: it drains what is written / writes as fast as it is read
+*/
+
+#include "../client/socket_handler.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* a loopback peer of a SocketHandler, accepts one connection and reads it to the end (sink) or writes to it until
+the connection is closed (source) */
+class LoopbackPeer
+{
+private:
+	boost::asio::io_context io_context;
+	tcp::acceptor acceptor;
+	std::thread thread;
+
+public:
+	LoopbackPeer(bool source, size_t buffer_size) : acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+	{
+		thread = std::thread([this, source, buffer_size]()
+		{
+			std::vector<uint8_t> buffer(buffer_size);
+			boost::system::error_code ec;
+			tcp::socket peer(io_context);
+			acceptor.accept(peer, ec);
+			while (!ec)
+			{
+				if (source)
+					boost::asio::write(peer, boost::asio::buffer(buffer), ec);
+				else
+					peer.read_some(boost::asio::buffer(buffer), ec);
+			}
+		});
+	}
+
+	virtual ~LoopbackPeer()
+	{
+		thread.join();
+	}
+
+	std::string port() const
+	{
+		return std::to_string(acceptor.local_endpoint().port());
+	}
+};
+
+static void BM_Socket(benchmark::State& state)
+{
+	const bool recv = state.range(0) != 0;
+	std::vector<uint8_t> buff(static_cast<size_t>(state.range(1)));
+	LoopbackPeer peer(recv, 256 * 1024);
+	SocketHandler socket;
+	if (!socket.set_socket("127.0.0.1", peer.port()) || !socket.connect())
+	{
+		state.SkipWithError("cannot connect to the loopback peer");
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		if (!(recv ? socket.recv_from_socket(buff.data(), buff.size()) : socket.write_to_socket(buff.data(), buff.size())))
+		{
+			state.SkipWithError("loopback connection failed");
+			break;
+		}
+	}
+	// the peer sees the connection closed and ends
+	socket.close_connection();
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+	state.SetLabel(recv ? "recv" : "write");
+}
+BENCHMARK(BM_Socket)
+	->ArgNames({ "recv", "size" })
+	->ArgsProduct({ { 0, 1 }, benchmark::CreateRange(64, 16 << 20, 16) })
+	->UseRealTime();
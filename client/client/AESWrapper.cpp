@@ -8,28 +8,148 @@
 #include <modes.h>
 #include <aes.h>
 #include <filters.h>
+#include <hmac.h>
+#include <sha.h>
+#include <osrng.h>
 #include <stdexcept>
-#include <immintrin.h>	// _rdrand32_step
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
+// CTR updates of at least 2 segments of this size (bytes, a multiple of the AES block size) are split over threads
+static const size_t CTR_SEGMENT_SIZE = 64 * 1024;
+static const size_t CTR_NONCE_SIZE = 8; // the rest of the iv is the block counter (big endian)
+static const size_t CTR_MAC_SIZE = 16; // of the MAC which ends an AES_CTR_HMAC content (HMAC-SHA256, truncated)
+static const char CTR_MAC_LABEL[] = "TransferIt content MAC"; // the MAC key is HMAC-SHA256(symmetric key, label)
+
+static std::atomic<unsigned int> ctr_threads(std::max(1u, std::thread::hardware_concurrency()));
+
+// workers of the CTR segments, shared by all the wrappers (the calling thread encrypts a segment as well)
+static boost::asio::thread_pool& ctr_workers()
+{
+	static boost::asio::thread_pool workers(std::max(1u, std::thread::hardware_concurrency()));
+	return workers;
+}
+
+// encrypt length bytes which are at offset (bytes) of the CTR key stream of iv, offset may be in the middle of a block
+void AESWrapper::ctr_process(const CltSymmetricKey& key, const uint8_t* iv, uint64_t offset, const uint8_t* in, uint8_t* out, size_t length)
+{
+	// the counter of the block at offset: the counter of iv + the block index (big endian, carried byte by byte)
+	CryptoPP::byte counter[CryptoPP::AES::BLOCKSIZE];
+	memcpy(counter, iv, sizeof(counter));
+	uint64_t block = offset / CryptoPP::AES::BLOCKSIZE;
+	for (size_t i = sizeof(counter); i > CTR_NONCE_SIZE && block > 0; --i)
+	{
+		const unsigned int sum = counter[i - 1] + static_cast<unsigned int>(block & 0xFF);
+		counter[i - 1] = static_cast<CryptoPP::byte>(sum);
+		block = (block >> 8) + (sum >> 8); // carry into the next byte
+	}
+
+	CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption ctr;
+	ctr.SetKeyWithIV(key.symmetric_key, sizeof(key.symmetric_key), counter, sizeof(counter));
+	const size_t skip = static_cast<size_t>(offset % CryptoPP::AES::BLOCKSIZE);
+	if (skip == 0)
+	{
+		ctr.ProcessData(out, in, length);
+		return;
+	}
+
+	// the key stream of the first (partial) block starts at skip
+	CryptoPP::byte first[CryptoPP::AES::BLOCKSIZE] = { 0 };
+	const size_t first_size = std::min(length, sizeof(first) - skip);
+	memcpy(first + skip, in, first_size);
+	ctr.ProcessData(first, first, sizeof(first));
+	memcpy(out, first + skip, first_size);
+	if (length > first_size)
+		ctr_process(key, iv, offset + first_size, in + first_size, out + first_size, length - first_size);
+}
+
+// fill buffer with random bytes of the OS generator, throws if it couldn't be read (the key / iv is never left unset)
 void AESWrapper::GenerateKey(uint8_t* const buffer, unsigned int length)
 {
-	for (size_t i = 0; i < length; i += sizeof(unsigned int))
-		_rdrand32_step(reinterpret_cast<unsigned int*>(&buffer[i]));
+	CryptoPP::AutoSeededRandomPool rng;
+	rng.GenerateBlock(buffer, length);
 }
 
+struct AESEncryptStream
+{
+	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// same fixed iv as encrypt()
+	CryptoPP::AES::Encryption aes;
+	CryptoPP::CBC_Mode_ExternalCipher::Encryption cbc;
+	std::string sink_buff;
+	CryptoPP::StreamTransformationFilter filter;
+
+	AESEncryptStream(const CltSymmetricKey& key) :
+		aes(key.symmetric_key, sizeof(key.symmetric_key)),
+		cbc(aes, iv),
+		filter(cbc, new CryptoPP::StringSink(sink_buff)) {}
+};
+
+struct AESDecryptStream
+{
+	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// same fixed iv as decrypt()
+	CryptoPP::AES::Decryption aes;
+	CryptoPP::CBC_Mode_ExternalCipher::Decryption cbc;
+	std::string sink_buff;
+	CryptoPP::StreamTransformationFilter filter;
+
+	AESDecryptStream(const CltSymmetricKey& key) :
+		aes(key.symmetric_key, sizeof(key.symmetric_key)),
+		cbc(aes, iv),
+		filter(cbc, new CryptoPP::StringSink(sink_buff)) {}
+};
+
+struct AESMacStream
+{
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac;
+
+	// the MAC key is derived from the symmetric key, so the same key is never used for both AES & HMAC
+	AESMacStream(const CltSymmetricKey& key)
+	{
+		CryptoPP::byte mac_key[CryptoPP::HMAC<CryptoPP::SHA256>::DIGESTSIZE];
+		CryptoPP::HMAC<CryptoPP::SHA256>(key.symmetric_key, sizeof(key.symmetric_key))
+			.CalculateDigest(mac_key, reinterpret_cast<const CryptoPP::byte*>(CTR_MAC_LABEL), sizeof(CTR_MAC_LABEL) - 1);
+		hmac.SetKey(mac_key, sizeof(mac_key));
+	}
+};
+
 AESWrapper::AESWrapper()
 {
 	GenerateKey(_key.symmetric_key, sizeof(_key.symmetric_key));
+	_mode = AES_CBC;
+	_stream = nullptr;
+	_decrypt_stream = nullptr;
+	_mac = nullptr;
+	_ctr_offset = 0;
+	_ctr_started = false;
 }
 
-AESWrapper::AESWrapper(const CltSymmetricKey& symmetric_key)
+AESWrapper::AESWrapper(const CltSymmetricKey& symmetric_key, AESMode mode)
 {
 	_key = symmetric_key;
+	_mode = mode;
+	_stream = nullptr;
+	_decrypt_stream = nullptr;
+	_mac = nullptr;
+	_ctr_offset = 0;
+	_ctr_started = false;
 }
 
 AESWrapper::~AESWrapper()
 {
-	
+	delete _stream;
+	delete _decrypt_stream;
+	delete _mac;
+}
+
+CltSymmetricKey AESWrapper::getKey() const
+{
+	return _key;
 }
 
 std::string AESWrapper::encrypt(const uint8_t* plain, size_t length)
@@ -61,3 +181,174 @@ std::string AESWrapper::decrypt(const uint8_t* cipher, size_t length)
 
 	return decrypted;
 }
+
+/* size of the ciphertext for a given plain length: CBC - PKCS padding always adds 1..BLOCKSIZE bytes,
+CTR - the iv is written ahead of the ciphertext (and the MAC after it) */
+size_t AESWrapper::encrypted_size(size_t length, AESMode mode)
+{
+	if (mode == AES_CBC)
+		return (length / CryptoPP::AES::BLOCKSIZE + 1) * CryptoPP::AES::BLOCKSIZE;
+	return CryptoPP::AES::BLOCKSIZE + length + ((mode == AES_CTR_HMAC) ? CTR_MAC_SIZE : 0);
+}
+
+// start a new streaming encryption, drops any unfinished one (CTR: with a new random iv)
+void AESWrapper::encrypt_begin()
+{
+	delete _stream;
+	_stream = nullptr;
+	delete _mac;
+	_mac = nullptr;
+	if (_mode != AES_CBC)
+	{
+		if (_mode == AES_CTR_HMAC)
+			_mac = new AESMacStream(_key);
+		GenerateKey(_iv, CTR_NONCE_SIZE);
+		memset(_iv + CTR_NONCE_SIZE, 0, sizeof(_iv) - CTR_NONCE_SIZE);
+		_ctr_offset = 0;
+		_ctr_started = true;
+		return;
+	}
+	_stream = new AESEncryptStream(_key);
+}
+
+/* encrypt the next plain chunk, cipher is replaced with the ciphertext which is ready so far
+(CBC holds back an incomplete block, so cipher may be shorter than length or even empty,
+CTR - cipher is exactly length bytes, the iv ahead of the first ones, AES_CTR_HMAC adds them to the MAC) */
+void AESWrapper::encrypt_update(const uint8_t* plain, size_t length, std::string& cipher)
+{
+	if (_mode != AES_CBC)
+	{
+		if (!_ctr_started)
+			throw std::logic_error("encrypt_update called before encrypt_begin");
+
+		const size_t iv_size = (_ctr_offset == 0) ? sizeof(_iv) : 0;
+		cipher.resize(iv_size + length);
+		uint8_t* out = reinterpret_cast<uint8_t*>(&cipher[0]);
+		memcpy(out, _iv, iv_size);
+		out += iv_size;
+
+		// split into segments, the calling thread encrypts the first one while the workers encrypt the others
+		const size_t segments = std::min<size_t>(ctr_threads.load(), length / CTR_SEGMENT_SIZE);
+		if (segments < 2)
+			ctr_process(_key, _iv, _ctr_offset, plain, out, length);
+		else
+		{
+			const size_t segment_size = (length / segments) / CryptoPP::AES::BLOCKSIZE * CryptoPP::AES::BLOCKSIZE;
+			std::mutex done_lock;
+			std::condition_variable done_cv;
+			size_t segments_left = segments - 1;
+			for (size_t i = 1; i < segments; ++i)
+			{
+				const size_t begin = i * segment_size;
+				const size_t size = (i + 1 == segments) ? length - begin : segment_size;
+				const uint64_t offset = _ctr_offset + begin;
+				boost::asio::post(ctr_workers(), [&, begin, size, offset]()
+					{
+						ctr_process(_key, _iv, offset, plain + begin, out + begin, size);
+						std::lock_guard<std::mutex> guard(done_lock);
+						if (--segments_left == 0)
+							done_cv.notify_one();
+					});
+			}
+			ctr_process(_key, _iv, _ctr_offset, plain, out, segment_size);
+			std::unique_lock<std::mutex> guard(done_lock);
+			done_cv.wait(guard, [&]() { return segments_left == 0; });
+		}
+		_ctr_offset += length;
+		if (_mac != nullptr)
+			_mac->hmac.Update(reinterpret_cast<const CryptoPP::byte*>(cipher.data()), cipher.size());
+		return;
+	}
+
+	if (_stream == nullptr)
+		throw std::logic_error("encrypt_update called before encrypt_begin");
+
+	_stream->sink_buff.clear();
+	_stream->filter.Put(plain, length);
+	cipher.swap(_stream->sink_buff); // swapping keeps both buffers capacity for the next chunk
+}
+
+/* finish the streaming encryption, cipher is replaced with the last (padded) ciphertext block
+(CTR: the iv of empty content, AES_CTR_HMAC: followed by the MAC) */
+void AESWrapper::encrypt_final(std::string& cipher)
+{
+	if (_mode != AES_CBC)
+	{
+		if (!_ctr_started)
+			throw std::logic_error("encrypt_final called before encrypt_begin");
+		cipher.assign(reinterpret_cast<const char*>(_iv), (_ctr_offset == 0) ? sizeof(_iv) : 0);
+		_ctr_started = false;
+		if (_mac == nullptr)
+			return;
+		CryptoPP::byte mac[CTR_MAC_SIZE];
+		_mac->hmac.Update(reinterpret_cast<const CryptoPP::byte*>(cipher.data()), cipher.size());
+		_mac->hmac.TruncatedFinal(mac, sizeof(mac));
+		cipher.append(reinterpret_cast<const char*>(mac), sizeof(mac));
+		delete _mac;
+		_mac = nullptr;
+		return;
+	}
+
+	if (_stream == nullptr)
+		throw std::logic_error("encrypt_final called before encrypt_begin");
+
+	_stream->sink_buff.clear();
+	_stream->filter.MessageEnd();
+	cipher.swap(_stream->sink_buff);
+	delete _stream;
+	_stream = nullptr;
+}
+
+// start a new streaming decryption, drops any unfinished one
+void AESWrapper::decrypt_begin()
+{
+	if (_mode != AES_CBC)
+		throw std::logic_error("streaming decryption is of CBC content only");
+	delete _decrypt_stream;
+	_decrypt_stream = new AESDecryptStream(_key);
+}
+
+/* decrypt the next cipher chunk, plain is replaced with the plain content which is ready so far
+(the last block is held back until decrypt_final since it contains the padding, so plain may be empty) */
+void AESWrapper::decrypt_update(const uint8_t* cipher, size_t length, std::string& plain)
+{
+	if (_decrypt_stream == nullptr)
+		throw std::logic_error("decrypt_update called before decrypt_begin");
+
+	_decrypt_stream->sink_buff.clear();
+	_decrypt_stream->filter.Put(cipher, length);
+	plain.swap(_decrypt_stream->sink_buff);
+}
+
+// finish the streaming decryption, plain is replaced with the last block without the padding,
+// throws CryptoPP::Exception if the content is not a whole number of blocks or the padding is invalid
+void AESWrapper::decrypt_final(std::string& plain)
+{
+	if (_decrypt_stream == nullptr)
+		throw std::logic_error("decrypt_final called before decrypt_begin");
+
+	_decrypt_stream->sink_buff.clear();
+	AESDecryptStream* stream = _decrypt_stream;
+	_decrypt_stream = nullptr;
+	try
+	{
+		stream->filter.MessageEnd();
+	}
+	catch (...)
+	{
+		delete stream;
+		throw;
+	}
+	plain.swap(stream->sink_buff);
+	delete stream;
+}
+
+void AESWrapper::set_threads(unsigned int threads)
+{
+	ctr_threads = std::max(1u, threads);
+}
+
+unsigned int AESWrapper::get_threads()
+{
+	return ctr_threads;
+}
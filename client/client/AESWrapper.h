@@ -9,16 +9,49 @@
 #include "networkProtocol.h"
 #include <string>
 
+// internal CBC encryption / decryption states used by the streaming (chunked) encryption / decryption
+struct AESEncryptStream;
+struct AESDecryptStream;
+// internal HMAC state of an authenticated CTR streaming encryption
+struct AESMacStream;
+
+/* file content cipher mode, negotiated by the protocol version (see VERSION_CTR, VERSION_AUTH):
+AES_CBC - zero iv & PKCS padding, serial.
+AES_CTR - a random iv (8 bytes nonce, 8 bytes counter = 0) is written ahead of the ciphertext, no padding,
+		  large updates are encrypted in segments on several threads (the counter of each segment is known in advance).
+		  the content is not authenticated, CTR ciphertext can be modified bit by bit and the cksum doesn't detect it
+AES_CTR_HMAC - AES_CTR followed by a 16 bytes MAC (truncated HMAC-SHA256 of the iv & ciphertext, with a key derived
+		  from the symmetric key), the server rejects a content whose MAC doesn't match */
+enum AESMode { AES_CBC, AES_CTR, AES_CTR_HMAC };
+
+inline AESMode cipher_mode(uint8_t protocol_version)
+{
+	if (protocol_version >= VERSION_AUTH)
+		return AES_CTR_HMAC;
+	return (protocol_version >= VERSION_CTR) ? AES_CTR : AES_CBC;
+}
+
 class AESWrapper
 {
 private:
 	CltSymmetricKey _key;
+	AESMode _mode;
+	AESEncryptStream* _stream;
+	AESDecryptStream* _decrypt_stream;
+	AESMacStream* _mac; // AES_CTR_HMAC only, between encrypt_begin and encrypt_final
+
+	// CTR streaming state
+	uint8_t _iv[CLT_SYMMETRICKEY_SIZE];
+	uint64_t _ctr_offset; // bytes encrypted so far, 0 = the iv was not written yet
+	bool _ctr_started;
 
 public:
 	static void GenerateKey(uint8_t* buffer, unsigned int length);
 
 	AESWrapper();
-	AESWrapper(const CltSymmetricKey& symmetric_key);
+	AESWrapper(const CltSymmetricKey& symmetric_key, AESMode mode = AES_CBC);
+	AESWrapper(const AESWrapper&) = delete; // owns its streaming states
+	AESWrapper& operator=(const AESWrapper&) = delete;
 	virtual ~AESWrapper();
 
 	CltSymmetricKey getKey() const;
@@ -26,5 +59,24 @@ public:
 	std::string encrypt(const uint8_t* plain, size_t length);
 	std::string decrypt(const uint8_t* cipher, size_t length);
 	std::string encrypt(const std::string& plain);
+
+	// streaming encryption, in CBC mode the output of begin + update... + final is identical to encrypt() over the whole input
+	static size_t encrypted_size(size_t length, AESMode mode = AES_CBC);
+	void encrypt_begin();
+	void encrypt_update(const uint8_t* plain, size_t length, std::string& cipher);
+	void encrypt_final(std::string& cipher);
+
+	// streaming decryption (CBC only), the output of begin + update... + final is identical to decrypt() over the whole input
+	void decrypt_begin();
+	void decrypt_update(const uint8_t* cipher, size_t length, std::string& plain);
+	void decrypt_final(std::string& plain);
+
+	// AES-CTR of length bytes at offset (bytes) of the key stream of iv (nonce & a big endian block counter of any value),
+	// the segments of a CTR update are encrypted with it
+	static void ctr_process(const CltSymmetricKey& key, const uint8_t* iv, uint64_t offset, const uint8_t* in, uint8_t* out, size_t length);
+
+	// number of threads a CTR update may be split over (default: the number of cores), for all the wrappers
+	static void set_threads(unsigned int threads);
+	static unsigned int get_threads();
 };
 
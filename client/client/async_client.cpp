@@ -0,0 +1,587 @@
+/*
+	TransferIt client
+	async_client.cpp
+	description: asynchronous client session on Boost.Asio, sends the same requests as Client without blocking,
+	file content is read and encrypted (as separate stages) on a workers pool while the socket sends the previous blocks
+*/
+
+#include "async_client.h"
+#include "client.h"
+#include "file_handler.h"
+#include "AESWrapper.h"
+#include "RSAWrapper.h"
+#include "crc.h"
+#include "compressor.h"
+#include <iostream>
+#include <cstring>
+#include <array>
+#include <algorithm>
+
+// largest response payload which is expected (the AES key response is the only one of variable size)
+const size_t MAX_RES_PAYLOAD_SIZE = 4096;
+
+// copy a (packed) request struct into a buffer which lives until the request is written
+template <typename T>
+static std::shared_ptr<std::vector<uint8_t>> request_bytes(const T& req)
+{
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&req);
+	return std::make_shared<std::vector<uint8_t>>(bytes, bytes + sizeof(req));
+}
+
+// the file request (header & payload header) of file_name in the layout of version (see ReqFileT)
+template <typename Size>
+static std::vector<uint8_t> file_request(const CltId& id, uint8_t version, const std::string& file_name, size_t content_size)
+{
+	ReqFileT<Size> req(id);
+	req.hdr.clt_version = version;
+	strcpy_s(reinterpret_cast<char*>(req.payload_hdr.file_name.file_name), FILE_NAME_SIZE, file_name.c_str());
+	req.payload_hdr.file_content_size = static_cast<Size>(content_size);
+	req.hdr.payload_size = content_payload_size(version, sizeof(req.payload_hdr), content_size);
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&req);
+	return std::vector<uint8_t>(bytes, bytes + sizeof(req));
+}
+
+AsyncClient::AsyncClient(boost::asio::io_context& io_context, boost::asio::thread_pool& workers, const CltId& clt_id)
+	: workers(workers), strand(boost::asio::make_strand(io_context)), socket(strand), resolver(strand),
+	id(clt_id)
+{
+	protocol_version = CLT_VERSION;
+	file = nullptr;
+	aes = nullptr;
+	digest = nullptr;
+	clt_cksum = 0;
+	svr_cksum = 0;
+	tries = 0;
+	confirmed = false;
+	read_left = 0;
+	encrypt_left = 0;
+	reading = false;
+	encrypting = false;
+	writing = false;
+	request_sent = false;
+}
+
+AsyncClient::~AsyncClient()
+{
+	release_file();
+	close();
+}
+
+void AsyncClient::set_symmetric_key(const CltSymmetricKey& key)
+{
+	symmetric_key = key;
+}
+
+CltSymmetricKey AsyncClient::get_symmetric_key() const
+{
+	return symmetric_key;
+}
+
+void AsyncClient::set_protocol_version(uint8_t version)
+{
+	protocol_version = version;
+}
+
+uint8_t AsyncClient::get_protocol_version() const
+{
+	return protocol_version;
+}
+
+CltId AsyncClient::get_id() const
+{
+	return id;
+}
+
+// whether the server confirmed the last file sent (valid CRC), a file which failed its cksum RETRIES times is not
+bool AsyncClient::file_confirmed() const
+{
+	return confirmed;
+}
+
+// close the connection, pending operations are cancelled (their handlers are called with a failure)
+void AsyncClient::close()
+{
+	boost::system::error_code ec;
+	socket.close(ec);
+}
+
+// resolve the server address & connect to it
+void AsyncClient::async_connect(const std::string& address, const std::string& port, Handler handler)
+{
+	auto self = shared_from_this();
+	resolver.async_resolve(address, port, boost::asio::bind_executor(strand,
+		[this, self, handler](const boost::system::error_code& ec, tcp::resolver::results_type endpoints)
+		{
+			if (ec)
+			{
+				std::cout << ec.message() << std::endl;
+				handler(false);
+				return;
+			}
+			boost::asio::async_connect(socket, endpoints, boost::asio::bind_executor(strand,
+				[this, self, handler](const boost::system::error_code& ec, const tcp::endpoint&)
+				{
+					if (ec)
+					{
+						std::cout << ec.message() << std::endl;
+						handler(false);
+						return;
+					}
+					boost::system::error_code option_ec;
+					socket.set_option(tcp::no_delay(true), option_ec); // requests are written whole
+					handler(true);
+				}));
+		}));
+}
+
+// write a whole request
+void AsyncClient::write_request(std::shared_ptr<std::vector<uint8_t>> request, Handler handler)
+{
+	auto self = shared_from_this();
+	boost::asio::async_write(socket, boost::asio::buffer(*request), boost::asio::bind_executor(strand,
+		[self, request, handler](const boost::system::error_code& ec, size_t)
+		{
+			handler(!ec);
+		}));
+}
+
+// read a response header (res_hdr) & its payload (res_payload), the response code should be code
+void AsyncClient::read_response(const uint16_t code, Handler handler)
+{
+	auto self = shared_from_this();
+	boost::asio::async_read(socket, boost::asio::buffer(&res_hdr, sizeof(res_hdr)), boost::asio::bind_executor(strand,
+		[this, self, code, handler](const boost::system::error_code& ec, size_t)
+		{
+			if (ec || res_hdr.res_code != code || res_hdr.payload_size > MAX_RES_PAYLOAD_SIZE)
+			{
+				if (!ec)
+					std::cout << "response code: " << res_hdr.res_code << " not match the expected code: " << code << std::endl;
+				handler(false);
+				return;
+			}
+			res_payload.resize(res_hdr.payload_size);
+			if (res_payload.empty())
+			{
+				handler(true);
+				return;
+			}
+			boost::asio::async_read(socket, boost::asio::buffer(res_payload), boost::asio::bind_executor(strand,
+				[self, handler](const boost::system::error_code& ec, size_t)
+				{
+					handler(!ec);
+				}));
+		}));
+}
+
+// register the client on the server, on success the client ID (get_id) is the one the server gave
+void AsyncClient::async_registration(const std::string& user_name, Handler handler)
+{
+	ReqRegistration req_registration;
+	req_registration.hdr.payload_size = sizeof(req_registration.payload);
+	strcpy_s(reinterpret_cast<char*>(req_registration.payload.username), CLT_USERNAME_SIZE, user_name.c_str());
+
+	auto self = shared_from_this();
+	write_request(request_bytes(req_registration), [this, self, handler](bool written)
+		{
+			if (!written)
+			{
+				std::cout << "failed to send registration request" << std::endl;
+				handler(false);
+				return;
+			}
+			read_response(RES_REGISTRATION_SUCCESS, [this, self, handler](bool success)
+				{
+					if (!success || res_payload.size() != sizeof(id))
+					{
+						std::cout << "failed to recieve server registration response" << std::endl;
+						handler(false);
+						return;
+					}
+					memcpy(&id, res_payload.data(), sizeof(id));
+					handler(true);
+				});
+		});
+}
+
+// send the public key of rsa, recieve the AES key (encrypted with it) which is used to encrypt the files from now on
+void AsyncClient::async_public_key(const std::string& user_name, RSAPrivateWrapper& rsa, Handler handler)
+{
+	ReqPublicKey req_public_key(id);
+	const std::string public_key = rsa.getPublicKey();
+	if (public_key.size() != CLT_PUBLICKEY_SIZE)
+	{
+		boost::asio::post(strand, [handler]() { handler(false); });
+		return;
+	}
+	req_public_key.hdr.payload_size = sizeof(req_public_key.payload);
+	strcpy_s(reinterpret_cast<char*>(req_public_key.payload.clt_name.username), CLT_USERNAME_SIZE, user_name.c_str());
+	memcpy(req_public_key.payload.clt_public_key.public_key, public_key.c_str(), CLT_PUBLICKEY_SIZE);
+
+	auto self = shared_from_this();
+	RSAPrivateWrapper* decryptor = &rsa;
+	write_request(request_bytes(req_public_key), [this, self, decryptor, handler](bool written)
+		{
+			if (!written)
+			{
+				std::cout << "failed to send public key request" << std::endl;
+				handler(false);
+				return;
+			}
+			read_response(RES_AES_KEY, [this, self, decryptor, handler](bool success)
+				{
+					if (!success || res_payload.size() <= sizeof(ResAES))
+					{
+						std::cout << "failed to recieve AES key from the server" << std::endl;
+						handler(false);
+						return;
+					}
+					std::string aes_key;
+					try
+					{
+						aes_key = decryptor->decrypt(res_payload.data() + sizeof(ResAES), res_payload.size() - sizeof(ResAES));
+					}
+					catch (std::exception& e)
+					{
+						std::cout << "failed to decrypt AES key" << std::endl;
+						handler(false);
+						return;
+					}
+					if (aes_key.size() != CLT_SYMMETRICKEY_SIZE)
+					{
+						std::cout << "AES key after decryption size not match the protocol, size recieved: " << aes_key.size() << std::endl;
+						handler(false);
+						return;
+					}
+					memcpy(symmetric_key.symmetric_key, aes_key.c_str(), aes_key.size());
+					protocol_version = std::min(CLT_VERSION, res_hdr.svr_version);
+					handler(true);
+				});
+		});
+}
+
+// send one of the CRC type requests (valid / not valid / 4th time not valid) for file_name and recieve the confirmation
+void AsyncClient::async_crc(const uint16_t type_code, const std::string& file_name, Handler handler)
+{
+	if (type_code != REQ_VALID_CRC && type_code != REQ_NVALID_CRC && type_code != REQ_4NVALID_CRC)
+	{
+		boost::asio::post(strand, [handler]() { handler(false); });
+		return;
+	}
+	ReqValidCRC req_crc(id); // all the CRC type requests share the same structure
+	req_crc.hdr.req_code = type_code;
+	req_crc.hdr.payload_size = sizeof(req_crc.payload);
+	strcpy_s(reinterpret_cast<char*>(req_crc.payload.file_name.file_name), FILE_NAME_SIZE, file_name.c_str());
+
+	auto self = shared_from_this();
+	write_request(request_bytes(req_crc), [this, self, type_code, handler](bool written)
+		{
+			if (!written)
+			{
+				std::cout << "failed to send CRC type request " << type_code << std::endl;
+				handler(false);
+				return;
+			}
+			read_response(RES_MSG_CONFIRM, handler);
+		});
+}
+
+/* send a file to the server, check its cksum against the server cksum and send it again if they differ,
+same as Client::req_file + Client::retries_mechanism (the handler gets true also if the 4th try failed, as there,
+file_confirmed tells whether the server confirmed the file) */
+void AsyncClient::async_send_file(const std::string& file_name, Handler handler)
+{
+	file_to_send = file_name;
+	file_done = handler;
+	tries = 1;
+	confirmed = false;
+	auto self = shared_from_this();
+	boost::asio::post(strand, [this, self]()
+		{
+			if (!send_file(false))
+				finish_file(false);
+		});
+}
+
+// open the file and start the pipeline (on the strand), on a retry the cksum is not calculated again
+bool AsyncClient::send_file(bool retry)
+{
+	release_file();
+	file = new FileHandler();
+	if (!file->open_file(file_to_send, "rb"))
+	{
+		std::cout << "cannot open file: " << file_to_send << std::endl;
+		return false;
+	}
+	const size_t num_of_bytes = file->get_file_size();
+	if (num_of_bytes == 0)
+	{
+		std::cout << "file is empty: " << file_to_send << std::endl;
+		return false;
+	}
+	if (num_of_bytes >= MIN_MAPPED_FILE_SIZE)
+		file->map_file(); // if it cannot be mapped, it is read through the filestream
+
+	if (protocol_version < VERSION_LARGE_FILES && num_of_bytes > MAX_32BIT_FILE_SIZE)
+	{
+		std::cout << "file is too large for protocol version " << static_cast<int>(protocol_version) << ": " << file_to_send << std::endl;
+		return false;
+	}
+	const size_t content_size = AESWrapper::encrypted_size(num_of_bytes + codec_prefix_size(protocol_version), cipher_mode(protocol_version));
+	request = (protocol_version >= VERSION_LARGE_FILES) ? file_request<uint64_t>(id, protocol_version, file_to_send, content_size) :
+		file_request<uint32_t>(id, protocol_version, file_to_send, content_size);
+	aes = new AESWrapper(symmetric_key, cipher_mode(protocol_version));
+	aes->encrypt_begin();
+	if (!retry)
+		digest = new CRC();
+
+	read_left = num_of_bytes;
+	encrypt_left = num_of_bytes;
+	request_sent = false;
+	if (codec_prefix_size(protocol_version) > 0) // the content is sent as is, ahead of the first block
+	{
+		ready_blocks.emplace_back();
+		aes->encrypt_update(&CODEC_NONE, sizeof(CODEC_NONE), ready_blocks.back());
+	}
+	read_next();
+	return true;
+}
+
+// a buffer for the next block, blocks which were sent are reused (keeping their capacity)
+std::string AsyncClient::take_free_block()
+{
+	if (free_blocks.empty())
+		return std::string();
+	std::string block = std::move(free_blocks.back());
+	free_blocks.pop_back();
+	return block;
+}
+
+// read the next block of the file into reading_block and add it to the cksum (runs on the workers pool),
+// a mapped file is viewed in place, otherwise the block is copied out of the file handler buffer
+bool AsyncClient::read_block()
+{
+	const uint8_t* block = nullptr;
+	size_t bytes_read = 0;
+	if (!file->view_file_chunk(block, std::min(read_left, FILE_BLOCK_SIZE), bytes_read) || bytes_read == 0)
+		return false;
+	if (digest != nullptr)
+		digest->update(block, static_cast<uint32_t>(bytes_read));
+	reading_block.size = bytes_read;
+	reading_block.view = file->is_mapped() ? block : nullptr;
+	if (reading_block.view == nullptr)
+		reading_block.buff.assign(reinterpret_cast<const char*>(block), bytes_read);
+	read_left -= bytes_read;
+	return true;
+}
+
+// read the next block on the workers pool, unless one is being read / the file was read / the pipeline is full
+void AsyncClient::read_next()
+{
+	const size_t in_pipeline = read_blocks.size() + (encrypting ? 1 : 0) + ready_blocks.size() + (writing ? 1 : 0);
+	if (reading || read_left == 0 || in_pipeline >= PIPELINE_DEPTH)
+		return;
+
+	reading = true;
+	reading_block.buff = take_free_block();
+	// the io_context has no pending work of this session while the block is read, keep it running
+	auto self = shared_from_this();
+	auto work = boost::asio::make_work_guard(strand);
+	boost::asio::post(workers, [this, self, work]()
+		{
+			const bool success = read_block();
+			boost::asio::post(strand, [this, self, success]() { on_read(success); });
+		});
+}
+
+void AsyncClient::on_read(bool success)
+{
+	reading = false;
+	if (!file_done) // the file failed meanwhile
+	{
+		release_file();
+		return;
+	}
+	if (!success)
+	{
+		std::cout << "cannot read file contents: " << file_to_send << std::endl;
+		finish_file(false);
+		return;
+	}
+	read_blocks.push_back(std::move(reading_block));
+	reading_block = PlainBlock();
+	encrypt_next();
+	read_next();
+}
+
+// encrypt encrypting_block into encrypted_block, the last block is followed by the final ciphertext (runs on the workers pool)
+void AsyncClient::encrypt_block()
+{
+	const uint8_t* block = (encrypting_block.view != nullptr) ? encrypting_block.view :
+		reinterpret_cast<const uint8_t*>(encrypting_block.buff.data());
+	aes->encrypt_update(block, encrypting_block.size, encrypted_block);
+	encrypt_left -= encrypting_block.size;
+	if (encrypt_left == 0)
+	{
+		std::string cipher_final;
+		aes->encrypt_final(cipher_final);
+		encrypted_block.append(cipher_final);
+	}
+}
+
+// encrypt the next block which was read on the workers pool, unless one is being encrypted
+void AsyncClient::encrypt_next()
+{
+	if (encrypting || read_blocks.empty())
+		return;
+
+	encrypting = true;
+	encrypting_block = std::move(read_blocks.front());
+	read_blocks.pop_front();
+	encrypted_block = take_free_block();
+	auto self = shared_from_this();
+	auto work = boost::asio::make_work_guard(strand);
+	boost::asio::post(workers, [this, self, work]()
+		{
+			encrypt_block();
+			boost::asio::post(strand, [this, self]() { on_encrypted(); });
+		});
+}
+
+void AsyncClient::on_encrypted()
+{
+	encrypting = false;
+	free_blocks.push_back(std::move(encrypting_block.buff));
+	encrypting_block = PlainBlock();
+	if (!file_done)
+	{
+		release_file();
+		return;
+	}
+	ready_blocks.push_back(std::move(encrypted_block));
+	encrypted_block.clear();
+	encrypt_next();
+	write_next();
+}
+
+// write the next encrypted block (the request goes with the first one) unless a write is in progress
+void AsyncClient::write_next()
+{
+	if (writing || ready_blocks.empty())
+		return;
+
+	writing = true;
+	sending_block = std::move(ready_blocks.front());
+	ready_blocks.pop_front();
+	const std::array<boost::asio::const_buffer, 2> buffers = {
+		boost::asio::buffer(request.data(), request_sent ? 0 : request.size()), boost::asio::buffer(sending_block) };
+	request_sent = true;
+
+	auto self = shared_from_this();
+	boost::asio::async_write(socket, buffers, boost::asio::bind_executor(strand,
+		[this, self](const boost::system::error_code& ec, size_t)
+		{
+			on_written(ec);
+		}));
+}
+
+void AsyncClient::on_written(const boost::system::error_code& ec)
+{
+	writing = false;
+	free_blocks.push_back(std::move(sending_block));
+	sending_block.clear();
+	if (!file_done)
+		return;
+	if (ec)
+	{
+		std::cout << "failed to send file request (content sending phase): " << file_to_send << std::endl;
+		finish_file(false);
+		return;
+	}
+	if (!encrypting && encrypt_left == 0 && ready_blocks.empty())
+	{
+		on_file_sent();
+		return;
+	}
+	read_next(); // a place in the pipeline was freed
+	write_next();
+}
+
+// the whole file was written, recieve the server cksum (Got file 2103)
+void AsyncClient::on_file_sent()
+{
+	if (digest != nullptr)
+		clt_cksum = digest->digest();
+	release_file();
+
+	auto self = shared_from_this();
+	read_response(RES_GOT_FILE, [this, self](bool success)
+		{
+			const size_t payload_size = (protocol_version >= VERSION_LARGE_FILES) ? sizeof(ResGotFile64::Payload) : sizeof(ResGotFile::Payload);
+			if (!success || res_payload.size() != payload_size)
+			{
+				std::cout << "failed to recieve server response: 2103 (CRC)  " << file_to_send << std::endl;
+				finish_file(false);
+				return;
+			}
+			// the cksum is the last field in both layouts
+			memcpy(&svr_cksum, res_payload.data() + payload_size - sizeof(svr_cksum), sizeof(svr_cksum));
+			on_got_file();
+		});
+}
+
+// compare the cksums, confirm the file or send it again (up to RETRIES times)
+void AsyncClient::on_got_file()
+{
+	auto self = shared_from_this();
+	if (clt_cksum == svr_cksum)
+	{
+		async_crc(REQ_VALID_CRC, file_to_send, [this, self](bool success)
+			{
+				confirmed = success;
+				finish_file(success);
+			});
+	}
+	else if (tries < RETRIES)
+	{
+		tries += 1;
+		async_crc(REQ_NVALID_CRC, file_to_send, [this, self](bool success)
+			{
+				if (!success || !send_file(true))
+					finish_file(false);
+			});
+	}
+	else
+	{
+		async_crc(REQ_4NVALID_CRC, file_to_send, [this, self](bool success) { finish_file(success); });
+	}
+}
+
+// call the handler of async_send_file (once), a failed session is closed
+void AsyncClient::finish_file(bool success)
+{
+	if (!file_done)
+		return;
+
+	Handler handler = std::move(file_done);
+	file_done = nullptr;
+	if (!success)
+		close();
+	release_file();
+	handler(success);
+}
+
+// free what the file being sent uses, not while a block of it is being read / encrypted
+void AsyncClient::release_file()
+{
+	if (reading || encrypting)
+		return;
+
+	delete file;
+	file = nullptr;
+	delete aes;
+	aes = nullptr;
+	delete digest;
+	digest = nullptr;
+	read_blocks.clear();
+	ready_blocks.clear();
+}
@@ -0,0 +1,127 @@
+/*
+	TransferIt client
+	async_client.h
+	description: header file for async_client.cpp
+*/
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "networkProtocol.h"
+
+// number of file blocks (FILE_BLOCK_SIZE each) which may be in the pipeline at once (read, encrypted, or waiting for
+// the socket), per session
+const size_t PIPELINE_DEPTH = 4;
+
+// forward declarations
+class FileHandler;
+class AESWrapper;
+class CRC;
+class RSAPrivateWrapper;
+
+using boost::asio::ip::tcp;
+
+/*
+	asynchronous client session - one connection to the server, the same requests as Client.
+	every operation returns at once and calls its handler (on the io_context) with the result when done,
+	so many sessions can run on one io_context thread. a file is sent as a pipeline of three stages with a queue
+	between each two: a block is read & added to the cksum (on the workers pool), encrypted (on the workers pool)
+	and written to the socket, so block N+1 is read while block N is encrypted and block N-1 is written.
+	only one operation at a time per session. requests are written as is (little endian hosts)
+*/
+class AsyncClient : public std::enable_shared_from_this<AsyncClient>
+{
+public:
+	typedef std::function<void(bool)> Handler;
+
+private:
+	boost::asio::thread_pool& workers;
+	boost::asio::strand<boost::asio::io_context::executor_type> strand;
+	tcp::socket socket;
+	tcp::resolver resolver;
+	CltId id;
+	CltSymmetricKey symmetric_key;
+	uint8_t protocol_version; // of the session, negotiated with the key exchange
+
+	// the file currently being sent
+	std::string file_to_send;
+	FileHandler* file;
+	AESWrapper* aes;
+	CRC* digest; // nullptr on retries, the cksum of the first send (clt_cksum) is kept
+	uint32_t clt_cksum;
+	uint32_t svr_cksum;
+	int tries;
+	bool confirmed; // the server confirmed the file (valid CRC)
+	Handler file_done; // handler of async_send_file, empty when no file is being sent
+
+	// a block which was read & added to the cksum: a view of the mapped file, or a copy in buff (view is nullptr)
+	struct PlainBlock
+	{
+		const uint8_t* view = nullptr;
+		size_t size = 0;
+		std::string buff;
+	};
+
+	// pipeline state, changed on the strand only (but the blocks which are being read / encrypted, every stage runs
+	// one block at a time since the file position, the cksum and the cipher are serial)
+	std::vector<uint8_t> request; // header & payload header of the file request, in the layout of the session version
+	size_t read_left; // bytes not read yet
+	size_t encrypt_left; // bytes not encrypted yet
+	bool reading;
+	bool encrypting;
+	bool writing;
+	bool request_sent;
+	std::deque<PlainBlock> read_blocks; // read, waiting to be encrypted
+	std::deque<std::string> ready_blocks; // encrypted, waiting for the socket
+	std::vector<std::string> free_blocks;
+	PlainBlock reading_block;
+	PlainBlock encrypting_block;
+	std::string encrypted_block;
+	std::string sending_block;
+
+	// responses
+	ResHeader res_hdr;
+	std::vector<uint8_t> res_payload;
+
+	bool send_file(bool retry);
+	std::string take_free_block();
+	bool read_block();
+	void read_next();
+	void on_read(bool success);
+	void encrypt_block();
+	void encrypt_next();
+	void on_encrypted();
+	void write_next();
+	void on_written(const boost::system::error_code& ec);
+	void on_file_sent();
+	void on_got_file();
+	void finish_file(bool success);
+	void release_file();
+
+	void write_request(std::shared_ptr<std::vector<uint8_t>> request, Handler handler);
+	void read_response(const uint16_t code, Handler handler);
+
+public:
+	AsyncClient(boost::asio::io_context& io_context, boost::asio::thread_pool& workers, const CltId& clt_id);
+	virtual ~AsyncClient();
+
+	void set_symmetric_key(const CltSymmetricKey& key);
+	CltSymmetricKey get_symmetric_key() const;
+	void set_protocol_version(uint8_t version);
+	uint8_t get_protocol_version() const;
+	CltId get_id() const;
+	bool file_confirmed() const;
+
+	// operations, same as the Client requests
+	void async_connect(const std::string& address, const std::string& port, Handler handler);
+	void async_registration(const std::string& user_name, Handler handler);
+	void async_public_key(const std::string& user_name, RSAPrivateWrapper& rsa, Handler handler);
+	void async_send_file(const std::string& file_name, Handler handler); // file request, cksum check & retries
+	void async_crc(const uint16_t type_code, const std::string& file_name, Handler handler);
+	void close();
+};
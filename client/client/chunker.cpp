@@ -0,0 +1,76 @@
+/*
+	TransferIt client
+	chunker.cpp
+	description: content defined chunking of file contents (gear rolling hash), chunks are identified by their SHA-256
+*/
+
+#include "chunker.h"
+#include <array>
+
+// a chunk ends where the top bits of the gear hash (log2(CDC_AVG_CHUNK_SIZE) of them) are all 0
+static const uint64_t CDC_MASK = ~(~0ULL >> 16);
+static_assert(CDC_AVG_CHUNK_SIZE == 64 * 1024, "CDC_MASK is 16 bits");
+
+// random value of every byte value (splitmix64 of a fixed seed), the client & the chunks it sent before must agree on it
+static const std::array<uint64_t, 256>& gear_table()
+{
+	static const std::array<uint64_t, 256> table = []()
+	{
+		std::array<uint64_t, 256> gear{};
+		uint64_t state = 0x5472616e73666572ULL;
+		for (uint64_t& value : gear)
+		{
+			uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			value = z ^ (z >> 31);
+		}
+		return gear;
+	}();
+	return table;
+}
+
+ContentChunker::ContentChunker() : hash(0), chunk_size(0)
+{
+}
+
+// close the current chunk
+void ContentChunker::cut()
+{
+	ChunkRef chunk;
+	sha.Final(chunk.hash);
+	chunk.size = static_cast<uint32_t>(chunk_size);
+	chunks.push_back(chunk);
+	hash = 0;
+	chunk_size = 0;
+}
+
+// feed the next size bytes of the content
+void ContentChunker::update(const uint8_t* data, size_t size)
+{
+	const std::array<uint64_t, 256>& gear = gear_table();
+	size_t start = 0; // of the part of data which is not hashed (SHA-256) yet
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash << 1) + gear[data[i]];
+		chunk_size += 1;
+		if ((chunk_size >= CDC_MIN_CHUNK_SIZE && (hash & CDC_MASK) == 0) || chunk_size >= CDC_MAX_CHUNK_SIZE)
+		{
+			sha.Update(data + start, i + 1 - start);
+			start = i + 1;
+			cut();
+		}
+	}
+	sha.Update(data + start, size - start);
+}
+
+void ContentChunker::final()
+{
+	if (chunk_size > 0)
+		cut();
+}
+
+const std::vector<ChunkRef>& ContentChunker::get_chunks() const
+{
+	return chunks;
+}
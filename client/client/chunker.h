@@ -0,0 +1,42 @@
+/*
+	TransferIt client
+	chunker.h
+	description: header file for chunker.cpp
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <sha.h>
+#include "networkProtocol.h"
+
+// content defined chunks are of CDC_MIN_CHUNK_SIZE to CDC_MAX_CHUNK_SIZE bytes, CDC_AVG_CHUNK_SIZE on average
+const size_t CDC_MIN_CHUNK_SIZE = 16 * 1024;
+const size_t CDC_AVG_CHUNK_SIZE = 64 * 1024;
+const size_t CDC_MAX_CHUNK_SIZE = 256 * 1024;
+
+/*
+	content defined chunking of a file (see VERSION_DEDUP): a gear rolling hash runs over the content and a chunk ends
+	where the hash of the last 64 bytes matches a pattern, so a boundary depends only on the bytes around it - an insertion
+	moves the boundaries next to it only, the chunks after it are the same as before and the server already has them.
+	the content is fed block by block, each chunk is identified by the SHA-256 of its bytes
+*/
+class ContentChunker
+{
+private:
+	std::vector<ChunkRef> chunks;
+	uint64_t hash;
+	size_t chunk_size; // bytes of the current (open) chunk
+	CryptoPP::SHA256 sha; // of the current chunk
+
+	void cut();
+
+public:
+	ContentChunker();
+
+	void update(const uint8_t* data, size_t size);
+	void final(); // close the last chunk
+	const std::vector<ChunkRef>& get_chunks() const;
+};
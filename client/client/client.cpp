@@ -10,11 +10,21 @@
 #include "helper.h"
 #include "RSAWrapper.h"
 #include "AESWrapper.h"
+#include "crc.h"
+#include "compressor.h"
+#include "chunker.h"
+#include "delta.h"
+#include "async_client.h"
+#include "run_metrics.h"
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/hex.hpp>
 #include <boost/filesystem.hpp>
 #include <iostream>
 #include <filesystem>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <set>
 
 Client::Client()
 {
@@ -25,6 +35,15 @@ Client::Client()
 	file_handler = new FileHandler();
 
 	rsa_decryptor = nullptr;
+
+	protocol_version = CLT_VERSION;
+	ticket_expiry = 0;
+	stripes = DEFAULT_STRIPES;
+	stripe_connection_lost = false;
+	compressor = nullptr;
+	dedup = false;
+	delta = false;
+	metrics = new RunMetrics();
 }
 
 Client::~Client()
@@ -32,6 +51,8 @@ Client::~Client()
 	delete socket_handler;
 	delete file_handler;
 	delete rsa_decryptor;
+	delete compressor;
+	delete metrics;
 }
 
 // stop the client from running, mainly created for an error in the client start up (clt_start)
@@ -41,14 +62,76 @@ void Client::stop_clt()
 	delete socket_handler;
 	delete file_handler;
 	delete rsa_decryptor;
+	delete compressor;
+	delete metrics;
 	std::cout << " fatal-error XXXXX Server responded with an error, client routine went unsuccessfully XXXXXX fatal-error " << std::endl;
 	exit(1);
 }
 
+// set the number of parallel connections each (large enough) file is striped over, 1 = single stream
+bool Client::set_stripes(unsigned int num_of_stripes)
+{
+	if (num_of_stripes == 0 || num_of_stripes > MAX_STRIPES)
+		return false;
+
+	stripes = num_of_stripes;
+	return true;
+}
+
+// send files by their content defined chunks (to servers of VERSION_DEDUP and on, see req_file_dedup)
+void Client::set_dedup(bool enabled)
+{
+	dedup = enabled;
+}
+
+// send files the server already has a copy of as the differences from it (to servers of VERSION_DELTA and on, see req_file_delta)
+void Client::set_delta(bool enabled)
+{
+	delta = enabled;
+}
+
+// compress file contents before they are encrypted, spec is "lz4" / "zstd" / "zstd:LEVEL" (see Compressor::parse)
+bool Client::set_compression(const std::string& spec)
+{
+	uint8_t codec = CODEC_NONE;
+	int level = DEFAULT_ZSTD_LEVEL;
+	if (!Compressor::parse(spec, codec, level))
+		return false;
+
+	delete compressor;
+	compressor = new Compressor(codec, level);
+	return true;
+}
+
+// write the timing & counters of the run as a JSON summary to path at its end (see RunMetrics)
+void Client::set_metrics(const std::string& path)
+{
+	metrics_path = path;
+}
+
+// write every timed phase of the run as a Chrome trace to path at its end
+void Client::set_trace(const std::string& path)
+{
+	trace_path = path;
+	metrics->set_tracing(!path.empty());
+}
+
+// write the run summary / trace (if asked for), success - the outcome of the run
+bool Client::write_metrics(bool success)
+{
+	bool written = true;
+	metrics->add_sockets(socket_handler->get_counters());
+	if (!metrics_path.empty())
+		written = metrics->write_summary(metrics_path, success, protocol_version) && written;
+	if (!trace_path.empty())
+		written = metrics->write_trace(trace_path) && written;
+	return written;
+}
+
 // the main client routine, working in *batch mode*
 bool Client::clt_start() 
 {
-	// read server ip address & port and set socket info, client username, and the file to send name
+	// read server ip address & port and set socket info, client username, and the files to send names
 	if(!read_instructions())
 	{
 		std::cout << "couldn't read " << CLT_INSTRUCTION_FILE << std::endl;
@@ -56,7 +139,10 @@ bool Client::clt_start()
 	}
 
 	// connect to the server
-	if(!socket_handler->connect())
+	const auto connect_time = std::chrono::steady_clock::now();
+	const bool connected = socket_handler->connect();
+	metrics->add(PHASE_CONNECT, connect_time);
+	if(!connected)
 	{
 		std::cout << "couldn't connect to server" << std::endl;
 		return false;
@@ -88,6 +174,7 @@ bool Client::clt_start()
 		// generate RSA pair
 		try
 		{
+			PhaseTimer timer(*metrics, PHASE_RSA_KEYGEN);
 			if(rsa_decryptor != nullptr)
 				delete rsa_decryptor;
 			rsa_decryptor = new RSAPrivateWrapper();
@@ -107,34 +194,220 @@ bool Client::clt_start()
 		}
 	}
 	 
+	// resume the session of the last run with its ticket (CLT_SESSION_FILE) if the server still accepts it, otherwise
 	// (1) send public key to the server (2) recieve encrypted AES key (3) decrypt AES key with private key
-	if (!req_public_key())
+	const bool resumed = read_session_info() && req_resume_session();
+	if (!resumed && !req_public_key())
 	{
 		socket_handler->close_connection();
 		std::cout << "request public key failed" << std::endl;
 		return false;
 	}
+	const std::chrono::duration<double, std::milli> setup_time = std::chrono::steady_clock::now() - connect_time;
+	std::cout << "session " << (resumed ? "resumed" : "keys exchanged") << ", first file request " << setup_time.count() << " ms after connect" << std::endl;
 
-	// Encrypt the file to send with the AES key, send encrypted file to server, check both clt and svr cksum, send up to 4 times before abort
-	if (!req_file())
+	// send every listed file over this session (no more connect / key exchange per file),
+	// each file: encrypt with the AES key, send to server, check both clt and svr cksum, send up to 4 times before abort
+	size_t files_sent = 0;
+	for (const std::string& file_name : files_to_send)
 	{
-		socket_handler->close_connection();
-		std::cout << "request file failed" << std::endl;
+		file_to_send = file_name;
+		const auto start_time = std::chrono::steady_clock::now();
+		const uint64_t retries = metrics->get_count(PHASE_RETRY);
+		bool sent = req_file();
+		// the connection may be lost in the middle of a file, the chunks which were stored by then are kept by the server,
+		// so connect again and resume the file. any other failure (the file can't be read, the server answered with an
+		// error) would fail the same way again
+		for (int attempt = 1; !sent && connection_lost() && attempt < RETRIES; ++attempt)
+		{
+			PhaseTimer timer(*metrics, PHASE_RETRY);
+			if (!reconnect())
+				break;
+			sent = req_file();
+		}
+		if (!sent)
+		{
+			socket_handler->close_connection();
+			std::cout << "request file failed: " << file_to_send << " (" << files_sent << " of " << files_to_send.size() << " files sent)" << std::endl;
+			return false;
+		}
+		bool confirmed = false;
+		if (!retries_mechanism(confirmed))
+		{
+			socket_handler->close_connection();
+			std::cout << " file retry send process went unsuccessfully: " << file_to_send << " (" << files_sent << " of " << files_to_send.size() << " files sent)" << std::endl;
+			return false;
+		}
+		if (!confirmed)
+		{
+			std::cout << "file " << file_to_send << " failed its cksum " << RETRIES << " times, the server dropped it" << std::endl;
+			continue;
+		}
+		files_sent += 1;
+
+		// throughput of the file (including retries), to compare single stream and striped sending
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+		std::error_code ec;
+		const uintmax_t file_size = std::filesystem::file_size(file_to_send, ec);
+		metrics->add_file(file_to_send, ec ? 0 : file_size, start_time, metrics->get_count(PHASE_RETRY) - retries);
+		if (!ec && elapsed.count() > 0)
+		{
+			std::cout << "sent " << file_to_send << ": " << file_size << " bytes in " << elapsed.count() << " s ("
+				<< (file_size / elapsed.count()) / (1024 * 1024) << " MB/s, "
+				<< ((stripes > 1 && file_size >= MIN_STRIPED_FILE_SIZE) ? stripes : 1) << " stream(s))" << std::endl;
+		}
+		// what compression saved on the wire & what it cost (contents of older servers / striped files are not compressed)
+		if (compressor != nullptr && compressor->get_contents() > 0)
+		{
+			std::cout << "compressed " << file_to_send << " " << compressor->stats() << std::endl;
+			compressor->reset_stats();
+		}
+	}
+	std::cout << files_sent << " of " << files_to_send.size() << " files sent" << std::endl;
+
+	// a ticket for the next run, not having one only means the next run exchanges keys
+	if (!req_session_ticket() || !write_session_info())
+		std::cout << "no session ticket for the next run" << std::endl;
+	
+	// close connection 
+	socket_handler->close_connection();
+	return files_sent == files_to_send.size();
+}
+
+/* the main client routine on the asynchronous engine (see AsyncClient), *batch mode* as well.
+the files are sent over num_of_sessions connections at once, all of them on one io_context (thread), file contents are
+read & encrypted on a workers pool. registration (if needed) is done first as in clt_start, the AES key is requested on the
+first connection only (the server keeps one key per client) and then used by all of them */
+bool Client::clt_start_async(unsigned int num_of_sessions)
+{
+	if (num_of_sessions == 0 || num_of_sessions > MAX_ASYNC_SESSIONS)
 		return false;
+	if (!read_instructions())
+	{
+		std::cout << "couldn't read " << CLT_INSTRUCTION_FILE << std::endl;
+		return false;
+	}
+
+	if (std::filesystem::exists(CLT_INFO_FILE))
+	{
+		if (!read_clt_info())
+		{
+			std::cout << "couldn't read" << CLT_INFO_FILE << " altho exists " << std::endl;
+			return false;
+		}
 	}
-	if(!retries_mechanism())
+	else
 	{
+		if (!socket_handler->connect() || !req_registration())
+		{
+			socket_handler->close_connection();
+			std::cout << "registration failed" << std::endl;
+			return false;
+		}
 		socket_handler->close_connection();
-		std::cout << " file retry send process went unsuccessfully " << std::endl;
-		return false;
+		try
+		{
+			delete rsa_decryptor;
+			rsa_decryptor = new RSAPrivateWrapper();
+		}
+		catch (std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+			return false;
+		}
+		if (!write_clt_info())
+		{
+			std::cout << "couldn't store the information into the client info file" << std::endl;
+			return false;
+		}
 	}
-	
-	// close connection 
-	socket_handler->close_connection();
-	return true;
+
+	boost::asio::io_context io_context;
+	boost::asio::thread_pool workers(std::max(2u, std::thread::hardware_concurrency()));
+	const size_t sessions_count = std::min<size_t>(num_of_sessions, files_to_send.size());
+	size_t files_sent = 0;
+	bool failed = false;
+	const auto start_time = std::chrono::steady_clock::now();
+
+	// every session sends the files i, i + sessions_count, i + 2 * sessions_count...
+	std::function<void(std::shared_ptr<AsyncClient>, size_t)> send_from = [&](std::shared_ptr<AsyncClient> session, size_t i)
+	{
+		if (i >= files_to_send.size())
+		{
+			session->close();
+			return;
+		}
+		session->async_send_file(files_to_send[i], [&, session, i](bool sent)
+			{
+				if (!sent)
+				{
+					std::cout << "request file failed: " << files_to_send[i] << std::endl;
+					failed = true;
+					return;
+				}
+				if (session->file_confirmed())
+					files_sent += 1;
+				else
+					std::cout << "file " << files_to_send[i] << " failed its cksum " << RETRIES << " times, the server dropped it" << std::endl;
+				send_from(session, i + sessions_count);
+			});
+	};
+
+	auto first = std::make_shared<AsyncClient>(io_context, workers, id);
+	first->async_connect(svr_address, svr_port, [&, first](bool connected)
+		{
+			if (!connected)
+			{
+				std::cout << "couldn't connect to server" << std::endl;
+				failed = true;
+				return;
+			}
+			first->async_public_key(user_name, *rsa_decryptor, [&, first](bool got_key)
+				{
+					if (!got_key)
+					{
+						std::cout << "request public key failed" << std::endl;
+						failed = true;
+						first->close();
+						return;
+					}
+					symmetric_key = first->get_symmetric_key();
+					send_from(first, 0);
+					for (size_t i = 1; i < sessions_count; ++i)
+					{
+						auto session = std::make_shared<AsyncClient>(io_context, workers, id);
+						session->set_symmetric_key(symmetric_key);
+						session->set_protocol_version(first->get_protocol_version());
+						session->async_connect(svr_address, svr_port, [&, session, i](bool session_connected)
+							{
+								if (!session_connected)
+								{
+									std::cout << "couldn't connect to server (session " << i << ")" << std::endl;
+									failed = true;
+									return;
+								}
+								send_from(session, i);
+							});
+					}
+				});
+		});
+	io_context.run();
+	workers.join();
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+	uintmax_t bytes_sent = 0;
+	for (const std::string& file_name : files_to_send)
+	{
+		std::error_code ec;
+		const uintmax_t file_size = std::filesystem::file_size(file_name, ec);
+		bytes_sent += ec ? 0 : file_size;
+	}
+	std::cout << files_sent << " of " << files_to_send.size() << " files sent in " << elapsed.count() << " s ("
+		<< (elapsed.count() > 0 ? (bytes_sent / elapsed.count()) / (1024 * 1024) : 0) << " MB/s, " << sessions_count << " session(s))" << std::endl;
+	return !failed && files_sent == files_to_send.size();
 }
 
-// read the server address & port from CLT_INSTRUCTION_FILE and set the socket info
+// read the server address & port, client username and the files to send from CLT_INSTRUCTION_FILE and set the socket info
 bool Client::read_instructions()
 {
 	if (!file_handler->open_file(CLT_INSTRUCTION_FILE, "rb"))
@@ -150,6 +423,8 @@ bool Client::read_instructions()
 	const std::string port = svr_info.substr(position + 1);
 	if (!socket_handler->set_socket(address, port))
 		return false;
+	svr_address = address; // kept for the extra connections of striped files
+	svr_port = port;
 
 	// read client username
 	std::string username;
@@ -165,14 +440,20 @@ bool Client::read_instructions()
 	}
 	user_name = username;
 
-	// read file name
+	// read file names, one per line from the 3rd line until the end of the file (or an empty line)
+	files_to_send.clear();
 	std::string file_name;
-	if (!file_handler->read_one_line(file_name))
-		return false;
-	boost::algorithm::trim(file_name);
-	if (file_name.size() >= FILE_NAME_SIZE)
+	while (file_handler->read_one_line(file_name))
+	{
+		boost::algorithm::trim(file_name);
+		if (file_name.size() == 0)
+			break;
+		if (file_name.size() >= FILE_NAME_SIZE)
+			return false;
+		files_to_send.push_back(file_name);
+	}
+	if (files_to_send.empty())
 		return false;
-	file_to_send = file_name;
 
 	file_handler->clear_handler();
 	return true;
@@ -261,9 +542,84 @@ bool Client::write_clt_info()
 }
 
 
+// read the session ticket, its expiry time (unix time) & the AES key it resumes from CLT_SESSION_FILE (the key is
+// decrypted with the private key), false if there is no such file / it's not of this client / the ticket expired
+bool Client::read_session_info()
+{
+	ticket_expiry = 0;
+	if (rsa_decryptor == nullptr || !std::filesystem::exists(CLT_SESSION_FILE) || !file_handler->open_file(CLT_SESSION_FILE, "rb"))
+		return false;
+
+	std::string uuid_hex, ticket_hex, expiry, key_hex;
+	bool valid = file_handler->read_one_line(uuid_hex) && file_handler->read_one_line(ticket_hex) &&
+		file_handler->read_one_line(expiry) && file_handler->read_one_line(key_hex);
+	file_handler->clear_handler();
+	try
+	{
+		const std::string uuid = boost::algorithm::unhex(boost::algorithm::trim_copy(uuid_hex));
+		const std::string ticket_bytes = boost::algorithm::unhex(boost::algorithm::trim_copy(ticket_hex));
+		const std::string encrypted_key = boost::algorithm::unhex(boost::algorithm::trim_copy(key_hex));
+		const std::string key = rsa_decryptor->decrypt(reinterpret_cast<const uint8_t*>(encrypted_key.data()), encrypted_key.size());
+		const std::time_t expiry_time = static_cast<std::time_t>(std::stoll(expiry));
+		valid = valid && uuid.size() == sizeof(id.uuid) && memcmp(uuid.c_str(), id.uuid, sizeof(id.uuid)) == 0 &&
+			ticket_bytes.size() == sizeof(ticket.ticket) && key.size() == sizeof(symmetric_key.symmetric_key) &&
+			expiry_time > std::time(nullptr);
+		if (!valid)
+			return false;
+		memcpy(ticket.ticket, ticket_bytes.c_str(), sizeof(ticket.ticket));
+		memcpy(symmetric_key.symmetric_key, key.c_str(), sizeof(symmetric_key.symmetric_key));
+		ticket_expiry = expiry_time;
+	}
+	catch (std::exception& e)
+	{
+		return false;
+	}
+	return true;
+}
+
+// write client UUID & the session ticket & its expiry time & the AES key it resumes (encrypted with the public key,
+// the file alone doesn't give the key away) into CLT_SESSION_FILE
+bool Client::write_session_info()
+{
+	if (ticket_expiry == 0 || rsa_decryptor == nullptr)
+		return false;
+	std::string encrypted_key;
+	try
+	{
+		const std::string public_key = rsa_decryptor->getPublicKey();
+		CltPublicKey clt_public_key;
+		if (public_key.size() != sizeof(clt_public_key.public_key))
+			return false;
+		memcpy(clt_public_key.public_key, public_key.c_str(), sizeof(clt_public_key.public_key));
+		encrypted_key = RSAPublicWrapper(clt_public_key).encrypt(symmetric_key.symmetric_key, sizeof(symmetric_key.symmetric_key));
+	}
+	catch (std::exception& e)
+	{
+		return false;
+	}
+	if (!file_handler->open_file(CLT_SESSION_FILE, "wb"))
+		return false;
+
+	bool result = false;
+	try
+	{
+		result = file_handler->write_one_line(boost::algorithm::hex(std::string(id.uuid, id.uuid + sizeof(id.uuid)))) &&
+			file_handler->write_one_line(boost::algorithm::hex(std::string(ticket.ticket, ticket.ticket + sizeof(ticket.ticket)))) &&
+			file_handler->write_one_line(std::to_string(static_cast<long long>(ticket_expiry))) &&
+			file_handler->write_one_line(boost::algorithm::hex(encrypted_key));
+	}
+	catch (std::exception& e)
+	{
+		result = false;
+	}
+	file_handler->clear_handler();
+	return result;
+}
+
 // attempt to register the client on the server, send a registration request and recieve response (uuid&username)
 bool Client::req_registration()
 {
+	PhaseTimer timer(*metrics, PHASE_REGISTRATION);
 	ReqRegistration req;
 	ResRegistration res;
 
@@ -302,6 +658,7 @@ bool Client::req_registration()
 // attempt to send public key request, recieve the response which contains the encrypted AES Symmetric key (decrypt the key after recieving)
 bool Client::req_public_key()
 {
+	PhaseTimer timer(*metrics, PHASE_KEY_EXCHANGE);
 	ReqPublicKey req(id);
 	//ResAEY res;
 
@@ -326,7 +683,8 @@ bool Client::req_public_key()
 	// recieve unknown payload (cuz encrypted AES key size changes), decrypt AES key with private key, check AES key size (== CLT_SYMMETRICKEY_SIZE )
 	uint8_t* payload = nullptr;
 	size_t payload_size = 0;
-	if(!recv_changing_payload(RES_AES_KEY, payload, payload_size))  
+	uint8_t svr_version = DEFAULT;
+	if(!recv_changing_payload(RES_AES_KEY, payload, payload_size, &svr_version))  
 	{
 		std::cout << "failed to recieve AES key from the server" << std::endl;
 		return false;
@@ -354,16 +712,75 @@ bool Client::req_public_key()
 		return false;
 	}
 	memcpy(symmetric_key.symmetric_key, aes_key.c_str(), aes_key.size());
+	protocol_version = std::min(CLT_VERSION, svr_version);
+	ticket_expiry = 0; // the server dropped the ticket of the former key
 	delete[] payload;  // $ CRASH PLACE $
 	return true;
 }
 
-// attempt to send a file to the server, obtain server response (mainly interested in the server cksum)
-bool Client::req_file()
+// ask the server for a session ticket of the current AES key, so the next run (or a reconnect) can skip the key exchange
+bool Client::req_session_ticket()
 {
-	ReqFile req(id);
-	ResGotFile res;
-	uint8_t* file_content = nullptr;
+	ReqSessionTicket req(id);
+	ResSessionTicket res;
+	req.hdr.payload_size = sizeof(req.payload);
+	if (!socket_handler->write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)))
+		return false;
+	if (!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res.hdr), sizeof(res.hdr)) || !check_response_hdr(res.hdr, RES_SESSION_TICKET))
+		return false;
+	if (!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res.payload), sizeof(res.payload)))
+		return false;
+
+	ticket = res.payload.ticket;
+	ticket_expiry = std::time(nullptr) + res.payload.lifetime;
+	return true;
+}
+
+// present the session ticket instead of the public key, on success the AES key the ticket was issued for is used,
+// a rejected ticket (expired / a newer key was exchanged) leaves the session open for the key exchange
+bool Client::req_resume_session()
+{
+	PhaseTimer timer(*metrics, PHASE_KEY_EXCHANGE);
+	ReqResumeSession req(id);
+	ResSessionResumed res;
+	req.hdr.payload_size = sizeof(req.payload);
+	req.payload.ticket = ticket;
+	if (!socket_handler->write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)))
+		return false;
+	if (!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res.hdr), sizeof(res.hdr)))
+		return false;
+	if (res.hdr.res_code == RES_SESSION_RESUME_FAIL)
+	{
+		std::cout << "session ticket was not accepted, exchanging keys" << std::endl;
+		ticket_expiry = 0;
+		std::error_code ec;
+		std::filesystem::remove(CLT_SESSION_FILE, ec);
+		return false;
+	}
+	if (!check_response_hdr(res.hdr, RES_SESSION_RESUMED) ||
+		!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res.payload), sizeof(res.payload)))
+		return false;
+	protocol_version = std::min(CLT_VERSION, res.hdr.svr_version);
+	return true;
+}
+
+// attempt to send a file to the server, obtain server response (mainly interested in the server cksum),
+// file sizes are 64-bit in sessions of VERSION_LARGE_FILES and on (see ReqFileT)
+bool Client::req_file(bool retry)
+{
+	stripe_connection_lost = false;
+	if (protocol_version >= VERSION_LARGE_FILES)
+		return req_file_sized<uint64_t>(retry);
+	return req_file_sized<uint32_t>(retry);
+}
+
+// the file is streamed: each block is read, added to the cksum, encrypted and written to the socket before reading the next one,
+// on a retry the cksum of the first send is reused and so is the ciphertext (if it was small enough to be kept)
+template <typename Size>
+bool Client::req_file_sized(bool retry)
+{
+	ReqFileT<Size> req(id);
+	req.hdr.clt_version = protocol_version;
 	try
 	{
 		strcpy_s(reinterpret_cast<char*>(req.payload_hdr.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
@@ -374,83 +791,973 @@ bool Client::req_file()
 		return false;
 	}
 
-	// get file content
-	if(!file_handler->open_file(file_to_send, "rb"))
+	if (!retry)
+		std::string().swap(cipher_cache); // drop the previous file ciphertext (and its memory)
+	const bool from_cache = retry && !cipher_cache.empty();
+
+	// get file size, the encrypted size is known in advance (CBC padding / CTR iv) so the header can be sent before the content
+	size_t num_of_bytes = 0;
+	if (from_cache)
+	{
+		req.payload_hdr.file_content_size = static_cast<Size>(cipher_cache.size());
+	}
+	else
+	{
+		if(!file_handler->open_file(file_to_send, "rb"))
+		{
+			std::cout << "cannot open file: " << file_to_send << std::endl;
+			return false;
+		}
+		num_of_bytes = file_handler->get_file_size();
+		if(num_of_bytes == 0)
+		{
+			std::cout << "file is empty: " << file_to_send << std::endl;
+			file_handler->clear_handler();
+			return false;
+		}
+		if (protocol_version < VERSION_LARGE_FILES && num_of_bytes > MAX_32BIT_FILE_SIZE)
+		{
+			std::cout << "file is too large for protocol version " << static_cast<int>(protocol_version) << ": " << file_to_send << std::endl;
+			file_handler->clear_handler();
+			return false;
+		}
+
+		// the server may have an older copy of the file, then only the differences are sent (a retry sends the whole file)
+		if (delta && !retry && protocol_version >= VERSION_DELTA)
+		{
+			bool has_copy = false;
+			const bool sent = req_file_delta<Size>(num_of_bytes, has_copy);
+			if (sent || has_copy)
+			{
+				file_handler->clear_handler();
+				return sent;
+			}
+		}
+		// the server may already have most of the file (chunks of this file / other files)
+		if (dedup && protocol_version >= VERSION_DEDUP)
+		{
+			file_handler->clear_handler();
+			return req_file_dedup<Size>(num_of_bytes, retry);
+		}
+		// large files may be split over several connections
+		if (stripes > 1 && num_of_bytes >= MIN_STRIPED_FILE_SIZE)
+		{
+			file_handler->clear_handler();
+			return req_file_striped<Size>(num_of_bytes, retry);
+		}
+		// files of more than one chunk are sent chunk by chunk
+		if (num_of_bytes > FILE_CHUNK_SIZE)
+		{
+			file_handler->clear_handler();
+			return req_file_chunked<Size>(num_of_bytes);
+		}
+		if (num_of_bytes >= MIN_MAPPED_FILE_SIZE)
+			file_handler->map_file(); // if it cannot be mapped, it is read through the filestream
+		req.payload_hdr.file_content_size = static_cast<Size>(AESWrapper::encrypted_size(num_of_bytes + codec_prefix_size(protocol_version),
+			cipher_mode(protocol_version)));
+	}
+	req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size);
+
+	// compressed, the file (up to a chunk) is packed in memory first, only then the content size is known
+	if (!from_cache && compressor != nullptr && protocol_version >= VERSION_CODEC)
+	{
+		CRC digest;
+		std::string packed;
+		const bool packed_read = read_packed(num_of_bytes, retry ? nullptr : &digest, packed);
+		file_handler->clear_handler();
+		if (!packed_read)
+			return false;
+		if (!retry)
+			clt_cksum = digest.digest();
+		req.payload_hdr.file_content_size = static_cast<Size>(AESWrapper::encrypted_size(packed.size(), cipher_mode(protocol_version)));
+		req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size);
+		if (!send_packed_content(reinterpret_cast<const uint8_t*>(&req), sizeof(req), packed, retry ? nullptr : &cipher_cache, nullptr))
+		{
+			std::string().swap(cipher_cache);
+			return false;
+		}
+		return recv_got_file();
+	}
+
+	// the request (header & payload header) is written together with the file content which follows it
+	if (from_cache)
+	{
+		const auto send_time = RunMetrics::Clock::now();
+		const bool cache_sent = socket_handler->write_to_socket({ boost::asio::buffer(&req, sizeof(req)), boost::asio::buffer(cipher_cache) });
+		metrics->add(PHASE_SEND, send_time, cipher_cache.size());
+		if (!cache_sent)
+		{
+			std::cout << "failed to send file request (content sending phase): " << file_to_send << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		// the cksum is calculated (and the ciphertext is kept) only on the first send
+		CRC digest;
+		const bool to_cache = !retry && req.payload_hdr.file_content_size <= RETRY_CACHE_MAX_SIZE;
+		if (to_cache)
+			cipher_cache.reserve(req.payload_hdr.file_content_size);
+		if (!send_file_content(socket_handler, file_handler, reinterpret_cast<const uint8_t*>(&req), sizeof(req), num_of_bytes,
+			req.payload_hdr.file_content_size, retry ? nullptr : &digest, to_cache ? &cipher_cache : nullptr))
+		{
+			file_handler->clear_handler();
+			std::string().swap(cipher_cache);
+			return false;
+		}
+		file_handler->clear_handler();
+		if (!retry)
+			clt_cksum = digest.digest();
+	}
+
+	return recv_got_file();
+}
+
+/* read num_of_bytes from file (current position), update digest, encrypt with AES Symmetric key and write to socket,
+block by block (each block is touched once while it is in cache), content_size is the expected encrypted size (as announced
+in the request). the request itself is written with the first block and the padding with the last one (one write per block).
+digest / cache are optional (nullptr): the cksum to update / a string to append the ciphertext to,
+if cksum_trailer is set the cksum (digest) of the content is written right after it */
+bool Client::send_file_content(SocketHandler* socket, FileHandler* file, const uint8_t* request, size_t request_size, size_t num_of_bytes,
+	size_t content_size, CRC* digest, std::string* cache, bool cksum_trailer)
+{
+	if (cksum_trailer && digest == nullptr)
+		return false;
+
+	AESWrapper aes(symmetric_key, cipher_mode(protocol_version));
+	aes.encrypt_begin();
+	const size_t block_size = (cipher_mode(protocol_version) != AES_CBC) ? CTR_FILE_BLOCK_SIZE : FILE_BLOCK_SIZE;
+	const uint8_t* block = nullptr;
+	std::string cipher_prefix; // the content is sent as is (CODEC_NONE), written with the first block
+	if (codec_prefix_size(protocol_version) > 0)
+		aes.encrypt_update(&CODEC_NONE, sizeof(CODEC_NONE), cipher_prefix);
+	std::string cipher;
+	std::string cipher_final;
+	uint32_t cksum = 0;
+	size_t cksum_size = 0;
+	size_t bytes_left = num_of_bytes;
+	size_t cipher_sent = 0;
+	while (bytes_left > 0)
+	{
+		size_t bytes_read = 0;
+		auto phase_time = RunMetrics::Clock::now();
+		if (!file->view_file_chunk(block, std::min(bytes_left, block_size), bytes_read) || bytes_read == 0)
+		{
+			std::cout << "cannot read file contents: " << file_to_send << std::endl;
+			return false;
+		}
+		metrics->add(PHASE_FILE_READ, phase_time, bytes_read);
+		if (digest != nullptr)
+		{
+			phase_time = RunMetrics::Clock::now();
+			digest->update(block, static_cast<uint32_t>(bytes_read));
+			metrics->add(PHASE_CKSUM, phase_time, bytes_read);
+		}
+		phase_time = RunMetrics::Clock::now();
+		aes.encrypt_update(block, bytes_read, cipher);
+		bytes_left -= bytes_read;
+		if (bytes_left == 0)
+		{
+			aes.encrypt_final(cipher_final);
+			if (cipher_sent + cipher_prefix.size() + cipher.size() + cipher_final.size() != content_size)
+			{
+				std::cout << "encrypted size " << cipher_sent + cipher_prefix.size() + cipher.size() + cipher_final.size() << " not match the announced size " << content_size << ": " << file_to_send << std::endl;
+				return false;
+			}
+			if (cksum_trailer)
+			{
+				cksum = digest->digest();
+				cksum_size = sizeof(cksum);
+			}
+		}
+		metrics->add(PHASE_ENCRYPT, phase_time, bytes_read);
+		if (cache != nullptr)
+		{
+			cache->append(cipher_prefix);
+			cache->append(cipher);
+			cache->append(cipher_final);
+		}
+
+		phase_time = RunMetrics::Clock::now();
+		const bool block_sent = socket->write_to_socket({ boost::asio::buffer(request, request_size), boost::asio::buffer(cipher_prefix),
+			boost::asio::buffer(cipher), boost::asio::buffer(cipher_final), boost::asio::buffer(&cksum, cksum_size) });
+		metrics->add(PHASE_SEND, phase_time, cipher_prefix.size() + cipher.size() + cipher_final.size());
+		if (!block_sent)
+		{
+			std::cout << "failed to send file request (content sending phase): " << file_to_send << std::endl;
+			return false;
+		}
+		request_size = 0; // sent with the first block
+		cipher_sent += cipher_prefix.size() + cipher.size() + cipher_final.size();
+		cipher_prefix.clear();
+	}
+
+	return true;
+}
+
+// read num_of_bytes from file_handler (current position), update digest (optional) and pack them (see Compressor::pack)
+bool Client::read_packed(size_t num_of_bytes, CRC* digest, std::string& packed)
+{
+	const uint8_t* content = nullptr;
+	size_t bytes_read = 0;
+	auto phase_time = RunMetrics::Clock::now();
+	if (!file_handler->view_file_chunk(content, num_of_bytes, bytes_read) || bytes_read != num_of_bytes)
+	{
+		std::cout << "cannot read file contents: " << file_to_send << std::endl;
+		return false;
+	}
+	metrics->add(PHASE_FILE_READ, phase_time, bytes_read);
+	if (digest != nullptr)
+	{
+		phase_time = RunMetrics::Clock::now();
+		digest->update(content, static_cast<uint32_t>(bytes_read));
+		metrics->add(PHASE_CKSUM, phase_time, bytes_read);
+	}
+	return compressor->pack(content, bytes_read, packed);
+}
+
+/* encrypt a packed content (see read_packed) and write it to the socket together with the request which announced it
+and the cksum trailer (optional), cache (optional) is replaced with the ciphertext */
+bool Client::send_packed_content(const uint8_t* request, size_t request_size, const std::string& packed, std::string* cache, const uint32_t* cksum_trailer)
+{
+	AESWrapper aes(symmetric_key, cipher_mode(protocol_version));
+	std::string cipher;
+	std::string cipher_final;
+	auto phase_time = RunMetrics::Clock::now();
+	aes.encrypt_begin();
+	aes.encrypt_update(reinterpret_cast<const uint8_t*>(packed.data()), packed.size(), cipher);
+	aes.encrypt_final(cipher_final);
+	metrics->add(PHASE_ENCRYPT, phase_time, packed.size());
+	if (cache != nullptr && cipher.size() + cipher_final.size() <= RETRY_CACHE_MAX_SIZE)
+		*cache = cipher + cipher_final;
+
+	phase_time = RunMetrics::Clock::now();
+	const bool content_sent = socket_handler->write_to_socket({ boost::asio::buffer(request, request_size), boost::asio::buffer(cipher),
+		boost::asio::buffer(cipher_final), boost::asio::buffer(cksum_trailer, cksum_trailer != nullptr ? sizeof(*cksum_trailer) : 0) });
+	metrics->add(PHASE_SEND, phase_time, cipher.size() + cipher_final.size());
+	if (!content_sent)
+	{
+		std::cout << "failed to send file request (content sending phase): " << file_to_send << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// recieve the response of a file request - Got file 2103, we mainly look for the cksum CRC
+bool Client::recv_got_file()
+{
+	PhaseTimer timer(*metrics, PHASE_SERVER_ACK);
+	ResHeader hdr;
+	if(!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr)))
+	{
+		std::cout << "failed to recieve server response: 2103 (CRC)  " << file_to_send << std::endl;
+		return false;
+	}
+
+	return recv_got_file_payload(hdr);
+}
+
+// recieve the rest of the Got file response 2103, after its header (hdr) was already recieved
+bool Client::recv_got_file_payload(const ResHeader& hdr)
+{
+	ResGotFile res;
+	ResGotFile64 res64;
+	const bool large = (protocol_version >= VERSION_LARGE_FILES);
+	if(!check_response_hdr(hdr, RES_GOT_FILE))
+	{
+		std::cout << " ResGotFile header validation went unsuccessfully: " << file_to_send << std::endl;
+		return false;
+	}
+	if(!socket_handler->recv_from_socket(large ? reinterpret_cast<uint8_t*>(&res64.payload) : reinterpret_cast<uint8_t*>(&res.payload),
+		large ? sizeof(res64.payload) : sizeof(res.payload)))
+	{
+		std::cout << "failed to recieve server response: 2103 (CRC)  " << file_to_send << std::endl;
+		return false;
+	}
+
+	// get server cksum 
+	svr_cksum = large ? res64.payload.cksum : res.payload.cksum;
+	return true;
+}
+
+// attempt to send a file to the server over several connections at once, each one carries a range (stripe) of the file,
+// the server assembles the stripes and answers (on the main connection) with the cksum of the whole file
+template <typename Size>
+bool Client::req_file_striped(size_t file_size, bool retry)
+{
+	// split the file into (up to) stripes ranges, aligned to FILE_BLOCK_SIZE
+	size_t stripe_size = (file_size + stripes - 1) / stripes;
+	stripe_size = (stripe_size + FILE_BLOCK_SIZE - 1) / FILE_BLOCK_SIZE * FILE_BLOCK_SIZE;
+	const size_t stripes_count = (file_size + stripe_size - 1) / stripe_size;
+
+	// send all the stripes at once, the cksum of each stripe is calculated separately and combined afterwards
+	// (on a retry the cksum of the first send is reused)
+	std::vector<CRC> digests(stripes_count);
+	std::vector<uint8_t> results(stripes_count, false);
+	std::vector<uint8_t> lost(stripes_count, false);
+	std::vector<std::thread> senders;
+	for (size_t i = 0; i < stripes_count; ++i)
+	{
+		const size_t offset = i * stripe_size;
+		senders.emplace_back(&Client::send_stripe<Size>, this, file_size, offset, std::min(stripe_size, file_size - offset), retry ? nullptr : &digests[i], std::ref(results[i]), std::ref(lost[i]));
+	}
+	for (std::thread& sender : senders)
+		sender.join();
+
+	CRC digest;
+	for (size_t i = 0; i < stripes_count; ++i)
+	{
+		if (!results[i])
+		{
+			std::cout << "failed to send stripe " << i << " of " << stripes_count << ": " << file_to_send << std::endl;
+			stripe_connection_lost = lost[i];
+			return false;
+		}
+		digest.combine(digests[i]);
+	}
+	if (!retry)
+		clt_cksum = digest.digest();
+
+	// all stripes arrived, ask the server to assemble the file
+	ReqFileStripesDoneT<Size> req(id);
+	req.hdr.clt_version = protocol_version;
+	req.hdr.payload_size = sizeof(req.payload);
+	req.payload.file_size = static_cast<Size>(file_size);
+	strcpy_s(reinterpret_cast<char*>(req.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	if (!socket_handler->write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)))
+	{
+		std::cout << "failed to send file stripes done request: " << file_to_send << std::endl;
+		return false;
+	}
+
+	return recv_got_file();
+}
+
+// send one stripe of file_to_send over a connection of its own, runs in a thread of its own (see req_file_striped),
+// lost - the stripe failed since its connection couldn't be made / was lost
+template <typename Size>
+void Client::send_stripe(size_t file_size, size_t offset, size_t size, CRC* digest, uint8_t& result, uint8_t& lost)
+{
+	result = false;
+	lost = false;
+	ReqFileStripeT<Size> req(id);
+	req.hdr.clt_version = protocol_version;
+	strcpy_s(reinterpret_cast<char*>(req.payload_hdr.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	req.payload_hdr.file_size = static_cast<Size>(file_size);
+	req.payload_hdr.stripe_offset = static_cast<Size>(offset);
+	req.payload_hdr.stripe_size = static_cast<Size>(size);
+	req.payload_hdr.file_content_size = static_cast<Size>(AESWrapper::encrypted_size(size + codec_prefix_size(protocol_version),
+		cipher_mode(protocol_version)));
+	req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size);
+
+	SocketHandler socket;
+	FileHandler file;
+	if (!socket.set_socket(svr_address, svr_port) || !socket.connect())
+	{
+		std::cout << "couldn't connect to server (stripe at " << offset << ")" << std::endl;
+		lost = true;
+		return;
+	}
+	if (file.open_file(file_to_send, "rb"))
+		file.map_file(); // every stripe maps the file, the mappings share the same page cache
+	if (!file.set_position(offset))
+	{
+		std::cout << "cannot read file contents (stripe at " << offset << "): " << file_to_send << std::endl;
+		return;
+	}
+
+	bool sent = send_file_content(&socket, &file, reinterpret_cast<const uint8_t*>(&req), sizeof(req), size, req.payload_hdr.file_content_size, digest, nullptr);
+	file.clear_handler();
+
+	// the server confirms after the stripe was stored
+	ResConfirmMsg res;
+	const auto ack_time = RunMetrics::Clock::now();
+	if (sent && (!socket.recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res)) || !check_response_hdr(res.hdr, RES_MSG_CONFIRM)))
+	{
+		std::cout << "failed to recieve file stripe confirmation (stripe at " << offset << "): " << file_to_send << std::endl;
+		sent = false;
+	}
+	if (sent)
+		metrics->add(PHASE_SERVER_ACK, ack_time);
+	lost = socket.connection_lost();
+	socket.close_connection();
+	metrics->add_sockets(socket.get_counters());
+	result = sent;
+}
+
+/* attempt to send a file to the server chunk by chunk, the server stores & verifies every chunk on arrival (by its cksum)
+and keeps track of the stored chunks, even across sessions. the file is read once: chunks the server already has (from an
+interrupted transfer) are only read to make sure they did not change, any other chunk is read, encrypted and sent.
+chunks which did not make it are reported back by the server and sent again (up to RETRIES rounds),
+the cksum of the whole file is checked afterwards as usual */
+template <typename Size>
+bool Client::req_file_chunked(size_t file_size)
+{
+	const size_t chunks_count = (file_size + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE;
+	ReqFileChunksBeginT<Size> req(id);
+	req.hdr.clt_version = protocol_version;
+	req.hdr.payload_size = sizeof(req.payload);
+	req.payload.file_size = static_cast<Size>(file_size);
+	req.payload.chunk_size = static_cast<uint32_t>(FILE_CHUNK_SIZE);
+	strcpy_s(reinterpret_cast<char*>(req.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	if (!socket_handler->write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)))
+	{
+		std::cout << "failed to send file chunks begin request: " << file_to_send << std::endl;
+		return false;
+	}
+
+	// the chunks the server already has and their cksums
+	uint8_t* payload = nullptr;
+	size_t payload_size = 0;
+	if (!recv_changing_payload(RES_FILE_CHUNKS_STATUS, payload, payload_size))
+	{
+		std::cout << "failed to recieve file chunks status: " << file_to_send << std::endl;
+		return false;
+	}
+	std::vector<uint32_t> svr_cksums;
+	std::vector<uint8_t> stored;
+	const bool valid_status = parse_chunks_status(payload, payload_size, chunks_count, svr_cksums, stored);
+	delete[] payload;
+	if (!valid_status)
+		return false;
+
+	if (!file_handler->open_file(file_to_send, "rb"))
 	{
 		std::cout << "cannot open file: " << file_to_send << std::endl;
 		return false;
 	}
-	size_t num_of_bytes = file_handler->get_file_size();
-	if(num_of_bytes == 0)
+	file_handler->map_file(); // if it cannot be mapped, it is read through the filestream
+	CRC digest;
+	size_t chunks_sent = 0;
+	bool valid = true;
+	const uint8_t* block = nullptr;
+	for (size_t i = 0; valid && i < chunks_count; ++i)
+	{
+		const size_t size = std::min(FILE_CHUNK_SIZE, file_size - i * FILE_CHUNK_SIZE);
+		CRC chunk_digest;
+		bool skip = false;
+		if (stored[i])
+		{
+			size_t bytes_left = size;
+			size_t bytes_read = 1;
+			while (bytes_left > 0 && bytes_read > 0 && file_handler->view_file_chunk(block, std::min(bytes_left, FILE_BLOCK_SIZE), bytes_read))
+			{
+				chunk_digest.update(block, static_cast<uint32_t>(bytes_read));
+				bytes_left -= bytes_read;
+			}
+			skip = (bytes_left == 0 && chunk_digest.digest() == svr_cksums[i]);
+			if (!skip) // the stored chunk is not the same as ours, go back and send it
+			{
+				chunk_digest = CRC();
+				valid = file_handler->set_position(i * FILE_CHUNK_SIZE);
+			}
+		}
+		if (valid && !skip)
+		{
+			valid = send_chunk(i, size, chunk_digest);
+			chunks_sent += 1;
+		}
+		digest.combine(chunk_digest);
+	}
+	if (!valid)
+	{
+		std::cout << "failed to send file chunks: " << file_to_send << std::endl;
+		file_handler->clear_handler();
+		return false;
+	}
+	clt_cksum = digest.digest();
+	if (chunks_sent < chunks_count)
+		std::cout << chunks_count - chunks_sent << " of " << chunks_count << " chunks already stored on the server: " << file_to_send << std::endl;
+
+	// ask the server to assemble the file, send again what is still missing until it does
+	for (int round = 0; round < RETRIES; ++round)
 	{
-		std::cout << "file is empty: " << file_to_send << std::endl;
+		ReqFileChunksDone done(id);
+		done.hdr.clt_version = protocol_version;
+		done.hdr.payload_size = sizeof(done.payload);
+		strcpy_s(reinterpret_cast<char*>(done.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+		ResHeader hdr;
+		const auto ack_time = RunMetrics::Clock::now();
+		const bool answered = socket_handler->write_to_socket(reinterpret_cast<const uint8_t*>(&done), sizeof(done)) &&
+			socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr));
+		metrics->add(PHASE_SERVER_ACK, ack_time);
+		if (!answered)
+		{
+			std::cout << "failed to send file chunks done request: " << file_to_send << std::endl;
+			file_handler->clear_handler();
+			return false;
+		}
+		if (hdr.res_code == RES_GOT_FILE)
+		{
+			file_handler->clear_handler();
+			return recv_got_file_payload(hdr);
+		}
+
+		// some chunks are missing (arrived corrupted)
+		if (!check_response_hdr(hdr, RES_FILE_CHUNKS_STATUS))
+			break;
+		payload_size = hdr.payload_size;
+		payload = new uint8_t[payload_size];
+		valid = socket_handler->recv_from_socket(payload, payload_size) &&
+			parse_chunks_status(payload, payload_size, chunks_count, svr_cksums, stored);
+		delete[] payload;
+		for (size_t i = 0; valid && i < chunks_count; ++i)
+		{
+			if (stored[i])
+				continue;
+			std::cout << "chunk " << i << " of " << chunks_count << " is sent again: " << file_to_send << std::endl;
+			CRC chunk_digest;
+			valid = file_handler->set_position(i * FILE_CHUNK_SIZE) &&
+				send_chunk(i, std::min(FILE_CHUNK_SIZE, file_size - i * FILE_CHUNK_SIZE), chunk_digest);
+		}
+		if (!valid)
+			break;
+	}
+
+	std::cout << "file chunks could not be stored on the server: " << file_to_send << std::endl;
+	file_handler->clear_handler();
+	return false;
+}
+
+// send one chunk (size bytes, from the current position of file_handler) of file_to_send, digest is updated with the chunk
+bool Client::send_chunk(size_t chunk_index, size_t size, CRC& digest)
+{
+	ReqFileChunk req(id);
+	req.hdr.clt_version = protocol_version;
+	strcpy_s(reinterpret_cast<char*>(req.payload_hdr.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	req.payload_hdr.chunk_index = static_cast<uint32_t>(chunk_index);
+
+	// compressed, the chunk is packed in memory first, only then its content size is known
+	if (compressor != nullptr && protocol_version >= VERSION_CODEC)
+	{
+		std::string packed;
+		if (!read_packed(size, &digest, packed))
+			return false;
+		req.payload_hdr.file_content_size = static_cast<uint32_t>(AESWrapper::encrypted_size(packed.size(), cipher_mode(protocol_version)));
+		req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size + sizeof(uint32_t));
+		const uint32_t cksum = digest.digest();
+		return send_packed_content(reinterpret_cast<const uint8_t*>(&req), sizeof(req), packed, nullptr, &cksum);
+	}
+
+	req.payload_hdr.file_content_size = static_cast<uint32_t>(AESWrapper::encrypted_size(size + codec_prefix_size(protocol_version),
+		cipher_mode(protocol_version)));
+	req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size + sizeof(uint32_t));
+
+	// the cksum follows the content, so the chunk is read & sent in one pass
+	return send_file_content(socket_handler, file_handler, reinterpret_cast<const uint8_t*>(&req), sizeof(req), size,
+		req.payload_hdr.file_content_size, &digest, nullptr, true);
+}
+
+/* attempt to send a file by its content defined chunks (see ContentChunker): the file is read once to cut it into chunks
+and calculate its cksum, then the server is sent the inventory of the file (hash & size of every chunk) and answers which
+chunks it already has, of this client or of any other. only the other chunks are read again, encrypted and sent (a chunk
+which repeats in the file is sent once), then the server assembles the file from its chunk store.
+chunks which did not make it are reported back by the server and sent again (up to RETRIES rounds) */
+template <typename Size>
+bool Client::req_file_dedup(size_t file_size, bool retry)
+{
+	if (!file_handler->open_file(file_to_send, "rb"))
+	{
+		std::cout << "cannot open file: " << file_to_send << std::endl;
 		return false;
 	}
-	file_content = new uint8_t[num_of_bytes];
-	if(!file_handler->read_file_bytes(file_content, num_of_bytes))
+	file_handler->map_file(); // if it cannot be mapped, it is read through the filestream
+	ContentChunker chunker;
+	CRC digest;
+	const uint8_t* block = nullptr;
+	size_t bytes_left = file_size;
+	size_t bytes_read = 1;
+	while (bytes_left > 0 && bytes_read > 0 && file_handler->view_file_chunk(block, std::min(bytes_left, FILE_BLOCK_SIZE), bytes_read))
+	{
+		chunker.update(block, bytes_read);
+		digest.update(block, static_cast<uint32_t>(bytes_read));
+		bytes_left -= bytes_read;
+	}
+	chunker.final();
+	const std::vector<ChunkRef>& chunks = chunker.get_chunks();
+	if (bytes_left > 0 || chunks.size() > MAX_INVENTORY_CHUNKS)
 	{
 		std::cout << "cannot read file contents: " << file_to_send << std::endl;
-		delete[] file_content;
+		file_handler->clear_handler();
 		return false;
 	}
-	// calc file cksum
-	clt_cksum = Helper::get_crc32(file_content, num_of_bytes);
-	if(!clt_cksum)
+	if (!retry)
+		clt_cksum = digest.digest();
+
+	// the chunks the server already has
+	ReqFileInventoryT<Size> req(id);
+	req.hdr.clt_version = protocol_version;
+	req.hdr.payload_size = static_cast<uint32_t>(sizeof(req.payload_hdr) + chunks.size() * sizeof(ChunkRef));
+	req.payload_hdr.file_size = static_cast<Size>(file_size);
+	req.payload_hdr.chunks_count = static_cast<uint32_t>(chunks.size());
+	strcpy_s(reinterpret_cast<char*>(req.payload_hdr.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	uint8_t* payload = nullptr;
+	size_t payload_size = 0;
+	if (!socket_handler->write_to_socket({ boost::asio::buffer(&req, sizeof(req)), boost::asio::buffer(chunks) }) ||
+		!recv_changing_payload(RES_FILE_INVENTORY, payload, payload_size))
 	{
-		std::cout << "CRC of file" << file_to_send << " couldn't be calculated " << std::endl;
+		std::cout << "failed to send file inventory request: " << file_to_send << std::endl;
+		file_handler->clear_handler();
 		return false;
 	}
+	std::vector<uint8_t> known;
+	bool valid = parse_inventory(payload, payload_size, chunks.size(), known);
+	delete[] payload;
+
+	std::vector<size_t> offsets(chunks.size());
+	for (size_t i = 1; i < chunks.size(); ++i)
+		offsets[i] = offsets[i - 1] + chunks[i - 1].size;
+	std::set<std::string> sent;
+	size_t chunks_sent = 0;
+	size_t bytes_sent = 0;
+	for (size_t i = 0; valid && i < chunks.size(); ++i)
+	{
+		if (known[i] || !sent.insert(std::string(reinterpret_cast<const char*>(chunks[i].hash), CHUNK_HASH_SIZE)).second)
+			continue;
+		valid = file_handler->set_position(offsets[i]) && send_dedup_chunk(i, chunks[i].size);
+		chunks_sent += 1;
+		bytes_sent += chunks[i].size;
+	}
+	if (!valid)
+	{
+		std::cout << "failed to send file chunks: " << file_to_send << std::endl;
+		file_handler->clear_handler();
+		return false;
+	}
+	std::cout << "deduplicated " << file_to_send << ": " << chunks_sent << " of " << chunks.size() << " chunks sent (" << bytes_sent
+		<< " of " << file_size << " bytes), the server has the rest" << std::endl;
+
+	// ask the server to assemble the file, send again what is still missing until it does
+	for (int round = 0; round < RETRIES; ++round)
+	{
+		ReqFileDedupDone done(id);
+		done.hdr.clt_version = protocol_version;
+		done.hdr.payload_size = sizeof(done.payload);
+		strcpy_s(reinterpret_cast<char*>(done.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+		ResHeader hdr;
+		const auto ack_time = RunMetrics::Clock::now();
+		const bool answered = socket_handler->write_to_socket(reinterpret_cast<const uint8_t*>(&done), sizeof(done)) &&
+			socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr));
+		metrics->add(PHASE_SERVER_ACK, ack_time);
+		if (!answered)
+		{
+			std::cout << "failed to send file dedup done request: " << file_to_send << std::endl;
+			file_handler->clear_handler();
+			return false;
+		}
+		if (hdr.res_code == RES_GOT_FILE)
+		{
+			file_handler->clear_handler();
+			return recv_got_file_payload(hdr);
+		}
+
+		// some chunks are missing (arrived corrupted / were removed from the store meanwhile)
+		if (!check_response_hdr(hdr, RES_FILE_INVENTORY))
+			break;
+		payload_size = hdr.payload_size;
+		payload = new uint8_t[payload_size];
+		valid = socket_handler->recv_from_socket(payload, payload_size) && parse_inventory(payload, payload_size, chunks.size(), known);
+		delete[] payload;
+		sent.clear();
+		for (size_t i = 0; valid && i < chunks.size(); ++i)
+		{
+			if (known[i] || !sent.insert(std::string(reinterpret_cast<const char*>(chunks[i].hash), CHUNK_HASH_SIZE)).second)
+				continue;
+			std::cout << "chunk " << i << " of " << chunks.size() << " is sent again: " << file_to_send << std::endl;
+			valid = file_handler->set_position(offsets[i]) && send_dedup_chunk(i, chunks[i].size);
+		}
+		if (!valid)
+			break;
+	}
+
+	std::cout << "file chunks could not be stored on the server: " << file_to_send << std::endl;
 	file_handler->clear_handler();
+	return false;
+}
 
-	// encrypt file with AES Symmetric key
-	AESWrapper aes(symmetric_key); 
-	const std::string encrypted_file = aes.encrypt(file_content, num_of_bytes);
-	req.payload_hdr.file_content_size = encrypted_file.size();
-	uint8_t* content_to_send = new uint8_t[req.payload_hdr.file_content_size];
-	memcpy(content_to_send, encrypted_file.c_str(), req.payload_hdr.file_content_size);
-	delete[] file_content;
-
-	// prepare header&payload, header will be sent first so server can check the payload size
-	// 
-	// header
-	req.hdr.payload_size = sizeof(req.payload_hdr) + req.payload_hdr.file_content_size;
-	const uint8_t* data_to_send = reinterpret_cast<const uint8_t*>(&req.hdr);
-	size_t data_size = sizeof(req.hdr);
-	if (!socket_handler->write_to_socket(data_to_send, data_size))
+// send one chunk (size bytes, from the current position of file_handler) of the inventory of file_to_send
+bool Client::send_dedup_chunk(size_t chunk_index, size_t size)
+{
+	ReqFileDedupChunk req(id);
+	req.hdr.clt_version = protocol_version;
+	strcpy_s(reinterpret_cast<char*>(req.payload_hdr.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	req.payload_hdr.chunk_index = static_cast<uint32_t>(chunk_index);
+
+	if (compressor != nullptr)
+	{
+		std::string packed;
+		if (!read_packed(size, nullptr, packed))
+			return false;
+		req.payload_hdr.file_content_size = static_cast<uint32_t>(AESWrapper::encrypted_size(packed.size(), cipher_mode(protocol_version)));
+		req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size);
+		return send_packed_content(reinterpret_cast<const uint8_t*>(&req), sizeof(req), packed, nullptr, nullptr);
+	}
+
+	req.payload_hdr.file_content_size = static_cast<uint32_t>(AESWrapper::encrypted_size(size + codec_prefix_size(protocol_version),
+		cipher_mode(protocol_version)));
+	req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size);
+	return send_file_content(socket_handler, file_handler, reinterpret_cast<const uint8_t*>(&req), sizeof(req), size,
+		req.payload_hdr.file_content_size, nullptr, nullptr);
+}
+
+// parse the payload of a file inventory response (2109) into whether the server has each chunk of the inventory
+bool Client::parse_inventory(const uint8_t* payload, size_t payload_size, size_t chunks_count, std::vector<uint8_t>& known)
+{
+	ResFileInventory inventory;
+	if (payload_size < sizeof(inventory))
+		return false;
+	memcpy(&inventory, payload, sizeof(inventory));
+	if (inventory.chunks_count != chunks_count || payload_size != sizeof(inventory) + (chunks_count + 7) / 8)
 	{
-		std::cout << "failed to send file request (header sending phase): " << file_to_send << std::endl;
+		std::cout << "file inventory response not match the file (" << inventory.chunks_count << " chunks): " << file_to_send << std::endl;
 		return false;
 	}
-	// payload
-	uint8_t* payload = new uint8_t[sizeof(req.payload_hdr) + req.payload_hdr.file_content_size];
-	memcpy(payload, &req.payload_hdr, sizeof(req.payload_hdr));
-	memcpy(payload + sizeof(req.payload_hdr), content_to_send, req.payload_hdr.file_content_size);
-	delete[] content_to_send;
-	size_t payload_size = sizeof(req.payload_hdr) + req.payload_hdr.file_content_size;
-	if(!socket_handler->write_to_socket(payload, payload_size))
+
+	const uint8_t* bitmap = payload + sizeof(inventory);
+	known.resize(chunks_count);
+	for (size_t i = 0; i < chunks_count; ++i)
+		known[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+	return true;
+}
+
+/* send file_to_send (file_handler is open on it) as the differences from the copy the server has, rsync style: the server
+sends the signatures of the blocks of its copy, the file is matched against them (see DeltaMatcher) and calculated its cksum
+in one pass, then the file is sent as operations which copy blocks of the server copy and the data in between.
+has_copy - the server has a copy of the file, if not the file is not sent (and file_handler is left at its start) */
+template <typename Size>
+bool Client::req_file_delta(size_t file_size, bool& has_copy)
+{
+	std::vector<BlockSignature> signatures;
+	size_t basis_size = 0;
+	size_t block_size = 0;
+	has_copy = false;
+	if (!req_file_signatures<Size>(signatures, basis_size, block_size))
 	{
-		std::cout << "failed to send file request (payload sending phase): " << file_to_send << std::endl;
+		has_copy = true; // the session is not in a state to send the file in another way
 		return false;
 	}
+	if (basis_size == 0)
+		return false;
+	has_copy = true;
 
-	// recieve response - Got file 2103, we mainly look for the cksum CRC
-	if(!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res)))
+	file_handler->map_file(); // if it cannot be mapped, it is read through the filestream
+	DeltaMatcher matcher(signatures, block_size, basis_size);
+	CRC digest;
+	const uint8_t* block = nullptr;
+	size_t bytes_left = file_size;
+	size_t bytes_read = 1;
+	while (bytes_left > 0 && bytes_read > 0 && file_handler->view_file_chunk(block, std::min(bytes_left, FILE_BLOCK_SIZE), bytes_read))
 	{
-		std::cout << "failed to recieve server response: 2103 (CRC)  " << file_to_send << std::endl;
+		matcher.update(block, bytes_read);
+		digest.update(block, static_cast<uint32_t>(bytes_read));
+		bytes_left -= bytes_read;
+	}
+	if (bytes_left > 0)
+	{
+		std::cout << "cannot read file contents: " << file_to_send << std::endl;
 		return false;
 	}
-	
-	if(!check_response_hdr(res.hdr, RES_GOT_FILE))
+	matcher.final();
+	clt_cksum = digest.digest();
+
+	ReqFileDeltaT<Size> req(id);
+	req.hdr.clt_version = protocol_version;
+	req.payload_hdr.file_size = static_cast<Size>(file_size);
+	req.payload_hdr.basis_size = static_cast<Size>(basis_size);
+	req.payload_hdr.block_size = static_cast<uint32_t>(block_size);
+	strcpy_s(reinterpret_cast<char*>(req.payload_hdr.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	const std::vector<DeltaRange>& ranges = matcher.get_ranges();
+	bool sent = false;
+
+	// compressed, the delta content (up to a chunk) is packed in memory first, only then its size is known
+	if (compressor != nullptr && matcher.content_size() <= FILE_CHUNK_SIZE)
 	{
-		std::cout << " ResGotFile header validation went unsuccessfully: " << file_to_send << std::endl;
+		std::string plain;
+		std::string packed;
+		plain.reserve(matcher.content_size());
+		for (const DeltaRange& range : ranges)
+		{
+			if (!append_delta_range(range, plain))
+				return false;
+		}
+		compressor->pack(reinterpret_cast<const uint8_t*>(plain.data()), plain.size(), packed);
+		req.payload_hdr.file_content_size = static_cast<Size>(AESWrapper::encrypted_size(packed.size(), cipher_mode(protocol_version)));
+		req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size);
+		sent = send_packed_content(reinterpret_cast<const uint8_t*>(&req), sizeof(req), packed, nullptr, nullptr);
+	}
+	else
+	{
+		req.payload_hdr.file_content_size = static_cast<Size>(AESWrapper::encrypted_size(matcher.content_size() + codec_prefix_size(protocol_version),
+			cipher_mode(protocol_version)));
+		req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), req.payload_hdr.file_content_size);
+		sent = send_delta_content(reinterpret_cast<const uint8_t*>(&req), sizeof(req), ranges, req.payload_hdr.file_content_size);
+	}
+	if (!sent)
+		return false;
+
+	size_t blocks_copied = 0;
+	for (const DeltaRange& range : ranges)
+		blocks_copied += range.copy ? range.count : 0;
+	std::cout << "delta " << file_to_send << ": " << matcher.data_size() << " of " << file_size << " bytes sent as data, " << blocks_copied
+		<< " of " << signatures.size() << " blocks of the server copy reused" << std::endl;
+	return recv_got_file();
+}
+
+// the block signatures of the copy of file_to_send the server has, basis_size - size of the copy, 0 - the server has no copy
+template <typename Size>
+bool Client::req_file_signatures(std::vector<BlockSignature>& signatures, size_t& basis_size, size_t& block_size)
+{
+	ReqFileSignatures req(id);
+	req.hdr.clt_version = protocol_version;
+	req.hdr.payload_size = sizeof(req.payload);
+	strcpy_s(reinterpret_cast<char*>(req.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
+	uint8_t* payload = nullptr;
+	size_t payload_size = 0;
+	if (!socket_handler->write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)) ||
+		!recv_changing_payload(RES_FILE_SIGNATURES, payload, payload_size))
+	{
+		std::cout << "failed to send file signatures request: " << file_to_send << std::endl;
 		return false;
 	}
+	const bool valid = parse_signatures<Size>(payload, payload_size, signatures, basis_size, block_size);
+	delete[] payload;
+	return valid;
+}
 
-	// get server cksum 
-	svr_cksum = res.payload.cksum;
+// parse the payload of a file signatures response (2110) into the block signatures of the server copy
+template <typename Size>
+bool Client::parse_signatures(const uint8_t* payload, size_t payload_size, std::vector<BlockSignature>& signatures, size_t& basis_size, size_t& block_size)
+{
+	ResFileSignaturesT<Size> res;
+	if (payload_size < sizeof(res))
+		return false;
+	memcpy(&res, payload, sizeof(res));
+	const size_t blocks_count = (res.block_size > 0) ? (static_cast<size_t>(res.file_size) + res.block_size - 1) / res.block_size : 0;
+	if (res.blocks_count != blocks_count || payload_size != sizeof(res) + blocks_count * sizeof(BlockSignature))
+	{
+		std::cout << "file signatures response not match its size (" << res.blocks_count << " blocks): " << file_to_send << std::endl;
+		return false;
+	}
+
+	basis_size = res.file_size;
+	block_size = res.block_size;
+	signatures.resize(blocks_count);
+	memcpy(signatures.data(), payload + sizeof(res), blocks_count * sizeof(BlockSignature));
 	return true;
 }
 
+// append the operation of a delta range to plain, followed by its data (read from file_handler) for a data range
+bool Client::append_delta_range(const DeltaRange& range, std::string& plain)
+{
+	const DeltaOp op(range.copy ? DELTA_COPY : DELTA_DATA, static_cast<uint32_t>(range.copy ? range.first : range.count),
+		static_cast<uint32_t>(range.copy ? range.count : 0));
+	plain.append(reinterpret_cast<const char*>(&op), sizeof(op));
+	if (range.copy)
+		return true;
+
+	const uint8_t* data = nullptr;
+	size_t bytes_read = 0;
+	if (!file_handler->set_position(range.first) || !file_handler->view_file_chunk(data, range.count, bytes_read) || bytes_read != range.count)
+	{
+		std::cout << "cannot read file contents: " << file_to_send << std::endl;
+		return false;
+	}
+	plain.append(reinterpret_cast<const char*>(data), bytes_read);
+	return true;
+}
+
+/* encrypt the delta content of ranges and write it to the socket together with the request which announced it,
+the operations & data are collected into blocks (see send_file_content) so memory usage not depends on the file size */
+bool Client::send_delta_content(const uint8_t* request, size_t request_size, const std::vector<DeltaRange>& ranges, size_t content_size)
+{
+	AESWrapper aes(symmetric_key, cipher_mode(protocol_version));
+	aes.encrypt_begin();
+	const size_t block_size = (cipher_mode(protocol_version) != AES_CBC) ? CTR_FILE_BLOCK_SIZE : FILE_BLOCK_SIZE;
+	std::string plain(codec_prefix_size(protocol_version), static_cast<char>(CODEC_NONE));
+	std::string cipher;
+	std::string cipher_final;
+	size_t cipher_sent = 0;
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		if (!append_delta_range(ranges[i], plain))
+			return false;
+		const bool last = (i + 1 == ranges.size());
+		if (plain.size() < block_size && !last)
+			continue;
+
+		auto phase_time = RunMetrics::Clock::now();
+		aes.encrypt_update(reinterpret_cast<const uint8_t*>(plain.data()), plain.size(), cipher);
+		if (last)
+		{
+			aes.encrypt_final(cipher_final);
+			if (cipher_sent + cipher.size() + cipher_final.size() != content_size)
+			{
+				std::cout << "encrypted size " << cipher_sent + cipher.size() + cipher_final.size() << " not match the announced size " << content_size << ": " << file_to_send << std::endl;
+				return false;
+			}
+		}
+		metrics->add(PHASE_ENCRYPT, phase_time, plain.size());
+		phase_time = RunMetrics::Clock::now();
+		const bool block_sent = socket_handler->write_to_socket({ boost::asio::buffer(request, request_size), boost::asio::buffer(cipher),
+			boost::asio::buffer(cipher_final) });
+		metrics->add(PHASE_SEND, phase_time, cipher.size() + cipher_final.size());
+		if (!block_sent)
+		{
+			std::cout << "failed to send file request (content sending phase): " << file_to_send << std::endl;
+			return false;
+		}
+		request_size = 0; // sent with the first block
+		cipher_sent += cipher.size() + cipher_final.size();
+		plain.clear();
+	}
+	return true;
+}
+
+// parse the payload of a file chunks status response (2105) into the chunks cksums and whether each chunk is stored
+bool Client::parse_chunks_status(const uint8_t* payload, size_t payload_size, size_t chunks_count, std::vector<uint32_t>& cksums, std::vector<uint8_t>& stored)
+{
+	ResFileChunksStatus status;
+	const size_t expected_size = sizeof(status) + chunks_count * sizeof(uint32_t) + (chunks_count + 7) / 8;
+	if (payload_size < sizeof(status))
+		return false;
+	memcpy(&status, payload, sizeof(status));
+	if (status.chunks_count != chunks_count || payload_size != expected_size)
+	{
+		std::cout << "file chunks status not match the file (" << status.chunks_count << " chunks): " << file_to_send << std::endl;
+		return false;
+	}
+
+	cksums.resize(chunks_count);
+	memcpy(cksums.data(), payload + sizeof(status), chunks_count * sizeof(uint32_t));
+	const uint8_t* bitmap = payload + sizeof(status) + chunks_count * sizeof(uint32_t);
+	stored.resize(chunks_count);
+	for (size_t i = 0; i < chunks_count; ++i)
+		stored[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+	return true;
+}
+
+// connect to the server again (after the connection was lost) and resume the session, or get a new AES key
+bool Client::reconnect()
+{
+	socket_handler->close_connection();
+	const auto connect_time = RunMetrics::Clock::now();
+	const bool connected = socket_handler->connect();
+	metrics->add(PHASE_CONNECT, connect_time);
+	if (!connected)
+	{
+		std::cout << "couldn't connect to server" << std::endl;
+		return false;
+	}
+	return (ticket_expiry > std::time(nullptr) && req_resume_session()) || req_public_key();
+}
+
+// whether the current file failed since a connection was lost (the main one / a stripe connection), then sending it
+// again on a new connection may succeed
+bool Client::connection_lost() const
+{
+	return socket_handler->connection_lost() || stripe_connection_lost;
+}
+
 // handle all types of CRC requests (valid crc, not valid crc, 4th time not valid crc
 bool Client::req_crc(const uint16_t type_code)
 {
@@ -458,6 +1765,7 @@ bool Client::req_crc(const uint16_t type_code)
 	if(type_code == REQ_VALID_CRC)
 	{
 		ReqValidCRC req(id);
+		req.hdr.payload_size = sizeof(req.payload);
 		strcpy_s(reinterpret_cast<char*>(req.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
 		const uint8_t* data_to_send = reinterpret_cast<const uint8_t*>(&req);
 		size_t data_size = sizeof(req);
@@ -470,6 +1778,7 @@ bool Client::req_crc(const uint16_t type_code)
 	else if(type_code == REQ_NVALID_CRC)
 	{
 		ReqNValidCRC req(id);
+		req.hdr.payload_size = sizeof(req.payload);
 		strcpy_s(reinterpret_cast<char*>(req.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
 		const uint8_t* data_to_send = reinterpret_cast<const uint8_t*>(&req);
 		size_t data_size = sizeof(req);
@@ -482,6 +1791,7 @@ bool Client::req_crc(const uint16_t type_code)
 	else if(type_code == REQ_4NVALID_CRC)
 	{
 		Req4NValidCRC req(id);
+		req.hdr.payload_size = sizeof(req.payload);
 		strcpy_s(reinterpret_cast<char*>(req.payload.file_name.file_name), FILE_NAME_SIZE, file_to_send.c_str());
 		const uint8_t* data_to_send = reinterpret_cast<const uint8_t*>(&req);
 		size_t data_size = sizeof(req);
@@ -497,7 +1807,10 @@ bool Client::req_crc(const uint16_t type_code)
 	}
 
 	// recieve response data, response is the same for all kind of CRC requests
-	if (!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res)))
+	const auto ack_time = RunMetrics::Clock::now();
+	const bool answered = socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res));
+	metrics->add(PHASE_SERVER_ACK, ack_time);
+	if (!answered)
 	{
 		std::cout << "failed to recieve CRC type response (Msg confirm: " << RES_MSG_CONFIRM << ") " << std::endl;
 		return false;
@@ -524,7 +1837,11 @@ bool Client::check_response_hdr(const ResHeader& hdr, const uint16_t code)
 	if (hdr.res_code == RES_REGISTRATION_SUCCESS)
 		payload_expected_size = sizeof(ResRegistration) - sizeof(ResHeader);
 	else if (hdr.res_code == RES_GOT_FILE)
-		payload_expected_size = sizeof(ResGotFile) - sizeof(ResHeader);
+		payload_expected_size = (protocol_version >= VERSION_LARGE_FILES) ? sizeof(ResGotFile64::Payload) : sizeof(ResGotFile::Payload);
+	else if (hdr.res_code == RES_SESSION_TICKET)
+		payload_expected_size = sizeof(ResSessionTicket) - sizeof(ResHeader);
+	else if (hdr.res_code == RES_SESSION_RESUMED)
+		payload_expected_size = sizeof(ResSessionResumed) - sizeof(ResHeader);
 	else
 		return true; // payload size changes (variable) or ResConfirmMsg type (only header no payload)
 	if(hdr.payload_size != payload_expected_size)
@@ -537,12 +1854,14 @@ bool Client::check_response_hdr(const ResHeader& hdr, const uint16_t code)
 }
 
 // recieve payload which we don't know (at first) it's size
-bool Client::recv_changing_payload(const uint16_t code, uint8_t*& payload, size_t& payload_size)
+bool Client::recv_changing_payload(const uint16_t code, uint8_t*& payload, size_t& payload_size, uint8_t* svr_version)
 {
 	ResHeader res;
 	// recieve response header
 	if (!socket_handler->recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res)))
 		return false;
+	if (svr_version != nullptr)
+		*svr_version = res.svr_version;
 
 	// check header validation
 	if (!check_response_hdr(res, code))
@@ -563,18 +1882,21 @@ bool Client::recv_changing_payload(const uint16_t code, uint8_t*& payload, size_
 }
 
 // perform the Retry mechanism until client cksum == server cksum or until retry reach the maximum retries value (RETRIES)
-bool Client::retries_mechanism()
+// confirmed is set if the server confirmed the file (valid CRC), it is not if the file failed its cksum RETRIES times
+bool Client::retries_mechanism(bool& confirmed)
 {
+	confirmed = false;
 	int i = 1;
 	bool same_cksum = (clt_cksum == svr_cksum);
 	while (!same_cksum && i < RETRIES)
 	{
+		PhaseTimer timer(*metrics, PHASE_RETRY);
 		if (!req_crc(REQ_NVALID_CRC))
 		{
 			std::cout << "failed to handle request unvalid crc (request code: " << REQ_NVALID_CRC << std::endl;
 			return false;
 		}
-		if (!req_file())
+		if (!req_file(true))
 		{
 			std::cout << "request file failed" << std::endl;
 			return false;
@@ -597,6 +1919,7 @@ bool Client::retries_mechanism()
 			std::cout << "failed to handle request valid crc (request code: " << REQ_VALID_CRC << std::endl;
 			return false;
 		}
+		confirmed = true;
 	}
 
 	return true;
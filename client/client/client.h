@@ -7,33 +7,83 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <ctime>
 #include "networkProtocol.h"
 
 // both files should located with the exe file
 const std::string CLT_INSTRUCTION_FILE = "transfer.info"; 
 const std::string CLT_INFO_FILE = "me.info";
+// session ticket of the last run & the AES key it resumes (encrypted with the client public key, only the private key
+// in CLT_INFO_FILE recovers it), written next to CLT_INFO_FILE (see req_resume_session)
+const std::string CLT_SESSION_FILE = "session.info";
 
 // file send retries
 const int RETRIES = 4;
 
+// file content is read, encrypted and sent in blocks of this size (bytes), so memory usage not depends on the file size
+const size_t FILE_BLOCK_SIZE = 64 * 1024;
+
+// in AES-CTR sessions (see VERSION_CTR) file content is read & encrypted in blocks of this size instead,
+// big enough to be encrypted on several threads at once
+const size_t CTR_FILE_BLOCK_SIZE = 2 * 1024 * 1024;
+
+// files of this size (bytes) or more are read through a memory mapping (see FileHandler::map_file)
+const size_t MIN_MAPPED_FILE_SIZE = 1024 * 1024;
+
+// number of parallel connections a file is split (striped) over, 1 = single stream (can be changed with --stripes)
+const unsigned int DEFAULT_STRIPES = 1;
+const unsigned int MAX_STRIPES = 64;
+// files smaller than this are always sent over a single stream, even if striping is on
+const size_t MIN_STRIPED_FILE_SIZE = 8 * 1024 * 1024;
+
+// files larger than this are sent chunk by chunk, the server verifies each chunk cksum on arrival, so only missing /
+// corrupted chunks are sent again and an interrupted transfer resumes from the chunks which are already stored
+const size_t FILE_CHUNK_SIZE = 4 * 1024 * 1024;
+
+// max number of connections (sessions) the asynchronous engine sends files over at once (see clt_start_async)
+const unsigned int MAX_ASYNC_SESSIONS = 64;
+
+// ciphertext of files up to this size (bytes) is kept from the first send, so a retry does not read & encrypt it again
+const size_t RETRY_CACHE_MAX_SIZE = 64 * 1024 * 1024;
+
 // forward declarations 
 class FileHandler;
 class SocketHandler;
 class RSAPrivateWrapper;
+class CRC;
+class Compressor;
+class RunMetrics;
+struct DeltaRange;
 
 class Client {
 
 private:
 	CltId id;
+	std::string svr_address;
+	std::string svr_port;
 	std::string user_name;
-	std::string file_to_send;
+	std::vector<std::string> files_to_send; // all the files listed in CLT_INSTRUCTION_FILE
+	std::string file_to_send; // the file currently being sent
 	CltPublicKey public_key;
 	CltSymmetricKey symmetric_key;
+	uint8_t protocol_version; // of the session, negotiated with the key exchange / resumption
+	SessionTicket ticket; // resumes the session of symmetric_key
+	std::time_t ticket_expiry; // 0 - no ticket for symmetric_key
 	SocketHandler* socket_handler;
 	FileHandler* file_handler;
 	RSAPrivateWrapper* rsa_decryptor;
-	uint32_t clt_cksum;
+	uint32_t clt_cksum; // calculated once per file, on its first send
 	uint32_t svr_cksum;
+	std::string cipher_cache; // ciphertext of the current file (if small enough, see RETRY_CACHE_MAX_SIZE)
+	unsigned int stripes;
+	bool stripe_connection_lost; // a stripe of the current file failed since its connection was lost
+	Compressor* compressor; // nullptr - file contents are sent as they are
+	bool dedup; // send files by their content defined chunks, only the chunks the server doesn't have (see VERSION_DEDUP)
+	bool delta; // send files the server has a copy of as the differences from that copy (see VERSION_DELTA)
+	RunMetrics* metrics; // timing & counters of the run
+	std::string metrics_path; // JSON summary of the run, empty - not written
+	std::string trace_path; // Chrome trace of the run, empty - not written
 
 public:
 	Client();
@@ -41,21 +91,55 @@ public:
 
 	// batch mode startup routine
 	bool clt_start();
+	bool clt_start_async(unsigned int num_of_sessions);
+	bool set_stripes(unsigned int num_of_stripes);
+	bool set_compression(const std::string& spec);
+	void set_dedup(bool enabled);
+	void set_delta(bool enabled);
+	void set_metrics(const std::string& path);
+	void set_trace(const std::string& path);
+	bool write_metrics(bool success);
 
 	// files
 	bool read_instructions();
 	bool read_clt_info();
 	bool write_clt_info();
+	bool read_session_info();
+	bool write_session_info();
 
 	// general
 	bool check_response_hdr(const ResHeader& hdr, const uint16_t code);
-	bool recv_changing_payload(const uint16_t code, uint8_t*& payload, size_t& payload_size);
-	bool retries_mechanism();
+	bool recv_changing_payload(const uint16_t code, uint8_t*& payload, size_t& payload_size, uint8_t* svr_version = nullptr);
+	bool retries_mechanism(bool& confirmed);
+	bool send_file_content(SocketHandler* socket, FileHandler* file, const uint8_t* request, size_t request_size, size_t num_of_bytes,
+		size_t content_size, CRC* digest, std::string* cache, bool cksum_trailer = false);
+	bool read_packed(size_t num_of_bytes, CRC* digest, std::string& packed);
+	bool send_packed_content(const uint8_t* request, size_t request_size, const std::string& packed, std::string* cache, const uint32_t* cksum_trailer);
+	bool recv_got_file();
+	bool recv_got_file_payload(const ResHeader& hdr);
+	bool parse_chunks_status(const uint8_t* payload, size_t payload_size, size_t chunks_count, std::vector<uint32_t>& cksums, std::vector<uint8_t>& stored);
+	bool parse_inventory(const uint8_t* payload, size_t payload_size, size_t chunks_count, std::vector<uint8_t>& known);
+	template <typename Size> bool parse_signatures(const uint8_t* payload, size_t payload_size, std::vector<BlockSignature>& signatures, size_t& basis_size, size_t& block_size);
+	bool append_delta_range(const DeltaRange& range, std::string& plain);
+	bool send_delta_content(const uint8_t* request, size_t request_size, const std::vector<DeltaRange>& ranges, size_t content_size);
+	bool reconnect();
+	bool connection_lost() const;
 
 	// request handlers
 	bool req_registration();
 	bool req_public_key();
-	bool req_file();
+	bool req_session_ticket();
+	bool req_resume_session();
+	bool req_file(bool retry = false);
+	template <typename Size> bool req_file_sized(bool retry);
+	template <typename Size> bool req_file_striped(size_t file_size, bool retry);
+	template <typename Size> void send_stripe(size_t file_size, size_t offset, size_t size, CRC* digest, uint8_t& result, uint8_t& lost);
+	template <typename Size> bool req_file_chunked(size_t file_size);
+	bool send_chunk(size_t chunk_index, size_t size, CRC& digest);
+	template <typename Size> bool req_file_dedup(size_t file_size, bool retry);
+	bool send_dedup_chunk(size_t chunk_index, size_t size);
+	template <typename Size> bool req_file_signatures(std::vector<BlockSignature>& signatures, size_t& basis_size, size_t& block_size);
+	template <typename Size> bool req_file_delta(size_t file_size, bool& has_copy);
 	bool req_crc(const uint16_t type_code);
 	
 	// exit(1)
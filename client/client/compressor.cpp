@@ -0,0 +1,153 @@
+/*
+	TransferIt client
+	compressor.cpp
+	description: compression stage of file contents (LZ4 / zstd), contents which don't compress are sent as is
+*/
+
+#include "compressor.h"
+#include <lz4frame.h>
+#include <zstd.h>
+#include <chrono>
+#include <sstream>
+
+Compressor::Compressor(uint8_t codec, int level) : codec(codec), level(level)
+{
+	reset_stats();
+}
+
+// parse the --compress option value into a codec & level
+bool Compressor::parse(const std::string& spec, uint8_t& codec, int& level)
+{
+	level = DEFAULT_ZSTD_LEVEL;
+	if (spec == "lz4")
+	{
+		codec = CODEC_LZ4;
+		return true;
+	}
+	if (spec.compare(0, 4, "zstd") != 0)
+		return false;
+	codec = CODEC_ZSTD;
+	if (spec.size() == 4)
+		return true;
+	if (spec[4] != ':')
+		return false;
+	try
+	{
+		size_t parsed = 0;
+		level = std::stoi(spec.substr(5), &parsed);
+		return parsed == spec.size() - 5 && level >= ZSTD_minCLevel() && level <= ZSTD_maxCLevel();
+	}
+	catch (std::exception& e)
+	{
+		return false;
+	}
+}
+
+const char* Compressor::codec_name(uint8_t codec)
+{
+	switch (codec)
+	{
+	case CODEC_LZ4: return "lz4";
+	case CODEC_ZSTD: return "zstd";
+	default: return "none";
+	}
+}
+
+// compress size bytes of data into packed, after the codec byte which is already there
+bool Compressor::compress(const uint8_t* data, size_t size, std::string& packed)
+{
+	const size_t offset = packed.size();
+	size_t compressed_size = 0;
+	if (codec == CODEC_LZ4)
+	{
+		packed.resize(offset + LZ4F_compressFrameBound(size, nullptr));
+		compressed_size = LZ4F_compressFrame(&packed[offset], packed.size() - offset, data, size, nullptr);
+		if (LZ4F_isError(compressed_size))
+			return false;
+	}
+	else
+	{
+		packed.resize(offset + ZSTD_compressBound(size));
+		compressed_size = ZSTD_compress(&packed[offset], packed.size() - offset, data, size, level);
+		if (ZSTD_isError(compressed_size))
+			return false;
+	}
+	packed.resize(offset + compressed_size);
+	return true;
+}
+
+/* pack size bytes of data into packed: the codec byte, then the compressed data - or CODEC_NONE, then the data as is,
+if it doesn't compress (a sample is tried first on large contents, see COMPRESS_SAMPLE_SIZE) */
+bool Compressor::pack(const uint8_t* data, size_t size, std::string& packed)
+{
+	const auto start_time = std::chrono::steady_clock::now();
+	packed.assign(1, static_cast<char>(codec));
+	bool compressed = false;
+	if (size >= 2 * COMPRESS_SAMPLE_SIZE)
+		compressed = compress(data, COMPRESS_SAMPLE_SIZE, packed) && packed.size() - 1 <= COMPRESS_SAMPLE_SIZE * COMPRESSIBLE_RATIO;
+	else
+		compressed = true;
+	if (compressed)
+	{
+		packed.resize(1);
+		compressed = compress(data, size, packed) && packed.size() - 1 < size;
+	}
+	if (!compressed)
+	{
+		packed.assign(1, static_cast<char>(CODEC_NONE));
+		packed.append(reinterpret_cast<const char*>(data), size);
+	}
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+	raw_bytes += size;
+	packed_bytes += packed.size();
+	seconds += elapsed.count();
+	contents += 1;
+	compressed_contents += compressed ? 1 : 0;
+	return true;
+}
+
+void Compressor::reset_stats()
+{
+	raw_bytes = 0;
+	packed_bytes = 0;
+	seconds = 0;
+	contents = 0;
+	compressed_contents = 0;
+}
+
+uint64_t Compressor::get_raw_bytes() const
+{
+	return raw_bytes;
+}
+
+uint64_t Compressor::get_packed_bytes() const
+{
+	return packed_bytes;
+}
+
+double Compressor::get_seconds() const
+{
+	return seconds;
+}
+
+size_t Compressor::get_contents() const
+{
+	return contents;
+}
+
+size_t Compressor::get_compressed_contents() const
+{
+	return compressed_contents;
+}
+
+// one line summary of the stats: wire size vs raw size & the CPU time it took
+std::string Compressor::stats() const
+{
+	std::ostringstream line;
+	line << codec_name(codec) << ": " << raw_bytes << " -> " << packed_bytes << " bytes";
+	if (packed_bytes > 0)
+		line << " (" << static_cast<double>(raw_bytes) / packed_bytes << "x)";
+	line << ", " << compressed_contents << " of " << contents << " contents compressed, " << seconds * 1000 << " ms compressing";
+	return line.str();
+}
@@ -0,0 +1,64 @@
+/*
+	TransferIt client
+	compressor.h
+	description: header file for compressor.cpp
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "networkProtocol.h"
+
+// zstd level when none is given (--compress zstd)
+const int DEFAULT_ZSTD_LEVEL = 3;
+
+// contents of this size (bytes) or more are first compressed on a sample of this size, if the sample doesn't shrink
+// to COMPRESSIBLE_RATIO of its size, the content is sent as is without compressing all of it
+const size_t COMPRESS_SAMPLE_SIZE = 64 * 1024;
+const double COMPRESSIBLE_RATIO = 0.9;
+
+// size of the codec byte file content starts with (see VERSION_CODEC) in sessions of protocol_version
+inline size_t codec_prefix_size(uint8_t protocol_version)
+{
+	return (protocol_version >= VERSION_CODEC) ? 1 : 0;
+}
+
+/*
+	compression stage of file contents, before encryption. a content is packed as one codec byte followed by
+	the compressed content (a LZ4 / zstd frame) or by the content as is, if it doesn't compress well enough.
+	counts the sizes & time of the contents it packs, so the client can report what compression saved and cost
+*/
+class Compressor
+{
+private:
+	uint8_t codec;
+	int level;
+
+	// stats since the last reset_stats
+	uint64_t raw_bytes;
+	uint64_t packed_bytes;
+	double seconds;
+	size_t contents;
+	size_t compressed_contents;
+
+	bool compress(const uint8_t* data, size_t size, std::string& packed);
+
+public:
+	Compressor(uint8_t codec, int level = DEFAULT_ZSTD_LEVEL);
+
+	// "lz4" / "zstd" / "zstd:LEVEL"
+	static bool parse(const std::string& spec, uint8_t& codec, int& level);
+	static const char* codec_name(uint8_t codec);
+
+	bool pack(const uint8_t* data, size_t size, std::string& packed);
+
+	void reset_stats();
+	uint64_t get_raw_bytes() const;
+	uint64_t get_packed_bytes() const;
+	double get_seconds() const;
+	size_t get_contents() const;
+	size_t get_compressed_contents() const;
+	std::string stats() const;
+};
@@ -6,6 +6,18 @@
 
 #include "crc.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CRC_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC_TARGET_PCLMUL
+#else
+#include <cpuid.h>
+#define CRC_TARGET_PCLMUL __attribute__((target("pclmul,ssse3")))
+#endif
+#endif
+
 static uint32_t const crctab[256] = {
 	0x00000000,	0x04C11DB7,	0x09823B6E,	0x0D4326D9,	0x130476DC,
 	0x17C56B6B,	0x1A864DB2,	0x1E475005,	0x2608EDB8,	0x22C9F00F,
@@ -61,27 +73,282 @@ static uint32_t const crctab[256] = {
 	0xB1F740B4,
 };
 
+// cksum generator polynomial (the x^32 term is implicit)
+static uint32_t const POLY = 0x04C11DB7;
 
-CRC::CRC()
+// multiply a by b modulo the generator polynomial (GF(2) polynomials, bit i is the coefficient of x^i)
+static uint32_t multmodp(uint32_t a, uint32_t b)
 {
-	nchar = 0;
-	crc = 0;
+	uint32_t p = 0;
+	for (int i = 31; i >= 0; i--)
+	{
+		p = (p & 0x80000000) ? (p << 1) ^ POLY : (p << 1);
+		if (a & (1u << i))
+			p ^= b;
+	}
+	return p;
 }
 
-void CRC::update(unsigned char* buf, uint32_t size) {
-	uint32_t crc_local = this->crc;
+// x^(8 * n) modulo the generator polynomial, the effect of appending n bytes on a crc value
+static uint32_t x8nmodp(uint64_t n)
+{
+	uint32_t result = 1; // x^0
+	uint32_t base = 0x100; // x^8
+	while (n)
+	{
+		if (n & 1)
+			result = multmodp(result, base);
+		base = multmodp(base, base);
+		n >>= 1;
+	}
+	return result;
+}
+
+/*
+	slicing tables: slicing_tab[k][b] is the crc of byte b followed by k zero bytes (slicing_tab[0] == crctab),
+	so 8 / 16 input bytes can be folded into the crc with 8 / 16 independent lookups instead of a serial chain
+*/
+struct SlicingTables
+{
+	uint32_t tab[16][256];
+
+	SlicingTables()
+	{
+		for (int b = 0; b < 256; b++)
+			tab[0][b] = crctab[b];
+		for (int k = 1; k < 16; k++)
+			for (int b = 0; b < 256; b++)
+				tab[k][b] = (tab[k - 1][b] << 8) ^ crctab[tab[k - 1][b] >> 24];
+	}
+};
+
+static const SlicingTables slicing;
+
+// crctab_index[crctab[b] & 0xFF] == b, the low bytes of crctab are all different (the polynomial has an x^0 term), so the
+// byte which was folded into a crc can be told from the crc (see CRC::restore)
+struct CrcTabIndex
+{
+	uint8_t index[256];
+
+	CrcTabIndex()
+	{
+		for (int b = 0; b < 256; b++)
+			index[crctab[b] & 0xFF] = static_cast<uint8_t>(b);
+	}
+};
+
+static const CrcTabIndex crctab_index;
+
+static uint32_t update_bytewise(uint32_t crc, const unsigned char* buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		crc = crctab[(crc >> 24) ^ buf[i]] ^ ((crc << 8) & 0xFFFFFFFF);
+	}
+	return crc;
+}
+
+// 4 bytes of buf as a big endian value (the first byte is the most significant, as the crc consumes them)
+static inline uint32_t load_be32(const unsigned char* buf)
+{
+	return (static_cast<uint32_t>(buf[0]) << 24) | (static_cast<uint32_t>(buf[1]) << 16) | (static_cast<uint32_t>(buf[2]) << 8) | buf[3];
+}
+
+static uint32_t update_slicing8(uint32_t crc, const unsigned char* buf, size_t size)
+{
+	const uint32_t(*t)[256] = slicing.tab;
+	while (size >= 8)
+	{
+		const uint32_t a = crc ^ load_be32(buf);
+		crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xFF] ^ t[5][(a >> 8) & 0xFF] ^ t[4][a & 0xFF] ^
+			t[3][buf[4]] ^ t[2][buf[5]] ^ t[1][buf[6]] ^ t[0][buf[7]];
+		buf += 8;
+		size -= 8;
+	}
+	return update_bytewise(crc, buf, size);
+}
+
+static uint32_t update_slicing16(uint32_t crc, const unsigned char* buf, size_t size)
+{
+	const uint32_t(*t)[256] = slicing.tab;
+	while (size >= 16)
+	{
+		const uint32_t a = crc ^ load_be32(buf);
+		crc = t[15][a >> 24] ^ t[14][(a >> 16) & 0xFF] ^ t[13][(a >> 8) & 0xFF] ^ t[12][a & 0xFF] ^
+			t[11][buf[4]] ^ t[10][buf[5]] ^ t[9][buf[6]] ^ t[8][buf[7]] ^
+			t[7][buf[8]] ^ t[6][buf[9]] ^ t[5][buf[10]] ^ t[4][buf[11]] ^
+			t[3][buf[12]] ^ t[2][buf[13]] ^ t[1][buf[14]] ^ t[0][buf[15]];
+		buf += 16;
+		size -= 16;
+	}
+	return update_slicing8(crc, buf, size);
+}
+
+#ifdef CRC_X86
+/*
+	carry-less multiplication folding (PCLMULQDQ), the buffer is handled as one big polynomial:
+	bytes are loaded byte-swapped so bit i of a 128 bit lane is the coefficient of x^i (the crc is not reflected),
+	a lane X = H*x^64 + L is moved n bits forward with H*(x^(n+64) mod P) ^ L*(x^n mod P), which stays congruent mod P.
+	4 lanes are folded in parallel (n = 512) and then into one (n = 128), the 128 bit remainder R (== message mod P)
+	is turned into the crc (R*x^32 mod P) by the table, the tail which is shorter than a lane is done by the table too
+*/
+static const uint64_t X128_MODP = 0xE8A45605;
+static const uint64_t X192_MODP = 0xC5B9CD4C;
+static const uint64_t X512_MODP = 0xE6228B11;
+static const uint64_t X576_MODP = 0x8833794C;
+
+CRC_TARGET_PCLMUL static inline __m128i fold(__m128i x, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+CRC_TARGET_PCLMUL static uint32_t update_pclmul(uint32_t crc, const unsigned char* buf, size_t size)
+{
+	if (size < 64)
+		return update_slicing16(crc, buf, size);
+
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i k512 = _mm_set_epi64x(X576_MODP, X512_MODP);
+	const __m128i k128 = _mm_set_epi64x(X192_MODP, X128_MODP);
+
+	// the current crc is added to the first 32 bits of the message
+	__m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf)), bswap);
+	__m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 16)), bswap);
+	__m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 32)), bswap);
+	__m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 48)), bswap);
+	x0 = _mm_xor_si128(x0, _mm_set_epi32(static_cast<int>(crc), 0, 0, 0));
+	buf += 64;
+	size -= 64;
+
+	while (size >= 64)
+	{
+		x0 = _mm_xor_si128(fold(x0, k512), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf)), bswap));
+		x1 = _mm_xor_si128(fold(x1, k512), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 16)), bswap));
+		x2 = _mm_xor_si128(fold(x2, k512), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 32)), bswap));
+		x3 = _mm_xor_si128(fold(x3, k512), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 48)), bswap));
+		buf += 64;
+		size -= 64;
+	}
 
-	for (uint32_t i = 0; i < size; i++)
+	__m128i x = _mm_xor_si128(fold(x0, k128), x1);
+	x = _mm_xor_si128(fold(x, k128), x2);
+	x = _mm_xor_si128(fold(x, k128), x3);
+	while (size >= 16)
 	{
-		crc_local = crctab[(crc_local >> 24) ^ buf[i]] ^ ((crc_local << 8) & 0xFFFFFFFF);
+		x = _mm_xor_si128(fold(x, k128), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf)), bswap));
+		buf += 16;
+		size -= 16;
 	}
-	this->crc = crc_local;
+
+	unsigned char remainder[16];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(remainder), _mm_shuffle_epi8(x, bswap));
+	crc = update_slicing16(0, remainder, sizeof(remainder));
+	return update_slicing16(crc, buf, size);
+}
+#endif
+
+// true if the CPU has PCLMULQDQ & SSSE3 (byte shuffle)
+static bool detect_pclmul()
+{
+#if defined(CRC_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	const unsigned int ecx = static_cast<unsigned int>(info[2]);
+	return (ecx & (1u << 1)) && (ecx & (1u << 9));
+#elif defined(CRC_X86)
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+	return (ecx & bit_PCLMUL) && (ecx & bit_SSSE3);
+#else
+	return false;
+#endif
+}
+
+// CPUID is slow (it may even trap to the hypervisor), so it runs once
+static bool cpu_has_pclmul()
+{
+	static const bool has_pclmul = detect_pclmul();
+	return has_pclmul;
+}
+
+bool CRC::kernel_supported(Kernel kernel)
+{
+	if (kernel == PCLMUL)
+		return cpu_has_pclmul();
+	return true;
+}
+
+// the fastest kernel for this CPU, detected once
+CRC::Kernel CRC::best_kernel()
+{
+	static const Kernel best = cpu_has_pclmul() ? PCLMUL : SLICING_16;
+	return best;
+}
+
+const char* CRC::kernel_name(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case AUTO: return "auto";
+	case BYTEWISE: return "bytewise";
+	case SLICING_8: return "slicing-by-8";
+	case SLICING_16: return "slicing-by-16";
+	case PCLMUL: return "pclmul";
+	}
+	return "unknown";
+}
+
+CRC::CRC(Kernel kernel)
+{
+	nchar = 0;
+	crc = 0;
+
+	if (kernel == AUTO || !kernel_supported(kernel))
+		kernel = best_kernel();
+	switch (kernel)
+	{
+#ifdef CRC_X86
+	case PCLMUL: update_fn = update_pclmul; break;
+#endif
+	case SLICING_8: update_fn = update_slicing8; break;
+	case BYTEWISE: update_fn = update_bytewise; break;
+	default: update_fn = update_slicing16; break;
+	}
+}
+
+void CRC::update(const unsigned char* buf, size_t size) {
+	this->crc = update_fn(this->crc, buf, size);
 	this->nchar += size;
 }
 
+// append the data of another CRC (calculated separately over the bytes which follow this one's) to this CRC
+void CRC::combine(const CRC& next) {
+	this->crc = multmodp(this->crc, x8nmodp(next.nchar)) ^ next.crc;
+	this->nchar += next.nchar;
+}
+
+// the CRC of nchar bytes whose digest is given (the length bytes digest appends are folded out again), so digests which
+// were calculated separately can be combined
+CRC CRC::restore(uint32_t digest, uint64_t nchar) {
+	unsigned char length[sizeof(nchar)];
+	size_t count = 0;
+	for (uint64_t n = nchar; n; n >>= 8)
+		length[count++] = static_cast<unsigned char>(n & 0xff);
+	uint32_t crc_local = ~digest;
+	while (count) {
+		const uint8_t b = crctab_index.index[crc_local & 0xFF];
+		crc_local = ((static_cast<uint32_t>(b ^ length[--count])) << 24) | ((crc_local ^ crctab[b]) >> 8);
+	}
+	CRC result;
+	result.crc = crc_local;
+	result.nchar = nchar;
+	return result;
+}
+
 uint32_t CRC::digest() {
 	uint32_t crc_local = this->crc;
-	uint32_t n = this->nchar;
+	uint64_t n = this->nchar;
 	uint32_t c = 0;
 	while (n) {
 		c = n & 0xff;
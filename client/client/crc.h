@@ -6,15 +6,29 @@
 
 #pragma once
 #include <cstdint>
+#include <cstddef>
 #include <string>
 
 class CRC {
+public:
+	// update implementations, all of them give the same result, AUTO picks the fastest one the CPU supports
+	enum Kernel { AUTO, BYTEWISE, SLICING_8, SLICING_16, PCLMUL };
+
+	static Kernel best_kernel();
+	static bool kernel_supported(Kernel kernel);
+	static const char* kernel_name(Kernel kernel);
+
 private:
+	typedef uint32_t (*UpdateFn)(uint32_t, const unsigned char*, size_t);
+
 	uint32_t crc;
-	uint32_t nchar;
+	uint64_t nchar; // length of the data so far, appended to it by digest (as cksum does, so files over 4GB too)
+	UpdateFn update_fn;
 
 public:
-	CRC();
-	void update(unsigned char*, uint32_t);
+	CRC(Kernel kernel = AUTO);
+	void update(const unsigned char*, size_t);
+	void combine(const CRC& next);
+	static CRC restore(uint32_t digest, uint64_t nchar);
 	uint32_t digest();
-};
\ No newline at end of file
+};
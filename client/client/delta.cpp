@@ -0,0 +1,154 @@
+/*
+	TransferIt client
+	delta.cpp
+	description: rsync style matching of a file against the block signatures of the server copy (see VERSION_DELTA)
+*/
+
+#include "delta.h"
+#include <algorithm>
+#include <cstring>
+
+// weak checksum of a window whose rolling checksum parts are a & b
+static inline uint32_t weak_checksum(uint32_t a, uint32_t b)
+{
+	return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+static inline uint16_t weak_tag(uint32_t weak)
+{
+	return static_cast<uint16_t>(weak ^ (weak >> 16));
+}
+
+DeltaMatcher::DeltaMatcher(const std::vector<BlockSignature>& signatures, size_t block_size, size_t basis_size) :
+	signatures(signatures), block_size(block_size), tags(64 * 1024 / 8), window(block_size), linear_window(block_size),
+	window_start(0), window_length(0), a(0), b(0), position(0), data_start(0)
+{
+	last_block_size = signatures.empty() ? 0 : basis_size - (signatures.size() - 1) * block_size;
+	for (size_t i = 0; i < signatures.size(); ++i)
+	{
+		blocks[signatures[i].weak].push_back(static_cast<uint32_t>(i));
+		const uint16_t tag = weak_tag(signatures[i].weak);
+		tags[tag / 8] |= 1 << (tag % 8);
+	}
+}
+
+/* find a block of the server copy (of length bytes) which is the same as the current window, a block which continues
+the last copy is preferred (so consecutive blocks are copied as one range) */
+bool DeltaMatcher::match(size_t length, size_t& block_index)
+{
+	const uint32_t weak = weak_checksum(a, b);
+	const uint16_t tag = weak_tag(weak);
+	if (!((tags[tag / 8] >> (tag % 8)) & 1))
+		return false;
+	auto candidates = blocks.find(weak);
+	if (candidates == blocks.end())
+		return false;
+
+	const size_t first_part = std::min(length, block_size - window_start);
+	memcpy(linear_window.data(), window.data() + window_start, first_part);
+	memcpy(linear_window.data() + first_part, window.data(), length - first_part);
+	uint8_t strong[CryptoPP::SHA256::DIGESTSIZE];
+	sha.CalculateDigest(strong, linear_window.data(), length);
+
+	const size_t next_block = (!ranges.empty() && ranges.back().copy) ? ranges.back().first + ranges.back().count : signatures.size();
+	bool found = false;
+	for (uint32_t candidate : candidates->second)
+	{
+		const size_t candidate_size = (candidate + 1 == signatures.size()) ? last_block_size : block_size;
+		if (candidate_size != length || memcmp(signatures[candidate].strong, strong, STRONG_HASH_SIZE) != 0)
+			continue;
+		if (!found || candidate == next_block)
+			block_index = candidate;
+		found = true;
+		if (candidate == next_block)
+			break;
+	}
+	return found;
+}
+
+// the window (length bytes, ending at position) is block_index of the server copy
+void DeltaMatcher::add_copy(size_t block_index, size_t length)
+{
+	add_data(position - length);
+	if (!ranges.empty() && ranges.back().copy && ranges.back().first + ranges.back().count == block_index)
+		ranges.back().count += 1;
+	else
+		ranges.push_back({ true, block_index, 1 });
+	data_start = position;
+	window_start = 0;
+	window_length = 0;
+	a = 0;
+	b = 0;
+}
+
+// feed the next size bytes of the file
+void DeltaMatcher::update(const uint8_t* data, size_t size)
+{
+	if (signatures.empty())
+	{
+		position += size;
+		return;
+	}
+	for (size_t i = 0; i < size; ++i)
+	{
+		const uint8_t in = data[i];
+		if (window_length < block_size)
+		{
+			window[window_length] = in;
+			window_length += 1;
+			a += in;
+			b += a;
+		}
+		else
+		{
+			const uint8_t out = window[window_start];
+			a += in - out;
+			b += a - static_cast<uint32_t>(block_size) * out;
+			window[window_start] = in;
+			window_start = (window_start + 1) % block_size;
+		}
+		position += 1;
+
+		size_t block_index = 0;
+		if (window_length == block_size && match(block_size, block_index))
+			add_copy(block_index, block_size);
+	}
+}
+
+// the end of the file may match the (shorter) last block of the server copy, the rest is sent as data
+void DeltaMatcher::final()
+{
+	size_t block_index = 0;
+	if (window_length > 0 && window_length == last_block_size && window_start == 0 && match(window_length, block_index))
+		add_copy(block_index, window_length);
+	add_data(position);
+}
+
+// the bytes from data_start up to end are sent as data
+void DeltaMatcher::add_data(size_t end)
+{
+	while (data_start < end)
+	{
+		const size_t count = std::min(end - data_start, DELTA_MAX_DATA_SIZE);
+		ranges.push_back({ false, data_start, count });
+		data_start += count;
+	}
+}
+
+const std::vector<DeltaRange>& DeltaMatcher::get_ranges() const
+{
+	return ranges;
+}
+
+size_t DeltaMatcher::content_size() const
+{
+	return ranges.size() * sizeof(DeltaOp) + data_size();
+}
+
+size_t DeltaMatcher::data_size() const
+{
+	size_t size = 0;
+	for (const DeltaRange& range : ranges)
+		size += range.copy ? 0 : range.count;
+	return size;
+}
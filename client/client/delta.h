@@ -0,0 +1,68 @@
+/*
+	TransferIt client
+	delta.h
+	description: header file for delta.cpp
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include <sha.h>
+#include "networkProtocol.h"
+
+// data of the file delta is sent in operations of up to this size (bytes), so it can be read & encrypted block by block
+const size_t DELTA_MAX_DATA_SIZE = 1024 * 1024;
+
+// a range of the file delta, copy - blocks [first, first + count) of the server copy,
+// otherwise - count bytes of the file from offset first (sent as data)
+struct DeltaRange
+{
+	bool copy;
+	size_t first;
+	size_t count;
+};
+
+/*
+	finds the blocks of the server copy of a file in the (changed) file, rsync style: a rolling checksum of a block size
+	window moves over the file byte by byte, a window whose checksum matches the weak checksum of a server block is compared
+	by its strong hash, a match is copied from the server copy and the window moves past it. the file is fed block by block,
+	the result is the list of ranges to copy / to send as data (the data itself is read again when it is sent)
+*/
+class DeltaMatcher
+{
+private:
+	const std::vector<BlockSignature>& signatures;
+	size_t block_size;
+	size_t last_block_size; // of the server copy, may be shorter than block_size
+	std::unordered_map<uint32_t, std::vector<uint32_t>> blocks; // block indexes by weak checksum
+	std::vector<uint8_t> tags; // bit per 16 bits tag of the weak checksums, most windows are rejected by it
+	CryptoPP::SHA256 sha;
+
+	// window of the last (up to block_size) bytes, a ring
+	std::vector<uint8_t> window;
+	std::vector<uint8_t> linear_window; // the window in order, for its strong hash
+	size_t window_start;
+	size_t window_length;
+	uint32_t a; // rolling checksum parts (mod 2^16)
+	uint32_t b;
+
+	size_t position; // of the next byte of the file
+	size_t data_start; // first byte which is not part of a range yet
+	std::vector<DeltaRange> ranges;
+
+	bool match(size_t length, size_t& block_index);
+	void add_copy(size_t block_index, size_t length);
+	void add_data(size_t end);
+
+public:
+	DeltaMatcher(const std::vector<BlockSignature>& signatures, size_t block_size, size_t basis_size);
+
+	void update(const uint8_t* data, size_t size);
+	void final();
+	const std::vector<DeltaRange>& get_ranges() const;
+	size_t content_size() const; // of the delta content (operations & data, before encryption)
+	size_t data_size() const; // bytes sent as data
+};
@@ -6,11 +6,22 @@
 
 #include "file_handler.h"
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
 
 FileHandler::FileHandler()
 {
 	fs = nullptr;
 	file_path = "";
+	mapping = nullptr;
+	region = nullptr;
+	position = 0;
 }
 
 FileHandler::~FileHandler()
@@ -21,6 +32,12 @@ FileHandler::~FileHandler()
 // close a file and clear file name
 void FileHandler::clear_handler()
 {
+	delete region;
+	region = nullptr;
+	delete mapping;
+	mapping = nullptr;
+	position = 0;
+
 	if (fs != nullptr)
 		fs->close();
 
@@ -35,9 +52,9 @@ size_t FileHandler::get_file_size()
 	if (fs == nullptr || !fs->is_open())
 		return 0;
 
-	uintmax_t fsize = boost::filesystem::file_size(file_path);
+	uintmax_t fsize = (region != nullptr) ? region->get_size() : boost::filesystem::file_size(file_path);
 	
-	if (fsize > UINT32_MAX) // up to 4gb files 
+	if (fsize > SIZE_MAX) // larger than the address space (32-bit builds)
 		return 0;
 
 	return static_cast<size_t>(fsize);
@@ -75,18 +92,137 @@ bool FileHandler::open_file(const std::string& fn, const std::string& type)
 	return result;
 }
 
-// read num_of_bytes from this filestream into buff
+// read exactly num_of_bytes from this filestream into buff, false on a short read (end of file, a file truncated after
+// it was opened / mapped)
 bool FileHandler::read_file_bytes(uint8_t* buff, size_t num_of_bytes)
 {
 	if (num_of_bytes == 0 || file_path.size() == 0 || fs == nullptr || buff == nullptr)
 		return false;
 
+	if (region != nullptr)
+	{
+		size_t bytes_read = 0;
+		return read_file_chunk(buff, num_of_bytes, bytes_read) && bytes_read == num_of_bytes;
+	}
+
 	try
 	{
 		fs->read(reinterpret_cast<char*>(buff), num_of_bytes);
+		return static_cast<size_t>(fs->gcount()) == num_of_bytes;
+	}
+	catch(std::exception& e)
+	{
+		return false;
+	}
+}
+
+// read up to max_bytes from this filestream into buff, bytes_read is set to the amount actually read (0 at end of file)
+bool FileHandler::read_file_chunk(uint8_t* buff, size_t max_bytes, size_t& bytes_read)
+{
+	bytes_read = 0;
+	if (max_bytes == 0 || file_path.size() == 0 || fs == nullptr || buff == nullptr)
+		return false;
+
+	if (region != nullptr)
+	{
+		const uint8_t* data = nullptr;
+		view_file_chunk(data, max_bytes, bytes_read);
+		memcpy(buff, data, bytes_read);
+		return true;
+	}
+
+	try
+	{
+		fs->read(reinterpret_cast<char*>(buff), max_bytes);
+		bytes_read = static_cast<size_t>(fs->gcount());
+		if (fs->bad())
+			return false;
+		return true;
+	}
+	catch(std::exception& e)
+	{
+		return false;
+	}
+}
+
+/* map this file (opened with "rb") into memory read-only, reading on from the current position, with a sequential access
+hint for the OS read-ahead. reads are then served from the mapping (page cache) instead of being copied by the filestream.
+return false if the file cannot be mapped (empty / not a regular file / no address space left for it),
+the file is then read through the filestream as before */
+bool FileHandler::map_file()
+{
+	if (file_path.size() == 0 || fs == nullptr || region != nullptr)
+		return false;
+
+	try
+	{
+		const std::streamoff offset = fs->tellg();
+		position = (offset > 0) ? static_cast<size_t>(offset) : 0;
+		mapping = new file_mapping(file_path.c_str(), boost::interprocess::read_only);
+		region = new mapped_region(*mapping, boost::interprocess::read_only);
+		region->advise(mapped_region::advice_sequential);
 		return true;
 	}
 	catch(std::exception& e)
+	{
+		delete region;
+		region = nullptr;
+		delete mapping;
+		mapping = nullptr;
+		position = 0;
+		return false;
+	}
+}
+
+bool FileHandler::is_mapped() const
+{
+	return region != nullptr;
+}
+
+/* point data at the next (up to) max_bytes of this file, bytes_read is set to the amount (0 at end of file).
+when the file is mapped data points into the mapping (no copy), otherwise the bytes are read into a buffer of this handler,
+either way data is valid until the next read / clear_handler */
+bool FileHandler::view_file_chunk(const uint8_t*& data, size_t max_bytes, size_t& bytes_read)
+{
+	bytes_read = 0;
+	if (max_bytes == 0 || file_path.size() == 0 || fs == nullptr)
+		return false;
+
+	if (region != nullptr)
+	{
+		bytes_read = std::min(max_bytes, region->get_size() - position);
+		data = static_cast<const uint8_t*>(region->get_address()) + position;
+		position += bytes_read;
+		return true;
+	}
+
+	if (block.size() < max_bytes)
+		block.resize(max_bytes);
+	data = block.data();
+	return read_file_chunk(block.data(), max_bytes, bytes_read);
+}
+
+// move this filestream reading position to offset (bytes from the beginning of the file)
+bool FileHandler::set_position(size_t offset)
+{
+	if (file_path.size() == 0 || fs == nullptr)
+		return false;
+
+	if (region != nullptr)
+	{
+		if (offset > region->get_size())
+			return false;
+		position = offset;
+		return true;
+	}
+
+	try
+	{
+		fs->clear(); // the file end may have been reached already
+		fs->seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+		return !fs->fail();
+	}
+	catch(std::exception& e)
 	{
 		return false;
 	}
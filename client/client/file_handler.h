@@ -8,15 +8,25 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 #include <cstdint>
 #include <iostream>
 
+// forward declarations
+namespace boost { namespace interprocess { class file_mapping; class mapped_region; } }
+
 class FileHandler 
 {
 private:
 	std::fstream* fs;
 	std::string file_path; 
 
+	// mapped mode (see map_file), reads are served from region at position instead of fs
+	boost::interprocess::file_mapping* mapping;
+	boost::interprocess::mapped_region* region;
+	size_t position;
+	std::vector<uint8_t> block; // view_file_chunk buffer when the file is not mapped
+
 
 public:
 	FileHandler();
@@ -26,6 +36,11 @@ public:
 	size_t get_file_size();
 	bool open_file(const std::string& fn, const std::string& type);
 	bool read_file_bytes(uint8_t* buff, size_t num_of_bytes);
+	bool read_file_chunk(uint8_t* buff, size_t max_bytes, size_t& bytes_read);
+	bool map_file();
+	bool is_mapped() const;
+	bool view_file_chunk(const uint8_t*& data, size_t max_bytes, size_t& bytes_read);
+	bool set_position(size_t offset);
 	bool read_one_line(std::string& buff);
 	bool write_file_bytes(const uint8_t* buff, size_t num_of_bytes);
 	bool write_one_line(const std::string& buff);
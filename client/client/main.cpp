@@ -6,12 +6,75 @@
 
 #include "client.h"
 #include "iostream"
+#include <string>
 
-int main()
+int main(int argc, char* argv[])
 {
 	Client clt;
+	unsigned int async_sessions = 0; // 0 = synchronous client
+
+	// options: --stripes N - send each large file over N parallel connections
+	//          --async N - send the files on the asynchronous engine, over N connections at once
+	//          --compress lz4|zstd[:LEVEL] - compress file contents before encryption (servers of protocol v5)
+	//          --dedup - send only the chunks of each file the server doesn't have yet (servers of protocol v6)
+	//          --delta - send files the server has an older copy of as the differences from it (servers of protocol v7)
+	//          --metrics PATH - write the timing of every phase & the socket counters of the run as JSON
+	//          --trace PATH - write every timed phase of the run as a Chrome trace
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string option = argv[i];
+		if (option == "--stripes" && i + 1 < argc)
+		{
+			try
+			{
+				if (clt.set_stripes(std::stoul(argv[++i])))
+					continue;
+			}
+			catch (std::exception& e) {}
+		}
+		else if (option == "--async" && i + 1 < argc)
+		{
+			try
+			{
+				async_sessions = std::stoul(argv[++i]);
+				if (async_sessions > 0 && async_sessions <= MAX_ASYNC_SESSIONS)
+					continue;
+			}
+			catch (std::exception& e) {}
+		}
+		else if (option == "--dedup")
+		{
+			clt.set_dedup(true);
+			continue;
+		}
+		else if (option == "--delta")
+		{
+			clt.set_delta(true);
+			continue;
+		}
+		else if (option == "--metrics" && i + 1 < argc)
+		{
+			clt.set_metrics(argv[++i]);
+			continue;
+		}
+		else if (option == "--trace" && i + 1 < argc)
+		{
+			clt.set_trace(argv[++i]);
+			continue;
+		}
+		else if (option == "--compress" && i + 1 < argc)
+		{
+			if (clt.set_compression(argv[++i]))
+				continue;
+		}
+		std::cout << "usage: " << argv[0] << " [--stripes N (1-" << MAX_STRIPES << ")] [--async N (1-" << MAX_ASYNC_SESSIONS << ")]"
+			<< " [--compress lz4|zstd[:LEVEL]] [--dedup] [--delta] [--metrics PATH] [--trace PATH]" << std::endl;
+		return 1;
+	}
 	
-	if (!clt.clt_start())
+	const bool done = (async_sessions > 0) ? clt.clt_start_async(async_sessions) : clt.clt_start();
+	clt.write_metrics(done);
+	if (!done)
 		clt.stop_clt();
 	else
 		std::cout << " Client routine went successfully! " << std::endl;
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <cstddef>  // for size_t
 #include <cstdint>  // for uintX_t types
 
 // initialization value
@@ -18,6 +19,18 @@ const uint16_t REQ_FILE = 1103;
 const uint16_t REQ_VALID_CRC = 1104;
 const uint16_t REQ_NVALID_CRC = 1105;
 const uint16_t REQ_4NVALID_CRC = 1106;
+const uint16_t REQ_FILE_STRIPE = 1107; // a range of a file, sent over one of several parallel connections
+const uint16_t REQ_FILE_STRIPES_DONE = 1108; // all the stripes of a file were sent (answered with RES_GOT_FILE)
+const uint16_t REQ_FILE_CHUNKS_BEGIN = 1109; // a file is about to be sent chunk by chunk (answered with RES_FILE_CHUNKS_STATUS)
+const uint16_t REQ_FILE_CHUNK = 1110; // one chunk of a file followed by its cksum (not answered, chunks are sent back to back)
+const uint16_t REQ_FILE_CHUNKS_DONE = 1111; // all the chunks were sent (answered with RES_GOT_FILE, or RES_FILE_CHUNKS_STATUS if some are missing)
+const uint16_t REQ_SESSION_TICKET = 1112; // ask for a ticket which lets the next run resume the session (answered with RES_SESSION_TICKET)
+const uint16_t REQ_RESUME_SESSION = 1113; // present a ticket instead of the public key (answered with RES_SESSION_RESUMED / RES_SESSION_RESUME_FAIL)
+const uint16_t REQ_FILE_INVENTORY = 1114; // the content defined chunks of a file (answered with RES_FILE_INVENTORY, which of them the server has)
+const uint16_t REQ_FILE_DEDUP_CHUNK = 1115; // one chunk of the inventory the server doesn't have (not answered)
+const uint16_t REQ_FILE_DEDUP_DONE = 1116; // all the missing chunks were sent (answered with RES_GOT_FILE, or RES_FILE_INVENTORY if some are still missing)
+const uint16_t REQ_FILE_SIGNATURES = 1117; // block signatures of the server copy of a file (answered with RES_FILE_SIGNATURES)
+const uint16_t REQ_FILE_DELTA = 1118; // a file as the differences from the server copy, see DeltaOp (answered with RES_GOT_FILE)
 
 
 // Response codes
@@ -26,9 +39,27 @@ const uint16_t RES_REGISTRATION_FAIL = 2101;
 const uint16_t RES_AES_KEY = 2102;
 const uint16_t RES_GOT_FILE = 2103;
 const uint16_t RES_MSG_CONFIRM = 2104;
-
-// Client version
-const uint8_t CLT_VERSION = 3;
+const uint16_t RES_FILE_CHUNKS_STATUS = 2105; // variable payload size
+const uint16_t RES_SESSION_TICKET = 2106;
+const uint16_t RES_SESSION_RESUMED = 2107;
+const uint16_t RES_SESSION_RESUME_FAIL = 2108; // no payload, the session goes on (exchange keys)
+const uint16_t RES_FILE_INVENTORY = 2109; // variable payload size
+const uint16_t RES_FILE_SIGNATURES = 2110; // variable payload size
+
+// Client version, the version of the session is the lower of the client & server versions (see the server version of
+// RES_AES_KEY / RES_SESSION_RESUMED), file type requests carry the session version
+const uint8_t CLT_VERSION = 9;
+const uint8_t VERSION_CTR = 4; // first version whose file content is encrypted with AES-CTR (AES-CBC before, see AESWrapper)
+const uint8_t VERSION_CODEC = 5; // first version whose file content (before encryption) starts with a codec byte (see Compressor)
+const uint8_t VERSION_DEDUP = 6; // first version whose server keeps a chunk store, files may be sent by their chunks (see ContentChunker)
+const uint8_t VERSION_DELTA = 7; // first version whose files may be sent as the differences from the server copy (see DeltaMatcher)
+const uint8_t VERSION_LARGE_FILES = 8; // first version whose file sizes & offsets are 64-bit (see ReqFileT), files may be over 4GB
+const uint8_t VERSION_AUTH = 9; // first version whose AES-CTR file content ends with a MAC of its iv & ciphertext (see AESWrapper)
+
+// codecs of file content, the codec byte is followed by the content as is / a LZ4 frame / a zstd frame
+const uint8_t CODEC_NONE = 0;
+const uint8_t CODEC_LZ4 = 1;
+const uint8_t CODEC_ZSTD = 2;
 
 // Request & Response fields sizes (bytes)
 const size_t CLT_ID_SIZE = 16;
@@ -36,6 +67,12 @@ const size_t CLT_USERNAME_SIZE = 255; // including null terminated
 const size_t CLT_PUBLICKEY_SIZE = 160; 
 const size_t CLT_SYMMETRICKEY_SIZE = 16;
 const size_t FILE_NAME_SIZE = 255;
+const size_t SESSION_TICKET_SIZE = 16;
+const size_t CHUNK_HASH_SIZE = 32; // SHA-256
+const size_t MAX_INVENTORY_CHUNKS = 256 * 1024; // chunks of a file inventory (enough for any file size at CDC_MIN_CHUNK_SIZE)
+const size_t STRONG_HASH_SIZE = 16; // of a block signature, the first bytes of its SHA-256
+// largest file of sessions before VERSION_LARGE_FILES, its sizes (with the encryption & protocol overhead) fit in 32 bits
+const uint64_t MAX_32BIT_FILE_SIZE = UINT32_MAX - 16 * 1024 * 1024;
 
 #pragma pack(push, 1)
 
@@ -69,11 +106,44 @@ struct FileName
 	FileName() : file_name{ DEFAULT } {}
 };
 
+struct SessionTicket
+{
+	uint8_t ticket[SESSION_TICKET_SIZE];
+	SessionTicket() : ticket{ DEFAULT } {}
+};
+
 struct FileCksum
 {
 	
 };
 
+// a content defined chunk of a file
+struct ChunkRef
+{
+	uint8_t hash[CHUNK_HASH_SIZE];
+	uint32_t size;
+	ChunkRef() : hash{ DEFAULT }, size(DEFAULT) {}
+};
+
+// signature of a block of the server copy of a file, weak - rolling checksum (see DeltaMatcher), strong - confirms a match
+struct BlockSignature
+{
+	uint32_t weak;
+	uint8_t strong[STRONG_HASH_SIZE];
+};
+
+// the content of a file delta request (after the codec byte) is a sequence of operations which build the file in order,
+// DELTA_DATA is followed by its data
+const uint8_t DELTA_COPY = 0; // first - block index in the server copy, count - number of blocks
+const uint8_t DELTA_DATA = 1; // first - number of bytes which follow, count - 0
+struct DeltaOp
+{
+	uint8_t op;
+	uint32_t first;
+	uint32_t count;
+	DeltaOp(uint8_t op, uint32_t first, uint32_t count) : op(op), first(first), count(count) {}
+};
+
 // protocol Request header 
 
 struct ReqHeader 
@@ -112,18 +182,216 @@ struct ReqPublicKey
 	ReqPublicKey(const CltId& id) : hdr(id, REQ_PUBLIC_KEY) {}
 };
 
-struct ReqFile
+// header payload size of a request of version whose content (content_size bytes) follows its payload header
+inline uint32_t content_payload_size(uint8_t version, size_t payload_hdr_size, size_t content_size)
+{
+	return static_cast<uint32_t>(payload_hdr_size + ((version >= VERSION_LARGE_FILES) ? 0 : content_size));
+}
+
+/* requests & responses which carry file sizes / offsets are templates of their type (Size): uint32_t up to
+VERSION_LARGE_FILES (ReqFile...), uint64_t from it on (ReqFile...64). from VERSION_LARGE_FILES on, the header payload size
+of a request whose content follows its payload header counts the payload header only (see content_payload_size) */
+template <typename Size>
+struct ReqFileT
 {
 	ReqHeader hdr;
 	struct PayloadHdr
 	{
 		CltId clt_id;
-		uint32_t file_content_size;
+		Size file_content_size;
 		FileName file_name;
 		PayloadHdr(const CltId& id) : clt_id(id), file_content_size(DEFAULT) {}
 	}payload_hdr;
 
-	ReqFile(const CltId& id) : hdr(id, REQ_FILE), payload_hdr(id) {}
+	ReqFileT(const CltId& id) : hdr(id, REQ_FILE), payload_hdr(id) {}
+};
+typedef ReqFileT<uint32_t> ReqFile;
+typedef ReqFileT<uint64_t> ReqFile64;
+
+template <typename Size>
+struct ReqFileStripeT
+{
+	ReqHeader hdr;
+	struct PayloadHdr
+	{
+		CltId clt_id;
+		Size file_size; // size of the whole file
+		Size stripe_offset; // position of the stripe in the file
+		Size stripe_size; // size of the stripe (before encryption)
+		Size file_content_size; // size of the stripe content which follows (after encryption)
+		FileName file_name;
+		PayloadHdr(const CltId& id) : clt_id(id), file_size(DEFAULT), stripe_offset(DEFAULT), stripe_size(DEFAULT), file_content_size(DEFAULT) {}
+	}payload_hdr;
+
+	ReqFileStripeT(const CltId& id) : hdr(id, REQ_FILE_STRIPE), payload_hdr(id) {}
+};
+typedef ReqFileStripeT<uint32_t> ReqFileStripe;
+typedef ReqFileStripeT<uint64_t> ReqFileStripe64;
+
+template <typename Size>
+struct ReqFileStripesDoneT
+{
+	ReqHeader hdr;
+	struct Payload
+	{
+		CltId clt_id;
+		Size file_size;
+		FileName file_name;
+		Payload(const CltId& id) : clt_id(id), file_size(DEFAULT) {}
+	}payload;
+
+	ReqFileStripesDoneT(const CltId& id) : hdr(id, REQ_FILE_STRIPES_DONE), payload(id) {}
+};
+typedef ReqFileStripesDoneT<uint32_t> ReqFileStripesDone;
+typedef ReqFileStripesDoneT<uint64_t> ReqFileStripesDone64;
+
+template <typename Size>
+struct ReqFileChunksBeginT
+{
+	ReqHeader hdr;
+	struct Payload
+	{
+		CltId clt_id;
+		Size file_size;
+		uint32_t chunk_size; // size of every chunk (before encryption) but the last one
+		FileName file_name;
+		Payload(const CltId& id) : clt_id(id), file_size(DEFAULT), chunk_size(DEFAULT) {}
+	}payload;
+
+	ReqFileChunksBeginT(const CltId& id) : hdr(id, REQ_FILE_CHUNKS_BEGIN), payload(id) {}
+};
+typedef ReqFileChunksBeginT<uint32_t> ReqFileChunksBegin;
+typedef ReqFileChunksBeginT<uint64_t> ReqFileChunksBegin64;
+
+struct ReqFileChunk
+{
+	ReqHeader hdr;
+	struct PayloadHdr
+	{
+		CltId clt_id;
+		uint32_t chunk_index; // position of the chunk in the file is chunk_index * chunk_size
+		uint32_t file_content_size; // size of the chunk content which follows (after encryption)
+		FileName file_name;
+		PayloadHdr(const CltId& id) : clt_id(id), chunk_index(DEFAULT), file_content_size(DEFAULT) {}
+	}payload_hdr;
+	/* file content, then the cksum (uint32_t) of the chunk (before encryption) */
+
+	ReqFileChunk(const CltId& id) : hdr(id, REQ_FILE_CHUNK), payload_hdr(id) {}
+};
+
+struct ReqFileChunksDone
+{
+	ReqHeader hdr;
+	struct Payload
+	{
+		CltId clt_id;
+		FileName file_name;
+		Payload(const CltId& id) : clt_id(id) {}
+	}payload;
+
+	ReqFileChunksDone(const CltId& id) : hdr(id, REQ_FILE_CHUNKS_DONE), payload(id) {}
+};
+
+template <typename Size>
+struct ReqFileInventoryT
+{
+	ReqHeader hdr;
+	struct PayloadHdr
+	{
+		CltId clt_id;
+		Size file_size;
+		uint32_t chunks_count;
+		FileName file_name;
+		PayloadHdr(const CltId& id) : clt_id(id), file_size(DEFAULT), chunks_count(DEFAULT) {}
+	}payload_hdr;
+	/* chunks_count ChunkRef, in the file order */
+
+	ReqFileInventoryT(const CltId& id) : hdr(id, REQ_FILE_INVENTORY), payload_hdr(id) {}
+};
+typedef ReqFileInventoryT<uint32_t> ReqFileInventory;
+typedef ReqFileInventoryT<uint64_t> ReqFileInventory64;
+
+struct ReqFileDedupChunk
+{
+	ReqHeader hdr;
+	struct PayloadHdr
+	{
+		CltId clt_id;
+		uint32_t chunk_index; // in the inventory
+		uint32_t file_content_size; // size of the chunk content which follows (after encryption)
+		FileName file_name;
+		PayloadHdr(const CltId& id) : clt_id(id), chunk_index(DEFAULT), file_content_size(DEFAULT) {}
+	}payload_hdr;
+	/* file content, the server verifies it by the hash in the inventory */
+
+	ReqFileDedupChunk(const CltId& id) : hdr(id, REQ_FILE_DEDUP_CHUNK), payload_hdr(id) {}
+};
+
+struct ReqFileDedupDone
+{
+	ReqHeader hdr;
+	struct Payload
+	{
+		CltId clt_id;
+		FileName file_name;
+		Payload(const CltId& id) : clt_id(id) {}
+	}payload;
+
+	ReqFileDedupDone(const CltId& id) : hdr(id, REQ_FILE_DEDUP_DONE), payload(id) {}
+};
+
+struct ReqFileSignatures
+{
+	ReqHeader hdr;
+	struct Payload
+	{
+		CltId clt_id;
+		FileName file_name;
+		Payload(const CltId& id) : clt_id(id) {}
+	}payload;
+
+	ReqFileSignatures(const CltId& id) : hdr(id, REQ_FILE_SIGNATURES), payload(id) {}
+};
+
+template <typename Size>
+struct ReqFileDeltaT
+{
+	ReqHeader hdr;
+	struct PayloadHdr
+	{
+		CltId clt_id;
+		Size file_size; // of the file after the delta is applied
+		Size basis_size; // of the server copy the signatures were calculated for
+		uint32_t block_size; // of the signatures
+		Size file_content_size; // size of the delta content which follows (after encryption)
+		FileName file_name;
+		PayloadHdr(const CltId& id) : clt_id(id), file_size(DEFAULT), basis_size(DEFAULT), block_size(DEFAULT), file_content_size(DEFAULT) {}
+	}payload_hdr;
+
+	ReqFileDeltaT(const CltId& id) : hdr(id, REQ_FILE_DELTA), payload_hdr(id) {}
+};
+typedef ReqFileDeltaT<uint32_t> ReqFileDelta;
+typedef ReqFileDeltaT<uint64_t> ReqFileDelta64;
+
+struct ReqSessionTicket
+{
+	ReqHeader hdr;
+	CltId payload;
+
+	ReqSessionTicket(const CltId& id) : hdr(id, REQ_SESSION_TICKET), payload(id) {}
+};
+
+struct ReqResumeSession
+{
+	ReqHeader hdr;
+	struct Payload
+	{
+		CltId clt_id;
+		SessionTicket ticket;
+		Payload(const CltId& id) : clt_id(id) {}
+	}payload;
+
+	ReqResumeSession(const CltId& id) : hdr(id, REQ_RESUME_SESSION), payload(id) {}
 };
 
 struct ReqValidCRC
@@ -188,17 +456,63 @@ struct ResAES
 	/* variable Size content  */
 };
 
-struct ResGotFile
+template <typename Size>
+struct ResGotFileT
 {
 	ResHeader hdr;
 	struct Payload
 	{
 		CltId clt_id;
-		uint32_t file_content_size;
+		Size file_content_size;
 		FileName file_name;
 		uint32_t cksum;
 	}payload;
 };
+typedef ResGotFileT<uint32_t> ResGotFile;
+typedef ResGotFileT<uint64_t> ResGotFile64;
+
+struct ResFileChunksStatus
+{
+	CltId clt_id;
+	uint32_t chunks_count;
+	/* variable Size content: chunks_count cksums (uint32_t), then a bitmap of the stored chunks (bit i % 8 of byte i / 8) */
+};
+
+struct ResFileInventory
+{
+	CltId clt_id;
+	uint32_t chunks_count;
+	/* variable Size content: a bitmap of the chunks the server has (bit i % 8 of byte i / 8) */
+};
+
+template <typename Size>
+struct ResFileSignaturesT
+{
+	CltId clt_id;
+	Size file_size; // of the server copy, 0 - no copy
+	uint32_t block_size;
+	uint32_t blocks_count;
+	/* variable Size content: blocks_count BlockSignature, the last block may be shorter than block_size */
+};
+typedef ResFileSignaturesT<uint32_t> ResFileSignatures;
+typedef ResFileSignaturesT<uint64_t> ResFileSignatures64;
+
+struct ResSessionTicket
+{
+	ResHeader hdr;
+	struct Payload
+	{
+		CltId clt_id;
+		SessionTicket ticket;
+		uint32_t lifetime; // seconds the ticket can be used
+	}payload;
+};
+
+struct ResSessionResumed
+{
+	ResHeader hdr;
+	CltId payload;
+};
 
 struct ResConfirmMsg
 {
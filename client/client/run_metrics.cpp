@@ -0,0 +1,160 @@
+/*
+	TransferIt client
+	run_metrics.cpp
+	description: per phase timing & counters of a client run, written as a JSON summary and a Chrome trace (see run_metrics.h)
+*/
+
+#include "run_metrics.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// a string as a JSON string (quoted), file names may have backslashes / quotes
+static std::string json_string(const std::string& text)
+{
+	std::ostringstream out;
+	out << '"';
+	for (const char c : text)
+	{
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+		else
+			out << c;
+	}
+	out << '"';
+	return out.str();
+}
+
+RunMetrics::RunMetrics() : origin(Clock::now()), tracing(false) {}
+
+const char* RunMetrics::phase_name(RunPhase phase)
+{
+	switch (phase)
+	{
+	case PHASE_CONNECT: return "connect";
+	case PHASE_REGISTRATION: return "registration";
+	case PHASE_RSA_KEYGEN: return "rsa_keygen";
+	case PHASE_KEY_EXCHANGE: return "key_exchange";
+	case PHASE_FILE_READ: return "file_read";
+	case PHASE_CKSUM: return "cksum";
+	case PHASE_ENCRYPT: return "encrypt";
+	case PHASE_SEND: return "send";
+	case PHASE_SERVER_ACK: return "server_ack";
+	case PHASE_RETRY: return "retry";
+	default: return "";
+	}
+}
+
+void RunMetrics::set_tracing(bool enabled)
+{
+	tracing = enabled;
+}
+
+double RunMetrics::since_origin(Clock::time_point time) const
+{
+	return std::chrono::duration<double, std::micro>(time - origin).count();
+}
+
+// keep a trace event, the lock is held by the caller
+void RunMetrics::add_event(const std::string& name, Clock::time_point start, Clock::time_point end, uint64_t bytes)
+{
+	const auto thread = threads.emplace(std::this_thread::get_id(), static_cast<unsigned int>(threads.size() + 1)).first;
+	events.push_back({ name, since_origin(start), since_origin(end) - since_origin(start), thread->second, bytes });
+}
+
+// a phase which started at start ended now, bytes - of file content it handled (0 - none)
+void RunMetrics::add(RunPhase phase, Clock::time_point start, uint64_t bytes)
+{
+	const Clock::time_point end = Clock::now();
+	std::lock_guard<std::mutex> guard(lock);
+	PhaseTotal& total = totals[phase];
+	total.count += 1;
+	total.bytes += bytes;
+	total.seconds += std::chrono::duration<double>(end - start).count();
+	if (tracing)
+		add_event(phase_name(phase), start, end, bytes);
+}
+
+// counters of a socket which is done (or of the whole run), added to the counters of the run
+void RunMetrics::add_sockets(const SocketCounters& counters)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	sockets += counters;
+}
+
+// a file which was sent, from start until now, retries - times it was sent again
+void RunMetrics::add_file(const std::string& name, uint64_t size, Clock::time_point start, uint64_t retries)
+{
+	const Clock::time_point end = Clock::now();
+	std::lock_guard<std::mutex> guard(lock);
+	files.push_back({ name, size, std::chrono::duration<double>(end - start).count(), retries });
+	if (tracing)
+		add_event(name, start, end, size);
+}
+
+uint64_t RunMetrics::get_count(RunPhase phase) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return totals[phase].count;
+}
+
+/* write the summary of the run as JSON: its outcome & duration, the count / total time / bytes (and MB/s) of every phase,
+the socket counters and the files sent. Return false if it couldn't be written */
+bool RunMetrics::write_summary(const std::string& path, bool success, uint8_t protocol_version) const
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "cannot write the run summary: " << path << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"success\": " << (success ? "true" : "false") << ",\n  \"protocol_version\": " << static_cast<int>(protocol_version)
+		<< ",\n  \"elapsed_ms\": " << since_origin(Clock::now()) / 1000 << ",\n  \"phases\": {";
+	for (int phase = 0; phase < PHASE_COUNT; ++phase)
+	{
+		const PhaseTotal& total = totals[phase];
+		out << (phase == 0 ? "\n" : ",\n") << "    " << json_string(phase_name(static_cast<RunPhase>(phase))) << ": {\"count\": " << total.count
+			<< ", \"total_ms\": " << total.seconds * 1000 << ", \"bytes\": " << total.bytes;
+		if (total.bytes > 0 && total.seconds > 0)
+			out << ", \"mb_per_s\": " << total.bytes / total.seconds / (1024 * 1024);
+		out << "}";
+	}
+	out << "\n  },\n  \"socket\": {\"bytes_sent\": " << sockets.bytes_sent << ", \"bytes_received\": " << sockets.bytes_received
+		<< ", \"send_calls\": " << sockets.send_calls << ", \"recv_calls\": " << sockets.recv_calls << "},\n  \"files\": [";
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		out << (i == 0 ? "\n" : ",\n") << "    {\"name\": " << json_string(files[i].name) << ", \"size\": " << files[i].size
+			<< ", \"elapsed_ms\": " << files[i].seconds * 1000 << ", \"retries\": " << files[i].retries << "}";
+	}
+	out << (files.empty() ? "]\n}\n" : "\n  ]\n}\n");
+	return static_cast<bool>(out);
+}
+
+// write the trace events of the run in the Chrome trace event format (complete events, microseconds)
+bool RunMetrics::write_trace(const std::string& path) const
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "cannot write the run trace: " << path << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		const TraceEvent& event = events[i];
+		out << (i == 0 ? "\n" : ",\n") << "{\"name\": " << json_string(event.name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+			<< ", \"ts\": " << event.start << ", \"dur\": " << event.duration << ", \"args\": {\"bytes\": " << event.bytes << "}}";
+	}
+	out << "\n]}\n";
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,108 @@
+/*
+	TransferIt client
+	run_metrics.h
+	description: header file for run_metrics.cpp
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "socket_handler.h"
+
+// phases of a client run which are timed, phases may nest (a retry contains the reads, encryption & sends of the file
+// it sends again), file read / cksum / encrypt / send are timed per block. the file read of a mapped file is only its
+// view, the pages are read (faulted in) by the cksum
+enum RunPhase
+{
+	PHASE_CONNECT,
+	PHASE_REGISTRATION,
+	PHASE_RSA_KEYGEN,
+	PHASE_KEY_EXCHANGE, // the public key request, or the session resumption
+	PHASE_FILE_READ,
+	PHASE_CKSUM,
+	PHASE_ENCRYPT,
+	PHASE_SEND,
+	PHASE_SERVER_ACK, // waiting for the response of a file / CRC request
+	PHASE_RETRY, // a file sent again after a not valid CRC, or after the connection was lost
+	PHASE_COUNT
+};
+
+/*
+	timing & counters of a client run: the total time, count & bytes of every phase, the socket counters and the files
+	sent, written as a JSON summary at the end of the run. if tracing is on, every timed phase is also kept as an event
+	of a Chrome trace (chrome://tracing, Perfetto), one track per thread. phases may be added from several threads
+	(striped files)
+*/
+class RunMetrics
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+private:
+	struct PhaseTotal
+	{
+		uint64_t count = 0;
+		uint64_t bytes = 0;
+		double seconds = 0;
+	};
+	struct TraceEvent
+	{
+		std::string name;
+		double start; // microseconds since the run started
+		double duration;
+		unsigned int thread;
+		uint64_t bytes;
+	};
+	struct FileRecord
+	{
+		std::string name;
+		uint64_t size;
+		double seconds;
+		uint64_t retries;
+	};
+
+	mutable std::mutex lock;
+	const Clock::time_point origin;
+	PhaseTotal totals[PHASE_COUNT];
+	SocketCounters sockets;
+	std::vector<FileRecord> files;
+	bool tracing;
+	std::vector<TraceEvent> events;
+	std::map<std::thread::id, unsigned int> threads; // trace track of every thread
+
+	double since_origin(Clock::time_point time) const;
+	void add_event(const std::string& name, Clock::time_point start, Clock::time_point end, uint64_t bytes);
+
+public:
+	RunMetrics();
+
+	static const char* phase_name(RunPhase phase);
+
+	void set_tracing(bool enabled);
+	void add(RunPhase phase, Clock::time_point start, uint64_t bytes = 0);
+	void add_sockets(const SocketCounters& counters);
+	void add_file(const std::string& name, uint64_t size, Clock::time_point start, uint64_t retries);
+	uint64_t get_count(RunPhase phase) const;
+
+	bool write_summary(const std::string& path, bool success, uint8_t protocol_version) const;
+	bool write_trace(const std::string& path) const;
+};
+
+// times a phase from its construction to its destruction (the phase of a whole function / block)
+class PhaseTimer
+{
+private:
+	RunMetrics& metrics;
+	RunPhase phase;
+	RunMetrics::Clock::time_point start;
+
+public:
+	PhaseTimer(RunMetrics& metrics, RunPhase phase) : metrics(metrics), phase(phase), start(RunMetrics::Clock::now()) {}
+	virtual ~PhaseTimer() { metrics.add(phase, start); }
+};
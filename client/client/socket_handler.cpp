@@ -6,6 +6,34 @@
 
 #include "socket_handler.h"
 
+/* completion condition of the reads / writes of a SocketHandler: transfers all as boost::asio::transfer_all does and
+counts the read_some / write_some calls (system calls) it lets the transfer make, one after every check that allows more */
+class CountingTransferAll
+{
+private:
+	uint64_t& calls;
+
+public:
+	CountingTransferAll(uint64_t& calls) : calls(calls) {}
+
+	size_t operator()(const boost::system::error_code& ec, size_t bytes_transferred)
+	{
+		const size_t max_size = boost::asio::transfer_all()(ec, bytes_transferred);
+		if (max_size > 0)
+			++calls;
+		return max_size;
+	}
+};
+
+SocketCounters& SocketCounters::operator+=(const SocketCounters& other)
+{
+	bytes_sent += other.bytes_sent;
+	bytes_received += other.bytes_received;
+	send_calls += other.send_calls;
+	recv_calls += other.recv_calls;
+	return *this;
+}
+
 SocketHandler::SocketHandler()
 {
 	// set endianess 
@@ -17,6 +45,7 @@ SocketHandler::SocketHandler()
 		little_endian = false;
 
 	is_connected = false;
+	io_failed = false;
 	io_context = nullptr;
 	socket = nullptr;
 	resolver = nullptr;
@@ -54,11 +83,13 @@ bool SocketHandler::connect()
 	try
 	{
 		close_connection();
+		io_failed = false;
 
 		io_context = new boost::asio::io_context;
 		socket = new tcp::socket(*io_context);
 		resolver = new tcp::resolver(*io_context);
 		boost::asio::connect(*socket, resolver->resolve(addr, port));
+		socket->set_option(tcp::no_delay(true)); // requests are written whole, no need to wait for more data
 		
 		is_connected = true;
 	}
@@ -71,28 +102,65 @@ bool SocketHandler::connect()
 	return is_connected; // ***************************
 }
 
-//
+// write size bytes of buff, on little endian hosts buff is written as is (no copy)
 bool SocketHandler::write_to_socket(const uint8_t* buff, size_t size)
 {
 	if(buff == nullptr || socket == nullptr || is_connected == false || size == 0)
 		return false;
 
 	boost::system::error_code ec;
+	size_t bytes_transferred = 0;
 
-	uint8_t* temp_buff = new uint8_t[size];// on the heap
-	memcpy(temp_buff, buff, size);
-
-	if (!little_endian)
+	if (little_endian)
+	{
+		bytes_transferred = boost::asio::write(*socket, boost::asio::buffer(buff, size), CountingTransferAll(counters.send_calls), ec);
+	}
+	else
+	{
+		uint8_t* temp_buff = new uint8_t[size];// on the heap
+		memcpy(temp_buff, buff, size);
 		endianess_swaping(temp_buff, size);
-	
-	size_t bytes_transferred = boost::asio::write(*socket, boost::asio::buffer(temp_buff, size), ec);
+		bytes_transferred = boost::asio::write(*socket, boost::asio::buffer(temp_buff, size), CountingTransferAll(counters.send_calls), ec);
+		delete[] temp_buff; // we shall de-allocate the memory
+	}
+	counters.bytes_sent += bytes_transferred;
 
-	delete[] temp_buff; // we shall de-allocate the memory
+	if (!bytes_transferred || ec) // nothing was written / write went non-successfully
+	{
+		io_failed = true;
+		return false;
+	}
 
-	if (!bytes_transferred) // nothing was written so we shall return false
+	return true;
+}
+
+/* write several buffers one after the other (for example request header, payload header and content) in one
+gather write (single system call when the socket takes it all), without copying them into one buffer first.
+empty buffers are skipped, on big endian hosts every buffer is swapped & written on its own */
+bool SocketHandler::write_to_socket(std::initializer_list<boost::asio::const_buffer> buffers)
+{
+	if (socket == nullptr || is_connected == false || boost::asio::buffer_size(buffers) == 0)
 		return false;
-	if (ec) // write went non-successfully
+
+	if (!little_endian)
+	{
+		for (const boost::asio::const_buffer& buff : buffers)
+		{
+			if (buff.size() > 0 && !write_to_socket(static_cast<const uint8_t*>(buff.data()), buff.size()))
+				return false;
+		}
+		return true;
+	}
+
+	boost::system::error_code ec;
+	size_t bytes_transferred = boost::asio::write(*socket, buffers, CountingTransferAll(counters.send_calls), ec);
+	counters.bytes_sent += bytes_transferred;
+
+	if (!bytes_transferred || ec)
+	{
+		io_failed = true;
 		return false;
+	}
 
 	return true;
 }
@@ -105,10 +173,14 @@ bool SocketHandler::recv_from_socket(uint8_t* buff, size_t size)
 
 	boost::system::error_code ec;
 
-	size_t bytes_transferred = boost::asio::read(*socket, boost::asio::buffer(buff, size), ec);
+	size_t bytes_transferred = boost::asio::read(*socket, boost::asio::buffer(buff, size), CountingTransferAll(counters.recv_calls), ec);
+	counters.bytes_received += bytes_transferred;
 
 	if (!bytes_transferred || ec) // recieved nothing or some error accured
+	{
+		io_failed = true;
 		return false;
+	}
 
 	if (!little_endian)
 		endianess_swaping(buff, bytes_transferred);
@@ -163,6 +235,8 @@ bool SocketHandler::port_validation(const std::string& prt)
 		std::cout << b.what() << std::endl;
 		return false;
 	}
+
+	return true;
 }
 
 bool SocketHandler::set_socket(const std::string& address, const std::string& prt)
@@ -174,3 +248,8 @@ bool SocketHandler::set_socket(const std::string& address, const std::string& pr
 	port = prt;
 	return true;
 }
+
+const SocketCounters& SocketHandler::get_counters() const
+{
+	return counters;
+}
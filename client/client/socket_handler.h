@@ -11,6 +11,7 @@
 #include <cstdint>
 #include <iostream>
 #include <vector>
+#include <initializer_list>
 #include <boost/lexical_cast.hpp>
 
 //MAYBE SEND IN CHUNKS
@@ -20,6 +21,17 @@ const size_t PORT_MAX = 65535;
 
 using boost::asio::ip::tcp;
 
+// bytes & system calls (read_some / write_some) of a SocketHandler, over all its connections
+struct SocketCounters
+{
+	uint64_t bytes_sent = 0;
+	uint64_t bytes_received = 0;
+	uint64_t send_calls = 0;
+	uint64_t recv_calls = 0;
+
+	SocketCounters& operator+=(const SocketCounters& other);
+};
+
 class SocketHandler 
 {
 private:
@@ -30,6 +42,8 @@ private:
 	std::string port;
 	bool little_endian; // will be used for endianess testing
 	bool is_connected; // true if connected to the socket
+	bool io_failed; // true if a read / write of the current connection failed (the connection is lost)
+	SocketCounters counters;
 
 public:
 	SocketHandler();
@@ -39,10 +53,13 @@ public:
 	
 	bool connect();
 	bool write_to_socket(const uint8_t* buff, size_t size);
+	bool write_to_socket(std::initializer_list<boost::asio::const_buffer> buffers);
 	bool recv_from_socket(uint8_t* buff, size_t size);
 	void close_connection();
+	bool connection_lost() const { return io_failed; }
 
 	bool addr_validation(const std::string& address);
 	bool port_validation(const std::string& prt);
 	bool set_socket(const std::string& address, const std::string& prt);
+	const SocketCounters& get_counters() const;
 };
\ No newline at end of file
@@ -0,0 +1,492 @@
+/*
+	TransferIt client
+	load_generator.cpp
+	description: load generator of the transfer protocol, concurrent clients run whole sessions against a server
+	(see load_generator.h) and the latency of every request is reported by its request code
+*/
+
+#include "load_generator.h"
+#include "../client/socket_handler.h"
+#include "../client/AESWrapper.h"
+#include "../client/RSAWrapper.h"
+#include "../client/compressor.h"
+#include "../client/crc.h"
+#include "../client/client.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+// largest AES key response payload accepted (the client ID and the RSA encrypted key, 128 bytes for 1024-bit keys)
+const size_t MAX_AES_KEY_PAYLOAD = sizeof(ResAES) + 1024;
+
+static double milliseconds_since(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// a size with an optional K / M / G suffix (binary), false if it isn't one
+static bool parse_size(const std::string& text, double& size)
+{
+	try
+	{
+		size_t end = 0;
+		size = std::stod(text, &end);
+		const std::string suffix = text.substr(end);
+		if (suffix == "K" || suffix == "k")
+			size *= 1024;
+		else if (suffix == "M" || suffix == "m")
+			size *= 1024 * 1024;
+		else if (suffix == "G" || suffix == "g")
+			size *= 1024.0 * 1024 * 1024;
+		else if (!suffix.empty())
+			return false;
+		return size >= 0;
+	}
+	catch (std::exception& e)
+	{
+		return false;
+	}
+}
+
+// fixed:SIZE, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA (sizes may end with K / M / G)
+bool SizeDistribution::parse(const std::string& spec)
+{
+	std::vector<std::string> fields;
+	std::stringstream stream(spec);
+	std::string field;
+	while (std::getline(stream, field, ':'))
+		fields.push_back(field);
+
+	if (fields.size() == 2 && fields[0] == "fixed")
+	{
+		kind = FIXED;
+		return parse_size(fields[1], a);
+	}
+	if (fields.size() == 3 && fields[0] == "uniform")
+	{
+		kind = UNIFORM;
+		return parse_size(fields[1], a) && parse_size(fields[2], b) && a <= b;
+	}
+	if (fields.size() == 3 && fields[0] == "lognormal")
+	{
+		kind = LOGNORMAL;
+		try
+		{
+			b = std::stod(fields[2]);
+		}
+		catch (std::exception& e)
+		{
+			return false;
+		}
+		return parse_size(fields[1], a) && a > 0 && b >= 0;
+	}
+	return false;
+}
+
+size_t SizeDistribution::sample(std::mt19937_64& gen, size_t max_size) const
+{
+	double size = a;
+	if (kind == UNIFORM)
+		size = std::uniform_real_distribution<double>(a, b)(gen);
+	else if (kind == LOGNORMAL)
+		size = std::lognormal_distribution<double>(std::log(a), b)(gen);
+	return static_cast<size_t>(std::min(std::max(size, 0.0), static_cast<double>(max_size)));
+}
+
+std::string SizeDistribution::describe() const
+{
+	std::ostringstream text;
+	if (kind == FIXED)
+		text << "fixed:" << static_cast<uint64_t>(a);
+	else if (kind == UNIFORM)
+		text << "uniform:" << static_cast<uint64_t>(a) << ":" << static_cast<uint64_t>(b);
+	else
+		text << "lognormal:" << static_cast<uint64_t>(a) << ":" << b;
+	return text.str();
+}
+
+void LoadStats::merge(const LoadStats& other)
+{
+	for (const auto& request : other.requests)
+	{
+		RequestStats& merged = requests[request.first];
+		merged.latencies.insert(merged.latencies.end(), request.second.latencies.begin(), request.second.latencies.end());
+		merged.errors += request.second.errors;
+	}
+	sessions += other.sessions;
+	failed_sessions += other.failed_sessions;
+	file_bytes += other.file_bytes;
+	cksum_mismatches += other.cksum_mismatches;
+	injected_failures += other.injected_failures;
+}
+
+/*
+	one client of the load, runs its sessions one after the other on its own connection. a request which fails ends
+	its session (counted as an error of its request code), the next session starts on a new connection
+*/
+class LoadClient
+{
+private:
+	const LoadConfig& config;
+	const std::string name_prefix;
+	RSAPrivateWrapper rsa;
+	std::string public_key;
+	LoadStats& stats;
+	std::mt19937_64 gen;
+	std::string content; // random file content, the file of a session is a prefix of it
+
+	SocketHandler socket;
+	CltId id;
+	CltSymmetricKey symmetric_key;
+	uint8_t protocol_version;
+
+	void think();
+	bool timed(uint16_t code, bool outcome, Clock::time_point start);
+	bool req_registration(const std::string& username);
+	bool req_public_key(const std::string& username);
+	template <typename Size> bool req_file(const std::string& file_name, size_t size, uint32_t& cksum);
+	bool req_crc(uint16_t code, const std::string& file_name);
+
+public:
+	LoadClient(const LoadConfig& config, const std::string& name_prefix, const std::string& private_key, uint64_t seed, LoadStats& stats);
+
+	bool session(unsigned int number);
+};
+
+LoadClient::LoadClient(const LoadConfig& config, const std::string& name_prefix, const std::string& private_key, uint64_t seed, LoadStats& stats) :
+	config(config), name_prefix(name_prefix), rsa(private_key), stats(stats), gen(seed), protocol_version(DEFAULT)
+{
+	public_key = rsa.getPublicKey();
+	socket.set_socket(config.address, config.port);
+}
+
+// wait a think time (exponentially distributed around its mean) before the next request
+void LoadClient::think()
+{
+	if (config.think_time <= 0)
+		return;
+	const double wait = std::exponential_distribution<double>(1.0 / config.think_time)(gen);
+	std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(wait));
+}
+
+// record the outcome of a request which started at start, Return the outcome
+bool LoadClient::timed(uint16_t code, bool outcome, Clock::time_point start)
+{
+	RequestStats& request = stats.requests[code];
+	if (outcome)
+		request.latencies.push_back(milliseconds_since(start));
+	else
+		++request.errors;
+	return outcome;
+}
+
+// run one session: connect, registration, public key, file & CRC (the file is sent again after a not valid CRC, up to
+// RETRIES times as the client does), Return false if it failed
+bool LoadClient::session(unsigned int number)
+{
+	const std::string username = name_prefix + " " + std::to_string(number);
+	const std::string file_name = "load " + std::to_string(number) + ".bin";
+	const size_t size = config.file_size.sample(gen, config.max_file_size);
+	if (content.size() < size)
+	{
+		const size_t old_size = content.size();
+		content.resize(size);
+		for (size_t i = old_size; i < size; ++i)
+			content[i] = static_cast<char>(gen());
+	}
+
+	bool done = false;
+	const auto start = Clock::now();
+	if (timed(LOAD_CONNECT, socket.connect(), start))
+	{
+		think();
+		done = req_registration(username);
+		if (done)
+		{
+			think();
+			done = req_public_key(username);
+		}
+		CRC digest;
+		digest.update(reinterpret_cast<const unsigned char*>(content.data()), size);
+		const uint32_t cksum = digest.digest();
+		for (int attempt = 1; done; ++attempt)
+		{
+			think();
+			uint32_t server_cksum = 0;
+			done = (protocol_version >= VERSION_LARGE_FILES) ? req_file<uint64_t>(file_name, size, server_cksum) :
+				req_file<uint32_t>(file_name, size, server_cksum);
+			if (!done)
+				break;
+			stats.file_bytes += size;
+			const bool mismatch = server_cksum != cksum;
+			const bool injected = !mismatch && std::bernoulli_distribution(config.crc_fail_rate)(gen);
+			stats.cksum_mismatches += mismatch ? 1 : 0;
+			stats.injected_failures += injected ? 1 : 0;
+
+			think();
+			if (!mismatch && !injected)
+			{
+				done = req_crc(REQ_VALID_CRC, file_name);
+				break;
+			}
+			if (attempt >= RETRIES)
+			{
+				done = req_crc(REQ_4NVALID_CRC, file_name);
+				break;
+			}
+			done = req_crc(REQ_NVALID_CRC, file_name);
+		}
+	}
+	socket.close_connection();
+	++(done ? stats.sessions : stats.failed_sessions);
+	return done;
+}
+
+bool LoadClient::req_registration(const std::string& username)
+{
+	ReqRegistration req;
+	ResRegistration res;
+	req.hdr.payload_size = sizeof(req.payload);
+	memcpy(req.payload.username, username.c_str(), std::min(username.size(), CLT_USERNAME_SIZE - 1));
+
+	const auto start = Clock::now();
+	const bool outcome = socket.write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)) &&
+		socket.recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res)) &&
+		res.hdr.res_code == RES_REGISTRATION_SUCCESS && res.hdr.payload_size == sizeof(res.payload);
+	if (outcome)
+		id = res.payload;
+	return timed(REQ_REGISTRATION, outcome, start);
+}
+
+// send the public key, the AES key the server answers with is decrypted after the request is timed
+bool LoadClient::req_public_key(const std::string& username)
+{
+	ReqPublicKey req(id);
+	ResHeader res_hdr;
+	req.hdr.payload_size = sizeof(req.payload);
+	memcpy(req.payload.clt_name.username, username.c_str(), std::min(username.size(), CLT_USERNAME_SIZE - 1));
+	memcpy(req.payload.clt_public_key.public_key, public_key.data(), std::min(public_key.size(), CLT_PUBLICKEY_SIZE));
+
+	std::vector<uint8_t> payload;
+	const auto start = Clock::now();
+	bool outcome = socket.write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)) &&
+		socket.recv_from_socket(reinterpret_cast<uint8_t*>(&res_hdr), sizeof(res_hdr)) &&
+		res_hdr.res_code == RES_AES_KEY && res_hdr.payload_size > sizeof(ResAES) && res_hdr.payload_size <= MAX_AES_KEY_PAYLOAD;
+	if (outcome)
+	{
+		payload.resize(res_hdr.payload_size);
+		outcome = socket.recv_from_socket(payload.data(), payload.size());
+	}
+	if (!timed(REQ_PUBLIC_KEY, outcome, start))
+		return false;
+
+	try
+	{
+		const std::string aes_key = rsa.decrypt(payload.data() + sizeof(ResAES), payload.size() - sizeof(ResAES));
+		if (aes_key.size() != CLT_SYMMETRICKEY_SIZE)
+			return false;
+		memcpy(symmetric_key.symmetric_key, aes_key.data(), aes_key.size());
+	}
+	catch (std::exception& e)
+	{
+		return false;
+	}
+	protocol_version = std::min(CLT_VERSION, res_hdr.svr_version);
+	return true;
+}
+
+// send the file of the session in one request of the session version (the content as is after the codec byte,
+// if the version has one), cksum is set to the cksum the server calculated
+template <typename Size>
+bool LoadClient::req_file(const std::string& file_name, size_t size, uint32_t& cksum)
+{
+	ReqFileT<Size> req(id);
+	req.hdr.clt_version = protocol_version;
+	memcpy(req.payload_hdr.file_name.file_name, file_name.c_str(), std::min(file_name.size(), FILE_NAME_SIZE - 1));
+
+	AESWrapper aes(symmetric_key, cipher_mode(protocol_version));
+	std::string cipher, part;
+	aes.encrypt_begin();
+	if (codec_prefix_size(protocol_version) > 0)
+	{
+		aes.encrypt_update(&CODEC_NONE, sizeof(CODEC_NONE), part);
+		cipher += part;
+	}
+	aes.encrypt_update(reinterpret_cast<const uint8_t*>(content.data()), size, part);
+	cipher += part;
+	aes.encrypt_final(part);
+	cipher += part;
+	req.payload_hdr.file_content_size = static_cast<Size>(cipher.size());
+	req.hdr.payload_size = content_payload_size(protocol_version, sizeof(req.payload_hdr), cipher.size());
+
+	ResHeader res_hdr;
+	typename ResGotFileT<Size>::Payload res;
+	const auto start = Clock::now();
+	const bool outcome = socket.write_to_socket({ boost::asio::buffer(&req, sizeof(req)), boost::asio::buffer(cipher) }) &&
+		socket.recv_from_socket(reinterpret_cast<uint8_t*>(&res_hdr), sizeof(res_hdr)) &&
+		res_hdr.res_code == RES_GOT_FILE && res_hdr.payload_size == sizeof(res) &&
+		socket.recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res));
+	if (outcome)
+		cksum = res.cksum;
+	return timed(REQ_FILE, outcome, start);
+}
+
+bool LoadClient::req_crc(uint16_t code, const std::string& file_name)
+{
+	// valid / not valid / 4th time not valid requests have the same layout
+	ReqValidCRC req(id);
+	ResConfirmMsg res;
+	req.hdr.req_code = code;
+	req.hdr.payload_size = sizeof(req.payload);
+	memcpy(req.payload.file_name.file_name, file_name.c_str(), std::min(file_name.size(), FILE_NAME_SIZE - 1));
+
+	const auto start = Clock::now();
+	const bool outcome = socket.write_to_socket(reinterpret_cast<const uint8_t*>(&req), sizeof(req)) &&
+		socket.recv_from_socket(reinterpret_cast<uint8_t*>(&res), sizeof(res)) && res.hdr.res_code == RES_MSG_CONFIRM;
+	return timed(code, outcome, start);
+}
+
+LoadGenerator::LoadGenerator(const LoadConfig& config) : config(config), elapsed(0)
+{
+	uint8_t tag[4];
+	AESWrapper::GenerateKey(tag, sizeof(tag));
+	std::ostringstream text;
+	for (uint8_t c : tag)
+		text << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c);
+	run_tag = text.str();
+}
+
+const char* LoadGenerator::request_name(uint16_t code)
+{
+	switch (code)
+	{
+	case LOAD_CONNECT: return "connect";
+	case REQ_REGISTRATION: return "registration";
+	case REQ_PUBLIC_KEY: return "public key";
+	case REQ_FILE: return "file";
+	case REQ_VALID_CRC: return "valid CRC";
+	case REQ_NVALID_CRC: return "not valid CRC";
+	case REQ_4NVALID_CRC: return "4th not valid CRC";
+	default: return "";
+	}
+}
+
+// a client thread, starts at its place in the ramp-up and runs its sessions
+void LoadGenerator::run_client(unsigned int index, const std::string& private_key, LoadStats& stats) const
+{
+	if (config.ramp_up > 0)
+		std::this_thread::sleep_for(std::chrono::duration<double>(config.ramp_up * index / config.clients));
+	LoadClient client(config, "load " + run_tag + " " + std::to_string(index), private_key,
+		std::hash<std::string>()(run_tag) + index, stats);
+	for (unsigned int number = 0; number < config.sessions; ++number)
+		client.session(number);
+}
+
+// run all the clients to the end, the RSA keys of the clients are generated before the load starts
+bool LoadGenerator::run()
+{
+	std::cout << "generating " << config.clients << " RSA keys" << std::endl;
+	std::vector<std::string> private_keys;
+	for (unsigned int i = 0; i < config.clients; ++i)
+		private_keys.push_back(RSAPrivateWrapper().getPrivateKey());
+
+	std::cout << config.clients << " clients x " << config.sessions << " sessions against " << config.address << ":" << config.port
+		<< ", file size " << config.file_size.describe() << ", think time " << config.think_time << " ms, ramp-up "
+		<< config.ramp_up << " s, CRC failure rate " << config.crc_fail_rate << std::endl;
+	std::vector<LoadStats> stats(config.clients);
+	std::vector<std::thread> threads;
+	const auto start = Clock::now();
+	for (unsigned int i = 0; i < config.clients; ++i)
+		threads.emplace_back(&LoadGenerator::run_client, this, i, std::cref(private_keys[i]), std::ref(stats[i]));
+	for (std::thread& thread : threads)
+		thread.join();
+	elapsed = milliseconds_since(start) / 1000;
+
+	for (const LoadStats& client_stats : stats)
+		total.merge(client_stats);
+	for (auto& request : total.requests)
+		std::sort(request.second.latencies.begin(), request.second.latencies.end());
+	return total.failed_sessions == 0;
+}
+
+// latency (of sorted latencies) at a fraction of them, nearest rank
+static double percentile(const std::vector<double>& latencies, double fraction)
+{
+	if (latencies.empty())
+		return 0;
+	const size_t rank = static_cast<size_t>(std::ceil(fraction * latencies.size()));
+	return latencies[std::min(latencies.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static uint64_t requests_count(const LoadStats& stats)
+{
+	uint64_t count = 0;
+	for (const auto& request : stats.requests)
+		count += (request.first != LOAD_CONNECT) ? request.second.latencies.size() : 0;
+	return count;
+}
+
+void LoadGenerator::report() const
+{
+	const double seconds = std::max(elapsed, 1e-9);
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << total.sessions << " sessions (" << total.failed_sessions << " failed) in " << elapsed << " s: "
+		<< total.sessions / seconds << " sessions/s, " << requests_count(total) / seconds << " requests/s, "
+		<< total.file_bytes / seconds / (1024 * 1024) << " MB/s of files" << std::endl;
+	std::cout << "CRC failures: " << total.injected_failures << " injected, " << total.cksum_mismatches << " real" << std::endl;
+	std::cout << std::left << std::setw(26) << "request" << std::right << std::setw(9) << "count" << std::setw(8) << "errors"
+		<< std::setw(11) << "p50 ms" << std::setw(11) << "p99 ms" << std::setw(11) << "p999 ms" << std::endl;
+	for (const auto& request : total.requests)
+	{
+		const std::string name = (request.first == LOAD_CONNECT ? std::string() : std::to_string(request.first) + " ") + request_name(request.first);
+		const std::vector<double>& latencies = request.second.latencies;
+		std::cout << std::left << std::setw(26) << name << std::right << std::setw(9) << latencies.size() << std::setw(8) << request.second.errors
+			<< std::setw(11) << percentile(latencies, 0.5) << std::setw(11) << percentile(latencies, 0.99)
+			<< std::setw(11) << percentile(latencies, 0.999) << std::endl;
+	}
+	std::cout.unsetf(std::ios::floatfield);
+}
+
+// the summary as a JSON object: the configuration, throughput and the latencies of every request code
+bool LoadGenerator::write_json(const std::string& path) const
+{
+	std::ofstream out(path);
+	if (!out)
+	{
+		std::cout << "couldn't write " << path << std::endl;
+		return false;
+	}
+	const double seconds = std::max(elapsed, 1e-9);
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"config\": {\"server\": \"" << config.address << ":" << config.port << "\", \"clients\": " << config.clients
+		<< ", \"sessions\": " << config.sessions << ", \"file_size\": \"" << config.file_size.describe() << "\", \"think_time_ms\": "
+		<< config.think_time << ", \"ramp_up_s\": " << config.ramp_up << ", \"crc_fail_rate\": " << config.crc_fail_rate << "},\n";
+	out << "  \"elapsed_s\": " << elapsed << ",\n  \"sessions\": " << total.sessions << ",\n  \"failed_sessions\": " << total.failed_sessions
+		<< ",\n  \"sessions_per_s\": " << total.sessions / seconds << ",\n  \"requests_per_s\": " << requests_count(total) / seconds
+		<< ",\n  \"file_bytes\": " << total.file_bytes << ",\n  \"file_mb_per_s\": " << total.file_bytes / seconds / (1024 * 1024)
+		<< ",\n  \"injected_crc_failures\": " << total.injected_failures << ",\n  \"cksum_mismatches\": " << total.cksum_mismatches
+		<< ",\n  \"requests\": {";
+	bool first = true;
+	for (const auto& request : total.requests)
+	{
+		const std::vector<double>& latencies = request.second.latencies;
+		double sum = 0;
+		for (double latency : latencies)
+			sum += latency;
+		out << (first ? "\n" : ",\n") << "    \"" << request.first << "\": {\"name\": \"" << request_name(request.first) << "\", \"count\": "
+			<< latencies.size() << ", \"errors\": " << request.second.errors << ", \"mean_ms\": " << (latencies.empty() ? 0 : sum / latencies.size())
+			<< ", \"p50_ms\": " << percentile(latencies, 0.5) << ", \"p99_ms\": " << percentile(latencies, 0.99) << ", \"p999_ms\": "
+			<< percentile(latencies, 0.999) << ", \"max_ms\": " << (latencies.empty() ? 0 : latencies.back()) << "}";
+		first = false;
+	}
+	out << "\n  }\n}\n";
+	return static_cast<bool>(out);
+}
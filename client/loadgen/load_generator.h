@@ -0,0 +1,92 @@
+/*
+	TransferIt client
+	load_generator.h
+	description: header file for load_generator.cpp
+*/
+
+#pragma once
+
+#include "../client/networkProtocol.h"
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// pseudo request code of the connection of a session (timed as a request)
+const uint16_t LOAD_CONNECT = 0;
+
+// file sizes of the load sessions: FIXED - a (bytes), UNIFORM - between a and b, LOGNORMAL - median a, sigma b
+struct SizeDistribution
+{
+	enum Kind { FIXED, UNIFORM, LOGNORMAL } kind;
+	double a;
+	double b;
+
+	SizeDistribution() : kind(FIXED), a(1024 * 1024), b(0) {}
+	bool parse(const std::string& spec);
+	size_t sample(std::mt19937_64& gen, size_t max_size) const;
+	std::string describe() const;
+};
+
+struct LoadConfig
+{
+	std::string address;
+	std::string port;
+	unsigned int clients; // concurrent clients, a thread (and a connection) each
+	unsigned int sessions; // sessions every client runs, one after the other
+	SizeDistribution file_size;
+	size_t max_file_size;
+	double think_time; // mean milliseconds between the requests of a session (exponentially distributed), 0 - none
+	double ramp_up; // seconds over which the clients start, evenly spread
+	double crc_fail_rate; // fraction of the CRC checks which are reported as not valid (REQ_NVALID_CRC, the file is sent again)
+	std::string json_path; // the summary is also written there as JSON (if not empty)
+
+	LoadConfig() : address("127.0.0.1"), port("1234"), clients(8), sessions(10), max_file_size(64 * 1024 * 1024),
+		think_time(0), ramp_up(0), crc_fail_rate(0) {}
+};
+
+// latencies (milliseconds) & failures of one request code
+struct RequestStats
+{
+	std::vector<double> latencies;
+	uint64_t errors = 0;
+};
+
+// what one client (or all of them, merged) measured
+struct LoadStats
+{
+	std::map<uint16_t, RequestStats> requests;
+	uint64_t sessions = 0;
+	uint64_t failed_sessions = 0;
+	uint64_t file_bytes = 0; // file content (before encryption) the server acknowledged, resent files included
+	uint64_t cksum_mismatches = 0; // files whose cksum from the server didn't match (not injected failures)
+	uint64_t injected_failures = 0;
+
+	void merge(const LoadStats& other);
+};
+
+/*
+	simulates concurrent clients, every client runs whole sessions against a server: connect, registration, public key,
+	file (resent after every not valid CRC), CRC. the requests are the ones the client sends (networkProtocol.h) over
+	SocketHandler, the version of every session is negotiated as the client does. the latency of a request is the time
+	from writing it until its response arrived (file content is encrypted before the request is timed).
+*/
+class LoadGenerator
+{
+private:
+	LoadConfig config;
+	std::string run_tag; // usernames of a run are unique, so runs can be repeated against the same server
+	LoadStats total;
+	double elapsed; // seconds
+
+	void run_client(unsigned int index, const std::string& private_key, LoadStats& stats) const;
+
+public:
+	LoadGenerator(const LoadConfig& config);
+
+	bool run();
+	void report() const;
+	bool write_json(const std::string& path) const;
+	static const char* request_name(uint16_t code);
+};
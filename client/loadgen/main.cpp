@@ -0,0 +1,104 @@
+/*
+	TransferIt client
+	main.cpp
+	description: entry point of the load generator
+*/
+
+#include "load_generator.h"
+#include "../client/socket_handler.h"
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+	LoadConfig config;
+	SocketHandler validator;
+
+	// options: --server ADDR:PORT - the server to load (default 127.0.0.1:1234)
+	//          --clients N - concurrent clients, --sessions N - sessions every client runs
+	//          --file-size fixed:SIZE|uniform:MIN:MAX|lognormal:MEDIAN:SIGMA - file size of each session (K / M / G suffixes)
+	//          --max-file-size SIZE - bound of the sampled file sizes
+	//          --think MS - mean think time between requests, --ramp-up S - seconds over which the clients start
+	//          --crc-fail RATE - fraction of the CRC checks reported as not valid (the file is sent again)
+	//          --json PATH - write the summary as JSON too
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string option = argv[i];
+		try
+		{
+			if (option == "--server" && i + 1 < argc)
+			{
+				const std::string server = argv[++i];
+				const size_t colon = server.rfind(':');
+				if (colon != std::string::npos && validator.addr_validation(server.substr(0, colon)) &&
+					validator.port_validation(server.substr(colon + 1)))
+				{
+					config.address = server.substr(0, colon);
+					config.port = server.substr(colon + 1);
+					continue;
+				}
+			}
+			else if (option == "--clients" && i + 1 < argc)
+			{
+				config.clients = std::stoul(argv[++i]);
+				if (config.clients > 0)
+					continue;
+			}
+			else if (option == "--sessions" && i + 1 < argc)
+			{
+				config.sessions = std::stoul(argv[++i]);
+				if (config.sessions > 0)
+					continue;
+			}
+			else if (option == "--file-size" && i + 1 < argc)
+			{
+				if (config.file_size.parse(argv[++i]))
+					continue;
+			}
+			else if (option == "--max-file-size" && i + 1 < argc)
+			{
+				SizeDistribution max_size;
+				if (max_size.parse(std::string("fixed:") + argv[++i]))
+				{
+					config.max_file_size = static_cast<size_t>(max_size.a);
+					continue;
+				}
+			}
+			else if (option == "--think" && i + 1 < argc)
+			{
+				config.think_time = std::stod(argv[++i]);
+				if (config.think_time >= 0)
+					continue;
+			}
+			else if (option == "--ramp-up" && i + 1 < argc)
+			{
+				config.ramp_up = std::stod(argv[++i]);
+				if (config.ramp_up >= 0)
+					continue;
+			}
+			else if (option == "--crc-fail" && i + 1 < argc)
+			{
+				config.crc_fail_rate = std::stod(argv[++i]);
+				if (config.crc_fail_rate >= 0 && config.crc_fail_rate <= 1)
+					continue;
+			}
+			else if (option == "--json" && i + 1 < argc)
+			{
+				config.json_path = argv[++i];
+				continue;
+			}
+		}
+		catch (std::exception& e) {}
+		std::cout << "usage: " << argv[0] << " [--server ADDR:PORT] [--clients N] [--sessions N]"
+			<< " [--file-size fixed:SIZE|uniform:MIN:MAX|lognormal:MEDIAN:SIGMA] [--max-file-size SIZE]"
+			<< " [--think MS] [--ramp-up S] [--crc-fail RATE (0-1)] [--json PATH]" << std::endl;
+		return 1;
+	}
+
+	LoadGenerator generator(config);
+	const bool all_sessions = generator.run();
+	generator.report();
+	if (!config.json_path.empty() && !generator.write_json(config.json_path))
+		return 1;
+	return all_sessions ? 0 : 2;
+}
@@ -0,0 +1,74 @@
+/*
+	TransferIt client
+	aes_ctr_test.cpp
+	description: test of the AES-CTR key stream at an offset (AESWrapper::ctr_process, which the segments of a CTR
+	update are encrypted with) against one CryptoPP CTR pass from the start of the stream. the iv counters are random
+	and near a byte overflow, so the block counter of an offset carries into the bytes above it
+*/
+
+#include "../client/AESWrapper.h"
+#include <modes.h>
+#include <aes.h>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static const size_t STREAM_SIZE = 2 * 1024 * 1024; // bytes of the key stream every iv is checked on
+
+// offset, length of the ranges of the stream which are encrypted on their own
+static const size_t RANGES[][2] = {
+	{ 0, 1 }, { 1, 15 }, { 16, 16 }, { 5, 4096 }, { 255 * 16, 32 }, { 256 * 16 - 3, 7 }, { 4095 * 16 + 9, 100 },
+	{ 65536 * 16 - 16, 48 }, { 70000 * 16 + 1, 64 * 1024 }, { STREAM_SIZE - 17, 17 }
+};
+
+// an iv of a random nonce & a random counter whose low bytes (low_bytes of them) are 0xFF - a small random value
+static void random_iv(std::mt19937_64& gen, uint8_t* iv, size_t low_bytes)
+{
+	for (size_t i = 0; i < CLT_SYMMETRICKEY_SIZE; ++i)
+		iv[i] = static_cast<uint8_t>(gen());
+	iv[8] &= 0x7F; // the 64-bit counter doesn't overflow into the nonce
+	for (size_t i = CLT_SYMMETRICKEY_SIZE - low_bytes; i < CLT_SYMMETRICKEY_SIZE; ++i)
+		iv[i] = 0xFF;
+	iv[CLT_SYMMETRICKEY_SIZE - 1] -= static_cast<uint8_t>(gen() % 16);
+}
+
+int main()
+{
+	std::mt19937_64 gen(std::random_device{}());
+	CltSymmetricKey key;
+	for (uint8_t& b : key.symmetric_key)
+		b = static_cast<uint8_t>(gen());
+
+	std::vector<uint8_t> plain(STREAM_SIZE);
+	for (uint8_t& b : plain)
+		b = static_cast<uint8_t>(gen());
+
+	int failures = 0;
+	for (size_t low_bytes = 1; low_bytes <= 4; ++low_bytes)
+	{
+		uint8_t iv[CLT_SYMMETRICKEY_SIZE];
+		random_iv(gen, iv, low_bytes);
+
+		std::vector<uint8_t> expected(STREAM_SIZE);
+		CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption ctr;
+		ctr.SetKeyWithIV(key.symmetric_key, sizeof(key.symmetric_key), iv, sizeof(iv));
+		ctr.ProcessData(expected.data(), plain.data(), plain.size());
+
+		for (const auto& range : RANGES)
+		{
+			std::vector<uint8_t> out(range[1]);
+			AESWrapper::ctr_process(key, iv, range[0], plain.data() + range[0], out.data(), out.size());
+			if (memcmp(out.data(), expected.data() + range[0], out.size()) != 0)
+			{
+				std::cout << "FAIL: counter with " << low_bytes << " low bytes near overflow, offset " << range[0]
+					<< ", length " << range[1] << std::endl;
+				failures += 1;
+			}
+		}
+	}
+
+	std::cout << (failures == 0 ? "PASS" : "FAIL") << std::endl;
+	return failures == 0 ? 0 : 1;
+}
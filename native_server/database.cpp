@@ -0,0 +1,414 @@
+/*
+	TransferIt server
+	database.cpp
+	description: the database of the native server (sqlite3), the same schema & queries as server/database.py
+*/
+
+#include "database.h"
+#include <sqlite3.h>
+#include <iostream>
+#include <set>
+#include <cstring>
+
+// pragmas of every connection, as server/database.py sets them
+static const char* const PRAGMAS[] = {
+	"PRAGMA journal_mode = WAL", // stored in the database file, kept by every connection after
+	"PRAGMA synchronous = NORMAL", // WAL is synced on checkpoints, not on every commit
+	"PRAGMA cache_size = -8192", // KB of page cache of every connection
+	"PRAGMA temp_store = MEMORY"
+};
+
+// schema migrations, the same as Database.MIGRATIONS of server/database.py (keep them in step): migration N (1-based)
+// upgrades a database of schema version N - 1 to N, the schema version of a database is kept in its user_version
+static const char* const MIGRATIONS[Database::SCHEMA_VERSION] = {
+	// 1 - clients, files, session tickets & the chunk store
+	R"(
+	CREATE TABLE IF NOT EXISTS clients(
+	ID CHAR(16) PRIMARY KEY,
+	Name CHAR(255) NOT NULL,
+	PublicKey CHAR(160),
+	LastSeen DATE,
+	AESKey CHAR(16));
+
+	CREATE TABLE IF NOT EXISTS files(
+	ID CHAR(16) NOT NULL,
+	FileName CHAR(255) NOT NULL,
+	PathName CHAR(160) NOT NULL,
+	Verified INTEGER CHECK(Verified = 0 or Verified = 1),
+	FOREIGN KEY(ID) REFERENCES clients(ID));
+
+	CREATE TABLE IF NOT EXISTS tickets(
+	ID CHAR(16) PRIMARY KEY,
+	Ticket CHAR(16) NOT NULL,
+	AESKey CHAR(16) NOT NULL,
+	Expires INTEGER NOT NULL,
+	FOREIGN KEY(ID) REFERENCES clients(ID));
+
+	CREATE TABLE IF NOT EXISTS chunks(
+	Hash CHAR(32) PRIMARY KEY,
+	Size INTEGER NOT NULL,
+	RefCount INTEGER NOT NULL);
+	)",
+	// 2 - keys & indexes of the lookup paths
+	R"(
+	DELETE FROM tickets WHERE ID IN (SELECT ID FROM clients WHERE rowid NOT IN
+		(SELECT MIN(rowid) FROM clients GROUP BY Name));
+	DELETE FROM clients WHERE rowid NOT IN (SELECT MIN(rowid) FROM clients GROUP BY Name);
+	CREATE UNIQUE INDEX clients_name ON clients(Name);
+
+	CREATE TABLE files_keyed(
+	ID CHAR(16) NOT NULL,
+	FileName CHAR(255) NOT NULL,
+	PathName CHAR(160) NOT NULL,
+	Verified INTEGER CHECK(Verified = 0 or Verified = 1),
+	PRIMARY KEY(ID, FileName),
+	FOREIGN KEY(ID) REFERENCES clients(ID));
+	INSERT INTO files_keyed SELECT ID, FileName, PathName, Verified FROM files
+		WHERE rowid IN (SELECT MAX(rowid) FROM files GROUP BY ID, FileName);
+	DROP TABLE files;
+	ALTER TABLE files_keyed RENAME TO files;
+
+	CREATE INDEX chunks_unreferenced ON chunks(Hash) WHERE RefCount <= 0;
+	)"
+};
+
+static DbParam id_param(const CltId& clt_id)
+{
+	return DbParam::blob(clt_id.uuid, sizeof(clt_id.uuid));
+}
+
+Database::Database(const std::string& db_name) : db_name(db_name), conn(nullptr) {}
+
+Database::~Database()
+{
+	flush_last_seen();
+	for (auto& statement : statements)
+		sqlite3_finalize(statement.second);
+	if (conn != nullptr)
+		sqlite3_close(conn);
+}
+
+// open the connection (once) and set its pragmas
+bool Database::connect()
+{
+	if (conn != nullptr)
+		return true;
+	if (sqlite3_open_v2(db_name.c_str(), &conn, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK)
+	{
+		std::cout << "database " << db_name << " couldn't be opened: " << sqlite3_errmsg(conn) << std::endl;
+		sqlite3_close(conn);
+		conn = nullptr;
+		return false;
+	}
+	sqlite3_busy_timeout(conn, BUSY_TIMEOUT);
+	for (const char* pragma : PRAGMAS)
+	{
+		if (sqlite3_exec(conn, pragma, nullptr, nullptr, nullptr) != SQLITE_OK)
+		{
+			std::cout << pragma << " failed: " << sqlite3_errmsg(conn) << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// create the database tables / upgrade them to SCHEMA_VERSION, every migration is applied in a transaction of its own
+bool Database::tables_init()
+{
+	if (!connect())
+		return false;
+	const int current = schema_version();
+	if (current < 0)
+		return false;
+	if (current > SCHEMA_VERSION)
+	{
+		std::cout << " database schema version " << current << " is newer than this server (" << SCHEMA_VERSION << ")" << std::endl;
+		return false;
+	}
+	for (int number = current + 1; number <= SCHEMA_VERSION; ++number)
+	{
+		const std::string script = "BEGIN; " + std::string(MIGRATIONS[number - 1]) + " PRAGMA user_version = " + std::to_string(number) + "; COMMIT;";
+		char* error = nullptr;
+		if (sqlite3_exec(conn, script.c_str(), nullptr, nullptr, &error) != SQLITE_OK)
+		{
+			std::cout << " database schema couldn't be upgraded, details: " << (error != nullptr ? error : "") << std::endl;
+			sqlite3_free(error);
+			sqlite3_exec(conn, "ROLLBACK", nullptr, nullptr, nullptr);
+			return false;
+		}
+	}
+	if (SCHEMA_VERSION > current)
+		std::cout << " database schema upgraded from version " << current << " to " << SCHEMA_VERSION << std::endl;
+	return true;
+}
+
+// Return the schema version of the database (-1 on failure)
+int Database::schema_version()
+{
+	std::vector<std::string> row;
+	if (!query_row("PRAGMA user_version", {}, row) || row.empty())
+		return -1;
+	return std::stoi(row[0]);
+}
+
+// the prepared statement of a query, prepared on its first use and kept
+sqlite3_stmt* Database::prepare(const std::string& query)
+{
+	if (!connect())
+		return nullptr;
+	auto found = statements.find(query);
+	if (found != statements.end())
+		return found->second;
+	sqlite3_stmt* statement = nullptr;
+	if (sqlite3_prepare_v2(conn, query.c_str(), static_cast<int>(query.size()), &statement, nullptr) != SQLITE_OK)
+	{
+		std::cout << sqlite3_errmsg(conn) << std::endl;
+		return nullptr;
+	}
+	statements[query] = statement;
+	return statement;
+}
+
+bool Database::bind(sqlite3_stmt* statement, std::initializer_list<DbParam> params)
+{
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
+	int index = 1;
+	for (const DbParam& param : params)
+	{
+		int result = SQLITE_OK;
+		if (param.type == DbParam::BLOB)
+			result = sqlite3_bind_blob(statement, index, param.value.data(), static_cast<int>(param.value.size()), SQLITE_TRANSIENT);
+		else if (param.type == DbParam::TEXT)
+			result = sqlite3_bind_text(statement, index, param.value.data(), static_cast<int>(param.value.size()), SQLITE_TRANSIENT);
+		else
+			result = sqlite3_bind_int64(statement, index, param.number);
+		if (result != SQLITE_OK)
+			return false;
+		++index;
+	}
+	return true;
+}
+
+// execute a write (a transaction of its own unless one is open), changes is set to the number of rows it changed
+bool Database::execute(const std::string& query, std::initializer_list<DbParam> params, int* changes)
+{
+	sqlite3_stmt* statement = prepare(query);
+	if (statement == nullptr || !bind(statement, params))
+		return false;
+	const int result = sqlite3_step(statement);
+	sqlite3_reset(statement);
+	if (result != SQLITE_DONE && result != SQLITE_ROW)
+	{
+		std::cout << sqlite3_errmsg(conn) << std::endl;
+		return false;
+	}
+	if (changes != nullptr)
+		*changes = sqlite3_changes(conn);
+	return true;
+}
+
+// execute a query, row is set to the columns of its first row (empty if there is no row)
+bool Database::query_row(const std::string& query, std::initializer_list<DbParam> params, std::vector<std::string>& row)
+{
+	row.clear();
+	sqlite3_stmt* statement = prepare(query);
+	if (statement == nullptr || !bind(statement, params))
+		return false;
+	const int result = sqlite3_step(statement);
+	if (result == SQLITE_ROW)
+	{
+		for (int i = 0; i < sqlite3_column_count(statement); ++i)
+		{
+			const void* value = sqlite3_column_blob(statement, i);
+			row.emplace_back(value != nullptr ? static_cast<const char*>(value) : "", static_cast<size_t>(sqlite3_column_bytes(statement, i)));
+		}
+	}
+	sqlite3_reset(statement);
+	if (result != SQLITE_ROW && result != SQLITE_DONE)
+	{
+		std::cout << sqlite3_errmsg(conn) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Database::clt_id_exists(const CltId& clt_id)
+{
+	std::vector<std::string> row;
+	return query_row("SELECT 1 FROM clients WHERE ID = ?", { id_param(clt_id) }, row) && !row.empty();
+}
+
+bool Database::clt_username_exists(const std::string& username)
+{
+	std::vector<std::string> row;
+	return query_row("SELECT 1 FROM clients WHERE Name = ?", { DbParam::text(username) }, row) && !row.empty();
+}
+
+// store a new client, keys are set later. the username is checked in the same write, so two sessions which register the
+// same username at once don't both succeed
+bool Database::store_clt(const CltId& clt_id, const std::string& username, const std::string& last_seen_time)
+{
+	int changes = 0;
+	return execute("INSERT INTO clients SELECT ?, ?, NULL, ?, NULL WHERE NOT EXISTS (SELECT 1 FROM clients WHERE Name = ?)",
+		{ id_param(clt_id), DbParam::text(username), DbParam::text(last_seen_time), DbParam::text(username) }, &changes) && changes == 1;
+}
+
+bool Database::get_clt_username(const CltId& clt_id, std::string& username)
+{
+	std::vector<std::string> row;
+	if (!query_row("SELECT Name FROM clients WHERE ID = ?", { id_param(clt_id) }, row) || row.empty() || row[0].empty())
+		return false;
+	username = row[0];
+	return true;
+}
+
+// false if the client has no AES key (yet)
+bool Database::get_clt_aes_key(const CltId& clt_id, CltSymmetricKey& aes_key)
+{
+	std::vector<std::string> row;
+	if (!query_row("SELECT AESKey FROM clients WHERE ID = ?", { id_param(clt_id) }, row) || row.empty() ||
+		row[0].size() != sizeof(aes_key.symmetric_key))
+		return false;
+	memcpy(aes_key.symmetric_key, row[0].data(), sizeof(aes_key.symmetric_key));
+	return true;
+}
+
+// the public key of the client of the given ID & username
+bool Database::set_public_key(const CltId& clt_id, const std::string& username, const CltPublicKey& public_key)
+{
+	int changes = 0;
+	return execute("UPDATE clients SET PublicKey = ? WHERE ID = ? AND Name = ?",
+		{ DbParam::blob(public_key.public_key, sizeof(public_key.public_key)), id_param(clt_id), DbParam::text(username) }, &changes) && changes == 1;
+}
+
+bool Database::set_aes_key(const CltId& clt_id, const CltSymmetricKey& aes_key)
+{
+	int changes = 0;
+	return execute("UPDATE clients SET AESKey = ? WHERE ID = ?",
+		{ DbParam::blob(aes_key.symmetric_key, sizeof(aes_key.symmetric_key)), id_param(clt_id) }, &changes) && changes == 1;
+}
+
+// the LastSeen of a client is written on the next flush_last_seen (not waited for)
+void Database::set_last_seen(const CltId& clt_id, const std::string& last_seen_time)
+{
+	last_seen[std::string(reinterpret_cast<const char*>(clt_id.uuid), sizeof(clt_id.uuid))] = last_seen_time;
+}
+
+// write the LastSeen updates which were collected so far, in one transaction
+bool Database::flush_last_seen()
+{
+	if (last_seen.empty())
+		return true;
+	if (!connect() || sqlite3_exec(conn, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK)
+	{
+		last_seen.clear();
+		return false;
+	}
+	bool result = true;
+	for (const auto& entry : last_seen)
+	{
+		result = execute("UPDATE clients SET LastSeen = ? WHERE ID = ?",
+			{ DbParam::text(entry.second), DbParam::blob(reinterpret_cast<const uint8_t*>(entry.first.data()), entry.first.size()) }) && result;
+	}
+	last_seen.clear();
+	if (sqlite3_exec(conn, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK)
+	{
+		std::cout << sqlite3_errmsg(conn) << std::endl;
+		sqlite3_exec(conn, "ROLLBACK", nullptr, nullptr, nullptr);
+		return false;
+	}
+	return result;
+}
+
+// the ticket of a client, replaces the ticket issued to it before
+bool Database::set_ticket(const CltId& clt_id, const SessionTicket& ticket, const CltSymmetricKey& aes_key, int64_t expires)
+{
+	return execute("INSERT OR REPLACE INTO tickets VALUES (?, ?, ?, ?)",
+		{ id_param(clt_id), DbParam::blob(ticket.ticket, sizeof(ticket.ticket)),
+		DbParam::blob(aes_key.symmetric_key, sizeof(aes_key.symmetric_key)), DbParam::integer(expires) });
+}
+
+// false if the client has no (valid) ticket
+bool Database::get_ticket(const CltId& clt_id, SessionTicket& ticket, CltSymmetricKey& aes_key, int64_t& expires)
+{
+	std::vector<std::string> row;
+	if (!query_row("SELECT Ticket, AESKey, Expires FROM tickets WHERE ID = ?", { id_param(clt_id) }, row) || row.size() != 3 ||
+		row[0].size() != sizeof(ticket.ticket) || row[1].size() != sizeof(aes_key.symmetric_key))
+		return false;
+	memcpy(ticket.ticket, row[0].data(), sizeof(ticket.ticket));
+	memcpy(aes_key.symmetric_key, row[1].data(), sizeof(aes_key.symmetric_key));
+	expires = std::stoll(row[2]);
+	return true;
+}
+
+bool Database::remove_ticket(const CltId& clt_id)
+{
+	return execute("DELETE FROM tickets WHERE ID = ?", { id_param(clt_id) });
+}
+
+bool Database::file_exists(const CltId& clt_id, const std::string& file_name)
+{
+	std::vector<std::string> row;
+	return query_row("SELECT 1 FROM files WHERE FileName = ? AND ID = ?", { DbParam::text(file_name), id_param(clt_id) }, row) && !row.empty();
+}
+
+// a new file entry, not verified until its cksum is confirmed (see set_file_verify)
+bool Database::store_file(const CltId& clt_id, const std::string& file_name, const std::string& path_name)
+{
+	return execute("INSERT INTO files VALUES (?, ?, ?, 0)", { id_param(clt_id), DbParam::text(file_name), DbParam::text(path_name) });
+}
+
+bool Database::set_file_path(const CltId& clt_id, const std::string& file_name, const std::string& path_name)
+{
+	return execute("UPDATE files SET PathName = ? WHERE ID = ? AND FileName = ?",
+		{ DbParam::text(path_name), id_param(clt_id), DbParam::text(file_name) });
+}
+
+bool Database::set_file_verify(int verified, const CltId& clt_id, const std::string& file_name)
+{
+	if (verified != 0 && verified != 1)
+		return false;
+	return execute("UPDATE files SET Verified = ? WHERE ID = ? AND FileName = ?",
+		{ DbParam::integer(verified), id_param(clt_id), DbParam::text(file_name) });
+}
+
+bool Database::remove_file(const CltId& clt_id, const std::string& file_name)
+{
+	return execute("DELETE FROM files WHERE ID = ? AND FileName = ?", { id_param(clt_id), DbParam::text(file_name) });
+}
+
+// remove a reference from every given chunk (a chunk which is given twice loses two), the chunks which are not referenced
+// anymore are removed, released is set to their hashes (their content should be deleted), all in one transaction
+bool Database::release_chunks(const std::vector<ChunkRef>& chunks, std::vector<std::string>& released)
+{
+	released.clear();
+	if (!connect() || sqlite3_exec(conn, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr) != SQLITE_OK)
+		return false;
+	bool result = true;
+	std::set<std::string> hashes;
+	for (const ChunkRef& chunk : chunks)
+	{
+		const DbParam hash = DbParam::blob(chunk.hash, sizeof(chunk.hash));
+		result = result && execute("UPDATE chunks SET RefCount = RefCount - 1 WHERE Hash = ?", { hash });
+		hashes.insert(hash.value);
+	}
+	std::vector<std::string> row;
+	for (auto hash = hashes.begin(); result && hash != hashes.end(); ++hash)
+	{
+		const DbParam param = DbParam::blob(reinterpret_cast<const uint8_t*>(hash->data()), hash->size());
+		result = query_row("SELECT 1 FROM chunks WHERE RefCount <= 0 AND Hash = ?", { param }, row);
+		if (result && !row.empty())
+		{
+			result = execute("DELETE FROM chunks WHERE Hash = ?", { param });
+			released.push_back(*hash);
+		}
+	}
+	if (!result || sqlite3_exec(conn, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK)
+	{
+		sqlite3_exec(conn, "ROLLBACK", nullptr, nullptr, nullptr);
+		released.clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,88 @@
+/*
+	TransferIt server
+	database.h
+	description: header file for database.cpp
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <initializer_list>
+#include "networkProtocol.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+const std::string DATABASE_NAME = "server.db";
+
+// a query parameter, of the type server/database.py binds it with: IDs & keys are blobs (bytes), names & paths are text
+// (str), numbers are integers
+struct DbParam
+{
+	enum Type { BLOB, TEXT, INTEGER } type;
+	std::string value;
+	int64_t number;
+
+	static DbParam blob(const uint8_t* data, size_t size) { return { BLOB, std::string(reinterpret_cast<const char*>(data), size), 0 }; }
+	static DbParam text(const std::string& value) { return { TEXT, value, 0 }; }
+	static DbParam integer(int64_t number) { return { INTEGER, std::string(), number }; }
+};
+
+/* the server database, the same schema as server/database.py (tables clients, files, tickets & chunks, schema version in
+user_version). every worker thread keeps one connection open (a Database object), which keeps its prepared statements.
+the database is in WAL mode, a write is a transaction of its own, except the LastSeen updates which are collected and
+committed together whenever the worker has no job waiting (see set_last_seen / flush_last_seen) */
+class Database
+{
+public:
+	static const int SCHEMA_VERSION = 2; // the latest migration, see MIGRATIONS in database.cpp
+	static const int BUSY_TIMEOUT = 10000; // milliseconds a connection waits for the write lock of another connection
+
+private:
+	std::string db_name;
+	sqlite3* conn;
+	std::map<std::string, sqlite3_stmt*> statements; // prepared statements by their query
+	std::map<std::string, std::string> last_seen; // LastSeen of clients (by client ID) which is not written yet
+
+	sqlite3_stmt* prepare(const std::string& query);
+	bool execute(const std::string& query, std::initializer_list<DbParam> params, int* changes = nullptr);
+	bool query_row(const std::string& query, std::initializer_list<DbParam> params, std::vector<std::string>& row);
+	bool bind(sqlite3_stmt* statement, std::initializer_list<DbParam> params);
+
+public:
+	Database(const std::string& db_name = DATABASE_NAME);
+	virtual ~Database();
+
+	bool connect();
+	bool tables_init();
+	int schema_version();
+
+	// clients
+	bool clt_id_exists(const CltId& clt_id);
+	bool clt_username_exists(const std::string& username);
+	bool store_clt(const CltId& clt_id, const std::string& username, const std::string& last_seen_time);
+	bool get_clt_username(const CltId& clt_id, std::string& username);
+	bool get_clt_aes_key(const CltId& clt_id, CltSymmetricKey& aes_key);
+	bool set_public_key(const CltId& clt_id, const std::string& username, const CltPublicKey& public_key);
+	bool set_aes_key(const CltId& clt_id, const CltSymmetricKey& aes_key);
+	void set_last_seen(const CltId& clt_id, const std::string& last_seen_time);
+	bool flush_last_seen();
+
+	// session tickets
+	bool set_ticket(const CltId& clt_id, const SessionTicket& ticket, const CltSymmetricKey& aes_key, int64_t expires);
+	bool get_ticket(const CltId& clt_id, SessionTicket& ticket, CltSymmetricKey& aes_key, int64_t& expires);
+	bool remove_ticket(const CltId& clt_id);
+
+	// files
+	bool file_exists(const CltId& clt_id, const std::string& file_name);
+	bool store_file(const CltId& clt_id, const std::string& file_name, const std::string& path_name);
+	bool set_file_path(const CltId& clt_id, const std::string& file_name, const std::string& path_name);
+	bool set_file_verify(int verified, const CltId& clt_id, const std::string& file_name);
+	bool remove_file(const CltId& clt_id, const std::string& file_name);
+
+	// the chunk store (files which were stored by their content defined chunks, by a server of VERSION_DEDUP)
+	bool release_chunks(const std::vector<ChunkRef>& chunks, std::vector<std::string>& released);
+};
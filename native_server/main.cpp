@@ -0,0 +1,70 @@
+/*
+	TransferIt server
+	main.cpp
+	description: entry point for the native server startup, run it from the server directory (port.info, server.db and
+	the client files directories are the ones server/main.py uses)
+*/
+
+#include "server.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+const uint16_t DEFAULT_PORT = 1234;
+
+// read the port from the 1st line of file_path, DEFAULT_PORT on failure
+static uint16_t acquire_port(const std::string& file_path)
+{
+	std::ifstream port_file(file_path);
+	std::string line;
+	try
+	{
+		if (std::getline(port_file, line))
+		{
+			const unsigned long port = std::stoul(line);
+			if (port > 0 && port <= UINT16_MAX)
+				return static_cast<uint16_t>(port);
+		}
+	}
+	catch (std::exception& e) {}
+	return DEFAULT_PORT;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	bool verbose = false;
+
+	// options: --threads N - number of reactors (default: the number of cores)
+	//          --verbose - print a line for every request which was handled, not only for failures
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string option = argv[i];
+		if (option == "--threads" && i + 1 < argc)
+		{
+			try
+			{
+				threads = std::stoul(argv[++i]);
+				if (threads > 0)
+					continue;
+			}
+			catch (std::exception& e) {}
+		}
+		else if (option == "--verbose")
+		{
+			verbose = true;
+			continue;
+		}
+		std::cout << "usage: " << argv[0] << " [--threads N] [--verbose]" << std::endl;
+		return 1;
+	}
+
+	Server svr(acquire_port("port.info"), threads, verbose);
+	if (!svr.svr_startup())
+	{
+		std::cout << "server couldn't finish appropriately, server will stop now " << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,546 @@
+/*
+	TransferIt server
+	server.cpp
+	description: main loop of the native server, one epoll reactor per thread, see server.h
+*/
+
+#include "server.h"
+#include "session.h"
+#include "database.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::mutex log_lock;
+
+/* the worker threads, which run the jobs of the sessions of all the reactors (the steps of the requests which block:
+database queries & writes, RSA, committing files). every worker keeps one database connection open, the LastSeen
+updates of the jobs it ran are committed together whenever no job waits */
+class Workers
+{
+	std::vector<std::unique_ptr<Database>> databases;
+	std::vector<std::thread> threads;
+	std::deque<std::function<void(Database&)>> jobs;
+	std::mutex jobs_lock;
+	std::condition_variable jobs_ready;
+	bool stopping;
+
+	void run(Database& database);
+	bool idle();
+
+public:
+	Workers() : stopping(false) {}
+	virtual ~Workers();
+
+	bool start(unsigned int count);
+	void post(std::function<void(Database&)> job);
+};
+
+Workers::~Workers()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobs_lock);
+		stopping = true;
+	}
+	jobs_ready.notify_all();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+// open the database connections & start the worker threads, false if a connection couldn't be opened
+bool Workers::start(unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		databases.emplace_back(new Database());
+		if (!databases.back()->connect())
+			return false;
+	}
+	for (auto& database : databases)
+		threads.emplace_back(&Workers::run, this, std::ref(*database));
+	return true;
+}
+
+void Workers::post(std::function<void(Database&)> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobs_lock);
+		jobs.push_back(std::move(job));
+	}
+	jobs_ready.notify_one();
+}
+
+void Workers::run(Database& database)
+{
+	while (true)
+	{
+		std::function<void(Database&)> job;
+		{
+			std::unique_lock<std::mutex> lock(jobs_lock);
+			jobs_ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job(database);
+		if (idle())
+			database.flush_last_seen();
+	}
+}
+
+bool Workers::idle()
+{
+	std::lock_guard<std::mutex> lock(jobs_lock);
+	return jobs.empty();
+}
+
+/* a reactor thread: its listening socket and the sessions it accepted. whatever arrives on a session socket is read into
+the reactor buffer and handed to the session right away (file content is decrypted & written from there), responses are
+sent once a request is handled, or when the socket is writable again. a step of a session which blocks is handed to the
+workers, the worker posts the session back when it's done (done_fd wakes the reactor up) and the reactor goes on with it */
+class Reactor
+{
+	static const size_t RECV_BUFFER_SIZE = 256 * 1024;
+	static const int MAX_EVENTS = 256;
+	static const int WAIT_TIMEOUT = 1000; // milliseconds, stalled sessions are looked for at least this often
+
+	Server& server;
+	Workers& workers;
+	uint16_t port;
+	int listen_fd;
+	int epoll_fd;
+	int done_fd; // eventfd, signaled when a worker finishes a job of a session of the reactor
+	std::map<int, std::unique_ptr<Session>> sessions;
+	std::set<int> working; // sessions whose job runs on a worker, the reactor doesn't touch them until it's done
+	std::vector<int> done; // sessions whose job is done, under done_lock
+	std::mutex done_lock;
+	std::vector<uint8_t> buffer;
+
+	bool listen_socket();
+	void accept_sessions();
+	void session_event(Session& session, uint32_t events);
+	void session_fed(Session& session, bool fed);
+	void run_job(Session& session);
+	void jobs_done();
+	void update_events(Session& session);
+	void end_session(int fd);
+	void end_stalled_sessions();
+
+public:
+	Reactor(Server& server, Workers& workers, uint16_t port) :
+		server(server), workers(workers), port(port), listen_fd(-1), epoll_fd(-1), done_fd(-1), buffer(RECV_BUFFER_SIZE) {}
+	virtual ~Reactor();
+
+	bool start();
+	void run();
+};
+
+Reactor::~Reactor()
+{
+	sessions.clear();
+	if (listen_fd >= 0)
+		::close(listen_fd);
+	if (epoll_fd >= 0)
+		::close(epoll_fd);
+	if (done_fd >= 0)
+		::close(done_fd);
+}
+
+// listen on the server port (dual stack if IPv6 is available), every reactor has a socket of its own on the same port
+bool Reactor::listen_socket()
+{
+	const int on = 1, off = 0;
+	sockaddr_in6 addr6 = {};
+	addr6.sin6_family = AF_INET6;
+	addr6.sin6_port = htons(port);
+	addr6.sin6_addr = in6addr_any;
+	sockaddr_in addr4 = {};
+	addr4.sin_family = AF_INET;
+	addr4.sin_port = htons(port);
+	addr4.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	for (const int family : { AF_INET6, AF_INET })
+	{
+		listen_fd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listen_fd < 0)
+			continue;
+		::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+		if (family == AF_INET6)
+			::setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		const bool bound = (family == AF_INET6) ?
+			::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr6), sizeof(addr6)) == 0 :
+			::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr4), sizeof(addr4)) == 0;
+		if (bound && ::listen(listen_fd, Server::LISTEN_BACKLOG) == 0)
+			return true;
+		::close(listen_fd);
+		listen_fd = -1;
+	}
+	Server::log(std::string("couldn't listen on port ") + std::to_string(port) + ", details: " + strerror(errno));
+	return false;
+}
+
+// open the listening socket, false if the reactor can't run
+bool Reactor::start()
+{
+	if (!listen_socket())
+		return false;
+	epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+	done_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epoll_event event = {}, done_event = {};
+	event.events = EPOLLIN;
+	event.data.fd = listen_fd;
+	done_event.events = EPOLLIN;
+	done_event.data.fd = done_fd;
+	if (epoll_fd < 0 || done_fd < 0 || ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0 ||
+		::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, done_fd, &done_event) != 0)
+	{
+		Server::log(std::string("epoll failed, details: ") + strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// serve the sessions of the reactor until the server stops
+void Reactor::run()
+{
+	std::vector<epoll_event> events(MAX_EVENTS);
+	while (true)
+	{
+		const int count = ::epoll_wait(epoll_fd, events.data(), MAX_EVENTS, WAIT_TIMEOUT);
+		if (count < 0 && errno != EINTR)
+		{
+			Server::log(std::string("epoll_wait failed, details: ") + strerror(errno));
+			return;
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			if (events[i].data.fd == listen_fd)
+			{
+				accept_sessions();
+				continue;
+			}
+			if (events[i].data.fd == done_fd)
+			{
+				jobs_done();
+				continue;
+			}
+			auto found = sessions.find(events[i].data.fd);
+			if (found != sessions.end() && working.count(found->first) == 0)
+				session_event(*found->second, events[i].events);
+		}
+		end_stalled_sessions();
+	}
+}
+
+void Reactor::accept_sessions()
+{
+	while (true)
+	{
+		sockaddr_storage addr = {};
+		socklen_t addr_size = sizeof(addr);
+		const int fd = ::accept4(listen_fd, reinterpret_cast<sockaddr*>(&addr), &addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				Server::log(std::string("accept failed, details: ") + strerror(errno));
+			return;
+		}
+		const int on = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		char host[INET6_ADDRSTRLEN] = { 0 };
+		uint16_t peer_port = 0;
+		if (addr.ss_family == AF_INET6)
+		{
+			const sockaddr_in6* addr6 = reinterpret_cast<const sockaddr_in6*>(&addr);
+			::inet_ntop(AF_INET6, &addr6->sin6_addr, host, sizeof(host));
+			peer_port = ntohs(addr6->sin6_port);
+		}
+		else
+		{
+			const sockaddr_in* addr4 = reinterpret_cast<const sockaddr_in*>(&addr);
+			::inet_ntop(AF_INET, &addr4->sin_addr, host, sizeof(host));
+			peer_port = ntohs(addr4->sin_port);
+		}
+		const std::string peer = "('" + std::string(host) + "', " + std::to_string(peer_port) + ")";
+
+		epoll_event event = {};
+		event.events = EPOLLIN | EPOLLRDHUP;
+		event.data.fd = fd;
+		if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			::close(fd);
+			continue;
+		}
+		sessions[fd].reset(new Session(fd, server.next_session(), peer, server));
+		sessions[fd]->set_epoll_events(event.events);
+		if (server.is_verbose())
+			Server::log("Connected by " + peer);
+	}
+}
+
+void Reactor::session_event(Session& session, uint32_t events)
+{
+	const int fd = session.get_fd();
+	if (events & EPOLLIN)
+	{
+		const ssize_t size = ::recv(fd, buffer.data(), buffer.size(), 0);
+		if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return;
+		if (size <= 0)
+		{
+			if (session.in_request())
+				Server::log(session.get_peer() + " X failed to receive request data, session will end now");
+			end_session(fd);
+			return;
+		}
+		session_fed(session, session.on_recv(buffer.data(), static_cast<size_t>(size)));
+		return;
+	}
+	else if (events & (EPOLLERR | EPOLLHUP))
+	{
+		end_session(fd);
+		return;
+	}
+	session_fed(session, true);
+}
+
+// send what the session answered, then hand its job to a worker / wait for its next events. a session which failed
+// ends (what was answered before the failure is still sent)
+void Reactor::session_fed(Session& session, bool fed)
+{
+	if (!session.on_send() || !fed)
+		end_session(session.get_fd());
+	else if (session.job_pending())
+		run_job(session);
+	else
+		update_events(session);
+}
+
+// hand the session to a worker for its job, its socket isn't watched until the job is done (so the session isn't fed /
+// ended meanwhile), what arrives meanwhile waits in the socket
+void Reactor::run_job(Session& session)
+{
+	const int fd = session.get_fd();
+	if (session.get_epoll_events() != 0 && ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) != 0)
+	{
+		end_session(fd);
+		return;
+	}
+	session.set_epoll_events(0);
+	working.insert(fd);
+	Session* job_session = &session;
+	workers.post([this, job_session, fd](Database& database)
+	{
+		job_session->run_job(database);
+		{
+			std::lock_guard<std::mutex> lock(done_lock);
+			done.push_back(fd);
+		}
+		const uint64_t one = 1;
+		if (::write(done_fd, &one, sizeof(one)) < 0)
+			Server::log(std::string("couldn't wake the reactor up, details: ") + strerror(errno));
+	});
+}
+
+// the workers finished the jobs of sessions, the reactor goes on with them
+void Reactor::jobs_done()
+{
+	uint64_t count = 0;
+	if (::read(done_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		Server::log(std::string("couldn't read the done jobs count, details: ") + strerror(errno));
+	std::vector<int> finished;
+	{
+		std::lock_guard<std::mutex> lock(done_lock);
+		finished.swap(done);
+	}
+	for (const int fd : finished)
+	{
+		working.erase(fd);
+		Session& session = *sessions[fd];
+		session_fed(session, session.job_done());
+	}
+}
+
+// wait for the socket to be writable only while a response is waiting, the events are modified only when that changes
+// (most events leave nothing to send, or a response which was sent right away). a session which is back from a worker
+// is watched again
+void Reactor::update_events(Session& session)
+{
+	epoll_event event = {};
+	event.events = EPOLLIN | EPOLLRDHUP | (session.send_pending() ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+	if (event.events == session.get_epoll_events())
+		return;
+	event.data.fd = session.get_fd();
+	const int operation = (session.get_epoll_events() == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+	if (::epoll_ctl(epoll_fd, operation, session.get_fd(), &event) == 0)
+		session.set_epoll_events(event.events);
+	else if (operation == EPOLL_CTL_ADD)
+		end_session(session.get_fd());
+}
+
+void Reactor::end_session(int fd)
+{
+	::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+	sessions.erase(fd);
+}
+
+// end the sessions whose client stalled in the middle of a request, so a stalled client doesn't hold its file
+void Reactor::end_stalled_sessions()
+{
+	const time_t now = time(nullptr);
+	std::vector<int> stalled;
+	for (const auto& session : sessions)
+	{
+		if (working.count(session.first) == 0 && session.second->stalled(now))
+			stalled.push_back(session.first);
+	}
+	for (const int fd : stalled)
+	{
+		Server::log(sessions[fd]->get_peer() + " client didn't respond within " + std::to_string(Session::RECV_TIMEOUT) +
+			" seconds, session will end now");
+		end_session(fd);
+	}
+}
+
+Server::Server(uint16_t port, unsigned int threads, bool verbose) : port(port), threads(std::max(1u, threads)), verbose(verbose), sessions(0) {}
+
+// prepare the database and serve the clients on all the reactors until the server stops
+// Return false if the server couldn't start / stopped on an error
+bool Server::svr_startup()
+{
+	Database database;
+	if (!database.tables_init())
+		return false;
+
+	// every session holds a socket
+	rlimit limit = {};
+	if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	// the workers stop before the reactors (whose sessions their jobs run) go away
+	std::vector<std::unique_ptr<Reactor>> reactors;
+	Workers workers;
+	if (!workers.start(threads * WORKERS_PER_REACTOR))
+		return false;
+	for (unsigned int i = 0; i < threads; ++i)
+	{
+		reactors.emplace_back(new Reactor(*this, workers, port));
+		if (!reactors.back()->start())
+			return false;
+	}
+	std::cout << " Server socket binded to port " << port << " \n Server is listening for new connections (" << threads << " reactors, " <<
+		threads * WORKERS_PER_REACTOR << " workers)" << std::endl;
+
+	std::vector<std::thread> reactor_threads;
+	for (auto& reactor : reactors)
+		reactor_threads.emplace_back(&Reactor::run, reactor.get());
+	for (auto& reactor_thread : reactor_threads)
+		reactor_thread.join();
+	return false;
+}
+
+// remove the recipe of a given file name (if exists) and release its chunks, the chunks which are not referenced
+// anymore are deleted
+void Server::remove_recipe(Database& database, const std::string& dir_path, const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(chunk_store_lock);
+	std::vector<ChunkRef> chunks;
+	if (!Storage::load_recipe(dir_path, file_name, chunks))
+		return;
+	Storage::delete_file(Storage::file_path(dir_path, file_name) + RECIPE_SUFFIX);
+	std::vector<std::string> released;
+	if (!database.release_chunks(chunks, released))
+	{
+		log(" chunk references couldn't be released, unreferenced chunks are left in the chunk store");
+		return;
+	}
+	Storage::delete_chunks(released);
+}
+
+// a session exchanged / resumed the key of a client (session_clt_id is its record of it), it owns the striped files of
+// the client from now on
+void Server::set_session_client(std::string& session_clt_id, const std::string& clt_id)
+{
+	std::lock_guard<std::mutex> lock(stripes_lock);
+	if (session_clt_id == clt_id)
+		return;
+	leave_client(session_clt_id);
+	session_clt_id = clt_id;
+	keyed_sessions[clt_id] += 1;
+}
+
+// a session doesn't own the striped files of its client anymore, the last one to leave drops them (stripes_lock is held)
+void Server::leave_client(std::string& session_clt_id)
+{
+	if (session_clt_id.empty())
+		return;
+	const std::string clt_id = session_clt_id;
+	session_clt_id.clear();
+	auto keyed = keyed_sessions.find(clt_id);
+	if (keyed == keyed_sessions.end() || --keyed->second > 0)
+		return;
+	keyed_sessions.erase(keyed);
+	std::vector<std::pair<FileKey, std::shared_ptr<StripedFile>>> abandoned;
+	for (const auto& entry : stripes)
+	{
+		if (entry.first.first == clt_id)
+			abandoned.push_back(entry);
+	}
+	for (const auto& entry : abandoned)
+	{
+		log(" " + entry.first.second + " stripes were abandoned, the file is dropped");
+		drop_striped_file(entry.first, entry.second);
+	}
+}
+
+// a striped file failed / was abandoned, its ranges are dropped now and its partial file once none of its stripes is
+// being received (stripes_lock is held)
+void Server::drop_striped_file(const FileKey& key, const std::shared_ptr<StripedFile>& striped)
+{
+	auto found = stripes.find(key);
+	if (found != stripes.end() && found->second == striped)
+		stripes.erase(found);
+	if (striped->receiving == 0)
+		Storage::delete_part_file(striped->dir_path, key.second);
+}
+
+// drop what a session which ended owned of the files which are being sent (aborted transfers), the chunk maps of the
+// files it sent chunk by chunk and the striped files of its client if no other session owns them (a chunk map is also
+// stored next to its partial file, so the file can still be resumed)
+void Server::release_session(uint64_t serial, std::string& session_clt_id)
+{
+	{
+		std::lock_guard<std::mutex> lock(chunk_maps_lock);
+		for (auto it = chunk_maps.begin(); it != chunk_maps.end();)
+			it = (it->second.owner == serial) ? chunk_maps.erase(it) : std::next(it);
+	}
+	std::lock_guard<std::mutex> lock(stripes_lock);
+	leave_client(session_clt_id);
+}
+
+// print a line, lines of different reactors are never mixed
+void Server::log(const std::string& message)
+{
+	std::lock_guard<std::mutex> lock(log_lock);
+	std::cout << message << std::endl;
+}
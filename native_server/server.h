@@ -0,0 +1,88 @@
+/*
+	TransferIt server
+	server.h
+	description: header file for server.cpp
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "crc.h"
+#include "storage.h"
+
+class Database;
+
+// a file of a client, by client ID (bytes) & file name
+typedef std::pair<std::string, std::string> FileKey;
+
+// a range of a file which arrived as a stripe: offset, size (decrypted), content size (encrypted) and the crc of its bytes
+// (the cksum of the file is put together from the crcs of its ranges)
+struct StripeRange
+{
+	uint64_t offset;
+	uint64_t size;
+	uint64_t content_size;
+	CRC crc;
+};
+
+// a file which arrives as stripes on several sessions at once: the directory of its partial file, the ranges which
+// arrived so far and the number of stripes which are being received
+struct StripedFile
+{
+	std::string dir_path;
+	std::vector<StripeRange> ranges;
+	unsigned int receiving = 0;
+};
+
+// a file which is being sent chunk by chunk and the session which sends it (a file which is sent again on another
+// session is taken over by it)
+struct ChunkedFile
+{
+	uint64_t owner;
+	std::shared_ptr<ChunkMap> chunk_map;
+};
+
+/* the native server, one reactor (epoll loop & listening socket) per thread and a pool of worker threads (each with its
+database connection) which run the steps of the requests which block. every reactor listens on the port itself
+(SO_REUSEPORT) so the kernel spreads the connections between them, a session stays on the reactor which accepted it. the state which sessions of different reactors share (file stripes & chunk maps) is kept
+here, under its locks, as server/server.py keeps it */
+class Server
+{
+	uint16_t port;
+	unsigned int threads;
+	bool verbose;
+	std::atomic<uint64_t> sessions;
+
+public:
+	static const int LISTEN_BACKLOG = 1024; // connections which wait to be accepted (per reactor)
+	static const unsigned int WORKERS_PER_REACTOR = 2;
+
+	// a striped file is dropped (with its partial file) when a stripe of it fails, or when the last session which
+	// exchanged / resumed the key of its client (the one which sends the stripes done request) ends, keyed_sessions
+	// counts those sessions by client ID (bytes), both under stripes_lock
+	std::map<FileKey, std::shared_ptr<StripedFile>> stripes;
+	std::map<std::string, unsigned int> keyed_sessions;
+	std::mutex stripes_lock;
+	std::map<FileKey, ChunkedFile> chunk_maps;
+	std::mutex chunk_maps_lock;
+	std::mutex chunk_store_lock; // chunk references are removed (and unreferenced chunks deleted) under it
+
+	Server(uint16_t port, unsigned int threads, bool verbose);
+
+	bool svr_startup();
+	uint64_t next_session() { return ++sessions; }
+	bool is_verbose() const { return verbose; }
+	void remove_recipe(Database& database, const std::string& dir_path, const std::string& file_name);
+	void set_session_client(std::string& session_clt_id, const std::string& clt_id);
+	void leave_client(std::string& session_clt_id);
+	void drop_striped_file(const FileKey& key, const std::shared_ptr<StripedFile>& striped);
+	void release_session(uint64_t serial, std::string& session_clt_id);
+	static void log(const std::string& message);
+};
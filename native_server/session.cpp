@@ -0,0 +1,1021 @@
+/*
+	TransferIt server
+	session.cpp
+	description: a client session of the native server, receives the requests of the client as they arrive and handles
+	them as server/server.py does (v3 - AES-CBC file content), see session.h
+*/
+
+#include "session.h"
+#include "server.h"
+#include "database.h"
+#include "RSAWrapper.h"
+#include <sha.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <iomanip>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// payload header sizes of the requests whose content follows their payload header (v3 - 32-bit sizes)
+static const size_t FILE_PAYLOAD_HDR_SIZE = sizeof(ReqFile::PayloadHdr);
+static const size_t STRIPE_PAYLOAD_HDR_SIZE = sizeof(ReqFileStripe::PayloadHdr);
+static const size_t CHUNK_PAYLOAD_HDR_SIZE = sizeof(ReqFileChunk::PayloadHdr);
+static const size_t CKSUM_SIZE = sizeof(uint32_t);
+
+// a null terminated string of a fixed size field
+static std::string field_string(const uint8_t* field, size_t size)
+{
+	const uint8_t* end = std::find(field, field + size, '\0');
+	return std::string(reinterpret_cast<const char*>(field), end - field);
+}
+
+static std::string id_key(const CltId& clt_id)
+{
+	return std::string(reinterpret_cast<const char*>(clt_id.uuid), sizeof(clt_id.uuid));
+}
+
+// what the database keeps of a session ticket, SHA-256 of it truncated to the ticket size (as server/helper.py
+// ticket_digest), whoever reads the database can't present the ticket
+static SessionTicket ticket_digest(const SessionTicket& ticket)
+{
+	uint8_t digest[CryptoPP::SHA256::DIGESTSIZE];
+	CryptoPP::SHA256().CalculateDigest(digest, ticket.ticket, sizeof(ticket.ticket));
+	SessionTicket stored;
+	memcpy(stored.ticket, digest, sizeof(stored.ticket));
+	return stored;
+}
+
+// the time as server/server.py stores LastSeen (str(datetime.now())), YYYY-MM-DD HH:MM:SS.ffffff
+static std::string now_text()
+{
+	const auto now = std::chrono::system_clock::now();
+	const time_t seconds = std::chrono::system_clock::to_time_t(now);
+	const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() % 1000000;
+	std::tm local = {};
+	localtime_r(&seconds, &local);
+	std::ostringstream text;
+	text << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << '.' << std::setw(6) << std::setfill('0') << micros;
+	return text.str();
+}
+
+static bool streamed_request(uint16_t req_code)
+{
+	return req_code == REQ_FILE || req_code == REQ_FILE_STRIPE || req_code == REQ_FILE_CHUNK;
+}
+
+static bool crc_request(uint16_t req_code)
+{
+	return req_code == REQ_VALID_CRC || req_code == REQ_NVALID_CRC || req_code == REQ_4NVALID_CRC;
+}
+
+// requests whose content mode / sizes follow the session version, the native server has them of v3 only
+static bool file_request(uint16_t req_code)
+{
+	return req_code == REQ_FILE || (req_code >= REQ_FILE_STRIPE && req_code <= REQ_FILE_CHUNKS_DONE);
+}
+
+Session::Session(int fd, uint64_t serial, const std::string& peer, Server& server) :
+	fd(fd), serial(serial), peer(peer), server(server), database(nullptr), job(nullptr), job_result(false), epoll_events(0), hdr(DEFAULT), content_left(0), file_fd(-1),
+	file_offset(0), content_size(0), file_size(0), stripe_offset(0), stripe_size(0), chunk_index(0), content_valid(false)
+{
+	next_request();
+	last_recv = time(nullptr);
+}
+
+Session::~Session()
+{
+	close_file();
+	if (striped != nullptr)
+		stripe_finished(false);
+	server.release_session(serial, keyed_clt_id);
+	::close(fd);
+}
+
+// feed the session with bytes which arrived on its socket, false if the session should end
+bool Session::on_recv(const uint8_t* data, size_t size)
+{
+	last_recv = time(nullptr);
+	while (size > 0 && job == nullptr)
+	{
+		if (state == CONTENT)
+		{
+			const size_t part = static_cast<size_t>(std::min<uint64_t>(size, content_left));
+			if (!recv_content(data, part))
+				return false;
+			data += part;
+			size -= part;
+			content_left -= part;
+			if (content_left == 0 && !content_complete())
+				return false;
+			continue;
+		}
+		const size_t part = std::min(size, expected - in_buff.size());
+		in_buff.append(reinterpret_cast<const char*>(data), part);
+		data += part;
+		size -= part;
+		if (in_buff.size() == expected && !step_complete())
+			return false;
+	}
+	// what arrived after a step which waits for its job is fed to the session once the job is done
+	held.append(reinterpret_cast<const char*>(data), size);
+	return true;
+}
+
+// run the job of the session on a worker thread (its reactor doesn't touch the session meanwhile), a step may go on to
+// another step which blocks, they run in the same job
+void Session::run_job(Database& worker_database)
+{
+	database = &worker_database;
+	job_result = true;
+	while (job_result && job != nullptr)
+	{
+		bool (Session::*step)() = job;
+		job = nullptr;
+		job_result = (this->*step)();
+	}
+	job = nullptr;
+	database = nullptr;
+}
+
+// the job of the session is done, back on its reactor thread: feed it what arrived meanwhile, false if the session
+// should end
+bool Session::job_done()
+{
+	if (!job_result)
+		return false;
+	std::string arrived;
+	arrived.swap(held);
+	return on_recv(reinterpret_cast<const uint8_t*>(arrived.data()), arrived.size());
+}
+
+// send the responses which are waiting (as much as the socket takes), false if the session should end
+bool Session::on_send()
+{
+	while (!out_buff.empty())
+	{
+		const ssize_t sent = ::send(fd, out_buff.data(), out_buff.size(), MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (sent <= 0)
+		{
+			log(std::string("failed to send response, details: ") + strerror(errno));
+			return false;
+		}
+		out_buff.erase(0, static_cast<size_t>(sent));
+	}
+	return true;
+}
+
+// true if the client stalled in the middle of a request for longer than RECV_TIMEOUT
+bool Session::stalled(time_t now) const
+{
+	return in_request() && now - last_recv > RECV_TIMEOUT;
+}
+
+// a step which blocks (database, RSA, committing a file) runs as the job of the session on a worker thread, the session
+// waits for it (see Reactor::run_job)
+bool Session::queue_job(bool (Session::*step)())
+{
+	job = step;
+	return true;
+}
+
+// wait for the header of the next request
+void Session::next_request()
+{
+	state = HEADER;
+	expected = sizeof(ReqHeader);
+	in_buff.clear();
+}
+
+// the current step of the request was received, move on to the next one
+bool Session::step_complete()
+{
+	switch (state)
+	{
+	case HEADER:
+		memcpy(&hdr, in_buff.data(), sizeof(hdr));
+		in_buff.clear();
+		if (file_request(hdr.req_code) && hdr.clt_version >= VERSION_CTR)
+		{
+			log("request " + std::to_string(hdr.req_code) + " of version " + std::to_string(hdr.clt_version) +
+				", the native server takes version " + std::to_string(SVR_VERSION) + " file requests only");
+			return false;
+		}
+		if (streamed_request(hdr.req_code))
+		{
+			state = PAYLOAD_HDR;
+			expected = (hdr.req_code == REQ_FILE) ? FILE_PAYLOAD_HDR_SIZE :
+				(hdr.req_code == REQ_FILE_STRIPE) ? STRIPE_PAYLOAD_HDR_SIZE : CHUNK_PAYLOAD_HDR_SIZE;
+			return true;
+		}
+		if (crc_request(hdr.req_code) && hdr.payload_size == 0)
+			hdr.payload_size = CRC_PAYLOAD_SIZE;
+		if (hdr.payload_size > DEFAULT_RECV_SIZE)
+		{
+			log("request " + std::to_string(hdr.req_code) + " payload size " + std::to_string(hdr.payload_size) + " is too big");
+			return false;
+		}
+		state = PAYLOAD;
+		expected = hdr.payload_size;
+		return expected > 0 || queue_job(&Session::handle_request);
+	case PAYLOAD:
+		return queue_job(&Session::handle_request);
+	case PAYLOAD_HDR:
+		return queue_job(&Session::begin_content);
+	case TRAILER:
+		return queue_job(&Session::chunk_received);
+	default:
+		return false;
+	}
+}
+
+// a request which is not a file request was received, call the appropriate request handler
+bool Session::handle_request()
+{
+	bool handled = false;
+	switch (hdr.req_code)
+	{
+	case REQ_REGISTRATION:
+		handled = req_registration();
+		break;
+	case REQ_PUBLIC_KEY:
+		handled = req_public_key();
+		break;
+	case REQ_FILE_STRIPES_DONE:
+		handled = req_file_stripes_done();
+		break;
+	case REQ_FILE_CHUNKS_BEGIN:
+		handled = req_file_chunks_begin();
+		break;
+	case REQ_FILE_CHUNKS_DONE:
+		handled = req_file_chunks_done();
+		break;
+	case REQ_SESSION_TICKET:
+		handled = req_session_ticket();
+		break;
+	case REQ_RESUME_SESSION:
+		handled = req_resume_session();
+		break;
+	case REQ_VALID_CRC:
+	case REQ_NVALID_CRC:
+	case REQ_4NVALID_CRC:
+		handled = req_crc();
+		break;
+	default:
+		log("request code " + std::to_string(hdr.req_code) + " do not match any protocol request code (of version " +
+			std::to_string(SVR_VERSION) + "), session will end now");
+		return false;
+	}
+	return request_handled(handled);
+}
+
+// the current request was handled, false if the session should end
+bool Session::request_handled(bool handled)
+{
+	if (!handled)
+	{
+		log("couldn't handle request " + std::to_string(hdr.req_code) + ", session will end now");
+		return false;
+	}
+	database->set_last_seen(hdr.clt_id, now_text());
+	next_request();
+	return true;
+}
+
+// the payload header of a file / file stripe / file chunk request was received, prepare to receive its content
+bool Session::begin_content()
+{
+	const uint8_t* payload_hdr = reinterpret_cast<const uint8_t*>(in_buff.data());
+	CltSymmetricKey aes_key;
+	if (hdr.req_code == REQ_FILE)
+	{
+		ReqFile::PayloadHdr req(clt_id);
+		memcpy(&req, payload_hdr, sizeof(req));
+		clt_id = req.clt_id;
+		content_size = req.file_content_size;
+		file_name = field_string(req.file_name.file_name, FILE_NAME_SIZE);
+	}
+	else if (hdr.req_code == REQ_FILE_STRIPE)
+	{
+		ReqFileStripe::PayloadHdr req(clt_id);
+		memcpy(&req, payload_hdr, sizeof(req));
+		clt_id = req.clt_id;
+		file_size = req.file_size;
+		stripe_offset = req.stripe_offset;
+		stripe_size = req.stripe_size;
+		content_size = req.file_content_size;
+		file_name = field_string(req.file_name.file_name, FILE_NAME_SIZE);
+		if (stripe_offset + stripe_size > file_size)
+		{
+			log("stripe " + std::to_string(stripe_offset) + "+" + std::to_string(stripe_size) + " exceeds file size " + std::to_string(file_size));
+			return false;
+		}
+	}
+	else
+	{
+		ReqFileChunk::PayloadHdr req(clt_id);
+		memcpy(&req, payload_hdr, sizeof(req));
+		clt_id = req.clt_id;
+		chunk_index = req.chunk_index;
+		content_size = req.file_content_size;
+		file_name = field_string(req.file_name.file_name, FILE_NAME_SIZE);
+	}
+	const uint64_t trailer_size = (hdr.req_code == REQ_FILE_CHUNK) ? CKSUM_SIZE : 0;
+	if (hdr.payload_size != content_payload_size(hdr.clt_version, in_buff.size(), content_size + trailer_size))
+	{
+		log("payload size " + std::to_string(hdr.payload_size) + " not match content size " + std::to_string(content_size));
+		return false;
+	}
+
+	if (hdr.req_code == REQ_FILE_CHUNK)
+	{
+		std::lock_guard<std::mutex> lock(server.chunk_maps_lock);
+		auto found = server.chunk_maps.find(FileKey(id_key(clt_id), file_name));
+		chunk_map = (found != server.chunk_maps.end() && found->second.owner == serial) ? found->second.chunk_map : nullptr;
+	}
+	if (hdr.req_code == REQ_FILE_CHUNK && (chunk_map == nullptr || chunk_index >= chunk_map->count ||
+		content_size != AESWrapper::encrypted_size(chunk_map->size_of(chunk_index))))
+	{
+		log(file_name + " chunk " + std::to_string(chunk_index) + " not match the announced file * file chunk request *");
+		return false;
+	}
+	if (!file_request_context(clt_id, aes_key))
+		return false;
+
+	// file content is decrypted with the client AES key as it arrives, a file is received in a file which replaces the
+	// stored file only when the whole content arrived, a stripe is written at its offset in the partial file and a chunk
+	// is verified in memory (a chunk which arrived corrupted never overwrites a stored one)
+	if (hdr.req_code == REQ_FILE_STRIPE)
+	{
+		std::lock_guard<std::mutex> lock(server.stripes_lock);
+		std::shared_ptr<StripedFile>& entry = server.stripes[FileKey(id_key(clt_id), file_name)];
+		if (entry == nullptr)
+		{
+			entry = std::make_shared<StripedFile>();
+			entry->dir_path = dir_path;
+		}
+		entry->receiving += 1;
+		striped = entry;
+	}
+	if (hdr.req_code == REQ_FILE)
+		file_fd = Storage::open_recv_file(dir_path, file_name);
+	else if (hdr.req_code == REQ_FILE_STRIPE)
+		file_fd = Storage::open_part_file(dir_path, file_name);
+	if (hdr.req_code != REQ_FILE_CHUNK && file_fd < 0)
+	{
+		log(file_name + " file couldn't be created / opened * file request *");
+		if (striped != nullptr)
+			stripe_finished(false);
+		return false;
+	}
+	file_offset = (hdr.req_code == REQ_FILE_STRIPE) ? stripe_offset : 0;
+	chunk.clear();
+	digest = CRC();
+	aes.reset(new AESWrapper(aes_key, AES_CBC));
+	aes->decrypt_begin();
+	content_valid = true;
+
+	state = CONTENT;
+	content_left = content_size;
+	in_buff.clear();
+	return content_size > 0 || content_complete();
+}
+
+// decrypt the next part of the content and store it
+bool Session::recv_content(const uint8_t* data, size_t size)
+{
+	aes->decrypt_update(data, size, plain);
+	return write_content(plain);
+}
+
+// add decrypted content to the cksum and write it to the file (at its position) / the chunk
+bool Session::write_content(const std::string& content)
+{
+	if (content.empty())
+		return true;
+	digest.update(reinterpret_cast<const unsigned char*>(content.data()), content.size());
+	if (hdr.req_code == REQ_FILE_CHUNK)
+	{
+		chunk.append(content);
+		return true;
+	}
+	if (!Storage::write_all(file_fd, reinterpret_cast<const uint8_t*>(content.data()), content.size(), static_cast<int64_t>(file_offset)))
+	{
+		log("file " + file_name + " content couldn't be stored, details: " + strerror(errno));
+		return false;
+	}
+	file_offset += content.size();
+	return true;
+}
+
+// the whole content of the request was received
+bool Session::content_complete()
+{
+	try
+	{
+		aes->decrypt_final(plain);
+		if (!write_content(plain))
+			content_valid = false;
+	}
+	catch (std::exception& e)
+	{
+		log("file " + file_name + " content couldn't be decrypted, details: " + e.what());
+		content_valid = false;
+	}
+	aes.reset();
+
+	// the cksum of a chunk follows it, a chunk which couldn't be decrypted is dropped after it (sent again)
+	if (hdr.req_code == REQ_FILE_CHUNK)
+	{
+		state = TRAILER;
+		expected = CKSUM_SIZE;
+		return true;
+	}
+	close_file();
+	return queue_job(&Session::commit_content);
+}
+
+// the content of a file / stripe request is written, the file replaces the stored one / the stripe counts for its file
+bool Session::commit_content()
+{
+	if (hdr.req_code == REQ_FILE)
+	{
+		std::string path = Storage::file_path(dir_path, file_name);
+		if (!content_valid || !Storage::commit_recv_file(dir_path, file_name, path))
+		{
+			log(file_name + " file couldn't be received / stored * file request *");
+			Storage::delete_file(path + RECV_FILE_SUFFIX);
+			return false;
+		}
+		return request_handled(file_received(clt_id, path, content_size, digest.digest()));
+	}
+
+	const bool received = content_valid && file_offset - stripe_offset == stripe_size;
+	if (!received)
+		log("file " + file_name + " stripe couldn't be received / decrypted / stored, decrypted stripe size " +
+			std::to_string(file_offset - stripe_offset) + " of " + std::to_string(stripe_size));
+	if (!stripe_finished(received))
+		return false;
+	if (server.is_verbose())
+		log(file_name + " stripe " + std::to_string(stripe_offset) + "+" + std::to_string(stripe_size) + " of " +
+			std::to_string(file_size) + " stored * file stripe request *");
+	send_header(RES_MSG_CONFIRM, 0);
+	return request_handled(true);
+}
+
+// the stripe which was being received is done, remember which range of the file arrived (the file is complete when all
+// of its ranges arrived). a stripe which failed fails the whole file, as does a stripe of a file which was dropped
+// meanwhile / which no session of its client owns (abandoned), false if the stripe doesn't count
+bool Session::stripe_finished(bool stored)
+{
+	std::lock_guard<std::mutex> lock(server.stripes_lock);
+	const FileKey key(id_key(clt_id), file_name);
+	striped->receiving -= 1;
+	auto found = server.stripes.find(key);
+	if (stored && found != server.stripes.end() && found->second == striped && server.keyed_sessions.count(key.first) > 0)
+		striped->ranges.push_back({ stripe_offset, stripe_size, content_size, digest });
+	else
+	{
+		if (stored)
+			log(file_name + " was dropped while the stripe arrived * file stripe request *");
+		stored = false;
+		server.drop_striped_file(key, striped);
+	}
+	striped.reset();
+	return stored;
+}
+
+// the cksum of a chunk was received, the chunk counts as stored only if its cksum matches the cksum sent with it
+// (otherwise the client will send it again)
+bool Session::chunk_received()
+{
+	uint32_t cksum = 0;
+	memcpy(&cksum, in_buff.data(), sizeof(cksum));
+	if (!content_valid || chunk.size() != chunk_map->size_of(chunk_index) || digest.digest() != cksum)
+	{
+		log(file_name + " chunk " + std::to_string(chunk_index) + " arrived corrupted, it will be sent again * file chunk request *");
+		chunk_map.reset();
+		return request_handled(true);
+	}
+
+	bool stored = false;
+	{
+		std::lock_guard<std::mutex> lock(server.chunk_maps_lock);
+		auto found = server.chunk_maps.find(FileKey(id_key(clt_id), file_name));
+		if (found == server.chunk_maps.end() || found->second.owner != serial)
+			log(file_name + " was taken over by another session * file chunk request *");
+		else
+		{
+			const int fd = Storage::open_part_file(dir_path, file_name);
+			stored = fd >= 0 && Storage::write_all(fd, reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size(),
+				static_cast<int64_t>(chunk_index) * chunk_map->chunk_size);
+			if (fd >= 0)
+				::close(fd);
+			if (stored)
+			{
+				chunk_map->set_stored(chunk_index, cksum);
+				stored = Storage::store_chunk_map(dir_path, file_name, *chunk_map);
+			}
+			else
+				log("file " + file_name + " chunk couldn't be stored * file chunk request *");
+		}
+	}
+	chunk_map.reset();
+	chunk.clear();
+	return request_handled(stored);
+}
+
+void Session::close_file()
+{
+	if (file_fd >= 0)
+		::close(file_fd);
+	file_fd = -1;
+}
+
+bool Session::req_registration()
+{
+	CltName name;
+	memcpy(&name, in_buff.data(), std::min(in_buff.size(), sizeof(name)));
+	const std::string username = field_string(name.username, CLT_USERNAME_SIZE);
+	// the username names the client files directory
+	if (in_buff.size() < sizeof(name) || !Storage::valid_file_name(username))
+	{
+		log("client username " + username + " is invalid *registration request*");
+		return false;
+	}
+	if (database->clt_username_exists(username))
+	{
+		log("client username " + username + " already exists *registration request*");
+		return false;
+	}
+
+	// a random (version 4) UUID, public key and aes key are not known in this phase
+	ResRegistration res;
+	AESWrapper::GenerateKey(res.payload.uuid, sizeof(res.payload.uuid));
+	res.payload.uuid[6] = static_cast<uint8_t>((res.payload.uuid[6] & 0x0F) | 0x40);
+	res.payload.uuid[8] = static_cast<uint8_t>((res.payload.uuid[8] & 0x3F) | 0x80);
+	if (!database->store_clt(res.payload, username, now_text()))
+	{
+		log("Failed to store client " + username + " data in the database *registration request*");
+		return false;
+	}
+	if (server.is_verbose())
+		log("client " + username + " is successfully registered *registration request*");
+
+	res.hdr.svr_version = SVR_VERSION;
+	res.hdr.res_code = RES_REGISTRATION_SUCCESS;
+	res.hdr.payload_size = sizeof(res.payload);
+	send(&res, sizeof(res));
+	return true;
+}
+
+bool Session::req_public_key()
+{
+	ReqPublicKey req(clt_id);
+	if (in_buff.size() < sizeof(req.payload))
+	{
+		log("failed to unpack public key data");
+		return false;
+	}
+	memcpy(&req.payload, in_buff.data(), sizeof(req.payload));
+	const std::string username = field_string(req.payload.clt_name.username, CLT_USERNAME_SIZE);
+	if (!database->clt_username_exists(username))
+	{
+		log("client " + username + " not registered *publicKey request*");
+		return false;
+	}
+	if (!database->set_public_key(hdr.clt_id, username, req.payload.clt_public_key))
+	{
+		log("client " + username + " public key cannot be stored in the database *publicKey request*");
+		return false;
+	}
+
+	// create AES key and encrypt it with the client public key
+	AESWrapper aes_key;
+	std::string encrypted_aes;
+	try
+	{
+		RSAPublicWrapper rsa(req.payload.clt_public_key);
+		const CltSymmetricKey key = aes_key.getKey();
+		encrypted_aes = rsa.encrypt(key.symmetric_key, sizeof(key.symmetric_key));
+	}
+	catch (std::exception& e)
+	{
+		log(std::string("AES key creation & encryption process failed *publicKey request* ") + e.what());
+		return false;
+	}
+	// a ticket issued for the former key would restore it, so it's dropped
+	if (!database->set_aes_key(hdr.clt_id, aes_key.getKey()))
+	{
+		log("AES key generated for client " + username + " cannot be stored in the database *publicKey request*");
+		return false;
+	}
+	database->remove_ticket(hdr.clt_id);
+	server.set_session_client(keyed_clt_id, id_key(hdr.clt_id));
+
+	send_header(RES_AES_KEY, static_cast<uint32_t>(CLT_ID_SIZE + encrypted_aes.size()));
+	send(hdr.clt_id.uuid, CLT_ID_SIZE);
+	send(encrypted_aes.data(), encrypted_aes.size());
+	if (server.is_verbose())
+		log("successfully sent response *publicKey request*");
+	return true;
+}
+
+// issues a ticket for the current AES key of the client, the client presents it on a later connection
+// (REQ_RESUME_SESSION) instead of its public key, so the key exchange is skipped. a ticket replaces the one issued
+// before, so it's issued only on a session which exchanged / resumed the key of that client
+bool Session::req_session_ticket()
+{
+	ReqSessionTicket req(clt_id);
+	if (in_buff.size() < sizeof(req.payload))
+	{
+		log("failed to unpack session ticket request data");
+		return false;
+	}
+	memcpy(&req.payload, in_buff.data(), sizeof(req.payload));
+	if (keyed_clt_id.empty() || keyed_clt_id != id_key(req.payload))
+	{
+		log("client didn't exchange / resume its key on this session *session ticket request*");
+		return false;
+	}
+	CltSymmetricKey aes_key;
+	if (!database->get_clt_aes_key(req.payload, aes_key))
+	{
+		log("client has no AES key *session ticket request*");
+		return false;
+	}
+
+	ResSessionTicket res;
+	res.hdr.svr_version = SVR_VERSION;
+	res.hdr.res_code = RES_SESSION_TICKET;
+	res.hdr.payload_size = sizeof(res.payload);
+	res.payload.clt_id = req.payload;
+	AESWrapper::GenerateKey(res.payload.ticket.ticket, sizeof(res.payload.ticket.ticket));
+	res.payload.lifetime = SESSION_TICKET_LIFETIME;
+	if (!database->set_ticket(req.payload, ticket_digest(res.payload.ticket), aes_key, static_cast<int64_t>(time(nullptr)) + res.payload.lifetime))
+	{
+		log("session ticket cannot be stored in the database *session ticket request*");
+		return false;
+	}
+	send(&res, sizeof(res));
+	return true;
+}
+
+// if the ticket is the one issued to the client and not expired, the AES key it was issued for is the client key again
+// (no key exchange), otherwise the client is told to exchange keys, the session goes on either way
+bool Session::req_resume_session()
+{
+	ReqResumeSession req(clt_id);
+	if (in_buff.size() < sizeof(req.payload))
+	{
+		log("failed to unpack resume session request data");
+		return false;
+	}
+	memcpy(&req.payload, in_buff.data(), sizeof(req.payload));
+
+	SessionTicket ticket;
+	CltSymmetricKey aes_key;
+	int64_t expires = 0;
+	bool resumed = database->get_ticket(req.payload.clt_id, ticket, aes_key, expires);
+	const SessionTicket presented = ticket_digest(req.payload.ticket);
+	uint8_t diff = 0; // compared in constant time
+	for (size_t i = 0; i < SESSION_TICKET_SIZE; ++i)
+		diff |= ticket.ticket[i] ^ presented.ticket[i];
+	resumed = resumed && diff == 0 && expires > static_cast<int64_t>(time(nullptr));
+	if (resumed && !database->set_aes_key(req.payload.clt_id, aes_key))
+	{
+		log("AES key of the ticket cannot be stored in the database *resume session request*");
+		return false;
+	}
+	if (resumed)
+	{
+		server.set_session_client(keyed_clt_id, id_key(req.payload.clt_id));
+		ResSessionResumed res;
+		res.hdr.svr_version = SVR_VERSION;
+		res.hdr.res_code = RES_SESSION_RESUMED;
+		res.hdr.payload_size = sizeof(res.payload);
+		res.payload = req.payload.clt_id;
+		send(&res, sizeof(res));
+	}
+	else
+		send_header(RES_SESSION_RESUME_FAIL, 0);
+	if (server.is_verbose())
+		log(std::string("session ") + (resumed ? "resumed" : "not resumed") + " *resume session request*");
+	return true;
+}
+
+// makes sure the whole file arrived, moves it from the partial file to the final file and puts its cksum together from the
+// cksums of its stripes (calculated as they arrived), the file is read again only if its stripes overlap
+bool Session::req_file_stripes_done()
+{
+	ReqFileStripesDone req(clt_id);
+	CltSymmetricKey aes_key;
+	if (in_buff.size() < sizeof(req.payload))
+	{
+		log("failed to unpack File stripes done data");
+		return false;
+	}
+	memcpy(&req.payload, in_buff.data(), sizeof(req.payload));
+	clt_id = req.payload.clt_id;
+	file_name = field_string(req.payload.file_name.file_name, FILE_NAME_SIZE);
+	if (!file_request_context(clt_id, aes_key))
+		return false;
+
+	const FileKey key(id_key(clt_id), file_name);
+	std::shared_ptr<StripedFile> done;
+	{
+		std::lock_guard<std::mutex> lock(server.stripes_lock);
+		auto found = server.stripes.find(key);
+		if (found != server.stripes.end())
+		{
+			done = found->second;
+			server.stripes.erase(found);
+		}
+	}
+	if (done == nullptr)
+	{
+		done = std::make_shared<StripedFile>();
+		done->dir_path = dir_path;
+	}
+	std::vector<StripeRange> ranges = done->ranges;
+	std::sort(ranges.begin(), ranges.end(), [](const StripeRange& a, const StripeRange& b)
+		{ return a.offset < b.offset || (a.offset == b.offset && a.size < b.size); });
+	uint64_t position = 0, total_content_size = 0;
+	CRC file_digest;
+	bool tiled = true; // every byte of the file is in one stripe (a stripe which was sent again is the same range)
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		const StripeRange& range = ranges[i];
+		if (range.offset > position)
+			break;
+		if (range.offset == position)
+			file_digest.combine(range.crc);
+		else if (range.offset != ranges[i - 1].offset || range.size != ranges[i - 1].size)
+			tiled = false;
+		position = std::max(position, range.offset + range.size);
+	}
+	if (position < req.payload.file_size)
+	{
+		log(file_name + " stripes cover only " + std::to_string(position) + " of " + std::to_string(req.payload.file_size) +
+			" bytes * file stripes done request *");
+		std::lock_guard<std::mutex> lock(server.stripes_lock);
+		server.drop_striped_file(key, done);
+		return false;
+	}
+	for (const StripeRange& range : ranges)
+		total_content_size += range.content_size;
+	tiled = tiled && position == req.payload.file_size;
+
+	std::string path;
+	uint32_t cksum = file_digest.digest();
+	if (!Storage::commit_part_file(dir_path, file_name, req.payload.file_size, path) || (!tiled && !Storage::calc_file_crc(path, cksum)))
+	{
+		log(file_name + " file couldn't be created / overwritten * file stripes done request *");
+		return false;
+	}
+	return file_received(clt_id, path, total_content_size, cksum);
+}
+
+// answers with the chunks of the file which are already stored (by an earlier transfer of the same file which was
+// interrupted)
+bool Session::req_file_chunks_begin()
+{
+	ReqFileChunksBegin req(clt_id);
+	CltSymmetricKey aes_key;
+	if (in_buff.size() < sizeof(req.payload))
+	{
+		log("failed to unpack File chunks begin data");
+		return false;
+	}
+	memcpy(&req.payload, in_buff.data(), sizeof(req.payload));
+	clt_id = req.payload.clt_id;
+	file_name = field_string(req.payload.file_name.file_name, FILE_NAME_SIZE);
+	const uint64_t file_size = req.payload.file_size, chunk_size = req.payload.chunk_size;
+	if (file_size == 0 || chunk_size == 0 || chunk_size > MAX_CHUNK_SIZE || (file_size + chunk_size - 1) / chunk_size > MAX_FILE_CHUNKS)
+	{
+		log(file_name + " chunks of " + std::to_string(chunk_size) + " bytes of a file of " + std::to_string(file_size) +
+			" bytes are not valid * file chunks begin request *");
+		return false;
+	}
+	if (!file_request_context(clt_id, aes_key))
+		return false;
+
+	// a file which is sent again on another session is taken over by it
+	auto loaded = std::make_shared<ChunkMap>(Storage::load_chunk_map(dir_path, file_name, file_size, req.payload.chunk_size));
+	{
+		std::lock_guard<std::mutex> lock(server.chunk_maps_lock);
+		server.chunk_maps[FileKey(id_key(clt_id), file_name)] = { serial, loaded };
+	}
+	if (server.is_verbose())
+		log(file_name + " " + std::to_string(loaded->stored_count()) + " of " + std::to_string(loaded->count) +
+			" chunks already stored * file chunks begin request *");
+	send_chunks_status(clt_id, *loaded);
+	return true;
+}
+
+// if all the chunks are stored - moves the partial file to the final file and puts its cksum together from the cksums of
+// its chunks (each one was verified as it arrived), otherwise answers with the chunks status so the client sends the
+// missing ones again
+bool Session::req_file_chunks_done()
+{
+	ReqFileChunksDone req(clt_id);
+	CltSymmetricKey aes_key;
+	if (in_buff.size() < sizeof(req.payload))
+	{
+		log("failed to unpack File chunks done data");
+		return false;
+	}
+	memcpy(&req.payload, in_buff.data(), sizeof(req.payload));
+	clt_id = req.payload.clt_id;
+	file_name = field_string(req.payload.file_name.file_name, FILE_NAME_SIZE);
+	const FileKey key(id_key(clt_id), file_name);
+	std::shared_ptr<ChunkMap> done;
+	{
+		std::lock_guard<std::mutex> lock(server.chunk_maps_lock);
+		auto found = server.chunk_maps.find(key);
+		if (found != server.chunk_maps.end() && found->second.owner == serial)
+			done = found->second.chunk_map;
+	}
+	if (done == nullptr)
+	{
+		log(file_name + " was not announced on this session * file chunks done request *");
+		return false;
+	}
+	if (!file_request_context(clt_id, aes_key))
+		return false;
+
+	if (!done->complete())
+	{
+		log(std::to_string(done->count - done->stored_count()) + " of " + std::to_string(done->count) + " chunks of " +
+			file_name + " are missing * file chunks done request *");
+		send_chunks_status(clt_id, *done);
+		return true;
+	}
+	{
+		std::lock_guard<std::mutex> lock(server.chunk_maps_lock);
+		server.chunk_maps.erase(key);
+	}
+	std::string path;
+	if (!Storage::commit_part_file(dir_path, file_name, done->file_size, path))
+	{
+		log(file_name + " file couldn't be created / overwritten * file chunks done request *");
+		return false;
+	}
+	Storage::delete_chunk_map(dir_path, file_name);
+	uint64_t total_content_size = 0;
+	CRC file_digest;
+	for (uint32_t i = 0; i < done->count; ++i)
+	{
+		total_content_size += AESWrapper::encrypted_size(done->size_of(i));
+		file_digest.combine(CRC::restore(done->cksums[i], done->size_of(i)));
+	}
+	return file_received(clt_id, path, total_content_size, file_digest.digest());
+}
+
+// handle type CRC request (valid / not valid / 4th time not valid)
+bool Session::req_crc()
+{
+	ReqValidCRC req(clt_id);
+	if (in_buff.size() < sizeof(req.payload))
+	{
+		log("failed to unpack CRC type request data");
+		return false;
+	}
+	memcpy(&req.payload, in_buff.data(), sizeof(req.payload));
+	const std::string name = field_string(req.payload.file_name.file_name, FILE_NAME_SIZE);
+	if (!database->clt_id_exists(req.payload.clt_id))
+	{
+		log("client ID not exists *CRC request*");
+		return false;
+	}
+
+	if (hdr.req_code == REQ_VALID_CRC && !database->set_file_verify(1, req.payload.clt_id, name))
+	{
+		log("*CRC Valid request* couldn't update file verification in the database");
+		return false;
+	}
+	if (hdr.req_code == REQ_4NVALID_CRC)
+	{
+		std::string username, user_dir;
+		if (!database->remove_file(req.payload.clt_id, name) || !database->get_clt_username(req.payload.clt_id, username) ||
+			!Storage::valid_file_name(name) || !Storage::create_dir(username, user_dir))
+		{
+			log("*CRC 4TH Time not valid* cannot remove file " + name);
+			return false;
+		}
+		// a file which was stored by its chunks is a recipe, its chunks are released
+		if (::access((Storage::file_path(user_dir, name) + RECIPE_SUFFIX).c_str(), F_OK) == 0)
+			server.remove_recipe(*database, user_dir, name);
+		else if (!Storage::delete_file(Storage::file_path(user_dir, name)))
+		{
+			log("*CRC 4TH Time not valid* cannot delete file " + name);
+			return false;
+		}
+	}
+	// after a not valid CRC confirm, the client sends the file again, as any other request
+	send_header(RES_MSG_CONFIRM, 0);
+	return true;
+}
+
+// validate the client of a file type request and prepare what is needed to store its file (dir_path is set to the
+// client files directory)
+bool Session::file_request_context(const CltId& clt_id, CltSymmetricKey& aes_key)
+{
+	std::string username;
+	if (!database->clt_id_exists(clt_id))
+	{
+		log("client ID not exists");
+		return false;
+	}
+	if (!database->get_clt_aes_key(clt_id, aes_key))
+	{
+		log("AES Key of client couldn't be retrieved from database");
+		return false;
+	}
+	// the directory of the client files is named after its username
+	if (!database->get_clt_username(clt_id, username) || !Storage::valid_file_name(username) ||
+		!Storage::create_dir(username, dir_path))
+	{
+		log("Directory for client files couldn't be created");
+		return false;
+	}
+	if (!Storage::valid_file_name(file_name))
+	{
+		log("file name " + file_name + " is not valid");
+		return false;
+	}
+	return true;
+}
+
+// store the File entry of a received file (if not already exists) and send the got file response
+bool Session::file_received(const CltId& clt_id, const std::string& path, uint64_t content_size, uint32_t cksum)
+{
+	if (!database->file_exists(clt_id, file_name))
+	{
+		// verified = 0 (false) until cksum is verified
+		if (!database->store_file(clt_id, file_name, path))
+		{
+			log(file_name + " file couldn't be stored in the database * file request *");
+			return false;
+		}
+	}
+	else if (!database->set_file_path(clt_id, file_name, path)) // a file replaced the recipe of a newer server
+	{
+		log(file_name + " file path couldn't be updated in the database * file request *");
+		return false;
+	}
+	// a file which was stored by its chunks before and now as a whole file, drops its recipe
+	server.remove_recipe(*database, dir_path, file_name);
+	if (server.is_verbose())
+		log(file_name + " file successfully stored in the database * file request *");
+
+	ResGotFile res;
+	res.hdr.svr_version = SVR_VERSION;
+	res.hdr.res_code = RES_GOT_FILE;
+	res.hdr.payload_size = sizeof(res.payload);
+	res.payload.clt_id = clt_id;
+	res.payload.file_content_size = static_cast<uint32_t>(content_size);
+	memset(res.payload.file_name.file_name, 0, FILE_NAME_SIZE);
+	memcpy(res.payload.file_name.file_name, file_name.data(), std::min(file_name.size(), FILE_NAME_SIZE));
+	res.payload.cksum = cksum;
+	send(&res, sizeof(res));
+	return true;
+}
+
+// send the file chunks status response, which chunks of the file are stored and their cksums
+void Session::send_chunks_status(const CltId& clt_id, const ChunkMap& chunk_map)
+{
+	ResFileChunksStatus res;
+	res.clt_id = clt_id;
+	res.chunks_count = chunk_map.count;
+	send_header(RES_FILE_CHUNKS_STATUS, static_cast<uint32_t>(sizeof(res) + chunk_map.cksums.size() * sizeof(uint32_t) + chunk_map.stored.size()));
+	send(&res, sizeof(res));
+	send(chunk_map.cksums.data(), chunk_map.cksums.size() * sizeof(uint32_t));
+	send(chunk_map.stored.data(), chunk_map.stored.size());
+}
+
+// queue data to be sent, the reactor sends it once the request is handled
+void Session::send(const void* data, size_t size)
+{
+	out_buff.append(static_cast<const char*>(data), size);
+}
+
+void Session::send_header(uint16_t res_code, uint32_t payload_size)
+{
+	ResHeader res_hdr;
+	res_hdr.svr_version = SVR_VERSION;
+	res_hdr.res_code = res_code;
+	res_hdr.payload_size = payload_size;
+	send(&res_hdr, sizeof(res_hdr));
+}
+
+void Session::log(const std::string& message) const
+{
+	Server::log(peer + " " + message);
+}
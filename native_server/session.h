@@ -0,0 +1,127 @@
+/*
+	TransferIt server
+	session.h
+	description: header file for session.cpp
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include "networkProtocol.h"
+#include "AESWrapper.h"
+#include "crc.h"
+#include "storage.h"
+
+class Server;
+class Database;
+struct StripedFile;
+
+const uint8_t SVR_VERSION = VERSION_CTR - 1; // the native server speaks the AES-CBC protocol (v3), see README
+const size_t DEFAULT_RECV_SIZE = 512; // max payload size of a request which is not a file request
+const size_t CRC_PAYLOAD_SIZE = CLT_ID_SIZE + FILE_NAME_SIZE; // v3 clients leave the payload size of CRC type requests unset (0)
+const uint32_t SESSION_TICKET_LIFETIME = 24 * 60 * 60; // seconds a session ticket can be used to skip the key exchange
+
+/* a client connection, a state machine which is fed by its reactor with whatever arrived on the socket (on_recv) and
+handles a request as soon as it is complete. file content is never buffered: it is decrypted, added to the cksum and
+written to the file as it arrives, a request is received in these steps:
+HEADER - the request header.
+PAYLOAD - the whole payload of a request which is not a file request (up to DEFAULT_RECV_SIZE bytes).
+PAYLOAD_HDR - the payload header of a file / file stripe / file chunk request, the content follows.
+CONTENT - the file content.
+TRAILER - the cksum which follows a file chunk.
+the steps which block (database, RSA, committing a file) don't run on the reactor: the session is handed to a worker
+thread with the step as its job, its socket isn't watched until the job is done (run_job, job_done). */
+class Session
+{
+	enum State { HEADER, PAYLOAD, PAYLOAD_HDR, CONTENT, TRAILER };
+
+	int fd;
+	uint64_t serial; // unique among the sessions of the server (owner of a file which is sent chunk by chunk)
+	std::string peer;
+	Server& server;
+	Database* database; // the connection of the worker which runs the job of the session, set only while it runs
+	bool (Session::*job)(); // a step which waits for a worker
+	bool job_result;
+	std::string held; // what arrived after the step which waits for its job
+
+	State state;
+	std::string in_buff; // the header / payload / payload header / trailer received so far
+	size_t expected; // bytes of the current step
+	std::string out_buff; // responses which were not sent yet
+	time_t last_recv;
+	std::string keyed_clt_id; // the client whose AES key this session exchanged / resumed (id_key), only it gets a ticket here
+	uint32_t epoll_events; // the events its reactor waits for on the socket (set by the reactor)
+
+	// the current request
+	ReqHeader hdr;
+	uint64_t content_left;
+	std::unique_ptr<AESWrapper> aes;
+	CRC digest;
+	std::string plain;
+	int file_fd;
+	uint64_t file_offset; // next write position
+	std::string dir_path;
+	CltId clt_id;
+	std::string file_name;
+	uint64_t content_size;
+	uint64_t file_size;
+	uint64_t stripe_offset;
+	uint64_t stripe_size;
+	uint32_t chunk_index;
+	std::shared_ptr<ChunkMap> chunk_map;
+	std::shared_ptr<StripedFile> striped; // the file of the stripe which is being received
+	std::string chunk; // a file chunk is verified in memory before it is stored
+	bool content_valid;
+
+	void next_request();
+	bool step_complete();
+	bool queue_job(bool (Session::*step)());
+	bool handle_request();
+	bool request_handled(bool handled);
+	bool begin_content();
+	bool recv_content(const uint8_t* data, size_t size);
+	bool content_complete();
+	bool commit_content();
+	bool write_content(const std::string& content);
+	void close_file();
+
+	// request handlers
+	bool req_registration();
+	bool req_public_key();
+	bool req_session_ticket();
+	bool req_resume_session();
+	bool req_file_stripes_done();
+	bool req_file_chunks_begin();
+	bool req_file_chunks_done();
+	bool req_crc();
+	bool file_request_context(const CltId& clt_id, CltSymmetricKey& aes_key);
+	bool file_received(const CltId& clt_id, const std::string& path, uint64_t content_size, uint32_t cksum);
+	bool stripe_finished(bool stored);
+	bool chunk_received();
+	void send_chunks_status(const CltId& clt_id, const ChunkMap& chunk_map);
+	void send(const void* data, size_t size);
+	void send_header(uint16_t res_code, uint32_t payload_size);
+	void log(const std::string& message) const;
+
+public:
+	static const time_t RECV_TIMEOUT = 60; // seconds a client may stall in the middle of a request
+
+	Session(int fd, uint64_t serial, const std::string& peer, Server& server);
+	virtual ~Session();
+
+	int get_fd() const { return fd; }
+	const std::string& get_peer() const { return peer; }
+	bool on_recv(const uint8_t* data, size_t size);
+	bool on_send();
+	bool job_pending() const { return job != nullptr; }
+	void run_job(Database& worker_database);
+	bool job_done();
+	bool send_pending() const { return !out_buff.empty(); }
+	uint32_t get_epoll_events() const { return epoll_events; }
+	void set_epoll_events(uint32_t events) { epoll_events = events; }
+	bool in_request() const { return state != HEADER || !in_buff.empty(); }
+	bool stalled(time_t now) const;
+};
@@ -0,0 +1,302 @@
+/*
+	TransferIt server
+	storage.cpp
+	description: the client files of the native server on disk, the same layout as server/helper.py (see storage.h),
+	so the native and the Python servers can take turns serving the same directory
+*/
+
+#include "storage.h"
+#include "crc.h"
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// files are read in blocks of this size (cksum of an assembled file)
+static const size_t READ_BLOCK_SIZE = 256 * 1024;
+
+ChunkMap::ChunkMap(uint64_t file_size, uint32_t chunk_size) : file_size(file_size), chunk_size(chunk_size)
+{
+	count = static_cast<uint32_t>((file_size + chunk_size - 1) / chunk_size);
+	cksums.assign(count, 0);
+	stored.assign((count + 7) / 8, 0);
+}
+
+// size (decrypted) of the chunk at index
+uint32_t ChunkMap::size_of(uint32_t index) const
+{
+	return static_cast<uint32_t>(std::min<uint64_t>(chunk_size, file_size - static_cast<uint64_t>(index) * chunk_size));
+}
+
+bool ChunkMap::is_stored(uint32_t index) const
+{
+	return (stored[index / 8] >> (index % 8)) & 1;
+}
+
+void ChunkMap::set_stored(uint32_t index, uint32_t cksum)
+{
+	cksums[index] = cksum;
+	stored[index / 8] |= static_cast<uint8_t>(1 << (index % 8));
+}
+
+uint32_t ChunkMap::stored_count() const
+{
+	uint32_t stored_chunks = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		stored_chunks += is_stored(i) ? 1 : 0;
+	return stored_chunks;
+}
+
+bool ChunkMap::complete() const
+{
+	return stored_count() == count;
+}
+
+std::string ChunkMap::pack() const
+{
+	std::string data(reinterpret_cast<const char*>(&file_size), sizeof(file_size));
+	data.append(reinterpret_cast<const char*>(&chunk_size), sizeof(chunk_size));
+	data.append(reinterpret_cast<const char*>(cksums.data()), cksums.size() * sizeof(uint32_t));
+	data.append(reinterpret_cast<const char*>(stored.data()), stored.size());
+	return data;
+}
+
+// replace the map with the one packed in data, false if data is not a valid chunk map
+bool ChunkMap::unpack(const std::string& data)
+{
+	uint64_t packed_file_size = 0;
+	uint32_t packed_chunk_size = 0;
+	const size_t hdr_size = sizeof(packed_file_size) + sizeof(packed_chunk_size);
+	if (data.size() < hdr_size)
+		return false;
+	memcpy(&packed_file_size, data.data(), sizeof(packed_file_size));
+	memcpy(&packed_chunk_size, data.data() + sizeof(packed_file_size), sizeof(packed_chunk_size));
+	if (packed_chunk_size == 0 || packed_file_size / packed_chunk_size > MAX_FILE_CHUNKS)
+		return false;
+
+	ChunkMap chunk_map(packed_file_size, packed_chunk_size);
+	if (data.size() != hdr_size + chunk_map.cksums.size() * sizeof(uint32_t) + chunk_map.stored.size())
+		return false;
+	memcpy(chunk_map.cksums.data(), data.data() + hdr_size, chunk_map.cksums.size() * sizeof(uint32_t));
+	memcpy(chunk_map.stored.data(), data.data() + hdr_size + chunk_map.cksums.size() * sizeof(uint32_t), chunk_map.stored.size());
+	*this = chunk_map;
+	return true;
+}
+
+// create (if not exists) the directory of a client in the working directory, dir_path is set to its path
+bool Storage::create_dir(const std::string& dir_name, std::string& dir_path)
+{
+	try
+	{
+		const std::filesystem::path path = std::filesystem::current_path() / dir_name;
+		std::filesystem::create_directories(path);
+		dir_path = path.string();
+		return true;
+	}
+	catch (std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return false;
+	}
+}
+
+std::string Storage::file_path(const std::string& dir_path, const std::string& file_name)
+{
+	return (std::filesystem::path(dir_path) / file_name).string();
+}
+
+// a file name is stored in the client directory itself, not anywhere else
+bool Storage::valid_file_name(const std::string& file_name)
+{
+	return !file_name.empty() && file_name != "." && file_name != ".." && file_name.find('/') == std::string::npos;
+}
+
+// open the file which a file is received in for writing (truncated if exists), the stored file is kept until then,
+// Return the file descriptor (-1 on failure)
+int Storage::open_recv_file(const std::string& dir_path, const std::string& file_name)
+{
+	const int fd = ::open((file_path(dir_path, file_name) + RECV_FILE_SUFFIX).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		std::cout << file_name << RECV_FILE_SUFFIX << ": " << strerror(errno) << std::endl;
+	return fd;
+}
+
+// turn the received file into the final file (overwrite it if exists), path is set to the final file path
+bool Storage::commit_recv_file(const std::string& dir_path, const std::string& file_name, std::string& path)
+{
+	path = file_path(dir_path, file_name);
+	if (::rename((path + RECV_FILE_SUFFIX).c_str(), path.c_str()) != 0)
+	{
+		std::cout << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// open (create if not exists) the partial file a file is assembled in, for random access writing, NOT truncated,
+// Return the file descriptor (-1 on failure)
+int Storage::open_part_file(const std::string& dir_path, const std::string& file_name)
+{
+	const int fd = ::open((file_path(dir_path, file_name) + PART_FILE_SUFFIX).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		std::cout << file_name << PART_FILE_SUFFIX << ": " << strerror(errno) << std::endl;
+	return fd;
+}
+
+// turn the assembled partial file into the final file (overwrite it if exists), truncated to file_size first
+bool Storage::commit_part_file(const std::string& dir_path, const std::string& file_name, uint64_t file_size, std::string& path)
+{
+	path = file_path(dir_path, file_name);
+	const std::string part_path = path + PART_FILE_SUFFIX;
+	if (::truncate(part_path.c_str(), static_cast<off_t>(file_size)) != 0 || ::rename(part_path.c_str(), path.c_str()) != 0)
+	{
+		std::cout << part_path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// delete the partial file of a file (of a striped file which failed / was abandoned), if exists
+void Storage::delete_part_file(const std::string& dir_path, const std::string& file_name)
+{
+	const std::string part_path = file_path(dir_path, file_name) + PART_FILE_SUFFIX;
+	if (::unlink(part_path.c_str()) != 0 && errno != ENOENT)
+		std::cout << part_path << ": " << strerror(errno) << std::endl;
+}
+
+// load the chunk map of a file, a new one (no chunk is stored) if there is none / it was stored for another file size
+// or chunk size (the file was changed)
+ChunkMap Storage::load_chunk_map(const std::string& dir_path, const std::string& file_name, uint64_t file_size, uint32_t chunk_size)
+{
+	std::ifstream map_file(file_path(dir_path, file_name) + CHUNK_MAP_SUFFIX, std::ios::binary);
+	if (map_file)
+	{
+		const std::string data((std::istreambuf_iterator<char>(map_file)), std::istreambuf_iterator<char>());
+		ChunkMap chunk_map(0, 1);
+		if (chunk_map.unpack(data) && chunk_map.file_size == file_size && chunk_map.chunk_size == chunk_size)
+			return chunk_map;
+	}
+	return ChunkMap(file_size, chunk_size);
+}
+
+// store the chunk map of a file (replaced at once, so a crash leaves either the old or the new chunk map)
+bool Storage::store_chunk_map(const std::string& dir_path, const std::string& file_name, const ChunkMap& chunk_map)
+{
+	const std::string map_path = file_path(dir_path, file_name) + CHUNK_MAP_SUFFIX;
+	const std::string data = chunk_map.pack();
+	const int fd = ::open((map_path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	const bool written = fd >= 0 && write_all(fd, reinterpret_cast<const uint8_t*>(data.data()), data.size());
+	if (fd >= 0)
+		::close(fd);
+	if (!written || ::rename((map_path + ".tmp").c_str(), map_path.c_str()) != 0)
+	{
+		std::cout << map_path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Storage::delete_chunk_map(const std::string& dir_path, const std::string& file_name)
+{
+	return ::unlink((file_path(dir_path, file_name) + CHUNK_MAP_SUFFIX).c_str()) == 0 || errno == ENOENT;
+}
+
+// load the recipe of a file (chunks count (uint32_t), then the chunks), false if there is no (valid) recipe
+bool Storage::load_recipe(const std::string& dir_path, const std::string& file_name, std::vector<ChunkRef>& chunks)
+{
+	std::ifstream recipe_file(file_path(dir_path, file_name) + RECIPE_SUFFIX, std::ios::binary);
+	if (!recipe_file)
+		return false;
+	const std::string data((std::istreambuf_iterator<char>(recipe_file)), std::istreambuf_iterator<char>());
+	uint32_t count = 0;
+	if (data.size() < sizeof(count))
+		return false;
+	memcpy(&count, data.data(), sizeof(count));
+	if (data.size() != sizeof(count) + static_cast<size_t>(count) * sizeof(ChunkRef))
+	{
+		std::cout << "recipe size " << data.size() << " not match its " << count << " chunks" << std::endl;
+		return false;
+	}
+	chunks.resize(count);
+	memcpy(chunks.data(), data.data() + sizeof(count), data.size() - sizeof(count));
+	return true;
+}
+
+// path of a chunk (by its hash) in the chunk store, chunk_store/<first 2 hex digits>/<hex hash>
+std::string Storage::chunk_path(const uint8_t* chunk_hash)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex_hash;
+	for (size_t i = 0; i < CHUNK_HASH_SIZE; ++i)
+	{
+		hex_hash += digits[chunk_hash[i] >> 4];
+		hex_hash += digits[chunk_hash[i] & 0xF];
+	}
+	return (std::filesystem::current_path() / CHUNK_STORE_DIR / hex_hash.substr(0, 2) / hex_hash).string();
+}
+
+// delete the contents of the given chunks from the chunk store (a chunk which is not there is skipped)
+void Storage::delete_chunks(const std::vector<std::string>& hashes)
+{
+	for (const std::string& chunk_hash : hashes)
+	{
+		if (chunk_hash.size() == CHUNK_HASH_SIZE)
+			::unlink(chunk_path(reinterpret_cast<const uint8_t*>(chunk_hash.data())).c_str());
+	}
+}
+
+// write all the data to fd (at its position, or at offset if not -1)
+bool Storage::write_all(int fd, const uint8_t* data, size_t size, int64_t offset)
+{
+	while (size > 0)
+	{
+		const ssize_t written = (offset < 0) ? ::write(fd, data, size) : ::pwrite(fd, data, size, static_cast<off_t>(offset));
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= static_cast<size_t>(written);
+		if (offset >= 0)
+			offset += written;
+	}
+	return true;
+}
+
+// cksum of a stored file, calculated identically to the Linux cksum command
+bool Storage::calc_file_crc(const std::string& path, uint32_t& cksum)
+{
+	const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		std::cout << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> block(READ_BLOCK_SIZE);
+	CRC digest;
+	ssize_t size = 0;
+	while ((size = ::read(fd, block.data(), block.size())) > 0 || (size < 0 && errno == EINTR))
+	{
+		if (size > 0)
+			digest.update(block.data(), static_cast<size_t>(size));
+	}
+	::close(fd);
+	if (size < 0)
+		return false;
+	cksum = digest.digest();
+	return true;
+}
+
+bool Storage::delete_file(const std::string& path)
+{
+	if (::unlink(path.c_str()) != 0)
+	{
+		std::cout << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
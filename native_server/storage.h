@@ -0,0 +1,76 @@
+/*
+	TransferIt server
+	storage.h
+	description: header file for storage.cpp
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "networkProtocol.h"
+
+// the same storage layout as server/helper.py: the files of a client are kept in a directory named after its username
+// (in the working directory), a file is received / assembled under a suffix and replaces the stored file once complete
+const std::string RECV_FILE_SUFFIX = ".recv"; // a file which is sent as a whole
+const std::string PART_FILE_SUFFIX = ".part"; // a file which is assembled from stripes / chunks
+const std::string CHUNK_MAP_SUFFIX = ".part.map"; // which chunks of a partial file are stored (resume after reconnect)
+const std::string RECIPE_SUFFIX = ".recipe"; // a file which was sent by its content defined chunks (by a newer server)
+const std::string CHUNK_STORE_DIR = "chunk_store"; // content defined chunks of all the clients, by their SHA-256
+
+// files which are sent chunk by chunk, as server/networkProtocol.py limits them
+const uint32_t MAX_FILE_CHUNKS = 64 * 1024; // keeps the chunks status response (cksum & bit per chunk) small
+const uint32_t MAX_CHUNK_SIZE = 16 * 1024 * 1024; // a chunk is verified in memory before it is stored
+
+// keeps track of which chunks of a file which is sent chunk by chunk are stored (and verified) so far, and the cksum of
+// each stored chunk. stored as helper.ChunkMap packs it: file size (uint64_t), chunk size (uint32_t), the cksums
+// (uint32_t each) and a bitmap of the stored chunks (bit i % 8 of byte i / 8), little endian
+class ChunkMap
+{
+public:
+	uint64_t file_size;
+	uint32_t chunk_size;
+	uint32_t count;
+	std::vector<uint32_t> cksums;
+	std::vector<uint8_t> stored;
+
+	ChunkMap(uint64_t file_size, uint32_t chunk_size);
+
+	uint32_t size_of(uint32_t index) const;
+	bool is_stored(uint32_t index) const;
+	void set_stored(uint32_t index, uint32_t cksum);
+	uint32_t stored_count() const;
+	bool complete() const;
+	std::string pack() const;
+	bool unpack(const std::string& data);
+};
+
+class Storage
+{
+public:
+	static bool create_dir(const std::string& dir_name, std::string& dir_path);
+	static std::string file_path(const std::string& dir_path, const std::string& file_name);
+	static bool valid_file_name(const std::string& file_name);
+
+	// files which are sent as a whole
+	static int open_recv_file(const std::string& dir_path, const std::string& file_name);
+	static bool commit_recv_file(const std::string& dir_path, const std::string& file_name, std::string& path);
+
+	// files which are assembled from stripes / chunks
+	static int open_part_file(const std::string& dir_path, const std::string& file_name);
+	static bool commit_part_file(const std::string& dir_path, const std::string& file_name, uint64_t file_size, std::string& path);
+	static void delete_part_file(const std::string& dir_path, const std::string& file_name);
+	static ChunkMap load_chunk_map(const std::string& dir_path, const std::string& file_name, uint64_t file_size, uint32_t chunk_size);
+	static bool store_chunk_map(const std::string& dir_path, const std::string& file_name, const ChunkMap& chunk_map);
+	static bool delete_chunk_map(const std::string& dir_path, const std::string& file_name);
+
+	// recipes & the chunk store (files which were sent by their content defined chunks)
+	static bool load_recipe(const std::string& dir_path, const std::string& file_name, std::vector<ChunkRef>& chunks);
+	static std::string chunk_path(const uint8_t* chunk_hash);
+	static void delete_chunks(const std::vector<std::string>& hashes);
+
+	static bool write_all(int fd, const uint8_t* data, size_t size, int64_t offset = -1);
+	static bool calc_file_crc(const std::string& path, uint32_t& cksum);
+	static bool delete_file(const std::string& path);
+};
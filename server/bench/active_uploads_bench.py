@@ -0,0 +1,107 @@
+"""
+TransferIt server
+active_uploads_bench.py
+description: benchmark of many file uploads in progress at once on the Python server: every upload sends the first half
+of its content and stalls, a probe session (registration, key exchange, file, valid CRC) is timed while they all wait,
+then the uploads send the rest of their contents and their cksums are checked. the uploads are more than the worker
+threads (Server.REQUEST_WORKERS), the probe shows whether a stalled upload holds a worker thread
+usage: python bench/active_uploads_bench.py [--uploads N] [--file-size BYTES] [--probe-timeout S]
+(run from the server directory, the server runs in a temporary directory in it)
+"""
+import os
+import time
+import uuid
+import socket
+import struct
+import argparse
+import tempfile
+from pathlib import Path
+
+from native_bench import SERVER_DIR, VERSION, BenchClient, recv_exact, start_server  # also puts the server on sys.path
+import networkProtocol
+import crc
+from Crypto.PublicKey import RSA
+from Crypto.Cipher import PKCS1_OAEP, AES
+from Crypto.Util.Padding import pad
+
+
+class StalledUpload(BenchClient):
+    """ a v3 client session which sends half of its file content and waits until it is told to send the rest """
+
+    def begin(self, content):
+        """ register, exchange keys and send the file request with the first half of its content """
+        name = f"bench {uuid.uuid4().hex[:12]}".encode().ljust(networkProtocol.CLT_USERNAME_SIZE, b"\0")
+        self.clt_id = self.request(networkProtocol.REQ_REGISTRATION, name, networkProtocol.RES_REGISTRATION_SUCCESS)
+        res = self.request(networkProtocol.REQ_PUBLIC_KEY, name + self.public_key, networkProtocol.RES_AES_KEY)
+        self.aes_key = PKCS1_OAEP.new(self.rsa_key).decrypt(res[networkProtocol.CLT_ID_SIZE:])
+
+        encrypted = AES.new(self.aes_key, AES.MODE_CBC, bytes(16)).encrypt(pad(content, 16))
+        payload = self.clt_id + struct.pack("<L", len(encrypted)) + \
+            b"stalled.bin".ljust(networkProtocol.FILE_NAME_SIZE, b"\0") + encrypted
+        request = self.clt_id + struct.pack("<BHL", VERSION, networkProtocol.REQ_FILE, len(payload)) + payload
+        self.rest = request[len(request) // 2:]
+        self.sock.sendall(request[:len(request) // 2])
+
+    def finish(self, content):
+        """ send the rest of the file content, Return True if the server answered with the cksum of the content
+        (False if the server gave up on the upload meanwhile) """
+        try:
+            self.sock.sendall(self.rest)
+            svr_version, res_code, payload_size = struct.unpack("<BHL", recv_exact(self.sock, 7))
+            res = recv_exact(self.sock, payload_size)
+        except OSError:
+            return False
+        digest = crc.crc32()
+        digest.update(content)
+        return res_code == networkProtocol.RES_GOT_FILE and struct.unpack("<L", res[-4:])[0] == digest.digest()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="file uploads in progress at once on the Python server")
+    parser.add_argument("--uploads", type=int, default=256, help="uploads which stall in the middle of their content")
+    parser.add_argument("--file-size", type=int, default=1024 * 1024, help="bytes of the file of every upload")
+    parser.add_argument("--probe-timeout", type=float, default=30, help="seconds the probe session may take")
+    args = parser.parse_args()
+
+    # e=17 gives the 160 bytes DER public key the protocol carries (as CryptoPP does)
+    rsa_key = RSA.generate(1024, e=17)
+    public_key = rsa_key.publickey().export_key("DER")
+    content = os.urandom(args.file_size)
+    with tempfile.TemporaryDirectory(dir=SERVER_DIR) as work_dir:
+        with socket.socket() as probe:  # a free port
+            probe.bind(("127.0.0.1", 0))
+            port = probe.getsockname()[1]
+        server = start_server("python", Path(work_dir), port, None, 0)
+        uploads = []
+        try:
+            start = time.perf_counter()
+            for _ in range(args.uploads):
+                uploads.append(StalledUpload(port, rsa_key, public_key))
+                uploads[-1].begin(content)
+            print(f"{args.uploads} uploads stalled in the middle of their content in {time.perf_counter() - start:.2f} s")
+
+            clt = BenchClient(port, rsa_key, public_key)
+            clt.sock.settimeout(args.probe_timeout)
+            start = time.perf_counter()
+            try:
+                clt.session(f"probe {uuid.uuid4().hex[:12]}", "probe.bin", content)
+                print(f"probe session while they wait: {(time.perf_counter() - start) * 1000:.2f} ms")
+            except socket.timeout:
+                print(f"probe session while they wait: no response within {args.probe_timeout} s")
+            finally:
+                clt.close()
+
+            start = time.perf_counter()
+            stored = sum(upload.finish(content) for upload in uploads)
+            elapsed = time.perf_counter() - start
+            print(f"{stored} of {args.uploads} uploads stored with a matching cksum in {elapsed:.2f} s, "
+                  f"{args.uploads * args.file_size / elapsed / 2 ** 20:.1f} MB/s")
+        finally:
+            for upload in uploads:
+                upload.close()
+            server.terminate()
+            server.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+"""
+TransferIt server
+database_bench.py
+description: benchmark of the database operations of concurrent sessions, every session registers a client, exchanges
+keys, stores a file and verifies its cksum (the queries the request handlers run for them, LastSeen after every request)
+usage: python bench/database_bench.py [--threads N] [--sessions N] [--batch-size N] [--batch-delay S]
+(run from the server directory)
+"""
+import sys
+import time
+import uuid
+import datetime
+import argparse
+import tempfile
+import threading
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+import database  # noqa: E402
+import networkProtocol  # noqa: E402
+
+
+def run_session(db, index):
+    """ the database operations of one session (4 requests)
+    Return the number of requests which succeeded """
+    name = f"bench {threading.get_ident()} {index}".encode()
+    clt = database.Client(uuid.uuid4().hex, name, None, str(datetime.datetime.now()), None)
+    done = 0
+
+    # registration request
+    if not db.clt_username_exists(name) and db.store_clt(clt):
+        done += 1
+    db.set_last_seen(clt.ID, str(datetime.datetime.now()))
+
+    # public key request
+    if db.clt_username_exists(name) and db.set_public_key(clt.ID, bytes(networkProtocol.CLT_PUBLICKEY_SIZE)) and \
+            db.set_aes_key(clt.ID, bytes(networkProtocol.CLT_SYMMETRICKEY_SIZE)) and db.remove_ticket(clt.ID):
+        done += 1
+    db.set_last_seen(clt.ID, str(datetime.datetime.now()))
+
+    # file request
+    if db.clt_id_exists(clt.ID) and db.get_clt_aes_key(clt.ID) and db.get_clt_username(clt.ID) and \
+            not db.file_exists(b"data.bin", clt.ID) and \
+            db.store_file(database.File(clt.ID, b"data.bin", f"{name.decode()}/data.bin", verified=0)):
+        done += 1
+    db.set_last_seen(clt.ID, str(datetime.datetime.now()))
+
+    # CRC valid request
+    if db.clt_id_exists(clt.ID) and db.set_file_verify(1, clt.ID, b"data.bin"):
+        done += 1
+    db.set_last_seen(clt.ID, str(datetime.datetime.now()))
+    return done
+
+
+def main():
+    parser = argparse.ArgumentParser(description="database operations of concurrent sessions, requests per second")
+    parser.add_argument("--threads", type=int, default=8, help="concurrent sessions")
+    parser.add_argument("--sessions", type=int, default=200, help="sessions of every thread")
+    parser.add_argument("--batch-size", type=int, default=database.Database.WRITE_BATCH_SIZE,
+                        help="writes of one commit at most")
+    parser.add_argument("--batch-delay", type=float, default=database.Database.WRITE_BATCH_DELAY,
+                        help="seconds a commit waits for more writes after the first one")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as temp_dir:
+        db = database.Database(str(Path(temp_dir) / "bench.db"), args.batch_size, args.batch_delay)
+        db.tables_init()
+        done = [0] * args.threads
+
+        def worker(thread_index):
+            for i in range(args.sessions):
+                done[thread_index] += run_session(db, i)
+
+        threads = [threading.Thread(target=worker, args=(i,)) for i in range(args.threads)]
+        start = time.perf_counter()
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        elapsed = time.perf_counter() - start
+        db.close()
+
+    requests = args.threads * args.sessions * 4
+    print(f"{sum(done)} of {requests} requests in {elapsed:.2f} s ({sum(done) / elapsed:.0f} requests/s, "
+          f"{args.threads} thread(s)), {db.writer.writes} writes in {db.writer.commits} commits")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,96 @@
+"""
+TransferIt server
+lookup_bench.py
+description: benchmark of the client / file lookups (by username, by client ID & file name) on a large database,
+the database is filled at schema version 1 (no keys / indexes on the lookup paths), the lookups are timed, the database
+is upgraded in place to the latest schema version (see Database.MIGRATIONS) and the lookups are timed again
+usage: python bench/lookup_bench.py [--clients N] [--files-per-client N] [--samples N] [--scan-samples N]
+(run from the server directory, the database is created in a temporary directory in it, about 1.5GB for the defaults)
+"""
+import sys
+import time
+import random
+import argparse
+import tempfile
+import statistics
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+import database  # noqa: E402
+
+FILL_BATCH = 100000  # rows inserted per transaction
+
+
+def clt_id(index):
+    return index.to_bytes(16, "little")
+
+
+def fill(db, clients, files_per_client):
+    """ insert clients & their files (directly, the bench fills the database before the server would use it) """
+    conn = db.connect()
+    for first in range(0, clients, FILL_BATCH):
+        last = min(clients, first + FILL_BATCH)
+        conn.executemany("INSERT INTO clients VALUES (?, ?, NULL, NULL, NULL)",
+                         ((clt_id(i), f"user {i}".encode()) for i in range(first, last)))
+        conn.executemany("INSERT INTO files VALUES (?, ?, ?, 0)",
+                         ((clt_id(i), f"file {j}.bin".encode(), f"user {i}/file {j}.bin")
+                          for i in range(first, last) for j in range(files_per_client)))
+        conn.commit()
+
+
+def time_lookups(db, clients, files_per_client, samples):
+    """ time the lookups of random clients / files
+    Return the latencies (seconds) of every lookup kind """
+    rand = random.Random(samples)
+    lookups = {
+        "clt_username_exists": lambda i, j: db.clt_username_exists(f"user {i}".encode()),
+        "file_exists": lambda i, j: db.file_exists(f"file {j}.bin".encode(), clt_id(i)),
+        "set_file_verify": lambda i, j: db.set_file_verify(1, clt_id(i), f"file {j}.bin".encode())}
+    latencies = {}
+    for name, lookup in lookups.items():
+        latencies[name] = []
+        for _ in range(samples):
+            i, j = rand.randrange(clients), rand.randrange(files_per_client)
+            start = time.perf_counter()
+            if not lookup(i, j):
+                raise RuntimeError(f"{name} of client {i} file {j} failed")
+            latencies[name].append(time.perf_counter() - start)
+    return latencies
+
+
+def report(version, latencies):
+    for name, times in latencies.items():
+        times = sorted(times)
+        p99 = times[min(len(times) - 1, len(times) * 99 // 100)]
+        print(f"schema version {version} {name:20} {len(times):6} lookups, "
+              f"median {statistics.median(times) * 1000:9.3f} ms, p99 {p99 * 1000:9.3f} ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="client / file lookup latency before and after the schema upgrade")
+    parser.add_argument("--clients", type=int, default=1000000)
+    parser.add_argument("--files-per-client", type=int, default=10)
+    parser.add_argument("--samples", type=int, default=1000, help="lookups of every kind after the upgrade")
+    parser.add_argument("--scan-samples", type=int, default=5, help="lookups of every kind before the upgrade")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory(dir=".") as temp_dir:
+        db = database.Database(str(Path(temp_dir) / "bench.db"))
+        if not db.tables_init(version=1):
+            return
+        start = time.perf_counter()
+        fill(db, args.clients, args.files_per_client)
+        print(f"{args.clients} clients, {args.clients * args.files_per_client} files inserted in "
+              f"{time.perf_counter() - start:.1f} s")
+        report(db.schema_version(), time_lookups(db, args.clients, args.files_per_client, args.scan_samples))
+
+        start = time.perf_counter()
+        if not db.tables_init():
+            return
+        print(f"upgraded to schema version {db.schema_version()} in {time.perf_counter() - start:.1f} s")
+        report(db.schema_version(), time_lookups(db, args.clients, args.files_per_client, args.samples))
+        db.close()
+
+
+if __name__ == '__main__':
+    main()
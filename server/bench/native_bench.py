@@ -0,0 +1,209 @@
+"""
+TransferIt server
+native_bench.py
+description: head-to-head benchmark of the Python server and the native server (native_server/), both serve the same
+load: concurrent client processes run whole v3 sessions (registration, public key, file, valid CRC) back to back,
+every server runs in a temporary directory of its own (port.info, server.db, client files)
+usage: python bench/native_bench.py --native PATH [--clients N] [--sessions N] [--file-size BYTES] [--threads N]
+[--servers python,native]
+(run from the server directory, PATH is the native server binary)
+"""
+import os
+import sys
+import time
+import uuid
+import socket
+import struct
+import argparse
+import tempfile
+import subprocess
+import multiprocessing
+from pathlib import Path
+
+SERVER_DIR = Path(__file__).resolve().parent.parent
+sys.path.insert(0, str(SERVER_DIR))
+import networkProtocol  # noqa: E402
+import crc  # noqa: E402
+from Crypto.PublicKey import RSA  # noqa: E402
+from Crypto.Cipher import PKCS1_OAEP, AES  # noqa: E402
+from Crypto.Util.Padding import pad  # noqa: E402
+
+VERSION = networkProtocol.VERSION_CTR - 1  # the protocol version both servers speak
+REQUESTS = {networkProtocol.REQ_REGISTRATION: "registration", networkProtocol.REQ_PUBLIC_KEY: "public key",
+            networkProtocol.REQ_FILE: "file", networkProtocol.REQ_VALID_CRC: "valid CRC"}
+START_TIMEOUT = 10  # seconds a server may take to listen
+start_barrier = None  # the clients start their sessions together, after their keys are generated
+
+
+def recv_exact(sock, size):
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed by the server")
+        data += chunk
+    return data
+
+
+class BenchClient:
+    """ a v3 client session, the requests are packed as client/client/networkProtocol.h packs them """
+
+    def __init__(self, port, rsa_key, public_key):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.rsa_key = rsa_key
+        self.public_key = public_key
+        self.clt_id = bytes(networkProtocol.CLT_ID_SIZE)
+        self.aes_key = None
+
+    def close(self):
+        self.sock.close()
+
+    def request(self, code, payload, expected_code):
+        """ send a request and receive its response
+        Return the response payload """
+        self.sock.sendall(self.clt_id + struct.pack("<BHL", VERSION, code, len(payload)) + payload)
+        svr_version, res_code, payload_size = struct.unpack("<BHL", recv_exact(self.sock, 7))
+        if res_code != expected_code:
+            raise ValueError(f"response code {res_code} to request {code}, expected {expected_code}")
+        return recv_exact(self.sock, payload_size)
+
+    def session(self, name, file_name, content):
+        """ run a whole session, Return the latency (seconds) of every request by its code """
+        latency = {}
+        padded_name = name.encode().ljust(networkProtocol.CLT_USERNAME_SIZE, b"\0")
+        padded_file_name = file_name.encode().ljust(networkProtocol.FILE_NAME_SIZE, b"\0")
+
+        start = time.perf_counter()
+        self.clt_id = self.request(networkProtocol.REQ_REGISTRATION, padded_name, networkProtocol.RES_REGISTRATION_SUCCESS)
+        latency[networkProtocol.REQ_REGISTRATION] = time.perf_counter() - start
+
+        start = time.perf_counter()
+        res = self.request(networkProtocol.REQ_PUBLIC_KEY, padded_name + self.public_key, networkProtocol.RES_AES_KEY)
+        latency[networkProtocol.REQ_PUBLIC_KEY] = time.perf_counter() - start
+        self.aes_key = PKCS1_OAEP.new(self.rsa_key).decrypt(res[networkProtocol.CLT_ID_SIZE:])
+
+        encrypted = AES.new(self.aes_key, AES.MODE_CBC, bytes(16)).encrypt(pad(content, 16))
+        start = time.perf_counter()
+        res = self.request(networkProtocol.REQ_FILE, self.clt_id + struct.pack("<L", len(encrypted)) + padded_file_name
+                           + encrypted, networkProtocol.RES_GOT_FILE)
+        latency[networkProtocol.REQ_FILE] = time.perf_counter() - start
+        digest = crc.crc32()
+        digest.update(content)
+        if struct.unpack("<L", res[-4:])[0] != digest.digest():
+            raise ValueError(f"cksum of {file_name} not match")
+
+        start = time.perf_counter()
+        self.request(networkProtocol.REQ_VALID_CRC, self.clt_id + padded_file_name, networkProtocol.RES_MSG_CONFIRM)
+        latency[networkProtocol.REQ_VALID_CRC] = time.perf_counter() - start
+        return latency
+
+
+def init_client(barrier):
+    global start_barrier
+    start_barrier = barrier
+
+
+def run_client(args):
+    """ run the sessions of one client process
+    Return the time its sessions started & ended, the session latencies & the request latencies (by request code) """
+    port, sessions, file_size = args
+    # the key pair of a process is reused by its sessions (the key exchange is timed on the server side),
+    # e=17 gives the 160 bytes DER public key the protocol carries (as CryptoPP does)
+    rsa_key = RSA.generate(1024, e=17)
+    public_key = rsa_key.publickey().export_key("DER")
+    content = os.urandom(file_size)
+    session_latency, request_latency = [], {code: [] for code in REQUESTS}
+    start_barrier.wait()
+    first = time.monotonic()
+    for i in range(sessions):
+        clt = BenchClient(port, rsa_key, public_key)
+        start = time.perf_counter()
+        try:
+            latency = clt.session(f"bench {uuid.uuid4().hex[:12]}", f"file {i}.bin", content)
+        finally:
+            clt.close()
+        session_latency.append(time.perf_counter() - start)
+        for code, seconds in latency.items():
+            request_latency[code].append(seconds)
+    return first, time.monotonic(), session_latency, request_latency
+
+
+def start_server(kind, work_dir, port, native_path, threads):
+    """ start a server in work_dir, Return its process once it listens """
+    (work_dir / "port.info").write_text(f"{port}\n")
+    if kind == "python":
+        command = [sys.executable, str(SERVER_DIR / "main.py")]
+    else:
+        command = [native_path] + (["--threads", str(threads)] if threads else [])
+    process = subprocess.Popen(command, cwd=work_dir, stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+    deadline = time.monotonic() + START_TIMEOUT
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=1).close()
+            return process
+        except OSError:
+            time.sleep(0.1)
+    process.kill()
+    raise RuntimeError(f"{kind} server didn't listen on port {port} within {START_TIMEOUT} seconds")
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def bench(kind, args):
+    """ run the load against one server kind, Return its results """
+    with tempfile.TemporaryDirectory(dir=SERVER_DIR) as work_dir:
+        with socket.socket() as probe:  # a free port
+            probe.bind(("127.0.0.1", 0))
+            port = probe.getsockname()[1]
+        server = start_server(kind, Path(work_dir), port, args.native, args.threads)
+        try:
+            barrier = multiprocessing.Barrier(args.clients)
+            with multiprocessing.Pool(args.clients, initializer=init_client, initargs=(barrier,)) as pool:
+                outcomes = pool.map(run_client, [(port, args.sessions, args.file_size)] * args.clients)
+        finally:
+            server.terminate()
+            server.wait()
+
+    elapsed = max(end for _, end, _, _ in outcomes) - min(start for start, _, _, _ in outcomes)
+    session_latency = [seconds for _, _, latency, _ in outcomes for seconds in latency]
+    request_latency = {code: [seconds for _, _, _, latency in outcomes for seconds in latency[code]] for code in REQUESTS}
+    return {"elapsed": elapsed, "sessions": len(session_latency), "session_latency": session_latency,
+            "request_latency": request_latency}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Python server vs native server, whole v3 sessions")
+    parser.add_argument("--native", required=True, help="path of the native server binary")
+    parser.add_argument("--clients", type=int, default=8, help="concurrent client processes")
+    parser.add_argument("--sessions", type=int, default=25, help="sessions every client runs")
+    parser.add_argument("--file-size", type=int, default=1024 * 1024, help="bytes of the file of every session")
+    parser.add_argument("--threads", type=int, default=0, help="native server reactors (default: the number of cores)")
+    parser.add_argument("--servers", default="python,native", help="the servers to bench, comma separated")
+    args = parser.parse_args()
+    args.native = str(Path(args.native).resolve())
+
+    print(f"{args.clients} clients x {args.sessions} sessions, {args.file_size} bytes file per session")
+    results = {}
+    for kind in args.servers.split(","):
+        results[kind] = bench(kind, args)
+        result = results[kind]
+        print(f"\n{kind} server: {result['sessions']} sessions in {result['elapsed']:.2f} s, "
+              f"{result['sessions'] / result['elapsed']:.1f} sessions/s, "
+              f"{result['sessions'] * args.file_size / result['elapsed'] / 2 ** 20:.1f} MB/s")
+        latency = result["session_latency"]
+        print(f"  session      p50 {percentile(latency, 0.5) * 1000:8.2f} ms  p99 {percentile(latency, 0.99) * 1000:8.2f} ms")
+        for code, name in REQUESTS.items():
+            latency = result["request_latency"][code]
+            print(f"  {name:<12} p50 {percentile(latency, 0.5) * 1000:8.2f} ms  p99 {percentile(latency, 0.99) * 1000:8.2f} ms")
+    if "python" in results and "native" in results:
+        speedup = (results["native"]["sessions"] / results["native"]["elapsed"]) / \
+                  (results["python"]["sessions"] / results["python"]["elapsed"])
+        print(f"\nnative / python throughput: {speedup:.2f}x")
+
+
+if __name__ == "__main__":
+    main()
@@ -4,8 +4,14 @@ crc.py
 description: calc CRC as Linux cksum command
 source: https://stackoverflow.com/questions/65131642/what-is-a-python-cksum-equivalent-for-very-large-files-and-how-does
 -it-work
+uses the native module (native/transferit_native) if it was built, the pure Python implementation (py_crc32) otherwise
 """
 
+try:
+    from native import transferit_native  # cksum without the GIL (python native/setup.py build_ext --inplace)
+except ImportError:
+    transferit_native = None
+
 crctab = [
     0x00000000,
     0x04C11DB7,
@@ -268,7 +274,7 @@ crctab = [
 UNSIGNED = lambda n: n & 0xFFFFFFFF
 
 
-class crc32:
+class py_crc32:
     def __init__(self):
         self.nchars = 0
         self.crc = 0
@@ -288,3 +294,7 @@ class crc32:
             crc = crctab[(crc >> 24) ^ c] ^ ((crc << 8) & 0xFFFFFFFF)
             n >>= 8
         return UNSIGNED(~crc)
+
+
+# the cksum of a content which arrives chunk by chunk (update / digest)
+crc32 = transferit_native.Cksum if transferit_native is not None else py_crc32
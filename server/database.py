@@ -5,69 +5,265 @@ description: this file handles the server database (creation, database operation
 """
 import networkProtocol
 import sqlite3
+import threading  # for the connection of every thread & the writer thread
+import queue  # for the writes of all the sessions (see MetadataWriter)
+import time  # for the delay of a write group
+
+
+class QueuedWrite:
+    """ a write which waits in the queue of the writer thread, its outcome is set once it was committed (the lock is
+    held until then) """
+
+    def __init__(self, query, params, many):
+        self.query = query
+        self.params = params
+        self.many = many
+        self.outcome = None
+        self.done = threading.Lock()
+        self.done.acquire()
+
+    def set_outcome(self, outcome):
+        self.outcome = outcome
+        self.done.release()
+
+    def result(self):
+        """ wait for the commit, Return the number of rows the write changed (None on failure) """
+        with self.done:
+            return self.outcome
+
+
+class MetadataWriter:
+    """ the single writer of the database: the writes of all the sessions are queued and executed in order by one
+    thread, which commits them in groups - a group takes the writes queued within max_delay seconds of its first write
+    (up to max_batch writes), so one commit serves several sessions. a write which fails doesn't fail the others of its
+    group (unless it aborted the transaction) """
+
+    def __init__(self, database, max_batch, max_delay):
+        self.database = database
+        self.max_batch = max(1, max_batch)
+        self.max_delay = max(0.0, max_delay)
+        self.queue = queue.SimpleQueue()
+        self.writes = 0  # executed so far
+        self.commits = 0
+        self.thread = threading.Thread(target=self.run, name="database writer", daemon=True)
+        self.thread.start()
+
+    def submit(self, query, params, many=False):
+        """ queue a write (query None - no write, its outcome tells the writes queued before it are committed)
+        Return the queued write (see QueuedWrite.result) """
+        write = QueuedWrite(query, params, many)
+        self.queue.put(write)
+        return write
+
+    def run(self):
+        conn = self.database.connect()  # the connection of the writer thread
+        while True:
+            batch = [self.queue.get()]
+            deadline = time.monotonic() + self.max_delay
+            while len(batch) < self.max_batch:
+                try:
+                    batch.append(self.queue.get(timeout=max(0.0, deadline - time.monotonic())))
+                except queue.Empty:
+                    break
+            MetadataWriter.write_batch(conn, batch)
+            self.writes += len(batch)
+            self.commits += 1
+
+    @staticmethod
+    def write_batch(conn, batch):
+        """ execute a group of writes in one transaction and set their outcomes """
+        outcomes = [None] * len(batch)
+        in_transaction = []  # writes of the open transaction
+        for i, write in enumerate(batch):
+            if write.query is None:
+                outcomes[i] = 0
+                continue
+            try:
+                if write.many:
+                    cur = conn.executemany(write.query, write.params)
+                else:
+                    cur = conn.execute(write.query, write.params)
+                outcomes[i] = cur.rowcount
+                in_transaction.append(i)
+            except Exception as e:
+                print(e)
+                if not conn.in_transaction:  # the failure rolled back the writes before it
+                    for j in in_transaction:
+                        outcomes[j] = None
+                    in_transaction = []
+        try:
+            conn.commit()
+        except Exception as e:
+            print(e)
+            conn.rollback()
+            for j in in_transaction:
+                outcomes[j] = None
+        for write, outcome in zip(batch, outcomes):
+            write.set_outcome(outcome)
 
 
 class Database:
-    """ represents the program database """
-
-    def __init__(self, db_name):
+    """ represents the program database. every thread (the request handlers run on several worker threads) keeps one
+    connection open for all its queries, which keeps the statements it prepared (see STATEMENT_CACHE_SIZE). the database
+    is in WAL mode, so readers don't wait for a writer and a commit is an append to the log (synced on checkpoints).
+    writes go through one writer thread, which commits the writes of concurrent sessions together (see MetadataWriter),
+    a write waits for its commit unless its outcome is not needed (the LastSeen of a client) """
+    MAX_QUERY_PARAMS = 500  # parameters of one query (sqlite may be built with a limit of 999)
+    WRITE_BATCH_SIZE = 256  # writes of one commit at most
+    WRITE_BATCH_DELAY = 0.0  # seconds a commit waits for more writes after the first one
+    STATEMENT_CACHE_SIZE = 256  # prepared statements kept by every connection
+    BUSY_TIMEOUT = 10  # seconds a connection waits for the write lock of another connection
+    PRAGMAS = ["PRAGMA synchronous = NORMAL",  # WAL is synced on checkpoints, not on every commit
+               "PRAGMA cache_size = -8192",  # KB of page cache of every connection
+               "PRAGMA temp_store = MEMORY"]
+
+    def __init__(self, db_name, write_batch_size=WRITE_BATCH_SIZE, write_batch_delay=WRITE_BATCH_DELAY):
         self.db_name = db_name
+        self.local = threading.local()
+        self.write_batch_size = write_batch_size
+        self.write_batch_delay = write_batch_delay
+        self.writer = None  # started on the first write
+        self.writer_lock = threading.Lock()
 
     def connect(self):
-        """ attempt to connect to the database """
-        conn = sqlite3.connect(self.db_name)
-        conn.text_factory = bytes
+        """ attempt to connect to the database, the connection of the calling thread is opened once and kept """
+        conn = getattr(self.local, "conn", None)
+        if conn is None:
+            conn = sqlite3.connect(self.db_name, timeout=Database.BUSY_TIMEOUT,
+                                   cached_statements=Database.STATEMENT_CACHE_SIZE)
+            conn.text_factory = bytes
+            conn.execute("PRAGMA journal_mode = WAL")  # stored in the database file, kept by every connection after
+            for pragma in Database.PRAGMAS:
+                conn.execute(pragma)
+            self.local.conn = conn
         return conn
 
-    def executescript(self, script):
-        """ attempt to execute a given script """
-        conn = self.connect()
-        try:
-            conn.executescript(script)
-            conn.commit()
-        except Exception as e:
-            pass
-        conn.close()
+    def close(self):
+        """ wait for the queued writes and close the connection of the calling thread (if open) """
+        self.flush()
+        conn = getattr(self.local, "conn", None)
+        if conn is not None:
+            conn.close()
+            self.local.conn = None
 
     def execute_query(self, query, params, to_commit=False):
-        """ attempt to execute a given query with a given params, return the query outcome.
-        params are for parameterized queries to protect from SQL Injections """
+        """ attempt to execute a given query with a given params, return the query outcome (True for a write which was
+        committed). params are for parameterized queries to protect from SQL Injections """
+        if to_commit:
+            return None if self.execute_write(query, params) is None else True
         outcome = None
         conn = self.connect()
         try:
             cur = conn.cursor()
             cur.execute(query, params)
-            if to_commit:
-                conn.commit()
-                outcome = True
-            else:
-                outcome = cur.fetchall()
+            outcome = cur.fetchall()
         except Exception as e:
             print(e)
-        conn.close()
+            conn.rollback()
         return outcome
 
-    def tables_init(self):
-        """ attempt to create database tables """
-        # clients table creation
-        self.executescript(f"""
-                    CREATE TABLE clients(
-                    ID CHAR(16) PRIMARY KEY,
-                    Name CHAR(255) NOT NULL, 
-                    PublicKey CHAR(160),
-                    LastSeen DATE, 
-                    AESKey CHAR(16));
-                    """)
-
-        # files table creation
-        self.executescript(f"""
-                    CREATE TABLE files(
-                    ID CHAR(16) NOT NULL,
-                    FileName CHAR(255) NOT NULL, 
-                    PathName CHAR(160) NOT NULL, 
-                    Verified INTEGER CHECK(Verified = 0 or Verified = 1),
-                    FOREIGN KEY(ID) REFERENCES clients(ID)); 
-                    """)  # Verified value is 0 or 1 represents a boolean type (sqlite3 don't have bool)
+    def execute_many(self, query, params_list):
+        """ attempt to execute a given query once per params (of params_list) in one transaction
+        Return True on success
+        Return None on failure """
+        return None if self.execute_write(query, params_list, many=True) is None else True
+
+    def execute_write(self, query, params, many=False, wait=True):
+        """ queue a write for the writer thread, wait for its commit (if wait)
+        Return the number of rows it changed (0 if not waited for) on success
+        Return None on failure """
+        with self.writer_lock:
+            if self.writer is None:
+                self.writer = MetadataWriter(self, self.write_batch_size, self.write_batch_delay)
+        write = self.writer.submit(query, params, many)
+        return write.result() if wait else 0
+
+    def flush(self):
+        """ wait until the writes which were queued so far are committed """
+        if self.writer is not None:
+            self.execute_write(None, None)
+
+    # schema migrations, migration N (1-based) upgrades a database of schema version N - 1 to N, the schema version
+    # of a database is kept in its user_version. a database which was created before the migrations has the tables of
+    # migration 1 and version 0 (migration 1 keeps them as is)
+    MIGRATIONS = [
+        # 1 - clients, files, session tickets & the chunk store
+        """
+        CREATE TABLE IF NOT EXISTS clients(
+        ID CHAR(16) PRIMARY KEY,
+        Name CHAR(255) NOT NULL,
+        PublicKey CHAR(160),
+        LastSeen DATE,
+        AESKey CHAR(16));
+
+        -- Verified value is 0 or 1 represents a boolean type (sqlite3 don't have bool)
+        CREATE TABLE IF NOT EXISTS files(
+        ID CHAR(16) NOT NULL,
+        FileName CHAR(255) NOT NULL,
+        PathName CHAR(160) NOT NULL,
+        Verified INTEGER CHECK(Verified = 0 or Verified = 1),
+        FOREIGN KEY(ID) REFERENCES clients(ID));
+
+        -- one ticket per client, bound to the AES key it was issued for, Expires is a unix time (seconds)
+        CREATE TABLE IF NOT EXISTS tickets(
+        ID CHAR(16) PRIMARY KEY,
+        Ticket CHAR(16) NOT NULL,
+        AESKey CHAR(16) NOT NULL,
+        Expires INTEGER NOT NULL,
+        FOREIGN KEY(ID) REFERENCES clients(ID));
+
+        -- content defined chunks (by their SHA-256) and the number of file recipes which reference each chunk,
+        -- a chunk is removed from the store when no recipe references it
+        CREATE TABLE IF NOT EXISTS chunks(
+        Hash CHAR(32) PRIMARY KEY,
+        Size INTEGER NOT NULL,
+        RefCount INTEGER NOT NULL);
+        """,
+        # 2 - keys & indexes of the lookup paths: a username is unique (a later registration of a username which was
+        # registered twice is removed), a file is keyed by its client ID & file name (the latest entry of a file which
+        # was stored twice is kept), the chunks no recipe references are indexed (collected on startup)
+        """
+        DELETE FROM tickets WHERE ID IN (SELECT ID FROM clients WHERE rowid NOT IN
+            (SELECT MIN(rowid) FROM clients GROUP BY Name));
+        DELETE FROM clients WHERE rowid NOT IN (SELECT MIN(rowid) FROM clients GROUP BY Name);
+        CREATE UNIQUE INDEX clients_name ON clients(Name);
+
+        CREATE TABLE files_keyed(
+        ID CHAR(16) NOT NULL,
+        FileName CHAR(255) NOT NULL,
+        PathName CHAR(160) NOT NULL,
+        Verified INTEGER CHECK(Verified = 0 or Verified = 1),
+        PRIMARY KEY(ID, FileName),
+        FOREIGN KEY(ID) REFERENCES clients(ID));
+        INSERT INTO files_keyed SELECT ID, FileName, PathName, Verified FROM files
+            WHERE rowid IN (SELECT MAX(rowid) FROM files GROUP BY ID, FileName);
+        DROP TABLE files;
+        ALTER TABLE files_keyed RENAME TO files;
+
+        CREATE INDEX chunks_unreferenced ON chunks(Hash) WHERE RefCount <= 0;
+        """]
+
+    def tables_init(self, version=len(MIGRATIONS)):
+        """ attempt to create the database tables / upgrade them to the given schema version (the latest by default),
+        every migration is applied in a transaction of its own
+        Return True on success
+        Return False on failure """
+        conn = self.connect()
+        try:
+            current = conn.execute("PRAGMA user_version").fetchone()[0]
+            for number in range(current + 1, version + 1):
+                conn.executescript(f"BEGIN; {Database.MIGRATIONS[number - 1]} PRAGMA user_version = {number}; COMMIT;")
+            if version > current:
+                print(f" database schema upgraded from version {current} to {version}")
+            return True
+        except Exception as e:
+            print(f" database schema couldn't be upgraded, details: {e}")
+            conn.rollback()
+            return False
+
+    def schema_version(self):
+        """ Return the schema version of the database (see MIGRATIONS) """
+        return self.connect().execute("PRAGMA user_version").fetchone()[0]
 
     def clt_id_exists(self, clt_id):
         """ check if a given client id is already exists in the database """
@@ -110,7 +306,8 @@ class Database:
         return self.execute_query(f"UPDATE clients SET PublicKey = ? WHERE ID = ? ", [clt_public_key, clt_id], True)
 
     def set_last_seen(self, clt_id, time):
-        return self.execute_query(f"UPDATE clients SET LastSeen = ? WHERE ID = ?", [time, clt_id], True)
+        """ queue the LastSeen update of a client (not waited for) """
+        return self.execute_write(f"UPDATE clients SET LastSeen = ? WHERE ID = ?", [time, clt_id], wait=False) == 0
 
     def set_aes_key(self, clt_id, aes_key):
         if not aes_key or len(aes_key) != networkProtocol.CLT_SYMMETRICKEY_SIZE:
@@ -127,8 +324,11 @@ class Database:
         if not type(
                 clt) is Client or not clt.check_clt_id() or not clt.check_clt_name() or not clt.check_clt_lastseen():
             return False
-        return self.execute_query(f"INSERT INTO clients VALUES (?, ?, ?, ?, ?)",
-                                  [clt.ID, clt.Name, clt.PublicKey, clt.LastSeen, clt.AESKey], True)
+        # the username is checked in the same write, two sessions which register the same username at once
+        # don't both succeed
+        return self.execute_write(f"INSERT INTO clients SELECT ?, ?, ?, ?, ? "
+                                  f"WHERE NOT EXISTS (SELECT 1 FROM clients WHERE Name = ?)",
+                                  [clt.ID, clt.Name, clt.PublicKey, clt.LastSeen, clt.AESKey, clt.Name]) == 1
 
     def store_file(self, file):
         """ attempt to store a file into the 'files' table """
@@ -137,6 +337,85 @@ class Database:
         return self.execute_query(f"INSERT INTO files VALUES (?, ? ,? ,?)",
                                   [file.ID, file.FileName, file.PathName, file.Verified], True)
 
+    def set_ticket(self, clt_id, ticket, aes_key, expires):
+        """ store the session ticket of a client (its digest, see helper.ticket_digest), replaces the ticket issued to
+        it before """
+        if not ticket or len(ticket) != networkProtocol.SESSION_TICKET_SIZE:
+            return False
+        if not aes_key or len(aes_key) != networkProtocol.CLT_SYMMETRICKEY_SIZE:
+            return False
+        return self.execute_query(f"INSERT OR REPLACE INTO tickets VALUES (?, ?, ?, ?)",
+                                  [clt_id, ticket, aes_key, expires], True)
+
+    def get_ticket(self, clt_id):
+        """ given a client ID, attempt to retrieve its session ticket digest, the AES key & the expiry time of the
+        ticket """
+        outcome = self.execute_query(f"SELECT Ticket, AESKey, Expires FROM tickets WHERE ID = ?", [clt_id])
+        if not outcome:
+            return None
+        return outcome[0]
+
+    def remove_ticket(self, clt_id):
+        return self.execute_query(f"DELETE FROM tickets WHERE ID = ?", [clt_id], True)
+
+    def set_file_path(self, clt_id, file_name, path_name):
+        return self.execute_query(f"UPDATE files SET PathName = ? WHERE ID = ? AND FileName = ?",
+                                  [path_name, clt_id, file_name], True)
+
+    def get_known_chunks(self, hashes):
+        """ given chunk hashes, return the set of the ones which are in the chunk store
+        Return None on failure """
+        known = set()
+        hashes = list(set(hashes))
+        for i in range(0, len(hashes), Database.MAX_QUERY_PARAMS):
+            batch = hashes[i:i + Database.MAX_QUERY_PARAMS]
+            outcome = self.execute_query(f"SELECT Hash FROM chunks WHERE Hash IN ({', '.join('?' * len(batch))})", batch)
+            if outcome is None:
+                return None
+            known.update(row[0] for row in outcome)
+        return known
+
+    def add_chunk(self, chunk_hash, size):
+        """ add a chunk to the chunk store table (not referenced yet), a chunk which is already there is kept as is """
+        if not chunk_hash or len(chunk_hash) != networkProtocol.CHUNK_HASH_SIZE:
+            return False
+        return self.execute_query(f"INSERT OR IGNORE INTO chunks VALUES (?, ?, 0)", [chunk_hash, size], True)
+
+    def ref_chunks(self, hashes):
+        """ add a reference to every given chunk (a hash which is given twice is referenced twice) """
+        return self.execute_many(f"UPDATE chunks SET RefCount = RefCount + 1 WHERE Hash = ?",
+                                 [[chunk_hash] for chunk_hash in hashes])
+
+    def release_chunks(self, hashes):
+        """ remove a reference from every given chunk, the chunks which are not referenced anymore are removed
+        Return the hashes of the removed chunks (their content should be deleted) on success
+        Return None on failure """
+        if not self.execute_many(f"UPDATE chunks SET RefCount = RefCount - 1 WHERE Hash = ?",
+                                 [[chunk_hash] for chunk_hash in hashes]):
+            return None
+        hashes = list(set(hashes))
+        released = []
+        for i in range(0, len(hashes), Database.MAX_QUERY_PARAMS):
+            batch = hashes[i:i + Database.MAX_QUERY_PARAMS]
+            outcome = self.execute_query(
+                f"SELECT Hash FROM chunks WHERE RefCount <= 0 AND Hash IN ({', '.join('?' * len(batch))})", batch)
+            if outcome is None:
+                return None
+            released += [row[0] for row in outcome]
+        if not self.remove_chunks(released):
+            return None
+        return released
+
+    def get_unreferenced_chunks(self):
+        """ Return the hashes of the chunks no recipe references (their file was never completed) """
+        outcome = self.execute_query(f"SELECT Hash FROM chunks WHERE RefCount <= 0", [])
+        if outcome is None:
+            return None
+        return [row[0] for row in outcome]
+
+    def remove_chunks(self, hashes):
+        return self.execute_many(f"DELETE FROM chunks WHERE Hash = ?", [[chunk_hash] for chunk_hash in hashes])
+
     def remove_file(self, clt_id, file_name):
         """ remove a file by id and file name from the database """
         return self.execute_query(f"DELETE FROM files WHERE ID = ? AND FileName = ?", [clt_id, file_name], True)
@@ -11,9 +11,33 @@ from Crypto.Cipher import AES  # for decryption of client file contents
 from Crypto.Util.Padding import unpad  # for un padding unnecessary bytes from the file content decryption
 import crc  # for file content CRC calculation (linux cksum command)
 from pathlib import Path  # for directory creation / file storage / file deletion
+import os  # for partial files (random access writing, truncate, atomic replace)
+import threading  # for unique temporary chunk names
+import struct  # for chunk maps & recipes
+import hashlib  # for content defined chunks (SHA-256)
+import hmac  # for the MAC of authenticated AES-CTR contents
+import itertools  # for block signatures (rolling checksum)
+import math  # for block signatures (block size)
+from concurrent.futures import ThreadPoolExecutor  # for parallel AES-CTR decryption
+import lz4.frame  # for compressed file contents
+import zstandard  # for compressed file contents
 import networkProtocol
 
 DEFAULT_PORT = 1234
+RECV_FILE_SUFFIX = ".recv"  # a file which is sent as a whole is received under this suffix until complete
+PART_FILE_SUFFIX = ".part"  # a file which is assembled from stripes / chunks is stored under this suffix until complete
+CHUNK_MAP_SUFFIX = ".part.map"  # which chunks of a partial file are stored, kept next to it (resume after reconnect)
+RECIPE_SUFFIX = ".recipe"  # a file which was sent by its content defined chunks is stored as the list of its chunks
+CHUNK_STORE_DIR = "chunk_store"  # content defined chunks of all the clients, by their SHA-256
+DELTA_FILE_SUFFIX = ".delta"  # a file which is patched by a delta is assembled under this suffix until complete
+MIN_SIGNATURE_BLOCK_SIZE = 4 * 1024  # block size of the signatures of a file is about the square root of its size,
+MAX_SIGNATURE_BLOCK_SIZE = 128 * 1024  # within these limits
+CTR_NONCE_SIZE = 8
+CTR_SEGMENT_SIZE = 256 * 1024  # AES-CTR content of at least 2 segments is decrypted on several threads
+
+# workers of the AES-CTR segments (pycryptodome releases the GIL while it decrypts), created on first use
+ctr_threads = os.cpu_count() or 1
+ctr_workers = None
 
 
 def gen_aes(public_key):
@@ -33,29 +57,274 @@ def gen_aes(public_key):
         return None, None
 
 
-def decrypt_content(aes_key, encrypted_content):
-    """ given an aes key and a content which was encrypted with the aes key, decrypt the content
-        Return decrypted content on success
-        Return None on failure"""
-    try:
+def ticket_digest(ticket):
+    """ Return what the database keeps of a session ticket, SHA-256 of it (truncated to the ticket size), a ticket is
+    a secret the client resumes its key with, whoever reads the database can't present it """
+    return hashlib.sha256(ticket).digest()[:networkProtocol.SESSION_TICKET_SIZE]
+
+
+def set_ctr_threads(threads):
+    """ set the number of threads an AES-CTR content may be decrypted on """
+    global ctr_threads, ctr_workers
+    ctr_threads = max(1, threads)
+    if ctr_workers is not None:
+        ctr_workers.shutdown()
+        ctr_workers = None
+
+
+def ctr_decrypt(aes_key, iv, offset, encrypted, output):
+    """ decrypt AES-CTR content which is at offset (bytes) of the key stream of iv into output (a writable buffer of
+        the same size), content of at least 2 segments (CTR_SEGMENT_SIZE) is split over ctr_threads threads,
+        the counter of every segment is known in advance """
+    global ctr_workers
+    segments = min(ctr_threads, len(encrypted) // CTR_SEGMENT_SIZE)
+    if segments < 2:
+        ctr_decrypt_segment(aes_key, iv, offset, encrypted, output)
+        return
+    if ctr_workers is None:
+        ctr_workers = ThreadPoolExecutor(max_workers=ctr_threads)
+    encrypted, output = memoryview(encrypted), memoryview(output)
+    size = len(encrypted) // segments // AES.block_size * AES.block_size
+    bounds = [(i * size, len(encrypted) if i == segments - 1 else (i + 1) * size) for i in range(segments)]
+    # the calling thread decrypts the first segment while the workers decrypt the others
+    futures = [ctr_workers.submit(ctr_decrypt_segment, aes_key, iv, offset + begin, encrypted[begin:end],
+                                  output[begin:end]) for begin, end in bounds[1:]]
+    ctr_decrypt_segment(aes_key, iv, offset, encrypted[:size], output[:size])
+    for future in futures:
+        future.result()
+
+
+def ctr_decrypt_segment(aes_key, iv, offset, encrypted, output):
+    """ decrypt (on the calling thread) AES-CTR content which is at offset (bytes) of the key stream of iv """
+    counter = int.from_bytes(iv[CTR_NONCE_SIZE:], "big") + offset // AES.block_size
+    cipher = AES.new(aes_key, AES.MODE_CTR, nonce=iv[:CTR_NONCE_SIZE], initial_value=counter)
+    if offset % AES.block_size:
+        cipher.decrypt(bytes(offset % AES.block_size))  # the key stream of the first (partial) block starts there
+    cipher.decrypt(encrypted, output=output)
+
+
+class ContentDecryptor:
+    """ decrypts a content which was encrypted with the aes key (AES-CBC, all 0's iv, PKCS#7 padding) chunk by chunk,
+        the last block is held back until final() since it contains the padding """
+
+    def __init__(self, aes_key):
         iv: bytes = bytes([0] * networkProtocol.CLT_SYMMETRICKEY_SIZE)  # in a real system this never should be all 0's
-        cipher = AES.new(aes_key, AES.MODE_CBC, iv)
-        decrypted: bytes = unpad(cipher.decrypt(encrypted_content), AES.block_size)
+        self.cipher = AES.new(aes_key, AES.MODE_CBC, iv)
+        self.pending = b""
+
+    def update(self, encrypted_chunk):
+        """ Return the decrypted content which is ready so far (may be empty) """
+        data = self.pending + encrypted_chunk
+        keep = len(data) % AES.block_size or AES.block_size
+        if len(data) <= keep:
+            self.pending = data
+            return b""
+        self.pending = data[-keep:]
+        return self.cipher.decrypt(data[:-keep])
+
+    def final(self):
+        """ Return the last decrypted block without the padding,
+            raise ValueError if the content is not a whole number of blocks or the padding is invalid """
+        return unpad(self.cipher.decrypt(self.pending), AES.block_size)
+
+
+class CtrContentDecryptor:
+    """ decrypts an AES-CTR content chunk by chunk, the content starts with the iv, (large) chunks are decrypted on
+        several threads (see ctr_decrypt). an authenticated content (VERSION_AUTH and on) ends with the MAC of the iv &
+        ciphertext, its last CONTENT_MAC_SIZE bytes are held back until final() verifies them """
+
+    def __init__(self, aes_key, authenticated=False):
+        self.aes_key = aes_key
+        self.iv = b""
+        self.offset = 0
+        self.mac = hmac.new(content_mac_key(aes_key), digestmod=hashlib.sha256) if authenticated else None
+        self.pending = b""
+
+    def update(self, encrypted_chunk):
+        """ Return the decrypted chunk (without the iv, and the bytes which may be the MAC) """
+        if self.mac is None:
+            return self.decrypt(encrypted_chunk)
+        data = self.pending + encrypted_chunk
+        if len(data) <= networkProtocol.CONTENT_MAC_SIZE:
+            self.pending = data
+            return b""
+        self.pending = data[-networkProtocol.CONTENT_MAC_SIZE:]
+        data = memoryview(data)[:-networkProtocol.CONTENT_MAC_SIZE]
+        self.mac.update(data)
+        return self.decrypt(data)
+
+    def decrypt(self, encrypted_chunk):
+        """ Return the decrypted chunk (without the iv) """
+        if len(self.iv) < networkProtocol.CONTENT_IV_SIZE:
+            iv_part = networkProtocol.CONTENT_IV_SIZE - len(self.iv)
+            self.iv += encrypted_chunk[:iv_part]
+            encrypted_chunk = memoryview(encrypted_chunk)[iv_part:]
+        decrypted = bytearray(len(encrypted_chunk))
+        if decrypted:
+            ctr_decrypt(self.aes_key, self.iv, self.offset, encrypted_chunk, decrypted)
+            self.offset += len(decrypted)
         return decrypted
-    except Exception as e:
-        print(e)
-        return None
 
+    def final(self):
+        """ Return b"" (no padding), raise ValueError if the content was shorter than its iv or its MAC doesn't match
+        (the content was modified / corrupted on its way, what update() returned should be dropped) """
+        if len(self.iv) < networkProtocol.CONTENT_IV_SIZE:
+            raise ValueError("AES-CTR content is shorter than its iv")
+        if self.mac is not None and not hmac.compare_digest(
+                self.mac.digest()[:networkProtocol.CONTENT_MAC_SIZE], self.pending):
+            raise ValueError("AES-CTR content MAC doesn't match")
+        return b""
+
+
+class NativeContentDecryptor:
+    """ ContentDecryptor on the native module (see crc.py), decrypts without the GIL and adds the decrypted content to
+        the cksum (a native one) in the same pass """
+
+    def __init__(self, aes_key, digest):
+        self.decryptor = crc.transferit_native.CbcDecryptor(aes_key)
+        self.digest = digest
+
+    def update(self, encrypted_chunk):
+        """ Return the decrypted content which is ready so far (may be empty), already added to the cksum """
+        return self.decryptor.update(encrypted_chunk, self.digest)
+
+    def final(self):
+        """ Return the last decrypted block without the padding (already added to the cksum),
+            raise ValueError if the content is not a whole number of blocks or the padding is invalid """
+        return self.decryptor.final(self.digest)
+
+
+def content_mac_key(aes_key):
+    """ Return the key of the MAC of authenticated contents, derived from the client AES key (never used as is for both) """
+    return hmac.new(aes_key, networkProtocol.CONTENT_MAC_LABEL, hashlib.sha256).digest()
+
+
+def content_decryptor(aes_key, version, digest=None):
+    """ Return a chunk by chunk decryptor of a file content in the mode of the given protocol version, and the cksum
+    the caller should add the decrypted content to (None if the decryptor adds it to digest itself) """
+    if version >= networkProtocol.VERSION_CTR:
+        return CtrContentDecryptor(aes_key, version >= networkProtocol.VERSION_AUTH), digest
+    if crc.transferit_native is not None and (digest is None or isinstance(digest, crc.transferit_native.Cksum)):
+        return NativeContentDecryptor(aes_key, digest), None
+    return ContentDecryptor(aes_key), digest
+
+
+class ContentWriter:
+    """ writes a file content which arrives chunk by chunk: decrypts it with the client AES key (in the file content mode
+        of the protocol version of the request), unpacks it (VERSION_CODEC and on), writes it to out_file (at its
+        current position) and adds it to digest (if given). update() / final() block (decryption, cksum & disk), the
+        server runs them on its worker threads """
+
+    def __init__(self, aes_key, out_file, digest=None, version=networkProtocol.VERSION_CTR - 1):
+        # CBC contents (before VERSION_CTR) have no codec byte, the native decryptor adds them to digest itself
+        self.decryptor, self.digest = content_decryptor(aes_key, version, digest)
+        self.unpacker = ContentUnpacker(networkProtocol.MAX_CHUNK_SIZE) \
+            if version >= networkProtocol.VERSION_CODEC else None
+        self.out_file = out_file
+        self.size = 0
+
+    def update(self, encrypted_chunk):
+        """ decrypt, unpack & write the next content chunk, raise an exception on failure """
+        self.write(self.decryptor.update(encrypted_chunk))
+
+    def final(self):
+        """ write the rest of the content, Return the content size, raise an exception on failure """
+        self.write(self.decryptor.final())
+        if self.unpacker is not None:
+            content = self.unpacker.final()
+            if self.digest is not None:
+                self.digest.update(content)
+            self.out_file.write(content)
+            self.size += len(content)
+        return self.size
+
+    def write(self, decrypted_chunk):
+        """ unpack a decrypted chunk (if there is an unpacker), write it to out_file and add it to digest (if given) """
+        if self.unpacker is not None:
+            decrypted_chunk = self.unpacker.update(decrypted_chunk)
+        if self.digest is not None:
+            self.digest.update(decrypted_chunk)
+        self.out_file.write(decrypted_chunk)
+        self.size += len(decrypted_chunk)
+
+
+class ContentUnpacker:
+    """ unpacks a decrypted file content of VERSION_CODEC and on chunk by chunk: the first byte is the codec,
+        a content sent as is (CODEC_NONE) streams through, a compressed content is collected and decompressed in final(),
+        both compressed & decompressed sizes are limited to max_size (a compressed content is a file / chunk in memory) """
+
+    def __init__(self, max_size):
+        self.max_size = max_size
+        self.codec = None
+        self.packed = bytearray()
+
+    def update(self, chunk):
+        """ Return the unpacked content which is ready so far (may be empty),
+            raise ValueError on an unknown codec / a too large content """
+        if self.codec is None:
+            if not chunk:
+                return b""
+            self.codec = chunk[0]
+            chunk = memoryview(chunk)[1:]
+            if self.codec not in (networkProtocol.CODEC_NONE, networkProtocol.CODEC_LZ4, networkProtocol.CODEC_ZSTD):
+                raise ValueError(f"unknown content codec {self.codec}")
+        if self.codec == networkProtocol.CODEC_NONE:
+            return chunk
+        if len(self.packed) + len(chunk) > self.max_size:
+            raise ValueError(f"compressed content is larger than {self.max_size} bytes")
+        self.packed += chunk
+        return b""
+
+    def final(self):
+        """ Return the rest of the unpacked content,
+            raise ValueError if the content has no codec / the compressed content is invalid / decompresses too large """
+        if self.codec is None:
+            raise ValueError("content has no codec")
+        if self.codec == networkProtocol.CODEC_NONE:
+            return b""
+        try:
+            if self.codec == networkProtocol.CODEC_ZSTD:
+                # max_output_size only limits frames which don't declare their size
+                if zstandard.frame_content_size(self.packed) > self.max_size:
+                    raise ValueError(f"zstd content decompresses larger than {self.max_size} bytes")
+                return zstandard.ZstdDecompressor().decompress(self.packed, max_output_size=self.max_size)
+            decompressor = lz4.frame.LZ4FrameDecompressor()
+            unpacked = decompressor.decompress(self.packed, max_length=self.max_size)
+            if not decompressor.eof:
+                raise ValueError(f"LZ4 content is truncated / decompresses larger than {self.max_size} bytes")
+            return unpacked
+        except (zstandard.ZstdError, RuntimeError) as e:
+            raise ValueError(f"compressed content couldn't be decompressed, details: {e}")
 
-def calc_crc(content):
-    """ Calc CRC of a for a given content, CRC calculated identically to Linux cksum command
+
+def packed_size(size, version):
+    """ Return the size of a file content of a given size before encryption, as sent in the given protocol version
+        (uncompressed, see ContentUnpacker) """
+    if version >= networkProtocol.VERSION_CODEC:
+        return 1 + size
+    return size
+
+
+def encrypted_size(size, version=networkProtocol.VERSION_CTR - 1):
+    """ Return the size of a content of a given size after encryption with the aes key,
+        CBC - padded, CTR (VERSION_CTR and on) - the iv ahead of the content (and the MAC after it, VERSION_AUTH and on) """
+    if version >= networkProtocol.VERSION_AUTH:
+        return networkProtocol.CONTENT_IV_SIZE + size + networkProtocol.CONTENT_MAC_SIZE
+    if version >= networkProtocol.VERSION_CTR:
+        return networkProtocol.CONTENT_IV_SIZE + size
+    return (size // AES.block_size + 1) * AES.block_size
+
+
+def calc_file_crc(file_path, chunk_size):
+    """ Calc CRC of a stored file, reading it chunk by chunk, CRC calculated identically to Linux cksum command
         Return CRC on success
         Return None on failure """
     try:
         digest = crc.crc32()
-        digest.update(content)
-        cksum: int = digest.digest()
-        return cksum
+        with open(file_path, "rb") as f:
+            while chunk := f.read(chunk_size):
+                digest.update(chunk)
+        return digest.digest()
     except Exception as e:
         print(e)
         return None
@@ -71,7 +340,7 @@ def create_dir(dir_name):
     try:
         curr_path = str(Path.cwd())
         # create directory if not exists, if exists NOT throws an exception (exist_ok=True)
-        dir_path: str = curr_path + '\\' + dir_name.decode('utf-8')
+        dir_path: str = str(Path(curr_path) / dir_name.decode('utf-8'))
         Path(dir_path).mkdir(parents=True, exist_ok=True)
         return dir_path
     except Exception as e:
@@ -79,21 +348,378 @@ def create_dir(dir_name):
         return None
 
 
-def store_file(file_content, dir_path, file_name):
-    """ attempt to store a given file content in a given directory path with a given file name.
-        if the file already exists, overwrite it
+def open_recv_file(dir_path, file_name):
+    """ attempt to open the file which a file with a given name is received in (in a given directory path) for (binary)
+        writing, overwritten if exists, the stored file (if any) is kept until the received file replaces it
+        Return file object & received file path on success
+        Return None & None on failure """
+    try:
+        recv_path: str = str(Path(dir_path) / (file_name + RECV_FILE_SUFFIX))
+        return open(recv_path, "wb"), recv_path
+    except Exception as e:
+        print(e)
+        return None, None
+
+
+def commit_recv_file(dir_path, file_name):
+    """ attempt to turn the received file of a given file name in a given directory path into the final file
+        (overwrite it if exists)
         Return file path on success
         Return None on failure """
     try:
-        file_path: str = dir_path + "\\" + file_name
-        p = Path(file_path)
-        p.write_bytes(file_content)
+        file_path: str = str(Path(dir_path) / file_name)
+        os.replace(file_path + RECV_FILE_SUFFIX, file_path)
+        return file_path
+    except Exception as e:
+        print(e)
+        return None
+
+
+def open_part_file(dir_path, file_name):
+    """ attempt to open (create if not exists) the partial file which a file with a given name is assembled in,
+        the partial file is opened for (binary) random access writing and is NOT truncated
+        Return file object & partial file path on success
+        Return None & None on failure """
+    try:
+        part_path: str = str(Path(dir_path) / (file_name + PART_FILE_SUFFIX))
+        fd = os.open(part_path, os.O_RDWR | os.O_CREAT | getattr(os, "O_BINARY", 0))
+        return os.fdopen(fd, "r+b"), part_path
+    except Exception as e:
+        print(e)
+        return None, None
+
+
+def commit_part_file(dir_path, file_name, file_size):
+    """ attempt to turn the assembled partial file of a given file name in a given directory path into the final file
+        (overwrite it if exists), the partial file is truncated to file_size first
+        Return file path on success
+        Return None on failure """
+    try:
+        file_path: str = str(Path(dir_path) / file_name)
+        part_path: str = file_path + PART_FILE_SUFFIX
+        os.truncate(part_path, file_size)
+        os.replace(part_path, file_path)
         return file_path
     except Exception as e:
         print(e)
         return None
 
 
+def delete_part_file(dir_path, file_name):
+    """ delete the partial file of a given file name (of a striped file which failed / was abandoned), if exists """
+    try:
+        (Path(dir_path) / (file_name + PART_FILE_SUFFIX)).unlink(missing_ok=True)
+    except Exception as e:
+        print(e)
+
+
+class ChunkMap:
+    """ keeps track of which chunks of a file which is sent chunk by chunk are stored (and verified) so far,
+        and the cksum of each stored chunk """
+    HDR_FORMAT = "<QL"  # file size, chunk size (a map of the 32-bit format is not loaded, a new map starts)
+
+    def __init__(self, file_size, chunk_size):
+        self.file_size = file_size
+        self.chunk_size = chunk_size
+        self.count = (file_size + chunk_size - 1) // chunk_size
+        self.cksums = [0] * self.count
+        self.stored = bytearray((self.count + 7) // 8)  # bit i % 8 of byte i // 8
+
+    def size_of(self, index):
+        """ Return the size (decrypted) of the chunk at index """
+        return min(self.chunk_size, self.file_size - index * self.chunk_size)
+
+    def is_stored(self, index):
+        return bool(self.stored[index // 8] >> (index % 8) & 1)
+
+    def set_stored(self, index, cksum):
+        self.cksums[index] = cksum
+        self.stored[index // 8] |= 1 << (index % 8)
+
+    def complete(self):
+        return all(self.is_stored(i) for i in range(self.count))
+
+    def pack(self):
+        return struct.pack(ChunkMap.HDR_FORMAT, self.file_size, self.chunk_size) + \
+               struct.pack(f"<{self.count}L", *self.cksums) + bytes(self.stored)
+
+    @staticmethod
+    def unpack(data):
+        """ Return the chunk map packed in data, raise an exception if data is not a valid chunk map """
+        hdr_size = struct.calcsize(ChunkMap.HDR_FORMAT)
+        chunk_map = ChunkMap(*struct.unpack(ChunkMap.HDR_FORMAT, data[:hdr_size]))
+        if len(data) != hdr_size + 4 * chunk_map.count + len(chunk_map.stored):
+            raise ValueError(f"chunk map size {len(data)} not match its header")
+        chunk_map.cksums = list(struct.unpack(f"<{chunk_map.count}L", data[hdr_size:hdr_size + 4 * chunk_map.count]))
+        chunk_map.stored = bytearray(data[hdr_size + 4 * chunk_map.count:])
+        return chunk_map
+
+
+def load_chunk_map(dir_path, file_name, file_size, chunk_size):
+    """ load the chunk map of a given file name in a given directory path, if there is no chunk map or it was stored
+        for another file size / chunk size (the file was changed), start a new one (no chunk is stored)
+        Return the chunk map """
+    try:
+        map_path = Path(dir_path) / (file_name + CHUNK_MAP_SUFFIX)
+        if map_path.exists():
+            chunk_map = ChunkMap.unpack(map_path.read_bytes())
+            if chunk_map.file_size == file_size and chunk_map.chunk_size == chunk_size:
+                return chunk_map
+    except Exception as e:
+        print(e)
+    return ChunkMap(file_size, chunk_size)
+
+
+def store_chunk_map(dir_path, file_name, chunk_map):
+    """ attempt to store the chunk map of a given file name in a given directory path (replaced at once, so a crash
+        leaves either the old or the new chunk map)
+        Return True on success
+        Return False on failure """
+    try:
+        map_path: str = str(Path(dir_path) / (file_name + CHUNK_MAP_SUFFIX))
+        Path(map_path + ".tmp").write_bytes(chunk_map.pack())
+        os.replace(map_path + ".tmp", map_path)
+        return True
+    except Exception as e:
+        print(e)
+        return False
+
+
+def delete_chunk_map(dir_path, file_name):
+    """ attempt to delete the chunk map of a given file name in a given directory path (if exists)
+        Return True on success
+        Return False on failure """
+    try:
+        (Path(dir_path) / (file_name + CHUNK_MAP_SUFFIX)).unlink(missing_ok=True)
+        return True
+    except Exception as e:
+        print(e)
+        return False
+
+
+def chunk_path(chunk_hash):
+    """ Return the path of a chunk (by its hash) in the chunk store """
+    hex_hash = chunk_hash.hex()
+    return Path.cwd() / CHUNK_STORE_DIR / hex_hash[:2] / hex_hash
+
+
+def calc_chunk_hash(content):
+    """ Return the hash (SHA-256) a content defined chunk is identified by """
+    return hashlib.sha256(content).digest()
+
+
+def store_chunk(chunk_hash, content):
+    """ attempt to store a chunk content in the chunk store (replace it atomically if already there)
+        Return True on success
+        Return False on failure """
+    try:
+        path = chunk_path(chunk_hash)
+        path.parent.mkdir(parents=True, exist_ok=True)
+        temp_path = path.with_name(f"{path.name}.{os.getpid()}.{threading.get_ident()}")
+        with open(temp_path, "wb") as chunk_file:
+            chunk_file.write(content)
+        os.replace(temp_path, path)
+        return True
+    except Exception as e:
+        print(e)
+        return False
+
+
+def delete_chunks(hashes):
+    """ delete the contents of the given chunks from the chunk store (a chunk which is not there is skipped) """
+    for chunk_hash in hashes:
+        try:
+            chunk_path(chunk_hash).unlink(missing_ok=True)
+        except Exception as e:
+            print(e)
+
+
+def store_recipe(dir_path, file_name, chunks):
+    """ attempt to store the recipe (list of (hash, size) chunks) of a given file name in a given directory path,
+        replaces the recipe which was stored before
+        Return recipe path on success
+        Return None on failure """
+    try:
+        recipe_path: str = str(Path(dir_path) / (file_name + RECIPE_SUFFIX))
+        data = struct.pack("<L", len(chunks)) + \
+            b"".join(struct.pack(networkProtocol.CHUNK_REF_FORMAT, hash_, size) for hash_, size in chunks)
+        with open(recipe_path + ".tmp", "wb") as recipe_file:
+            recipe_file.write(data)
+        os.replace(recipe_path + ".tmp", recipe_path)
+        return recipe_path
+    except Exception as e:
+        print(e)
+        return None
+
+
+def load_recipe(dir_path, file_name):
+    """ load the recipe of a given file name in a given directory path
+        Return the list of (hash, size) chunks on success
+        Return None if there is no (valid) recipe """
+    try:
+        with open(Path(dir_path) / (file_name + RECIPE_SUFFIX), "rb") as recipe_file:
+            data = recipe_file.read()
+        count = struct.unpack("<L", data[:4])[0]
+        if len(data) != 4 + count * struct.calcsize(networkProtocol.CHUNK_REF_FORMAT):
+            raise ValueError(f"recipe size {len(data)} not match its {count} chunks")
+        return list(struct.iter_unpack(networkProtocol.CHUNK_REF_FORMAT, data[4:]))
+    except FileNotFoundError:
+        return None
+    except Exception as e:
+        print(e)
+        return None
+
+
+def read_recipe(chunks):
+    """ generator of the contents of the chunks of a recipe, in the file order,
+        raise an exception if a chunk is missing from the chunk store """
+    for hash_, size in chunks:
+        with open(chunk_path(hash_), "rb") as chunk_file:
+            content = chunk_file.read()
+        if len(content) != size:
+            raise ValueError(f"chunk {hash_.hex()} size {len(content)} not match {size}")
+        yield content
+
+
+def calc_recipe_crc(chunks):
+    """ Calc CRC of the file a recipe describes (identically to Linux cksum command)
+        Return CRC on success
+        Return None on failure """
+    try:
+        digest = crc.crc32()
+        for content in read_recipe(chunks):
+            digest.update(content)
+        return digest.digest()
+    except Exception as e:
+        print(e)
+        return None
+
+
+def rebuild_file(dir_path, file_name):
+    """ attempt to rebuild a file which is stored as a recipe (see store_recipe) from the chunk store, next to the
+        recipe (the recipe is kept, the chunks stay referenced)
+        Return file path on success
+        Return None on failure """
+    chunks = load_recipe(dir_path, file_name)
+    if chunks is None:
+        return None
+    try:
+        file_path: str = str(Path(dir_path) / file_name)
+        with open(file_path + ".tmp", "wb") as rebuilt_file:
+            for content in read_recipe(chunks):
+                rebuilt_file.write(content)
+        os.replace(file_path + ".tmp", file_path)
+        return file_path
+    except Exception as e:
+        print(e)
+        return None
+
+
+def calc_signatures(file_path):
+    """ calculate the block signatures of a stored file (see REQ_FILE_SIGNATURES): the file is split into blocks of about
+        the square root of its size, each block is signed by its weak checksum - a & b (mod 2^16) where a is the sum of
+        the bytes & b the sum of the running sums of a (the rolling checksum the client matches windows with) - and by
+        the first STRONG_HASH_SIZE bytes of its SHA-256
+        Return file size, block size & the (weak, strong) signatures on success
+        Return None, None, None on failure """
+    try:
+        file_size = os.path.getsize(file_path)
+        block_size = min(max(math.isqrt(file_size), MIN_SIGNATURE_BLOCK_SIZE), MAX_SIGNATURE_BLOCK_SIZE)
+        block_size = max(block_size, -(-file_size // networkProtocol.MAX_INVENTORY_CHUNKS))
+        signatures = []
+        with open(file_path, "rb") as f:
+            while block := f.read(block_size):
+                weak = (sum(block) & 0xffff) | ((sum(itertools.accumulate(block)) & 0xffff) << 16)
+                signatures.append((weak, hashlib.sha256(block).digest()[:networkProtocol.STRONG_HASH_SIZE]))
+        return file_size, block_size, signatures
+    except Exception as e:
+        print(e)
+        return None, None, None
+
+
+class DeltaPatcher:
+    """ applies a file delta (see REQ_FILE_DELTA) to the stored copy of a file: the decrypted delta content is written
+        to it chunk by chunk (it is used as the output file of the content), its operations are parsed as they arrive
+        and copy blocks of the stored copy / data into the new file, which is assembled next to the copy and replaces it
+        in finish(). the cksum of the new file is calculated on the way """
+
+    OP_SIZE = struct.calcsize(networkProtocol.DELTA_OP_FORMAT)
+    COPY_SIZE = 1024 * 1024  # blocks are copied in reads of up to this size
+
+    def __init__(self, file_path, basis_size, block_size, file_size):
+        self.file_path = file_path
+        self.block_size = block_size
+        self.blocks_count = -(-basis_size // block_size)
+        self.file_size = file_size
+        self.size = 0  # of the new file so far
+        self.digest = crc.crc32()
+        self.op = bytearray()  # an operation which didn't arrive whole yet
+        self.data_left = 0  # bytes of the current DELTA_DATA operation which didn't arrive yet
+        self.basis = open(file_path, "rb")
+        try:
+            self.out = open(file_path + DELTA_FILE_SUFFIX, "wb")
+        except Exception:
+            self.basis.close()
+            raise
+
+    def write(self, chunk):
+        """ apply the next chunk of the delta content, raise ValueError on an invalid operation """
+        chunk = memoryview(chunk)
+        while chunk:
+            if self.data_left > 0:
+                data = chunk[:self.data_left]
+                self.output(data)
+                self.data_left -= len(data)
+                chunk = chunk[len(data):]
+                continue
+            needed = DeltaPatcher.OP_SIZE - len(self.op)
+            self.op += chunk[:needed]
+            chunk = chunk[needed:]
+            if len(self.op) < DeltaPatcher.OP_SIZE:
+                break
+            op, first, count = struct.unpack(networkProtocol.DELTA_OP_FORMAT, self.op)
+            self.op.clear()
+            if op == networkProtocol.DELTA_DATA:
+                self.data_left = first
+            elif op == networkProtocol.DELTA_COPY:
+                self.copy_blocks(first, count)
+            else:
+                raise ValueError(f"unknown delta operation {op}")
+
+    def copy_blocks(self, first, count):
+        """ copy count blocks of the stored copy from block first into the new file """
+        if first + count > self.blocks_count:
+            raise ValueError(f"blocks {first}+{count} exceed the {self.blocks_count} blocks of the stored copy")
+        self.basis.seek(first * self.block_size)
+        bytes_left = count * self.block_size
+        while bytes_left > 0 and (data := self.basis.read(min(bytes_left, DeltaPatcher.COPY_SIZE))):
+            self.output(data)
+            bytes_left -= len(data)
+
+    def output(self, data):
+        if self.size + len(data) > self.file_size:
+            raise ValueError(f"delta builds a file larger than {self.file_size} bytes")
+        self.out.write(data)
+        self.digest.update(data)
+        self.size += len(data)
+
+    def finish(self):
+        """ replace the stored copy with the new file
+            Return the cksum of the new file, raise ValueError if the delta is incomplete """
+        self.basis.close()
+        self.out.close()
+        if self.op or self.data_left > 0 or self.size != self.file_size:
+            raise ValueError(f"delta is incomplete, built {self.size} of {self.file_size} bytes")
+        os.replace(self.file_path + DELTA_FILE_SUFFIX, self.file_path)
+        return self.digest.digest()
+
+    def discard(self):
+        """ drop the new file, the stored copy is kept """
+        self.basis.close()
+        self.out.close()
+        delete_file(self.file_path + DELTA_FILE_SUFFIX)
+
+
 def delete_file(file_path):
     """ attempt to delete a file given a file path
         Return True on success
@@ -5,9 +5,19 @@ description: Server execution
 """
 import server
 import helper
+import sys
 
 
 def main():
+    # python main.py --rebuild <username> <file name> - rebuild a file which was stored by its chunks (a recipe)
+    if len(sys.argv) == 4 and sys.argv[1] == "--rebuild":
+        file_path = helper.rebuild_file(sys.argv[2], sys.argv[3])
+        if file_path is None:
+            print(f"{sys.argv[3]} of {sys.argv[2]} couldn't be rebuilt from the chunk store")
+            exit(1)
+        print(f"{file_path} rebuilt from the chunk store")
+        return
+
     port = helper.acquire_port("port.info")  # if can't acquire port use a default port (1234 in time writing this)
     svr = server.Server('', port)
     if not svr.svr_startup():
@@ -0,0 +1,27 @@
+"""
+TransferIt server
+setup.py
+description: builds the native module of the server (transferit_native), the cksum of the client and AES-CBC decryption
+of file contents without the GIL, needs a C++17 compiler, the Python headers and OpenSSL (libcrypto)
+usage: python setup.py build_ext --inplace (run from the server/native directory)
+"""
+import sys
+from pathlib import Path
+from setuptools import setup, Extension
+
+CLIENT_SOURCES = Path(__file__).resolve().parent.parent.parent / "client" / "client"
+
+if sys.platform == "win32":
+    compile_args, libraries = ["/std:c++17", "/O2"], ["libcrypto"]
+else:
+    compile_args, libraries = ["-std=c++17", "-O2"], ["crypto"]
+
+setup(
+    name="transferit_native",
+    ext_modules=[Extension(
+        "transferit_native",
+        sources=["transferit_native.cpp", str(CLIENT_SOURCES / "crc.cpp")],
+        include_dirs=[str(CLIENT_SOURCES)],
+        libraries=libraries,
+        extra_compile_args=compile_args,
+        language="c++")])
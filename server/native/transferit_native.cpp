@@ -0,0 +1,304 @@
+/*
+	TransferIt server
+	transferit_native.cpp
+	description: native module of the server (see setup.py), the cksum of the client (client/client/crc.cpp) and AES-CBC
+	decryption of file contents (OpenSSL), both release the GIL while they run so sessions go on meanwhile.
+	crc.py / helper.py use it if it was built, their pure Python implementations otherwise
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <openssl/evp.h>
+#include <string>
+#include <cstring>
+#include "crc.h"
+
+// data shorter than this is handled without releasing the GIL (releasing it costs more than the work)
+static const Py_ssize_t RELEASE_GIL_SIZE = 4096;
+static const size_t AES_BLOCK = 16;
+
+/*
+	Cksum - the cksum of a content which arrives chunk by chunk, the same interface as crc.crc32
+*/
+struct CksumObject
+{
+	PyObject_HEAD
+	CRC* crc;
+};
+
+static PyTypeObject CksumType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+static int cksum_init(CksumObject* self, PyObject* args, PyObject* kwds)
+{
+	static const char* kwlist[] = { nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "", const_cast<char**>(kwlist)))
+		return -1;
+	delete self->crc;
+	self->crc = new CRC();
+	return 0;
+}
+
+static void cksum_dealloc(CksumObject* self)
+{
+	delete self->crc;
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+// add data (of a buffer) to the cksum
+static void cksum_update_buffer(CRC& crc, const Py_buffer& view)
+{
+	const unsigned char* data = static_cast<const unsigned char*>(view.buf);
+	if (view.len < RELEASE_GIL_SIZE)
+	{
+		crc.update(data, static_cast<size_t>(view.len));
+		return;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	crc.update(data, static_cast<size_t>(view.len));
+	Py_END_ALLOW_THREADS
+}
+
+static PyObject* cksum_update(CksumObject* self, PyObject* arg)
+{
+	Py_buffer view;
+	if (PyObject_GetBuffer(arg, &view, PyBUF_SIMPLE) < 0)
+		return nullptr;
+	cksum_update_buffer(*self->crc, view);
+	PyBuffer_Release(&view);
+	Py_RETURN_NONE;
+}
+
+static PyObject* cksum_digest(CksumObject* self, PyObject* Py_UNUSED(ignored))
+{
+	CRC crc = *self->crc; // digest appends the length, the cksum may be updated after it
+	return PyLong_FromUnsignedLong(crc.digest());
+}
+
+static PyMethodDef cksum_methods[] = {
+	{ "update", reinterpret_cast<PyCFunction>(cksum_update), METH_O, "add a content chunk (bytes-like) to the cksum" },
+	{ "digest", reinterpret_cast<PyCFunction>(cksum_digest), METH_NOARGS, "Return the cksum of the content so far" },
+	{ nullptr }
+};
+
+/*
+	CbcDecryptor - decrypts an AES-CBC content (all 0's iv, PKCS#7 padding) chunk by chunk, the same interface as
+	helper.ContentDecryptor. the last block is held back until final() since it contains the padding. update / final
+	add the decrypted content to a Cksum (if given), in the same pass
+*/
+struct CbcDecryptorObject
+{
+	PyObject_HEAD
+	EVP_CIPHER_CTX* ctx;
+	std::string* pending; // encrypted bytes which are not decrypted yet (the last block at least)
+};
+
+static PyTypeObject CbcDecryptorType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+static int cbc_init(CbcDecryptorObject* self, PyObject* args, PyObject* kwds)
+{
+	static const char* kwlist[] = { "key", nullptr };
+	Py_buffer key;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*", const_cast<char**>(kwlist), &key))
+		return -1;
+	const EVP_CIPHER* cipher = key.len == 16 ? EVP_aes_128_cbc() : key.len == 24 ? EVP_aes_192_cbc() :
+		key.len == 32 ? EVP_aes_256_cbc() : nullptr;
+	if (cipher == nullptr)
+	{
+		PyBuffer_Release(&key);
+		PyErr_SetString(PyExc_ValueError, "AES key should be of 16 / 24 / 32 bytes");
+		return -1;
+	}
+	if (self->ctx == nullptr)
+		self->ctx = EVP_CIPHER_CTX_new();
+	const unsigned char iv[AES_BLOCK] = { 0 }; // in a real system this never should be all 0's
+	const bool ready = self->ctx != nullptr &&
+		EVP_DecryptInit_ex(self->ctx, cipher, nullptr, static_cast<const unsigned char*>(key.buf), iv) == 1 &&
+		EVP_CIPHER_CTX_set_padding(self->ctx, 0) == 1;
+	PyBuffer_Release(&key);
+	if (!ready)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "AES-CBC decryption couldn't be initialized");
+		return -1;
+	}
+	delete self->pending;
+	self->pending = new std::string();
+	return 0;
+}
+
+static void cbc_dealloc(CbcDecryptorObject* self)
+{
+	if (self->ctx != nullptr)
+		EVP_CIPHER_CTX_free(self->ctx);
+	delete self->pending;
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+// the Cksum argument (None - no cksum), Return false (and set an exception) if it is of another type
+static bool parse_cksum(PyObject* arg, CRC*& crc)
+{
+	crc = nullptr;
+	if (arg == nullptr || arg == Py_None)
+		return true;
+	if (!PyObject_TypeCheck(arg, &CksumType))
+	{
+		PyErr_SetString(PyExc_TypeError, "cksum should be a transferit_native.Cksum");
+		return false;
+	}
+	crc = reinterpret_cast<CksumObject*>(arg)->crc;
+	return true;
+}
+
+// decrypt size bytes (whole blocks) into output, add them to crc (if given)
+static bool cbc_decrypt(EVP_CIPHER_CTX* ctx, const unsigned char* input, size_t size, unsigned char* output, CRC* crc)
+{
+	int written = 0;
+	if (EVP_DecryptUpdate(ctx, output, &written, input, static_cast<int>(size)) != 1 || written != static_cast<int>(size))
+		return false;
+	if (crc != nullptr)
+		crc->update(output, size);
+	return true;
+}
+
+static PyObject* cbc_update(CbcDecryptorObject* self, PyObject* args)
+{
+	Py_buffer chunk;
+	PyObject* cksum = nullptr;
+	CRC* crc = nullptr;
+	if (!PyArg_ParseTuple(args, "y*|O", &chunk, &cksum))
+		return nullptr;
+	if (!parse_cksum(cksum, crc))
+	{
+		PyBuffer_Release(&chunk);
+		return nullptr;
+	}
+
+	// the pending bytes & the chunk, but the last block (or the bytes after the last whole block)
+	const size_t total = self->pending->size() + static_cast<size_t>(chunk.len);
+	const size_t keep = total % AES_BLOCK ? total % AES_BLOCK : AES_BLOCK;
+	const size_t ready = total > keep ? total - keep : 0;
+	PyObject* decrypted = PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(ready));
+	if (decrypted == nullptr)
+	{
+		PyBuffer_Release(&chunk);
+		return nullptr;
+	}
+
+	bool valid = true;
+	if (ready > 0)
+	{
+		unsigned char* output = reinterpret_cast<unsigned char*>(PyBytes_AS_STRING(decrypted));
+		const unsigned char* input = static_cast<const unsigned char*>(chunk.buf);
+		const size_t pending_size = self->pending->size(); // less than a block + a block
+		Py_BEGIN_ALLOW_THREADS
+		// the pending bytes are completed to whole blocks by the first bytes of the chunk
+		size_t done = 0;
+		if (pending_size > 0)
+		{
+			const size_t head = (pending_size + AES_BLOCK - 1) / AES_BLOCK * AES_BLOCK;
+			self->pending->append(reinterpret_cast<const char*>(input), head - pending_size);
+			valid = cbc_decrypt(self->ctx, reinterpret_cast<const unsigned char*>(self->pending->data()), head, output, crc);
+			done = head;
+			input += head - pending_size;
+		}
+		if (valid && ready > done)
+		{
+			valid = cbc_decrypt(self->ctx, input, ready - done, output + done, crc);
+			input += ready - done;
+		}
+		self->pending->assign(reinterpret_cast<const char*>(input), keep);
+		Py_END_ALLOW_THREADS
+	}
+	else
+		self->pending->append(static_cast<const char*>(chunk.buf), static_cast<size_t>(chunk.len));
+	PyBuffer_Release(&chunk);
+	if (!valid)
+	{
+		Py_DECREF(decrypted);
+		PyErr_SetString(PyExc_ValueError, "AES-CBC content couldn't be decrypted");
+		return nullptr;
+	}
+	return decrypted;
+}
+
+static PyObject* cbc_final(CbcDecryptorObject* self, PyObject* args)
+{
+	PyObject* cksum = nullptr;
+	CRC* crc = nullptr;
+	if (!PyArg_ParseTuple(args, "|O", &cksum) || !parse_cksum(cksum, crc))
+		return nullptr;
+	if (self->pending->size() != AES_BLOCK)
+	{
+		PyErr_SetString(PyExc_ValueError, "Data must be padded to 16 byte boundary in CBC mode");
+		return nullptr;
+	}
+	unsigned char block[AES_BLOCK];
+	if (!cbc_decrypt(self->ctx, reinterpret_cast<const unsigned char*>(self->pending->data()), AES_BLOCK, block, nullptr))
+	{
+		PyErr_SetString(PyExc_ValueError, "AES-CBC content couldn't be decrypted");
+		return nullptr;
+	}
+	self->pending->clear();
+
+	// PKCS#7 padding, checked as pycryptodome unpad does
+	const size_t padding = block[AES_BLOCK - 1];
+	bool valid = padding >= 1 && padding <= AES_BLOCK;
+	for (size_t i = AES_BLOCK - padding; valid && i < AES_BLOCK; i++)
+		valid = block[i] == padding;
+	if (!valid)
+	{
+		PyErr_SetString(PyExc_ValueError, "Padding is incorrect.");
+		return nullptr;
+	}
+	if (crc != nullptr)
+		crc->update(block, AES_BLOCK - padding);
+	return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(block), static_cast<Py_ssize_t>(AES_BLOCK - padding));
+}
+
+static PyMethodDef cbc_methods[] = {
+	{ "update", reinterpret_cast<PyCFunction>(cbc_update), METH_VARARGS,
+		"update(chunk, cksum=None) - Return the decrypted content which is ready so far (may be empty), add it to cksum" },
+	{ "final", reinterpret_cast<PyCFunction>(cbc_final), METH_VARARGS,
+		"final(cksum=None) - Return the last decrypted block without the padding, add it to cksum, "
+		"raise ValueError if the content is not a whole number of blocks or the padding is invalid" },
+	{ nullptr }
+};
+
+static PyModuleDef native_module = {
+	PyModuleDef_HEAD_INIT, "transferit_native", "cksum & AES-CBC decryption of the TransferIt server", -1, nullptr
+};
+
+PyMODINIT_FUNC PyInit_transferit_native()
+{
+	CksumType.tp_name = "transferit_native.Cksum";
+	CksumType.tp_doc = "cksum (as the Linux cksum command) of a content which arrives chunk by chunk";
+	CksumType.tp_basicsize = sizeof(CksumObject);
+	CksumType.tp_flags = Py_TPFLAGS_DEFAULT;
+	CksumType.tp_new = PyType_GenericNew;
+	CksumType.tp_init = reinterpret_cast<initproc>(cksum_init);
+	CksumType.tp_dealloc = reinterpret_cast<destructor>(cksum_dealloc);
+	CksumType.tp_methods = cksum_methods;
+
+	CbcDecryptorType.tp_name = "transferit_native.CbcDecryptor";
+	CbcDecryptorType.tp_doc = "AES-CBC decryption of a content which arrives chunk by chunk";
+	CbcDecryptorType.tp_basicsize = sizeof(CbcDecryptorObject);
+	CbcDecryptorType.tp_flags = Py_TPFLAGS_DEFAULT;
+	CbcDecryptorType.tp_new = PyType_GenericNew;
+	CbcDecryptorType.tp_init = reinterpret_cast<initproc>(cbc_init);
+	CbcDecryptorType.tp_dealloc = reinterpret_cast<destructor>(cbc_dealloc);
+	CbcDecryptorType.tp_methods = cbc_methods;
+
+	if (PyType_Ready(&CksumType) < 0 || PyType_Ready(&CbcDecryptorType) < 0)
+		return nullptr;
+	PyObject* module = PyModule_Create(&native_module);
+	if (module == nullptr)
+		return nullptr;
+	Py_INCREF(&CksumType);
+	Py_INCREF(&CbcDecryptorType);
+	if (PyModule_AddObject(module, "Cksum", reinterpret_cast<PyObject*>(&CksumType)) < 0 ||
+		PyModule_AddObject(module, "CbcDecryptor", reinterpret_cast<PyObject*>(&CbcDecryptorType)) < 0)
+	{
+		Py_DECREF(module);
+		return nullptr;
+	}
+	return module;
+}
@@ -16,6 +16,18 @@ REQ_FILE = 1103
 REQ_VALID_CRC = 1104
 REQ_NVALID_CRC = 1105
 REQ_4NVALID_CRC = 1106
+REQ_FILE_STRIPE = 1107  # a range of a file, sent over one of several parallel connections
+REQ_FILE_STRIPES_DONE = 1108  # all the stripes of a file were sent, server should assemble & cksum the file
+REQ_FILE_CHUNKS_BEGIN = 1109  # a file is about to be sent chunk by chunk, server answers with the chunks it already has
+REQ_FILE_CHUNK = 1110  # one chunk of a file followed by its cksum, not answered (chunks are sent back to back)
+REQ_FILE_CHUNKS_DONE = 1111  # all the chunks were sent, server should assemble & cksum the file or report missing chunks
+REQ_SESSION_TICKET = 1112  # client asks for a ticket, so its next run can resume the session (skip the key exchange)
+REQ_RESUME_SESSION = 1113  # client presents a ticket instead of its public key
+REQ_FILE_INVENTORY = 1114  # the content defined chunks of a file (hash & size), server answers which of them it has
+REQ_FILE_DEDUP_CHUNK = 1115  # one chunk of the inventory the server doesn't have, not answered
+REQ_FILE_DEDUP_DONE = 1116  # the missing chunks were sent, server should assemble & cksum the file or report missing chunks
+REQ_FILE_SIGNATURES = 1117  # client asks for the block signatures of the server copy of a file
+REQ_FILE_DELTA = 1118  # a file as the differences from the server copy (blocks to copy & data), answered with RES_GOT_FILE
 
 # Response codes
 RES_REGISTRATION_SUCCESS = 2100
@@ -23,9 +35,27 @@ RES_REGISTRATION_FAIL = 2101  # no payload
 RES_AES_KEY = 2102  # variable payload size
 RES_GOT_FILE = 2103
 RES_MSG_CONFIRM = 2104  # no payload
-
-# Server version
-SVR_VERSION = 3
+RES_FILE_CHUNKS_STATUS = 2105  # variable payload size
+RES_SESSION_TICKET = 2106
+RES_SESSION_RESUMED = 2107
+RES_SESSION_RESUME_FAIL = 2108  # no payload, client should exchange keys (request public key) on the same session
+RES_FILE_INVENTORY = 2109  # variable payload size
+RES_FILE_SIGNATURES = 2110  # variable payload size
+
+# Server version, a client of an older version is answered as usual (the responses didn't change),
+# file content of requests of version VERSION_CTR and on is encrypted with AES-CTR (AES-CBC before),
+# plain file content of requests of version VERSION_CODEC and on starts with a codec byte (compressed / as is),
+# clients of version VERSION_DEDUP and on may send a file by its chunks (only the ones the chunk store doesn't have),
+# clients of version VERSION_DELTA and on may send a file as the differences from the copy the server has,
+# file sizes & offsets of requests / responses of version VERSION_LARGE_FILES and on are 64-bit (see sizes_format),
+# AES-CTR file content of requests of version VERSION_AUTH and on ends with a MAC of its iv & ciphertext
+SVR_VERSION = 9
+VERSION_CTR = 4
+VERSION_CODEC = 5
+VERSION_DEDUP = 6  # file inventory / dedup chunk / dedup done requests
+VERSION_DELTA = 7  # file signatures / file delta requests
+VERSION_LARGE_FILES = 8  # files over 4GB
+VERSION_AUTH = 9  # authenticated file content (AES-CTR content is malleable, the cksum doesn't detect a modification)
 
 # sizes in bytes
 CLT_ID_SIZE = 16
@@ -36,6 +66,53 @@ FILE_NAME_SIZE = 255
 FILE_PATH_NAME_SIZE = 255
 CKSUM_SIZE = 4
 HEADER_SIZE = 7  # Version, Code, Payload size
+REQ_HEADER_SIZE = CLT_ID_SIZE + HEADER_SIZE
+CRC_PAYLOAD_SIZE = CLT_ID_SIZE + FILE_NAME_SIZE  # ID, File name
+CHUNK_PAYLOAD_HDR_SIZE = CLT_ID_SIZE + 4 * 2 + FILE_NAME_SIZE  # ID, Chunk index, Content size, File name (content & cksum follow)
+CHUNKS_DONE_PAYLOAD_SIZE = CLT_ID_SIZE + FILE_NAME_SIZE  # ID, File name
+DEDUP_CHUNK_PAYLOAD_HDR_SIZE = CLT_ID_SIZE + 4 * 2 + FILE_NAME_SIZE  # ID, Chunk index, Content size, File name (content follows)
+DEDUP_DONE_PAYLOAD_SIZE = CLT_ID_SIZE + FILE_NAME_SIZE  # ID, File name
+SIGNATURES_PAYLOAD_SIZE = CLT_ID_SIZE + FILE_NAME_SIZE  # ID, File name
+SESSION_TICKET_SIZE = 16
+CONTENT_IV_SIZE = 16  # AES-CTR content starts with its iv (8 bytes nonce, 8 bytes initial counter)
+CONTENT_MAC_SIZE = 16  # and ends with its MAC (VERSION_AUTH and on), HMAC-SHA256 of the iv & ciphertext, truncated
+CONTENT_MAC_LABEL = b"TransferIt content MAC"  # the MAC key is HMAC-SHA256 of the label with the AES key
+CODEC_NONE = 0  # the content follows as is
+CODEC_LZ4 = 1  # a LZ4 frame follows
+CODEC_ZSTD = 2  # a zstd frame follows
+MAX_FILE_CHUNKS = 64 * 1024  # keeps the chunks status response (cksum & bit per chunk) small
+MAX_CHUNK_SIZE = 16 * 1024 * 1024  # a chunk is verified in memory before it is stored
+CHUNK_HASH_SIZE = 32  # SHA-256 of a content defined chunk
+CHUNK_REF_FORMAT = f"<{CHUNK_HASH_SIZE}sL"  # hash, size of a content defined chunk
+MAX_INVENTORY_CHUNKS = 256 * 1024  # content defined chunks of a file inventory
+STRONG_HASH_SIZE = 16  # of a block signature, the first bytes of the block SHA-256
+BLOCK_SIGNATURE_FORMAT = f"<L{STRONG_HASH_SIZE}s"  # weak (rolling) checksum, strong hash of a block of the server copy
+DELTA_OP_FORMAT = "<BLL"  # op, first, count (see DeltaPatcher)
+DELTA_COPY = 0  # copy count blocks of the server copy, from block first
+DELTA_DATA = 1  # first bytes of data follow
+
+
+def sizes_format(version, count=1):
+    """ Return the struct format of count file sizes / offsets in a request / response of the given protocol version,
+    32-bit up to VERSION_LARGE_FILES, 64-bit from it on """
+    return "<" + ("Q" if version >= VERSION_LARGE_FILES else "L") * count
+
+
+def content_payload_size(version, payload_hdr_size, content_size):
+    """ Return the header payload size of a request of the given protocol version whose content (content_size bytes)
+    follows its payload header, from VERSION_LARGE_FILES on it counts the payload header only (the content may be
+    larger than the 32-bit payload size) """
+    return payload_hdr_size + (0 if version >= VERSION_LARGE_FILES else content_size)
+
+
+async def recv_chunks(client_socket, size, chunk_size):
+    """ async generator which receives exactly size bytes from the session connection, chunk by chunk
+    (up to chunk_size bytes each) """
+    bytes_left = size
+    while bytes_left > 0:
+        chunk = await client_socket.recv_exact(min(chunk_size, bytes_left))
+        bytes_left -= len(chunk)
+        yield chunk
 
 
 # Request header
@@ -112,27 +189,378 @@ class ReqFile:
         self.clt_id = b""
         self.content_size = DEFAULT
         self.file_name = b""
-        self.content = b""
 
-    def unpack(self, client_socket, data):
-        """ unpack request file in little endian (<) """
+    async def unpack(self, client_socket, data):
+        """ unpack request file header & payload header in little endian (<),
+        the file content itself is left in the socket and should be consumed with recv_content """
         if not self.header.unpack(data):
             return False
         try:
-            data = client_socket.recv(self.header.payload_size)  # getting the payload
+            sizes = sizes_format(self.header.clt_version)  # Content size
+            sizes_end = CLT_ID_SIZE + struct.calcsize(sizes)
+            payload_hdr_size = sizes_end + FILE_NAME_SIZE  # ID, Content size, File name (content follows)
+            data = await client_socket.recv_exact(payload_hdr_size)  # getting the payload header
             id_bytes = data[:CLT_ID_SIZE]
             self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", id_bytes)[0]
-            self.content_size = struct.unpack("<L", data[CLT_ID_SIZE:CLT_ID_SIZE + 4])[0]
-            filename_bytes = data[CLT_ID_SIZE + 4: CLT_ID_SIZE + 4 + FILE_NAME_SIZE]
+            self.content_size = struct.unpack(sizes, data[CLT_ID_SIZE:sizes_end])[0]
+            filename_bytes = data[sizes_end:payload_hdr_size]
             self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", filename_bytes)[0].partition(b'\0')[0].decode())  # .decode('utf-8')
-            content_bytes = data[CLT_ID_SIZE + 4 + FILE_NAME_SIZE:]
-            self.content = struct.unpack(f"<{self.content_size}s", content_bytes)[0]
+            if self.header.payload_size != content_payload_size(self.header.clt_version, payload_hdr_size, self.content_size):
+                raise ValueError(f"payload size {self.header.payload_size} not match content size {self.content_size}")
             return True
         except Exception as e:
             self.clt_id = b""
             self.content_size = DEFAULT
             self.file_name = b""
-            self.content = b""
+            return False
+
+    def recv_content(self, client_socket, chunk_size):
+        """ receive the file content from the socket, return an async generator of chunks (up to chunk_size bytes each) """
+        return recv_chunks(client_socket, self.content_size, chunk_size)
+
+
+class ReqFileStripe:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_size = DEFAULT  # size of the whole file
+        self.stripe_offset = DEFAULT  # position of the stripe in the file
+        self.stripe_size = DEFAULT  # size of the stripe (decrypted)
+        self.content_size = DEFAULT  # size of the stripe content (encrypted)
+        self.file_name = b""
+
+    async def unpack(self, client_socket, data):
+        """ unpack request file stripe header & payload header in little endian (<),
+        the stripe content itself is left in the socket and should be consumed with recv_content """
+        if not self.header.unpack(data):
+            return False
+        try:
+            sizes = sizes_format(self.header.clt_version, 4)  # File size, Offset, Size, Content size
+            sizes_end = CLT_ID_SIZE + struct.calcsize(sizes)
+            payload_hdr_size = sizes_end + FILE_NAME_SIZE  # ID, sizes, File name (content follows)
+            data = await client_socket.recv_exact(payload_hdr_size)  # getting the payload header
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", data[:CLT_ID_SIZE])[0]
+            self.file_size, self.stripe_offset, self.stripe_size, self.content_size = \
+                struct.unpack(sizes, data[CLT_ID_SIZE:sizes_end])
+            filename_bytes = data[sizes_end:payload_hdr_size]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", filename_bytes)[0].partition(b'\0')[0].decode())
+            if self.header.payload_size != content_payload_size(self.header.clt_version, payload_hdr_size, self.content_size):
+                raise ValueError(f"payload size {self.header.payload_size} not match content size {self.content_size}")
+            if self.stripe_offset + self.stripe_size > self.file_size:
+                raise ValueError(f"stripe {self.stripe_offset}+{self.stripe_size} exceeds file size {self.file_size}")
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+    def recv_content(self, client_socket, chunk_size):
+        """ receive the stripe content from the socket, return an async generator of chunks (up to chunk_size bytes each) """
+        return recv_chunks(client_socket, self.content_size, chunk_size)
+
+
+class ReqFileStripesDone:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_size = DEFAULT
+        self.file_name = b""
+
+    def unpack(self, byte_array):
+        """ unpack request file stripes done in little endian (<) """
+        if not self.header.unpack(byte_array):
+            return False
+        try:
+            offset = self.header.size
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", byte_array[offset:offset + CLT_ID_SIZE])[0]
+            offset += CLT_ID_SIZE
+            sizes = sizes_format(self.header.clt_version)  # File size
+            self.file_size = struct.unpack(sizes, byte_array[offset:offset + struct.calcsize(sizes)])[0]
+            offset += struct.calcsize(sizes)
+            file_name_bytes = byte_array[offset:offset + FILE_NAME_SIZE]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", file_name_bytes)[0].partition(b'\0')[0].decode())
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+
+class ReqFileChunksBegin:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_size = DEFAULT
+        self.chunk_size = DEFAULT  # size of every chunk (decrypted) but the last one
+        self.file_name = b""
+
+    def unpack(self, byte_array):
+        """ unpack request file chunks begin in little endian (<) """
+        if not self.header.unpack(byte_array):
+            return False
+        try:
+            offset = self.header.size
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", byte_array[offset:offset + CLT_ID_SIZE])[0]
+            offset += CLT_ID_SIZE
+            sizes = sizes_format(self.header.clt_version) + "L"  # File size, Chunk size
+            self.file_size, self.chunk_size = struct.unpack(sizes, byte_array[offset:offset + struct.calcsize(sizes)])
+            offset += struct.calcsize(sizes)
+            file_name_bytes = byte_array[offset:offset + FILE_NAME_SIZE]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", file_name_bytes)[0].partition(b'\0')[0].decode())
+            if self.file_size == 0 or self.chunk_size == 0 or self.chunk_size > MAX_CHUNK_SIZE:
+                raise ValueError(f"file size {self.file_size} / chunk size {self.chunk_size} is invalid")
+            if (self.file_size + self.chunk_size - 1) // self.chunk_size > MAX_FILE_CHUNKS:
+                raise ValueError(f"chunk size {self.chunk_size} is too small for file size {self.file_size}")
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+
+class ReqFileChunk:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.chunk_index = DEFAULT  # position of the chunk in the file is chunk_index * chunk size
+        self.content_size = DEFAULT  # size of the chunk content (encrypted)
+        self.file_name = b""
+
+    async def unpack(self, client_socket, data):
+        """ unpack request file chunk header & payload header in little endian (<),
+        the chunk content and cksum are left in the socket and should be consumed with recv_content & recv_cksum """
+        if not self.header.unpack(data):
+            return False
+        try:
+            data = await client_socket.recv_exact(CHUNK_PAYLOAD_HDR_SIZE)  # getting the payload header
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", data[:CLT_ID_SIZE])[0]
+            self.chunk_index, self.content_size = struct.unpack("<LL", data[CLT_ID_SIZE:CLT_ID_SIZE + 4 * 2])
+            filename_bytes = data[CLT_ID_SIZE + 4 * 2:CHUNK_PAYLOAD_HDR_SIZE]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", filename_bytes)[0].partition(b'\0')[0].decode())
+            if self.header.payload_size != content_payload_size(self.header.clt_version, CHUNK_PAYLOAD_HDR_SIZE,
+                                                                self.content_size + CKSUM_SIZE):
+                raise ValueError(f"payload size {self.header.payload_size} not match content size {self.content_size}")
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+    def recv_content(self, client_socket, chunk_size):
+        """ receive the chunk content from the socket, return an async generator of chunks (up to chunk_size bytes each) """
+        return recv_chunks(client_socket, self.content_size, chunk_size)
+
+    @staticmethod
+    async def recv_cksum(client_socket):
+        """ receive the cksum which follows the chunk content """
+        return struct.unpack("<L", await client_socket.recv_exact(CKSUM_SIZE))[0]
+
+
+class ReqFileChunksDone:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_name = b""
+
+    def unpack(self, byte_array):
+        """ unpack request file chunks done in little endian (<) """
+        if not self.header.unpack(byte_array):
+            return False
+        try:
+            offset = self.header.size
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", byte_array[offset:offset + CLT_ID_SIZE])[0]
+            offset += CLT_ID_SIZE
+            file_name_bytes = byte_array[offset:offset + FILE_NAME_SIZE]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", file_name_bytes)[0].partition(b'\0')[0].decode())
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+
+class ReqFileInventory:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_size = DEFAULT
+        self.file_name = b""
+        self.chunks = []  # (hash, size) of every chunk, in the file order
+
+    async def unpack(self, client_socket, data):
+        """ unpack request file inventory header & payload in little endian (<),
+        the chunks follow the payload header in the socket (the inventory may be larger than any other request) """
+        if not self.header.unpack(data):
+            return False
+        try:
+            sizes = sizes_format(self.header.clt_version) + "L"  # File size, Chunks count
+            sizes_end = CLT_ID_SIZE + struct.calcsize(sizes)
+            payload_hdr_size = sizes_end + FILE_NAME_SIZE  # ID, sizes, File name (chunks follow)
+            data = await client_socket.recv_exact(payload_hdr_size)  # getting the payload header
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", data[:CLT_ID_SIZE])[0]
+            self.file_size, chunks_count = struct.unpack(sizes, data[CLT_ID_SIZE:sizes_end])
+            filename_bytes = data[sizes_end:payload_hdr_size]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", filename_bytes)[0].partition(b'\0')[0].decode())
+            chunk_ref_size = struct.calcsize(CHUNK_REF_FORMAT)
+            if chunks_count == 0 or chunks_count > MAX_INVENTORY_CHUNKS or \
+                    self.header.payload_size != payload_hdr_size + chunks_count * chunk_ref_size:
+                raise ValueError(f"payload size {self.header.payload_size} not match {chunks_count} chunks")
+            self.chunks = list(struct.iter_unpack(CHUNK_REF_FORMAT, await client_socket.recv_exact(chunks_count * chunk_ref_size)))
+            if sum(size for _, size in self.chunks) != self.file_size or \
+                    any(size == 0 or size > MAX_CHUNK_SIZE for _, size in self.chunks):
+                raise ValueError(f"chunk sizes not match file size {self.file_size}")
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+
+class ReqFileDedupChunk:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.chunk_index = DEFAULT  # in the inventory
+        self.content_size = DEFAULT  # size of the chunk content (encrypted)
+        self.file_name = b""
+
+    async def unpack(self, client_socket, data):
+        """ unpack request file dedup chunk header & payload header in little endian (<),
+        the chunk content is left in the socket and should be consumed with recv_content """
+        if not self.header.unpack(data):
+            return False
+        try:
+            data = await client_socket.recv_exact(DEDUP_CHUNK_PAYLOAD_HDR_SIZE)  # getting the payload header
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", data[:CLT_ID_SIZE])[0]
+            self.chunk_index, self.content_size = struct.unpack("<LL", data[CLT_ID_SIZE:CLT_ID_SIZE + 4 * 2])
+            filename_bytes = data[CLT_ID_SIZE + 4 * 2:DEDUP_CHUNK_PAYLOAD_HDR_SIZE]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", filename_bytes)[0].partition(b'\0')[0].decode())
+            if self.header.payload_size != content_payload_size(self.header.clt_version, DEDUP_CHUNK_PAYLOAD_HDR_SIZE,
+                                                                self.content_size):
+                raise ValueError(f"payload size {self.header.payload_size} not match content size {self.content_size}")
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+    def recv_content(self, client_socket, chunk_size):
+        """ receive the chunk content from the socket, return an async generator of chunks (up to chunk_size bytes each) """
+        return recv_chunks(client_socket, self.content_size, chunk_size)
+
+
+class ReqFileDedupDone:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_name = b""
+
+    def unpack(self, byte_array):
+        """ unpack request file dedup done in little endian (<) """
+        if not self.header.unpack(byte_array):
+            return False
+        try:
+            offset = self.header.size
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", byte_array[offset:offset + CLT_ID_SIZE])[0]
+            offset += CLT_ID_SIZE
+            file_name_bytes = byte_array[offset:offset + FILE_NAME_SIZE]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", file_name_bytes)[0].partition(b'\0')[0].decode())
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+
+class ReqFileSignatures:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_name = b""
+
+    def unpack(self, byte_array):
+        """ unpack request file signatures in little endian (<) """
+        if not self.header.unpack(byte_array):
+            return False
+        try:
+            offset = self.header.size
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", byte_array[offset:offset + CLT_ID_SIZE])[0]
+            offset += CLT_ID_SIZE
+            file_name_bytes = byte_array[offset:offset + FILE_NAME_SIZE]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", file_name_bytes)[0].partition(b'\0')[0].decode())
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+
+class ReqFileDelta:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.file_size = DEFAULT  # of the file after the delta is applied
+        self.basis_size = DEFAULT  # of the server copy the signatures were calculated for
+        self.block_size = DEFAULT  # of the signatures
+        self.content_size = DEFAULT  # size of the delta content (encrypted)
+        self.file_name = b""
+
+    async def unpack(self, client_socket, data):
+        """ unpack request file delta header & payload header in little endian (<),
+        the delta content is left in the socket and should be consumed with recv_content """
+        if not self.header.unpack(data):
+            return False
+        try:
+            size = sizes_format(self.header.clt_version)[1:]
+            sizes = f"<{size}{size}L{size}"  # File size, Basis size, Block size, Content size
+            sizes_end = CLT_ID_SIZE + struct.calcsize(sizes)
+            payload_hdr_size = sizes_end + FILE_NAME_SIZE  # ID, sizes, File name (content follows)
+            data = await client_socket.recv_exact(payload_hdr_size)  # getting the payload header
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", data[:CLT_ID_SIZE])[0]
+            self.file_size, self.basis_size, self.block_size, self.content_size = \
+                struct.unpack(sizes, data[CLT_ID_SIZE:sizes_end])
+            filename_bytes = data[sizes_end:payload_hdr_size]
+            self.file_name = str(struct.unpack(f"<{FILE_NAME_SIZE}s", filename_bytes)[0].partition(b'\0')[0].decode())
+            if self.header.payload_size != content_payload_size(self.header.clt_version, payload_hdr_size, self.content_size):
+                raise ValueError(f"payload size {self.header.payload_size} not match content size {self.content_size}")
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+    def recv_content(self, client_socket, chunk_size):
+        """ receive the delta content from the socket, return an async generator of chunks (up to chunk_size bytes each) """
+        return recv_chunks(client_socket, self.content_size, chunk_size)
+
+
+class ReqSessionTicket:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+
+    def unpack(self, byte_array):
+        """ unpack request session ticket in little endian (<) """
+        if not self.header.unpack(byte_array):
+            return False
+        try:
+            offset = self.header.size
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", byte_array[offset:offset + CLT_ID_SIZE])[0]
+            return True
+        except Exception as e:
+            self.__init__()
+            return False
+
+
+class ReqResumeSession:
+    def __init__(self):
+        self.header = ReqHeader()
+        self.clt_id = b""
+        self.ticket = b""
+
+    def unpack(self, byte_array):
+        """ unpack request resume session in little endian (<) """
+        if not self.header.unpack(byte_array):
+            return False
+        try:
+            offset = self.header.size
+            self.clt_id = struct.unpack(f"<{CLT_ID_SIZE}s", byte_array[offset:offset + CLT_ID_SIZE])[0]
+            offset += CLT_ID_SIZE
+            self.ticket = struct.unpack(f"<{SESSION_TICKET_SIZE}s",
+                                        byte_array[offset:offset + SESSION_TICKET_SIZE])[0]
+            return True
+        except Exception as e:
+            self.__init__()
             return False
 
 
@@ -211,6 +639,7 @@ class ResAES:
 class ResGotFile:
     def __init__(self):
         self.header = ResHeader(RES_GOT_FILE)
+        self.version = DEFAULT  # of the request, the content size is 64-bit from VERSION_LARGE_FILES on
         self.clt_id = b""
         self.content_size = 0
         self.file_name = b""
@@ -219,9 +648,11 @@ class ResGotFile:
     def pack(self):
         """ pack response got file in little endian (<) """
         try:
+            sizes = sizes_format(self.version)
+            self.header.payload_size = CLT_ID_SIZE + struct.calcsize(sizes) + FILE_NAME_SIZE + CKSUM_SIZE
             byte_stream = self.header.pack()
             byte_stream += struct.pack(f"<{CLT_ID_SIZE}s", self.clt_id)
-            byte_stream += struct.pack("<L", self.content_size)
+            byte_stream += struct.pack(sizes, self.content_size)
             byte_stream += struct.pack(f"<{FILE_NAME_SIZE}s", bytes(self.file_name, 'utf-8'))
             byte_stream += struct.pack("<L", self.cksum)
             return byte_stream
@@ -229,6 +660,107 @@ class ResGotFile:
             return b""
 
 
+class ResFileChunksStatus:
+    def __init__(self):
+        self.header = ResHeader(RES_FILE_CHUNKS_STATUS)
+        self.clt_id = b""
+        self.cksums = []  # cksum of every chunk (0 if not stored)
+        self.stored = b""  # bitmap of the stored chunks, bit i % 8 of byte i // 8
+
+    def pack(self):
+        """ pack response file chunks status in little endian (<) """
+        try:
+            self.header.payload_size = CLT_ID_SIZE + 4 + CKSUM_SIZE * len(self.cksums) + len(self.stored)
+            byte_stream = self.header.pack()
+            byte_stream += struct.pack(f"<{CLT_ID_SIZE}s", self.clt_id)
+            byte_stream += struct.pack("<L", len(self.cksums))
+            byte_stream += struct.pack(f"<{len(self.cksums)}L", *self.cksums)
+            byte_stream += bytes(self.stored)
+            return byte_stream
+        except Exception as e:
+            return b""
+
+
+class ResFileInventory:
+    def __init__(self):
+        self.header = ResHeader(RES_FILE_INVENTORY)
+        self.clt_id = b""
+        self.chunks_count = 0
+        self.known = b""  # bitmap of the chunks the server has, bit i % 8 of byte i // 8
+
+    def pack(self):
+        """ pack response file inventory in little endian (<) """
+        try:
+            self.header.payload_size = CLT_ID_SIZE + 4 + len(self.known)
+            byte_stream = self.header.pack()
+            byte_stream += struct.pack(f"<{CLT_ID_SIZE}s", self.clt_id)
+            byte_stream += struct.pack("<L", self.chunks_count)
+            byte_stream += bytes(self.known)
+            return byte_stream
+        except Exception as e:
+            return b""
+
+
+class ResFileSignatures:
+    def __init__(self):
+        self.header = ResHeader(RES_FILE_SIGNATURES)
+        self.version = DEFAULT  # of the request, the file size is 64-bit from VERSION_LARGE_FILES on
+        self.clt_id = b""
+        self.file_size = 0  # of the server copy, 0 - no copy
+        self.block_size = 0
+        self.signatures = []  # (weak, strong) of every block, the last block may be shorter than block_size
+
+    def pack(self):
+        """ pack response file signatures in little endian (<) """
+        try:
+            sizes = sizes_format(self.version) + "LL"  # File size, Block size, Blocks count
+            self.header.payload_size = CLT_ID_SIZE + struct.calcsize(sizes) + \
+                struct.calcsize(BLOCK_SIGNATURE_FORMAT) * len(self.signatures)
+            byte_stream = self.header.pack()
+            byte_stream += struct.pack(f"<{CLT_ID_SIZE}s", self.clt_id)
+            byte_stream += struct.pack(sizes, self.file_size, self.block_size, len(self.signatures))
+            byte_stream += b"".join(struct.pack(BLOCK_SIGNATURE_FORMAT, weak, strong) for weak, strong in self.signatures)
+            return byte_stream
+        except Exception as e:
+            return b""
+
+
+class ResSessionTicket:
+    def __init__(self):
+        self.header = ResHeader(RES_SESSION_TICKET)
+        self.clt_id = b""
+        self.ticket = b""
+        self.lifetime = 0  # seconds
+
+    def pack(self):
+        """ pack response session ticket in little endian (<) """
+        try:
+            self.header.payload_size = CLT_ID_SIZE + SESSION_TICKET_SIZE + 4
+            byte_stream = self.header.pack()
+            byte_stream += struct.pack(f"<{CLT_ID_SIZE}s", self.clt_id)
+            byte_stream += struct.pack(f"<{SESSION_TICKET_SIZE}s", self.ticket)
+            byte_stream += struct.pack("<L", self.lifetime)
+            return byte_stream
+        except Exception as e:
+            return b""
+
+
+class ResSessionResumed:
+    def __init__(self):
+        self.header = ResHeader(RES_SESSION_RESUMED)
+        self.clt_id = b""
+
+    def pack(self):
+        """ pack response session resumed in little endian (<) """
+        try:
+            self.header.payload_size = CLT_ID_SIZE
+            byte_stream = self.header.pack()
+            byte_stream += struct.pack(f"<{CLT_ID_SIZE}s", self.clt_id)
+            return byte_stream
+        except Exception as e:
+            return b""
+
+
 class ResConfirmMsg:
     def __init__(self):
         self.header = ResHeader(RES_MSG_CONFIRM)
@@ -253,3 +785,16 @@ class ResRegistrationFailed:
             return byte_stream
         except Exception as e:
             return b""
+
+
+class ResSessionResumeFailed:
+    def __init__(self):
+        self.header = ResHeader(RES_SESSION_RESUME_FAIL)
+
+    def pack(self):
+        """ pack response session resume failed in little endian (<) """
+        try:
+            byte_stream = self.header.pack()
+            return byte_stream
+        except Exception as e:
+            return b""
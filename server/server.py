@@ -1,22 +1,108 @@
 """
 TransferIt server
 server.py
-description: main loop of the server and socket operations, contains server startup routine
+description: main loop of the server and socket operations, contains server startup routine.
+sessions run as coroutines of one event loop (asyncio), a session waits for its next request and for the content of a
+file type request without holding a thread. the blocking parts of a request (decryption & cksum, file and database
+operations) run on a bounded pool of worker threads, the request handlers reach the session connection through
+SessionStream
 """
 
 import networkProtocol
 import database
 import helper
-import socket  # for socket operations (send recv)
+import crc  # for file content CRC calculation while receiving it (linux cksum command)
 import uuid  # for client id
 import datetime  # for database LastSeen
-import threading  # for multithreading sessions
+import threading  # for the locks of the state sessions share (handler parts run on several worker threads)
+import asyncio  # for the sessions event loop
+from concurrent.futures import ThreadPoolExecutor  # for the worker threads of the blocking parts of the requests
+import io  # for file chunks which are verified before they are stored
+import time  # for session tickets expiry
+import hmac  # for session tickets comparison (constant time)
+from Crypto.Random import get_random_bytes  # for session tickets
+from pathlib import Path  # for the client files directory of a stored file
+try:
+    import resource  # for the open files limit (POSIX only)
+except ImportError:
+    resource = None
+
+
+class StripedFile:
+    """ a file which arrives as stripes on several sessions at once: the directory of its partial file, the ranges
+    (offset, size, content size) which arrived so far and the number of stripes which are being received """
+
+    def __init__(self, dir_path):
+        self.dir_path = dir_path
+        self.ranges = []
+        self.receiving = 0
+
+
+class SessionStream:
+    """ the connection of a session as the request handlers see it. file content is received with recv_exact (in the
+    event loop), a handler which waits for its client longer than RECV_TIMEOUT seconds (in the middle of a request)
+    gives up. responses are queued with send / sendall (also by the parts of a handler which run on a worker thread)
+    and written by the session with flush when the handler is done """
+    RECV_TIMEOUT = 60
+
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+        self.responses = []
+        self.clt_id = None  # the client whose AES key this session exchanged / resumed, only it gets a ticket here
+
+    def __str__(self):
+        return f"{self.writer.get_extra_info('peername')}"
+
+    async def recv_exact(self, size):
+        """ receive exactly size bytes, raise ConnectionError if the peer closed the connection before all bytes
+        arrived or didn't send them in time """
+        try:
+            return await asyncio.wait_for(self.reader.readexactly(size), SessionStream.RECV_TIMEOUT)
+        except asyncio.IncompleteReadError as e:
+            raise ConnectionError(f"connection closed after {len(e.partial)} of {size} bytes")
+        except asyncio.TimeoutError:
+            raise ConnectionError(f"client didn't respond within {SessionStream.RECV_TIMEOUT} seconds")
+
+    def send(self, data):
+        """ queue all the given data, Return its size """
+        self.responses.append(bytes(data))
+        return len(data)
+
+    def sendall(self, data):
+        """ queue all the given data """
+        self.responses.append(bytes(data))
+
+    async def flush(self):
+        """ write the queued responses, raise ConnectionError if the client didn't read them in time """
+        if not self.responses:
+            return
+        self.writer.writelines(self.responses)
+        self.responses.clear()
+        try:
+            await asyncio.wait_for(self.writer.drain(), SessionStream.RECV_TIMEOUT)
+        except asyncio.TimeoutError:
+            raise ConnectionError(f"client didn't read the response within {SessionStream.RECV_TIMEOUT} seconds")
 
 
 class Server:
     """ class which represents the server, contains the main server startup routine """
     DATABASE = "server.db"
-    DEFAULT_RECV_SIZE = 512
+    DEFAULT_RECV_SIZE = 512  # max payload size of a request which is not a file request
+    REQUEST_WORKERS = 64  # worker threads which run the blocking parts of the requests (of all the sessions)
+    LISTEN_BACKLOG = 1024  # connections which wait to be accepted
+    STREAM_BUFFER_SIZE = 64 * 1024  # bytes buffered per session before reading from its socket pauses
+    SESSION_TICKET_LIFETIME = 24 * 60 * 60  # seconds a session ticket can be used to skip the key exchange
+    FILE_CHUNK_SIZE = 64 * 1024  # file content is received, decrypted and stored chunk by chunk
+    CTR_FILE_CHUNK_SIZE = 1024 * 1024  # AES-CTR content chunks are larger, they are decrypted on several threads
+    CRC_TYPE_CODES = [networkProtocol.REQ_VALID_CRC, networkProtocol.REQ_NVALID_CRC, networkProtocol.REQ_4NVALID_CRC]
+    STREAMED_REQ_CODES = [networkProtocol.REQ_FILE, networkProtocol.REQ_FILE_STRIPE, networkProtocol.REQ_FILE_CHUNK,
+                          networkProtocol.REQ_FILE_INVENTORY,
+                          networkProtocol.REQ_FILE_DEDUP_CHUNK,
+                          networkProtocol.REQ_FILE_DELTA]  # content (or a large payload) is left in the socket,
+    # their handlers are coroutines which receive it, the handlers of the other requests run on a worker thread
+    KEY_EXCHANGE_REQ_CODES = [networkProtocol.REQ_REGISTRATION, networkProtocol.REQ_PUBLIC_KEY,
+                              networkProtocol.REQ_RESUME_SESSION]  # the requests of a client before it has a key
 
     def __init__(self, svr_addr, port):
         self.addr = svr_addr
@@ -25,75 +111,232 @@ class Server:
         self.req_handler = {
             networkProtocol.REQ_REGISTRATION: self.req_registration,
             networkProtocol.REQ_PUBLIC_KEY: self.req_public_key,
-            networkProtocol.REQ_FILE: self.req_file}
+            networkProtocol.REQ_FILE: self.req_file,
+            networkProtocol.REQ_FILE_STRIPE: self.req_file_stripe,
+            networkProtocol.REQ_FILE_STRIPES_DONE: self.req_file_stripes_done,
+            networkProtocol.REQ_FILE_CHUNKS_BEGIN: self.req_file_chunks_begin,
+            networkProtocol.REQ_FILE_CHUNK: self.req_file_chunk,
+            networkProtocol.REQ_FILE_CHUNKS_DONE: self.req_file_chunks_done,
+            networkProtocol.REQ_SESSION_TICKET: self.req_session_ticket,
+            networkProtocol.REQ_RESUME_SESSION: self.req_resume_session,
+            networkProtocol.REQ_FILE_INVENTORY: self.req_file_inventory,
+            networkProtocol.REQ_FILE_DEDUP_CHUNK: self.req_file_dedup_chunk,
+            networkProtocol.REQ_FILE_DEDUP_DONE: self.req_file_dedup_done,
+            networkProtocol.REQ_FILE_SIGNATURES: self.req_file_signatures,
+            networkProtocol.REQ_FILE_DELTA: self.req_file_delta}
+        # files which arrive as stripes (StripedFile by client ID & file name), stripes arrive on several sessions at
+        # once. a striped file is dropped (with its partial file) when a stripe of it fails, or when the last session
+        # which exchanged / resumed the key of its client (the one which sends the stripes done request) closes,
+        # keyed_sessions counts those sessions by client ID
+        self.stripes = {}
+        self.keyed_sessions = {}
+        self.stripes_lock = threading.Lock()
+        # chunk maps of the files which are being sent chunk by chunk (by client ID & file name) and the socket of the
+        # session which sends each file, every chunk map is also stored next to its partial file, so the file can be
+        # resumed on another session (which takes the file over from the session before it)
+        self.chunk_maps = {}
+        self.chunk_maps_lock = threading.Lock()
+        # inventories (content defined chunks) of the files which are being sent by their chunks (by client ID & file
+        # name) and the socket of the session which sends each file. the chunk store is shared by all the clients,
+        # chunk references are added / removed (and unreferenced chunks deleted) under chunk_store_lock
+        self.inventories = {}
+        self.inventories_lock = threading.Lock()
+        self.chunk_store_lock = threading.Lock()
+        # the protocol version the current AES key of every client was exchanged (or resumed) with (by client ID), the
+        # requests which use the key must be of that version, the version byte of a request isn't covered by the MAC
+        # of its content, a rewritten one mustn't turn the MAC check off (VERSION_AUTH) or change the content format
+        self.key_versions = {}
+        self.key_versions_lock = threading.Lock()
+        self.workers = ThreadPoolExecutor(max_workers=Server.REQUEST_WORKERS, thread_name_prefix="request")
 
     def svr_startup(self):
-        """ """
-        self.database.tables_init()
-        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as svr_socket:
-            try:
-                svr_socket.bind((self.addr, self.port))
-                svr_socket.listen()
-            except Exception as e:
-                print(e)
-                return False
+        """ prepare the database & the chunk store and serve the clients until the server stops
+        Return False if the server couldn't start / stopped on an error """
+        if not self.database.tables_init():
+            return False
+        self.collect_chunks()
+        Server.raise_open_files_limit()
+        try:
+            return asyncio.run(self.serve())
+        except Exception as e:
+            print(f" server main loop raised an exception, details: {e}")
+            return False
 
-            print(f" Server socket binded to port {self.port} \n Server is listening for new connections ")
-            while True:
-                try:
-                    # establish connection with client
-                    clt_socket, addr = svr_socket.accept()
-                    print(f"Connected by {addr}")
-
-                    # create separate thread for client session
-                    # self.session(clt_socket, addr)
-                    clt_session_thread = threading.Thread(target=self.session, args=(clt_socket, addr))
-                    clt_session_thread.start()
-                except Exception as e:
-                    print(f" server main loop raised an exception, details: {e}")
-                    return False
+    async def serve(self):
+        """ listen for new connections, every connection runs a session coroutine """
+        try:
+            svr = await asyncio.start_server(self.session, self.addr, self.port, limit=Server.STREAM_BUFFER_SIZE,
+                                             backlog=Server.LISTEN_BACKLOG)
+        except Exception as e:
+            print(e)
+            return False
+
+        print(f" Server socket binded to port {self.port} \n Server is listening for new connections ")
+        async with svr:
+            await svr.serve_forever()
+        return True
 
-    def session(self, clt_socket, clt_addr):
-        """ starts a season with the client, each loop iteration
-        is handling a request from the client, if a request couldn't be handle, the whole session will be over """
-        with clt_socket:  # will close clt_socket when finish
+    async def session(self, reader, writer):
+        """ starts a season with the client, each loop iteration is handling a request from the client,
+        if a request couldn't be handle, the whole session will be over """
+        clt_addr = writer.get_extra_info("peername")
+        print(f"Connected by {clt_addr}")
+        clt_socket = SessionStream(reader, writer)
+        try:
             while True:
-                # receive the first chunk of data from the client,
-                # get the request code, and call the appropriate request handler
-                data = clt_socket.recv(Server.DEFAULT_RECV_SIZE)
-                if not data:
-                    print(f" X failed to receive first chunk of request data, client {clt_addr} session will end now")
+                # receive the request header (and payload, except of file content) from the client,
+                # and call the appropriate request handler
+                req_header, data = await self.recv_request(reader)
+                if req_header is None:
+                    print(f" X failed to receive request data, client {clt_addr} session will end now")
                     return
-
-                # parse the request header and obtain the request code
-                req_header = networkProtocol.ReqHeader()
-                if not req_header.unpack(data):
-                    print(f" X failed to unpack request header, client {clt_addr} session will end now")
+                if not await self.handle_request(req_header, data, clt_socket, clt_addr):
                     return
+        finally:
+            await self.run_blocking(self.release_session, clt_socket)
+            writer.close()  # sends what is left in the buffer first
+            try:
+                await writer.wait_closed()
+            except Exception as e:
+                pass
 
-                crc_type_codes = [networkProtocol.REQ_VALID_CRC, networkProtocol.REQ_NVALID_CRC,
-                                  networkProtocol.REQ_4NVALID_CRC]
-                # check whether the request code is a valid one
-                if req_header.req_code in self.req_handler.keys():
-                    # invoke the appropriate request handler based on the request code (not CRC type request)
-                    if not self.req_handler[req_header.req_code](data, clt_socket):
-                        print(
-                            f" X couldn't handle request {req_header.req_code}, client {clt_addr} session will end now")
-                        return
-
-                # CRC type request
-                elif req_header.req_code in crc_type_codes:
-                    if not self.req_crc(data, clt_socket):
-                        print(
-                            f" X couldn't handle request {req_header.req_code}, client {clt_addr} session will end now")
-                        return
-                else:
-                    print(
-                        f" X request code {req_header.req_code} do not match any protocol request code,"
-                        f" client {clt_addr} session will end now")
-                    return
+    async def handle_request(self, req_header, data, clt_socket, clt_addr):
+        """ get the request code and call the appropriate request handler, a coroutine (streamed requests) or on a
+        worker thread, then send its responses
+        Return False if the session should end """
+        # check whether the request code is a valid one
+        if req_header.req_code in self.req_handler.keys():
+            handler = self.req_handler[req_header.req_code]
+        elif req_header.req_code in Server.CRC_TYPE_CODES:  # CRC type request
+            handler = self.req_crc
+        else:
+            print(
+                f" X request code {req_header.req_code} do not match any protocol request code,"
+                f" client {clt_addr} session will end now")
+            return False
+        if req_header.req_code not in Server.KEY_EXCHANGE_REQ_CODES and \
+                req_header.clt_version != self.key_version(req_header.clt_id):
+            print(f" X request {req_header.req_code} of version {req_header.clt_version} doesn't match the key version"
+                  f" of the client, client {clt_addr} session will end now")
+            return False
+
+        if req_header.req_code in Server.STREAMED_REQ_CODES:
+            handled = await handler(data, clt_socket)
+        else:
+            handled = await self.run_blocking(handler, data, clt_socket)
+        try:
+            await clt_socket.flush()  # what was answered before a failure is still sent
+        except Exception as e:
+            print(f" X failed to send response to {clt_socket}, details: {e}")
+            return False
+        if not handled:
+            print(f" X couldn't handle request {req_header.req_code}, client {clt_addr} session will end now")
+            return False
+
+        await self.run_blocking(self.database.set_last_seen, req_header.clt_id, str(datetime.datetime.now()))
+        return True
+
+    def key_version(self, clt_id):
+        """ Return the protocol version the current AES key of the client was exchanged with (None if it wasn't
+        exchanged / resumed since the server started) """
+        with self.key_versions_lock:
+            return self.key_versions.get(clt_id)
 
-                self.database.set_last_seen(req_header.clt_id, str(datetime.datetime.now()))
+    def set_key_version(self, clt_id, clt_version):
+        """ the client got a new AES key (or resumed one) with a request of version clt_version, the requests which use
+        the key are of the version both sides speak """
+        with self.key_versions_lock:
+            self.key_versions[clt_id] = min(clt_version, networkProtocol.SVR_VERSION)
+
+    def set_session_client(self, clt_socket, clt_id):
+        """ the session exchanged / resumed the key of a client, it owns the striped files of the client from now on """
+        with self.stripes_lock:
+            if clt_socket.clt_id == clt_id:
+                return
+            self.leave_client(clt_socket)
+            clt_socket.clt_id = clt_id
+            self.keyed_sessions[clt_id] = self.keyed_sessions.get(clt_id, 0) + 1
+
+    def leave_client(self, clt_socket):
+        """ the session doesn't own the striped files of its client anymore, the last one to leave drops them
+        (stripes_lock is held) """
+        clt_id = clt_socket.clt_id
+        if clt_id is None:
+            return
+        clt_socket.clt_id = None
+        self.keyed_sessions[clt_id] -= 1
+        if self.keyed_sessions[clt_id] > 0:
+            return
+        del self.keyed_sessions[clt_id]
+        for key, striped in [(key, striped) for key, striped in self.stripes.items() if key[0] == clt_id]:
+            print(f" {key[1]} stripes were abandoned, the file is dropped")
+            self.drop_striped_file(key, striped)
+
+    def drop_striped_file(self, key, striped):
+        """ a striped file failed / was abandoned, its ranges are dropped now and its partial file once none of its
+        stripes is being received (stripes_lock is held) """
+        if self.stripes.get(key) is striped:
+            del self.stripes[key]
+        if striped.receiving == 0:
+            helper.delete_part_file(striped.dir_path, key[1])
+
+    def release_session(self, clt_socket):
+        """ drop what the session owned of the files which are being sent (aborted transfers), chunk maps & inventories
+        of the files it sent chunk by chunk / by their chunks and the striped files of its client if no other session
+        owns them. a chunk map is also stored next to its partial file, so the file can still be resumed on a later
+        session """
+        with self.stripes_lock:
+            self.leave_client(clt_socket)
+        with self.chunk_maps_lock:
+            for key in [key for key, (owner, chunk_map) in self.chunk_maps.items() if owner is clt_socket]:
+                del self.chunk_maps[key]
+        with self.inventories_lock:
+            for key in [key for key, (owner, chunks) in self.inventories.items() if owner is clt_socket]:
+                del self.inventories[key]
+
+    def run_blocking(self, function, *args):
+        """ run a blocking function (decryption & cksum, file / database operations) on a worker thread
+        Return a future of its result, the event loop goes on meanwhile """
+        return asyncio.get_running_loop().run_in_executor(self.workers, function, *args)
+
+    @staticmethod
+    async def recv_request(reader):
+        """ receive exactly one request header and parse it, for any request but a file / file stripe request the
+        payload is received as well (file content is left in the socket for the request handler to stream).
+        Return the parsed header & the received bytes (header + payload) on success
+        Return None & None on failure """
+        try:
+            data = await reader.readexactly(networkProtocol.REQ_HEADER_SIZE)
+            req_header = networkProtocol.ReqHeader()
+            if not req_header.unpack(data):
+                return None, None
+            if req_header.req_code not in Server.STREAMED_REQ_CODES:
+                # v3 clients leave the payload size of CRC type requests unset (0)
+                if req_header.req_code in Server.CRC_TYPE_CODES and req_header.payload_size == 0:
+                    req_header.payload_size = networkProtocol.CRC_PAYLOAD_SIZE
+                if req_header.payload_size > Server.DEFAULT_RECV_SIZE:
+                    print(f"request {req_header.req_code} payload size {req_header.payload_size} is too big")
+                    return None, None
+                data += await reader.readexactly(req_header.payload_size)
+            return req_header, data
+        except asyncio.IncompleteReadError as e:
+            print(f"connection closed after {len(e.partial)} of {e.expected} bytes")
+            return None, None
+        except Exception as e:
+            print(e)
+            return None, None
+
+    @staticmethod
+    def raise_open_files_limit():
+        """ raise the open files limit of the process to its hard limit (every session holds a socket) """
+        if resource is None:
+            return
+        try:
+            soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+            if soft != hard:
+                resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+        except Exception as e:
+            print(f" open files limit couldn't be raised, details: {e}")
 
     def req_registration(self, data, clt_socket):
         """ handles registration request """
@@ -160,11 +403,14 @@ class Server:
         aes_key, encrypted_aes = helper.gen_aes(req.clt_public_key)
         if aes_key is None:
             return False
-        # store aes key in database
+        # store aes key in database, a ticket issued for the former key would restore it, so it's dropped
         if not self.database.set_aes_key(req.header.clt_id, aes_key):
             print(
                 f"AES key generated for client {req.clt_name} cannot be stored in the database *publicKey request*")
             return False
+        self.database.remove_ticket(req.header.clt_id)
+        self.set_key_version(req.header.clt_id, req.header.clt_version)
+        self.set_session_client(clt_socket, req.header.clt_id)
 
         # attempt to send the appropriate response, sending the header first
         res.clt_id = req.header.clt_id
@@ -180,72 +426,662 @@ class Server:
         print(f"successfully sent response *publicKey request*")
         return True
 
-    def req_file(self, data, clt_socket):
+    def req_session_ticket(self, data, clt_socket):
+        """ handles session ticket request, issues a ticket for the current AES key of the client, the client presents
+        it on a later connection (REQ_RESUME_SESSION) instead of its public key, so the key exchange is skipped.
+        a ticket replaces the one issued before, so it's issued only on a session which exchanged / resumed the key
+        of that client (knowing a client ID isn't enough) """
+        req = networkProtocol.ReqSessionTicket()
+        res = networkProtocol.ResSessionTicket()
+        if not req.unpack(data):
+            print(f"failed to unpack session ticket request data")
+            return False
+        if clt_socket.clt_id != req.clt_id:
+            print(f"client ID {req.clt_id} didn't exchange / resume its key on this session *session ticket request*")
+            return False
+        aes_key = self.database.get_clt_aes_key(req.clt_id)
+        if not aes_key or len(aes_key) != networkProtocol.CLT_SYMMETRICKEY_SIZE:
+            print(f"client ID {req.clt_id} has no AES key *session ticket request*")
+            return False
+
+        res.clt_id = req.clt_id
+        res.ticket = get_random_bytes(networkProtocol.SESSION_TICKET_SIZE)
+        res.lifetime = Server.SESSION_TICKET_LIFETIME
+        if not self.database.set_ticket(req.clt_id, helper.ticket_digest(res.ticket), aes_key,
+                                        int(time.time()) + res.lifetime):
+            print(f"session ticket cannot be stored in the database *session ticket request*")
+            return False
+        try:
+            clt_socket.sendall(res.pack())
+        except Exception as e:
+            print(f"failed to send response to {clt_socket} *session ticket request*")
+            return False
+        print(f"successfully sent response *session ticket request*")
+        return True
+
+    def req_resume_session(self, data, clt_socket):
+        """ handles resume session request, if the ticket is the one issued to the client and not expired, the AES key
+        it was issued for is the client key again (no key exchange), otherwise the client is told to exchange keys,
+        the session goes on either way """
+        req = networkProtocol.ReqResumeSession()
+        if not req.unpack(data):
+            print(f"failed to unpack resume session request data")
+            return False
+
+        entry = self.database.get_ticket(req.clt_id)
+        resumed = entry is not None and hmac.compare_digest(entry[0], helper.ticket_digest(req.ticket)) and \
+            entry[2] > time.time()
+        if resumed and not self.database.set_aes_key(req.clt_id, entry[1]):
+            print(f"AES key of the ticket cannot be stored in the database *resume session request*")
+            return False
+        if resumed:
+            self.set_key_version(req.clt_id, req.header.clt_version)
+            self.set_session_client(clt_socket, req.clt_id)
+            res = networkProtocol.ResSessionResumed()
+            res.clt_id = req.clt_id
+        else:
+            res = networkProtocol.ResSessionResumeFailed()
+        try:
+            clt_socket.sendall(res.pack())
+        except Exception as e:
+            print(f"failed to send response to {clt_socket} *resume session request*")
+            return False
+        print(f"successfully sent response, session {'resumed' if resumed else 'not resumed'} *resume session request*")
+        return True
+
+    async def req_file(self, data, clt_socket):
         """ handles file request """
         req = networkProtocol.ReqFile()
-        res = networkProtocol.ResGotFile()
-        if not req.unpack(clt_socket, data):
+        if not await req.unpack(clt_socket, data):
             print(f"failed to unpack File data")
             return False
+        aes_key, clt_files_dir_path = await self.run_blocking(self.file_request_context, req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        # attempt to store the file in the client files directory, overwritten file which already exists.
+        # file contents are received chunk by chunk (memory doesn't grow with the file size), each chunk is decrypted
+        # with the client AES key, added to the file cksum (Identical to linux cksum command) and written to the
+        # received file, which replaces the stored file only when the whole content arrived
+        recv_file, recv_path = await self.run_blocking(helper.open_recv_file, clt_files_dir_path, req.file_name)
+        if recv_file is None:
+            print(f" {req.file_name} file couldn't be created / overwritten * file request *")
+            return False
+        digest = crc.crc32()
         try:
-            if not self.database.clt_id_exists(req.clt_id):
-                print(f"client ID {req.clt_id} not exists ")
+            with recv_file:
+                await self.recv_file_content(
+                    req.recv_content(clt_socket, Server.content_chunk_size(req.header.clt_version)), aes_key,
+                    recv_file, digest, req.header.clt_version)
+        except Exception as e:
+            print(f"file {req.file_name} content couldn't be received / decrypted / stored, details: {e}")
+            await self.run_blocking(helper.delete_file, recv_path)
+            return False
+        clt_file_path = await self.run_blocking(helper.commit_recv_file, clt_files_dir_path, req.file_name)
+        if clt_file_path is None:
+            print(f" {req.file_name} file couldn't be created / overwritten * file request *")
+            await self.run_blocking(helper.delete_file, recv_path)
+            return False
+
+        return await self.run_blocking(self.file_received, clt_socket, req.clt_id, req.file_name, clt_file_path,
+                                       req.content_size, digest.digest(), req.header.clt_version)
+
+    async def req_file_stripe(self, data, clt_socket):
+        """ handles file stripe request, the stripe is decrypted and written at its offset in the partial file """
+        req = networkProtocol.ReqFileStripe()
+        res = networkProtocol.ResConfirmMsg()
+        if not await req.unpack(clt_socket, data):
+            print(f"failed to unpack File stripe data")
+            return False
+        aes_key, clt_files_dir_path = await self.run_blocking(self.file_request_context, req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        key = (req.clt_id, req.file_name)
+        with self.stripes_lock:
+            striped = self.stripes.setdefault(key, StripedFile(clt_files_dir_path))
+            striped.receiving += 1
+        stored = False
+        try:
+            part_file, part_path = await self.run_blocking(helper.open_part_file, clt_files_dir_path, req.file_name)
+            if part_file is None:
+                raise OSError("partial file couldn't be opened")
+            with part_file:
+                part_file.seek(req.stripe_offset)
+                stripe_size = await self.recv_file_content(
+                    req.recv_content(clt_socket, Server.content_chunk_size(req.header.clt_version)), aes_key,
+                    part_file, version=req.header.clt_version)
+            if stripe_size != req.stripe_size:
+                raise ValueError(f"decrypted stripe size {stripe_size} not match the stripe size {req.stripe_size}")
+            stored = True
+        except Exception as e:
+            print(f"file {req.file_name} stripe couldn't be received / decrypted / stored, details: {e}")
+        finally:
+            # remember which range of the file arrived, the file is complete when all of its ranges arrived. a stripe
+            # which failed fails the whole file, as does a stripe of a file which was dropped meanwhile / which no
+            # session of its client owns (abandoned)
+            with self.stripes_lock:
+                striped.receiving -= 1
+                if stored and self.stripes.get(key) is striped and self.keyed_sessions.get(req.clt_id):
+                    striped.ranges.append((req.stripe_offset, req.stripe_size, req.content_size))
+                else:
+                    stored = False
+                    self.drop_striped_file(key, striped)
+        if not stored:
+            return False
+        print(f"{req.file_name} stripe {req.stripe_offset}+{req.stripe_size} of {req.file_size} stored * file stripe request *")
+
+        try:
+            clt_socket.sendall(res.pack())
+        except Exception as e:
+            print(f"failed to send response to {clt_socket} * file stripe request *")
+            return False
+        return True
+
+    def req_file_stripes_done(self, data, clt_socket):
+        """ handles file stripes done request, makes sure the whole file arrived, calculates its cksum and
+        moves it from the partial file to the final file """
+        req = networkProtocol.ReqFileStripesDone()
+        if not req.unpack(data):
+            print(f"failed to unpack File stripes done data")
+            return False
+        aes_key, clt_files_dir_path = self.file_request_context(req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        key = (req.clt_id, req.file_name)
+        with self.stripes_lock:
+            striped = self.stripes.pop(key, None) or StripedFile(clt_files_dir_path)
+        ranges = sorted(striped.ranges)
+        position = 0
+        for offset, size, content_size in ranges:
+            if offset > position:
+                break
+            position = max(position, offset + size)
+        if position < req.file_size:
+            print(f" {req.file_name} stripes cover only {position} of {req.file_size} bytes * file stripes done request *")
+            with self.stripes_lock:
+                self.drop_striped_file(key, striped)
+            return False
+
+        clt_file_path = helper.commit_part_file(clt_files_dir_path, req.file_name, req.file_size)
+        if clt_file_path is None:
+            print(f" {req.file_name} file couldn't be created / overwritten * file stripes done request *")
+            return False
+        cksum = helper.calc_file_crc(clt_file_path, Server.FILE_CHUNK_SIZE)
+        if cksum is None:
+            print(f"cksum of file {req.file_name} couldn't be calculated ")
+            return False
+
+        content_size = sum(content_size for offset, size, content_size in ranges)
+        return self.file_received(clt_socket, req.clt_id, req.file_name, clt_file_path, content_size, cksum,
+                                  req.header.clt_version)
+
+    def req_file_chunks_begin(self, data, clt_socket):
+        """ handles file chunks begin request, answers with the chunks of the file which are already stored
+        (by an earlier transfer of the same file which was interrupted) """
+        req = networkProtocol.ReqFileChunksBegin()
+        if not req.unpack(data):
+            print(f"failed to unpack File chunks begin data")
+            return False
+        aes_key, clt_files_dir_path = self.file_request_context(req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        chunk_map = helper.load_chunk_map(clt_files_dir_path, req.file_name, req.file_size, req.chunk_size)
+        with self.chunk_maps_lock:
+            self.chunk_maps[(req.clt_id, req.file_name)] = (clt_socket, chunk_map)
+        stored = sum(chunk_map.is_stored(i) for i in range(chunk_map.count))
+        print(f"{req.file_name} {stored} of {chunk_map.count} chunks already stored * file chunks begin request *")
+        return self.send_chunks_status(clt_socket, req.clt_id, chunk_map)
+
+    async def req_file_chunk(self, data, clt_socket):
+        """ handles file chunk request, the chunk is decrypted and written at its position in the partial file,
+        it counts as stored only if its cksum matches the cksum sent with it (otherwise the client will send it again) """
+        req = networkProtocol.ReqFileChunk()
+        if not await req.unpack(clt_socket, data):
+            print(f"failed to unpack File chunk data")
+            return False
+        # chunk_maps_lock is held while a chunk is written, so it is taken on a worker thread
+        owner, chunk_map = await self.run_blocking(self.get_chunk_map, req.clt_id, req.file_name)
+        if owner is not clt_socket or req.chunk_index >= chunk_map.count or \
+                not Server.chunk_content_size_valid(req.content_size, chunk_map.size_of(req.chunk_index),
+                                                    req.header.clt_version):
+            print(f" {req.file_name} chunk {req.chunk_index} not match the announced file * file chunk request *")
+            return False
+        aes_key, clt_files_dir_path = await self.run_blocking(self.file_request_context, req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        # the chunk is decrypted & verified in memory, a chunk which arrived corrupted never overwrites a stored one.
+        # a chunk which couldn't be decrypted (its MAC doesn't match, VERSION_AUTH and on) ends the session, the cksum
+        # trailer is outside the MAC so it can't vouch for the chunk
+        chunk = io.BytesIO()
+        digest = crc.crc32()
+        try:
+            await self.recv_file_content(
+                req.recv_content(clt_socket, Server.content_chunk_size(req.header.clt_version)), aes_key, chunk,
+                digest, req.header.clt_version)
+            cksum = await req.recv_cksum(clt_socket)
+        except ValueError as e:
+            print(f"file {req.file_name} chunk {req.chunk_index} couldn't be decrypted, details: {e}")
+            return False
+        except Exception as e:
+            print(f"file {req.file_name} chunk couldn't be received, details: {e}")
+            return False
+        if chunk.getbuffer().nbytes != chunk_map.size_of(req.chunk_index) or digest.digest() != cksum:
+            print(f"{req.file_name} chunk {req.chunk_index} arrived corrupted, it will be sent again * file chunk request *")
+            return True
+        return await self.run_blocking(self.store_file_chunk, req, clt_socket, clt_files_dir_path, chunk_map, chunk,
+                                       cksum)
+
+    def get_chunk_map(self, clt_id, file_name):
+        """ Return the socket of the session which sends a file chunk by chunk and the chunk map of the file
+        (None & None if the file is not being sent) """
+        with self.chunk_maps_lock:
+            return self.chunk_maps.get((clt_id, file_name), (None, None))
+
+    def store_file_chunk(self, req, clt_socket, clt_files_dir_path, chunk_map, chunk, cksum):
+        """ write a verified chunk at its position in the partial file and mark it stored in the chunk map,
+        unless the file was taken over by another session meanwhile """
+        with self.chunk_maps_lock:
+            if self.chunk_maps.get((req.clt_id, req.file_name), (None, None))[0] is not clt_socket:
+                print(f" {req.file_name} was taken over by another session * file chunk request *")
+                return False
+            part_file, part_path = helper.open_part_file(clt_files_dir_path, req.file_name)
+            if part_file is None:
+                print(f" {req.file_name} partial file couldn't be opened * file chunk request *")
                 return False
+            try:
+                with part_file:
+                    part_file.seek(req.chunk_index * chunk_map.chunk_size)
+                    part_file.write(chunk.getbuffer())
+            except Exception as e:
+                print(f"file {req.file_name} chunk couldn't be stored, details: {e}")
+                return False
+            chunk_map.set_stored(req.chunk_index, cksum)
+            return helper.store_chunk_map(clt_files_dir_path, req.file_name, chunk_map)
+
+    def req_file_chunks_done(self, data, clt_socket):
+        """ handles file chunks done request, if all the chunks are stored - moves the partial file to the final file and
+        calculates its cksum, otherwise answers with the chunks status so the client sends the missing ones again """
+        req = networkProtocol.ReqFileChunksDone()
+        if not req.unpack(data):
+            print(f"failed to unpack File chunks done data")
+            return False
+        with self.chunk_maps_lock:
+            owner, chunk_map = self.chunk_maps.get((req.clt_id, req.file_name), (None, None))
+        if owner is not clt_socket:
+            print(f" {req.file_name} was not announced on this session * file chunks done request *")
+            return False
+        aes_key, clt_files_dir_path = self.file_request_context(req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        if not chunk_map.complete():
+            missing = sum(not chunk_map.is_stored(i) for i in range(chunk_map.count))
+            print(f" {missing} of {chunk_map.count} chunks of {req.file_name} are missing * file chunks done request *")
+            return self.send_chunks_status(clt_socket, req.clt_id, chunk_map)
+
+        with self.chunk_maps_lock:
+            self.chunk_maps.pop((req.clt_id, req.file_name), None)
+        clt_file_path = helper.commit_part_file(clt_files_dir_path, req.file_name, chunk_map.file_size)
+        if clt_file_path is None:
+            print(f" {req.file_name} file couldn't be created / overwritten * file chunks done request *")
+            return False
+        helper.delete_chunk_map(clt_files_dir_path, req.file_name)
+        cksum = helper.calc_file_crc(clt_file_path, Server.FILE_CHUNK_SIZE)
+        if cksum is None:
+            print(f"cksum of file {req.file_name} couldn't be calculated ")
+            return False
+
+        content_size = sum(helper.encrypted_size(helper.packed_size(chunk_map.size_of(i), req.header.clt_version),
+                                                 req.header.clt_version)
+                           for i in range(chunk_map.count))
+        return self.file_received(clt_socket, req.clt_id, req.file_name, clt_file_path, content_size, cksum,
+                                  req.header.clt_version)
+
+    async def req_file_inventory(self, data, clt_socket):
+        """ handles file inventory request, the content defined chunks of a file which is about to be sent by its
+        chunks, answered with the chunks the chunk store already has (of any client) """
+        req = networkProtocol.ReqFileInventory()
+        if not await req.unpack(clt_socket, data):
+            print(f"failed to unpack File inventory data")
+            return False
+        aes_key, clt_files_dir_path = await self.run_blocking(self.file_request_context, req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        # a file which is sent again on another session is taken over by it
+        with self.inventories_lock:
+            self.inventories[(req.clt_id, req.file_name)] = (clt_socket, req.chunks)
+        return await self.run_blocking(self.send_inventory, clt_socket, req.clt_id, req.file_name, req.chunks)
+
+    async def req_file_dedup_chunk(self, data, clt_socket):
+        """ handles file dedup chunk request, the chunk is decrypted & verified by its hash in the inventory and added to
+        the chunk store (not referenced until the file is assembled), a chunk which arrived corrupted is dropped """
+        req = networkProtocol.ReqFileDedupChunk()
+        if not await req.unpack(clt_socket, data):
+            print(f"failed to unpack File dedup chunk data")
+            return False
+        with self.inventories_lock:
+            owner, chunks = self.inventories.get((req.clt_id, req.file_name), (None, None))
+        if owner is not clt_socket or req.chunk_index >= len(chunks) or \
+                not Server.chunk_content_size_valid(req.content_size, chunks[req.chunk_index][1], req.header.clt_version):
+            print(f" {req.file_name} chunk {req.chunk_index} not match the file inventory * file dedup chunk request *")
+            return False
+        aes_key, clt_files_dir_path = await self.run_blocking(self.file_request_context, req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        # a chunk which couldn't be decrypted (its MAC doesn't match, VERSION_AUTH and on) ends the session, the hash in
+        # the inventory is the client's own so it can't vouch for the chunk
+        chunk = io.BytesIO()
+        try:
+            await self.recv_file_content(
+                req.recv_content(clt_socket, Server.content_chunk_size(req.header.clt_version)), aes_key, chunk,
+                version=req.header.clt_version)
+        except ValueError as e:
+            print(f"file {req.file_name} chunk {req.chunk_index} couldn't be decrypted, details: {e}")
+            return False
         except Exception as e:
-            print(f"failed to connect to the database")
+            print(f"file {req.file_name} chunk couldn't be received, details: {e}")
             return False
+        chunk_hash, chunk_size = chunks[req.chunk_index]
+        if chunk.getbuffer().nbytes != chunk_size or \
+                await self.run_blocking(helper.calc_chunk_hash, chunk.getbuffer()) != chunk_hash:
+            print(f"{req.file_name} chunk {req.chunk_index} arrived corrupted, it will be sent again * file dedup chunk request *")
+            return True
 
-        # decrypt file contents with the client AES key
-        aes_key = self.database.get_clt_aes_key(req.clt_id)
-        if not aes_key:
-            print(f" AES Key of client with ID {req.clt_id} couldn't be retrieved from database")
+        if not await self.run_blocking(self.store_dedup_chunk, chunk_hash, chunk, chunk_size):
+            print(f"file {req.file_name} chunk {req.chunk_index} couldn't be stored * file dedup chunk request *")
             return False
-        decrypted_file_content = helper.decrypt_content(aes_key, req.content)
-        if decrypted_file_content is None:
-            print(f"file {req.file_name} content couldn't be decrypted")
+        return True
+
+    def store_dedup_chunk(self, chunk_hash, chunk, chunk_size):
+        """ add a verified chunk to the chunk store, Return False if it couldn't be stored """
+        # the content is stored before the table entry, an entry always has its content
+        return helper.store_chunk(chunk_hash, chunk.getbuffer()) and self.database.add_chunk(chunk_hash, chunk_size)
+
+    def req_file_dedup_done(self, data, clt_socket):
+        """ handles file dedup done request, if the chunk store has all the chunks of the file inventory - stores the
+        file as a recipe (which references its chunks) and calculates its cksum, otherwise answers with the inventory
+        status so the client sends the missing chunks again """
+        req = networkProtocol.ReqFileDedupDone()
+        if not req.unpack(data):
+            print(f"failed to unpack File dedup done data")
+            return False
+        with self.inventories_lock:
+            owner, chunks = self.inventories.get((req.clt_id, req.file_name), (None, None))
+        if owner is not clt_socket:
+            print(f" {req.file_name} inventory was not sent on this session * file dedup done request *")
             return False
+        aes_key, clt_files_dir_path = self.file_request_context(req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        # the chunks are referenced before the recipe which was stored before (if any) releases its chunks,
+        # so chunks both of them have are never removed
+        hashes = [chunk_hash for chunk_hash, _ in chunks]
+        with self.chunk_store_lock:
+            known = self.database.get_known_chunks(hashes)
+            if known is None:
+                print(f"failed to connect to the database")
+                return False
+            if len(known) != len(set(hashes)):
+                missing = len(set(hashes) - known)
+                print(f" {missing} of {len(chunks)} chunks of {req.file_name} are missing * file dedup done request *")
+                return self.send_inventory(clt_socket, req.clt_id, req.file_name, chunks, known)
+            if not self.database.ref_chunks(hashes):
+                print(f" {req.file_name} chunks couldn't be referenced * file dedup done request *")
+                return False
+            old_chunks = helper.load_recipe(clt_files_dir_path, req.file_name)
+            recipe_path = helper.store_recipe(clt_files_dir_path, req.file_name, chunks)
+            if recipe_path is None:
+                self.release_chunks(hashes)
+                print(f" {req.file_name} recipe couldn't be stored * file dedup done request *")
+                return False
+            if old_chunks is not None:
+                self.release_chunks([chunk_hash for chunk_hash, _ in old_chunks])
+        with self.inventories_lock:
+            self.inventories.pop((req.clt_id, req.file_name), None)
+        file_path = Path(clt_files_dir_path) / req.file_name
+        if file_path.exists():  # replaced by the recipe
+            helper.delete_file(file_path)
 
-        # calculate file cksum (Identical to linux cksum command)
-        cksum = helper.calc_crc(decrypted_file_content)
+        cksum = helper.calc_recipe_crc(chunks)
         if cksum is None:
             print(f"cksum of file {req.file_name} couldn't be calculated ")
             return False
+        content_size = sum(helper.encrypted_size(helper.packed_size(size, req.header.clt_version), req.header.clt_version)
+                           for _, size in chunks)
+        print(f"{req.file_name} stored as a recipe of {len(chunks)} chunks * file dedup done request *")
+        return self.file_received(clt_socket, req.clt_id, req.file_name, recipe_path, content_size, cksum,
+                                  req.header.clt_version)
+
+    def req_file_signatures(self, data, clt_socket):
+        """ handles file signatures request, answered with the block signatures of the stored copy of a file (no blocks
+        if there is no copy), a file which is stored as a recipe is rebuilt first so the delta can be applied to it """
+        req = networkProtocol.ReqFileSignatures()
+        res = networkProtocol.ResFileSignatures()
+        if not req.unpack(data):
+            print(f"failed to unpack File signatures data")
+            return False
+        res.version = req.header.clt_version
+        aes_key, clt_files_dir_path = self.file_request_context(req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        res.clt_id = req.clt_id
+        file_path = Path(clt_files_dir_path) / req.file_name
+        with self.chunk_store_lock:
+            if not file_path.exists() and helper.rebuild_file(clt_files_dir_path, req.file_name) is not None:
+                print(f" {req.file_name} rebuilt from its recipe * file signatures request *")
+        if file_path.exists():
+            file_size, block_size, signatures = helper.calc_signatures(str(file_path))
+            if signatures is None:
+                print(f" {req.file_name} signatures couldn't be calculated * file signatures request *")
+                return False
+            res.file_size, res.block_size, res.signatures = file_size, block_size, signatures
+        print(f"{req.file_name} {len(res.signatures)} block signatures (block size {res.block_size}) * file signatures request *")
+        try:
+            clt_socket.sendall(res.pack())
+        except Exception as e:
+            print(f"failed to send response to {clt_socket} * file signatures request *")
+            return False
+        return True
+
+    async def req_file_delta(self, data, clt_socket):
+        """ handles file delta request, the delta content is decrypted and applied to the stored copy of the file
+        (see helper.DeltaPatcher), the patched file replaces the copy """
+        req = networkProtocol.ReqFileDelta()
+        if not await req.unpack(clt_socket, data):
+            print(f"failed to unpack File delta data")
+            return False
+        aes_key, clt_files_dir_path = await self.run_blocking(self.file_request_context, req.clt_id, clt_socket)
+        if aes_key is None:
+            return False
+
+        # the signatures the client matched the file against must still be of the stored copy
+        file_path = str(Path(clt_files_dir_path) / req.file_name)
+        try:
+            if req.block_size == 0 or Path(file_path).stat().st_size != req.basis_size:
+                raise ValueError(f"stored copy is not of {req.basis_size} bytes")
+            patcher = await self.run_blocking(helper.DeltaPatcher, file_path, req.basis_size, req.block_size,
+                                              req.file_size)
+        except Exception as e:
+            print(f" {req.file_name} delta doesn't match the stored copy, details: {e} * file delta request *")
+            return False
+        try:
+            await self.recv_file_content(
+                req.recv_content(clt_socket, Server.content_chunk_size(req.header.clt_version)), aes_key, patcher,
+                version=req.header.clt_version)
+            cksum = await self.run_blocking(patcher.finish)
+        except Exception as e:
+            print(f"file {req.file_name} delta couldn't be received / decrypted / applied, details: {e}")
+            await self.run_blocking(patcher.discard)
+            return False
+
+        print(f"{req.file_name} patched, {req.content_size} bytes of delta content for {req.file_size} bytes * file delta request *")
+        return await self.run_blocking(self.file_received, clt_socket, req.clt_id, req.file_name, file_path,
+                                       req.content_size, cksum, req.header.clt_version)
+
+    def send_inventory(self, clt_socket, clt_id, file_name, chunks, known=None):
+        """ send the file inventory response, which chunks of the inventory the chunk store has
+        (known - the hashes of the chunks the store has, if already retrieved) """
+        if known is None:
+            known = self.database.get_known_chunks([chunk_hash for chunk_hash, _ in chunks])
+            if known is None:
+                print(f"failed to connect to the database")
+                return False
+        res = networkProtocol.ResFileInventory()
+        res.clt_id = clt_id
+        res.chunks_count = len(chunks)
+        res.known = bytearray((len(chunks) + 7) // 8)
+        for i, (chunk_hash, _) in enumerate(chunks):
+            if chunk_hash in known:
+                res.known[i // 8] |= 1 << (i % 8)
+        known_count = sum(chunk_hash in known for chunk_hash, _ in chunks)
+        print(f"{file_name} {known_count} of {len(chunks)} chunks already in the chunk store * file inventory *")
+        try:
+            clt_socket.sendall(res.pack())
+        except Exception as e:
+            print(f"failed to send response to {clt_socket} * file inventory *")
+            return False
+        return True
+
+    def release_chunks(self, hashes):
+        """ remove a reference from every given chunk and delete the chunks which are not referenced anymore
+        (should be called under chunk_store_lock) """
+        released = self.database.release_chunks(hashes)
+        if released is None:
+            print(f" chunk references couldn't be released, unreferenced chunks are left in the chunk store")
+            return
+        helper.delete_chunks(released)
+
+    def remove_recipe(self, dir_path, file_name):
+        """ remove the recipe of a given file name (if exists) and release its chunks """
+        with self.chunk_store_lock:
+            chunks = helper.load_recipe(dir_path, file_name)
+            if chunks is None:
+                return
+            helper.delete_file(Path(dir_path) / (file_name + helper.RECIPE_SUFFIX))
+            self.release_chunks([chunk_hash for chunk_hash, _ in chunks])
+
+    def collect_chunks(self):
+        """ delete the chunks no recipe references, sent for files which were never completed """
+        with self.chunk_store_lock:
+            hashes = self.database.get_unreferenced_chunks()
+            if not hashes or not self.database.remove_chunks(hashes):
+                return
+            helper.delete_chunks(hashes)
+        print(f" {len(hashes)} unreferenced chunks removed from the chunk store")
+
+    @staticmethod
+    def send_chunks_status(clt_socket, clt_id, chunk_map):
+        """ send the file chunks status response, which chunks of the file are stored and their cksums """
+        res = networkProtocol.ResFileChunksStatus()
+        res.clt_id = clt_id
+        res.cksums = chunk_map.cksums
+        res.stored = chunk_map.stored
+        try:
+            clt_socket.sendall(res.pack())
+        except Exception as e:
+            print(f"failed to send response to {clt_socket} * file chunks status *")
+            return False
+        return True
+
+    def file_request_context(self, clt_id, clt_socket):
+        """ validate the client of a file type request and prepare what is needed to store its file
+        Return the client AES key & the client files directory path on success
+        Return None & None on failure """
+        try:
+            if not self.database.clt_id_exists(clt_id):
+                print(f"client ID {clt_id} not exists ")
+                return None, None
+        except Exception as e:
+            print(f"failed to connect to the database")
+            return None, None
+
+        aes_key = self.database.get_clt_aes_key(clt_id)
+        if not aes_key:
+            print(f" AES Key of client with ID {clt_id} couldn't be retrieved from database")
+            return None, None
 
         # attempt to create directory for the client files if not already exists,
         # directory name will be the client username
-        username = self.database.get_clt_username(req.clt_id)
+        username = self.database.get_clt_username(clt_id)
         if not username:
             print(f"error occurred when trying to retrieve username from the database"
                   f" (usage: creating client directory) ")
-            return False
+            return None, None
         clt_files_dir_path = helper.create_dir(username)
         if clt_files_dir_path is None:
             print(f" Directory for client {clt_socket} files couldn't be created OR "
                   f"directory exists but the process raised an error")
-            return False
+            return None, None
+        return aes_key, clt_files_dir_path
 
-        # attempt to store the file in the client files directory
-        # overwritten file which already exists
-        clt_file_path = helper.store_file(req.content, clt_files_dir_path, req.file_name)
-        if clt_file_path is None:
-            print(f" {req.file_name} file couldn't be created / overwritten * file request *")
-            return False
+    @staticmethod
+    def content_chunk_size(version):
+        """ Return the size of the chunks a file content of the given protocol version is received in """
+        return Server.CTR_FILE_CHUNK_SIZE if version >= networkProtocol.VERSION_CTR else Server.FILE_CHUNK_SIZE
+
+    @staticmethod
+    def chunk_content_size_valid(content_size, chunk_size, version):
+        """ Return True if a chunk content of content_size may carry a chunk of chunk_size, a compressed chunk
+        (VERSION_CODEC and on) is never larger than the chunk sent as is """
+        expected_size = helper.encrypted_size(helper.packed_size(chunk_size, version), version)
+        if version >= networkProtocol.VERSION_CODEC:
+            return content_size <= expected_size
+        return content_size == expected_size
+
+    async def recv_file_content(self, encrypted_chunks, aes_key, out_file, digest=None,
+                                version=networkProtocol.VERSION_CTR - 1):
+        """ receive the content chunks, decrypt them with the client AES key, unpack them, write them to out_file
+        (at its current position) and add them to digest (if given), see helper.ContentWriter.
+        Return the content size, raise an exception on failure """
+        # a chunk is decrypted & written on a worker thread while the next one is received
+        content = helper.ContentWriter(aes_key, out_file, digest, version)
+        pending = None
+        try:
+            async for encrypted_chunk in encrypted_chunks:
+                if pending is not None:
+                    await pending
+                pending = self.run_blocking(content.update, encrypted_chunk)
+            if pending is not None:
+                await pending
+        finally:
+            if pending is not None:  # the worker is done with out_file before it may be closed
+                await asyncio.gather(pending, return_exceptions=True)
+        return await self.run_blocking(content.final)
+
+    def file_received(self, clt_socket, clt_id, file_name, clt_file_path, content_size, cksum, version):
+        """ store the File entry of a received file (if not already exists) and send the got file response (of the
+        request protocol version) """
+        res = networkProtocol.ResGotFile()
+        res.version = version
 
         # check if there's already a File entry for the client file in the database
         # if not, attempt to store it
-        if not self.database.file_exists(req.file_name, req.clt_id):
+        if not self.database.file_exists(file_name, clt_id):
             # store file information in database, verified = 0 (false) until cksum is verified
-            file_entry = database.File(req.clt_id, req.file_name, clt_file_path, verified=0)
+            file_entry = database.File(clt_id, file_name, clt_file_path, verified=0)
             if not self.database.store_file(file_entry):
-                print(f" {req.file_name} file couldn't be stored in the database * file request *")
+                print(f" {file_name} file couldn't be stored in the database * file request *")
                 return False
-        print(f"{req.file_name} file from client ID {req.clt_id} successfully stored in the database * file request * ")
+        elif not self.database.set_file_path(clt_id, file_name, clt_file_path):  # a recipe / a file replaced the other
+            print(f" {file_name} file path couldn't be updated in the database * file request *")
+            return False
+        # a file which was stored by its chunks before and now as a whole file, drops its recipe
+        if not clt_file_path.endswith(helper.RECIPE_SUFFIX):
+            self.remove_recipe(str(Path(clt_file_path).parent), file_name)
+        print(f"{file_name} file from client ID {clt_id} successfully stored in the database * file request * ")
 
         # attempt to send the appropriate response
-        res.header.payload_size = networkProtocol.CLT_ID_SIZE + 4 + networkProtocol.FILE_NAME_SIZE + 4
-        res.clt_id = req.clt_id
-        res.content_size = req.content_size
-        res.file_name = req.file_name
+        res.clt_id = clt_id
+        res.content_size = content_size
+        res.file_name = file_name
         res.cksum = cksum
         try:  # {maybe check if need to validate all was sent}
             clt_socket.send(res.pack())
@@ -289,7 +1125,10 @@ class Server:
                     print(
                         f"*CRC 4TH Time not valid* cannot retrieve client username for file {req.file_name} deletion ")
                     return False
-                if not helper.delete_file(username + "/" + req.file_name):
+                # a file which was stored by its chunks is a recipe, its chunks are released
+                if (Path(username.decode("utf-8")) / (req.file_name + helper.RECIPE_SUFFIX)).exists():
+                    self.remove_recipe(username.decode("utf-8"), req.file_name)
+                elif not helper.delete_file(username.decode("utf-8") + "/" + req.file_name):
                     print(f"*CRC 4TH Time not valid* cannot delete file {req.file_name} ")
                     return False
 
@@ -311,14 +1150,8 @@ class Server:
                 return False
             print(f"successfully sent response * confirm msg (CRC not valid request) *")
 
-            # after sending confirm msg response, client should try to send the file again.
-            req_file_data = clt_socket.recv(Server.DEFAULT_RECV_SIZE)
-            if not req_file_data:
-                print(f" failed to receive first chunk of request file data * CRC not valid request *")
-                return False
-            if not self.req_file(req_file_data, clt_socket):
-                print(f" Request file failed * CRC not valid request *")
-                return False
+            # after sending confirm msg response, client should try to send the file again,
+            # as a file request or as file stripes, which the session loop receives as any other request
         else:
             print(f" couldn't start the handling of any CRC type request (code not match) {clt_socket}")
             return False
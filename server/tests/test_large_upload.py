@@ -0,0 +1,139 @@
+"""
+TransferIt server
+test_large_upload.py
+description: test of the streamed receive of a whole file: the server runs with its address space limited (RLIMIT_AS),
+a v3 client session uploads a file several times larger than the limit (generated, encrypted and sent chunk by chunk,
+the test doesn't hold it either). the server must answer with the cksum of the file, store it byte-identical and keep
+its peak RSS under the limit
+usage: python -m unittest discover tests (run from the server directory, POSIX only)
+"""
+import os
+import sys
+import time
+import uuid
+import socket
+import struct
+import hashlib
+import tempfile
+import unittest
+import subprocess
+from pathlib import Path
+
+SERVER_DIR = Path(__file__).resolve().parent.parent
+sys.path.insert(0, str(SERVER_DIR))
+import networkProtocol  # noqa: E402
+import crc  # noqa: E402
+from Crypto.PublicKey import RSA  # noqa: E402
+from Crypto.Cipher import PKCS1_OAEP, AES  # noqa: E402
+from Crypto.Util.Padding import pad  # noqa: E402
+try:
+    import resource  # for the address space limit & the peak RSS of the server (POSIX only)
+except ImportError:
+    resource = None
+
+VERSION = networkProtocol.VERSION_CTR - 1  # AES-CBC content, the size of the PKCS#7 padded content is known up front
+MEMORY_LIMIT = 512 * 1024 * 1024  # address space of the server process
+FILE_SIZE = 3 * MEMORY_LIMIT
+SEND_CHUNK_SIZE = 1024 * 1024  # bytes of content generated, encrypted and sent at a time
+START_TIMEOUT = 10  # seconds the server may take to listen
+
+
+def recv_exact(sock, size):
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed by the server")
+        data += chunk
+    return data
+
+
+def limit_memory():
+    """ runs in the server process before it starts """
+    resource.setrlimit(resource.RLIMIT_AS, (MEMORY_LIMIT, MEMORY_LIMIT))
+
+
+@unittest.skipIf(resource is None, "RLIMIT_AS is POSIX only")
+class LargeUploadTest(unittest.TestCase):
+
+    def setUp(self):
+        self.work_dir = tempfile.TemporaryDirectory()
+        with socket.socket() as probe:  # a free port
+            probe.bind(("127.0.0.1", 0))
+            self.port = probe.getsockname()[1]
+        Path(self.work_dir.name, "port.info").write_text(f"{self.port}\n")
+        self.server = subprocess.Popen([sys.executable, str(SERVER_DIR / "main.py")], cwd=self.work_dir.name,
+                                       stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT, preexec_fn=limit_memory)
+        deadline = time.monotonic() + START_TIMEOUT
+        while True:
+            try:
+                self.sock = socket.create_connection(("127.0.0.1", self.port), timeout=60)
+                break
+            except OSError:
+                if time.monotonic() > deadline or self.server.poll() is not None:
+                    self.stop_server()
+                    self.work_dir.cleanup()
+                    raise
+                time.sleep(0.1)
+        self.clt_id = bytes(networkProtocol.CLT_ID_SIZE)
+
+    def tearDown(self):
+        self.sock.close()
+        self.stop_server()
+        self.work_dir.cleanup()
+
+    def stop_server(self):
+        if self.server.poll() is None:
+            self.server.terminate()
+        self.server.wait()
+
+    def request(self, code, payload, expected_code):
+        """ send a request and receive its response, Return the response payload """
+        self.sock.sendall(self.clt_id + struct.pack("<BHL", VERSION, code, len(payload)) + payload)
+        svr_version, res_code, payload_size = struct.unpack("<BHL", recv_exact(self.sock, 7))
+        self.assertEqual(res_code, expected_code, f"response code to request {code}")
+        return recv_exact(self.sock, payload_size)
+
+    def test_file_larger_than_memory_limit(self):
+        name = f"test {uuid.uuid4().hex[:12]}".encode().ljust(networkProtocol.CLT_USERNAME_SIZE, b"\0")
+        # e=17 gives the 160 bytes DER public key the protocol carries (as CryptoPP does)
+        rsa_key = RSA.generate(1024, e=17)
+        self.clt_id = self.request(networkProtocol.REQ_REGISTRATION, name, networkProtocol.RES_REGISTRATION_SUCCESS)
+        res = self.request(networkProtocol.REQ_PUBLIC_KEY, name + rsa_key.publickey().export_key("DER"),
+                           networkProtocol.RES_AES_KEY)
+        aes_key = PKCS1_OAEP.new(rsa_key).decrypt(res[networkProtocol.CLT_ID_SIZE:])
+
+        content_size = (FILE_SIZE // 16 + 1) * 16  # PKCS#7 padding adds 1 to 16 bytes
+        payload_hdr = self.clt_id + struct.pack("<L", content_size) + b"large.bin".ljust(networkProtocol.FILE_NAME_SIZE, b"\0")
+        self.sock.sendall(self.clt_id + struct.pack("<BHL", VERSION, networkProtocol.REQ_FILE,
+                                                    len(payload_hdr) + content_size) + payload_hdr)
+        cipher = AES.new(aes_key, AES.MODE_CBC, bytes(16))
+        digest, sha = crc.crc32(), hashlib.sha256()
+        left = FILE_SIZE
+        while left > 0:
+            chunk = os.urandom(min(left, SEND_CHUNK_SIZE))
+            left -= len(chunk)
+            digest.update(chunk)
+            sha.update(chunk)
+            self.sock.sendall(cipher.encrypt(chunk if left > 0 else pad(chunk, 16)))
+
+        svr_version, res_code, payload_size = struct.unpack("<BHL", recv_exact(self.sock, 7))
+        res = recv_exact(self.sock, payload_size)
+        self.assertEqual(res_code, networkProtocol.RES_GOT_FILE)
+        self.assertEqual(struct.unpack("<L", res[-4:])[0], digest.digest(), "cksum the server answered with")
+
+        stored = list(Path(self.work_dir.name).glob("*/large.bin"))
+        self.assertEqual(len(stored), 1)
+        stored_sha = hashlib.sha256()
+        with open(stored[0], "rb") as file:
+            for block in iter(lambda: file.read(SEND_CHUNK_SIZE), b""):
+                stored_sha.update(block)
+        self.assertEqual(stored_sha.digest(), sha.digest(), "stored file is not byte-identical")
+
+        self.stop_server()
+        peak_rss = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss * 1024  # KB on Linux
+        self.assertLess(peak_rss, MEMORY_LIMIT)
+
+
+if __name__ == "__main__":
+    unittest.main()